@@ -0,0 +1,361 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Replays a capture through the nftnl_*_nlmsg_parse() functions and reports
+ * how long each kind of message takes to parse. The capture is either one
+ * taken by nft-ruleset-capture from a live ruleset, or a synthetic one with
+ * a set of many elements plus some rules.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/capture.h>
+#include <libnftnl/gen.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+#define RULES_DEFAULT	10000
+#define ELEMS_DEFAULT	100000
+#define ELEMS_PER_MSG	1000
+#define ROUNDS_DEFAULT	10
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int capture_elems(struct nftnl_capture *cap, char *buf, uint32_t first,
+			 uint32_t n)
+{
+	struct nftnl_set_elem *e;
+	struct nlmsghdr *nlh;
+	struct nftnl_set *s;
+	uint32_t i, key;
+	int ret;
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		return -1;
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, "addrs");
+	for (i = first; i < first + n; i++) {
+		e = nftnl_set_elem_alloc();
+		if (e == NULL) {
+			nftnl_set_free(s);
+			return -1;
+		}
+		key = htonl(0x0a000000 + i);
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+		nftnl_set_elem_add(s, e);
+	}
+
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWSETELEM, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_set_elems_nlmsg_build_payload(nlh, s);
+	ret = nftnl_capture_nlmsg(cap, nlh);
+	nftnl_set_free(s);
+
+	return ret;
+}
+
+static int capture_rule(struct nftnl_capture *cap, char *buf, uint32_t i)
+{
+	struct nftnl_expr *e;
+	struct nlmsghdr *nlh;
+	struct nftnl_rule *r;
+	uint32_t addr;
+	int ret;
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		return -1;
+
+	nftnl_rule_set(r, NFTNL_RULE_TABLE, "filter");
+	nftnl_rule_set(r, NFTNL_RULE_CHAIN, "input");
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, i + 2);
+
+	e = nftnl_expr_alloc("payload");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_BASE,
+			   NFT_PAYLOAD_NETWORK_HEADER);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET, 12);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_LEN, 4);
+	nftnl_rule_add_expr(r, e);
+
+	e = nftnl_expr_alloc("cmp");
+	addr = htonl(0xc0a80000 + i);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, NFT_CMP_EQ);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, &addr, sizeof(addr));
+	nftnl_rule_add_expr(r, e);
+
+	nftnl_rule_add_expr(r, nftnl_expr_alloc("counter"));
+
+	e = nftnl_expr_alloc("immediate");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_DREG, NFT_REG_VERDICT);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_VERDICT, NF_ACCEPT);
+	nftnl_rule_add_expr(r, e);
+
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWRULE, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_rule_nlmsg_build_payload(nlh, r);
+	ret = nftnl_capture_nlmsg(cap, nlh);
+	nftnl_rule_free(r);
+
+	return ret;
+}
+
+static FILE *capture_generate(uint32_t rules, uint32_t elems)
+{
+	static char buf[1 << 17];
+	struct nftnl_capture *cap;
+	struct nlmsghdr *nlh;
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	struct nftnl_set *s;
+	uint32_t i, n;
+	FILE *fp;
+	int ret;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	cap = nftnl_capture_alloc(fp, NULL);
+	t = nftnl_table_alloc();
+	c = nftnl_chain_alloc();
+	s = nftnl_set_alloc();
+	if (cap == NULL || t == NULL || c == NULL || s == NULL) {
+		fclose(fp);
+		return NULL;
+	}
+
+	nftnl_table_set(t, NFTNL_TABLE_NAME, "filter");
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWTABLE, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_table_nlmsg_build_payload(nlh, t);
+	ret = nftnl_capture_nlmsg(cap, nlh);
+
+	nftnl_chain_set(c, NFTNL_CHAIN_TABLE, "filter");
+	nftnl_chain_set(c, NFTNL_CHAIN_NAME, "input");
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWCHAIN, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_chain_nlmsg_build_payload(nlh, c);
+	ret |= nftnl_capture_nlmsg(cap, nlh);
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, "addrs");
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_TYPE, 7);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, 4);
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWSET, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_set_nlmsg_build_payload(nlh, s);
+	ret |= nftnl_capture_nlmsg(cap, nlh);
+
+	for (i = 0; i < elems && ret == 0; i += n) {
+		n = elems - i < ELEMS_PER_MSG ? elems - i : ELEMS_PER_MSG;
+		ret = capture_elems(cap, buf, i, n);
+	}
+	for (i = 0; i < rules && ret == 0; i++)
+		ret = capture_rule(cap, buf, i);
+	if (ret == 0)
+		ret = nftnl_capture_end(cap);
+
+	nftnl_set_free(s);
+	nftnl_chain_free(c);
+	nftnl_table_free(t);
+	nftnl_capture_free(cap);
+	if (ret < 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+enum {
+	STAT_TABLE,
+	STAT_CHAIN,
+	STAT_SET,
+	STAT_SETELEM,
+	STAT_RULE,
+	STAT_MAX
+};
+
+static const char *stat_name[STAT_MAX] = {
+	[STAT_TABLE]	= "tables",
+	[STAT_CHAIN]	= "chains",
+	[STAT_SET]	= "sets",
+	[STAT_SETELEM]	= "set elements",
+	[STAT_RULE]	= "rules",
+};
+
+struct stats {
+	uint64_t	msgs[STAT_MAX];
+	uint64_t	bytes[STAT_MAX];
+	double		time[STAT_MAX];
+	struct nftnl_set *set;
+};
+
+/* each message is parsed into a fresh object, which is released at once */
+static int replay_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct stats *st = data;
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+	int i, ret = -1;
+	double start;
+
+	start = now();
+	switch (NFNL_MSG_TYPE(nlh->nlmsg_type)) {
+	case NFT_MSG_NEWTABLE:
+		i = STAT_TABLE;
+		t = nftnl_table_alloc();
+		ret = nftnl_table_nlmsg_parse(nlh, t);
+		nftnl_table_free(t);
+		break;
+	case NFT_MSG_NEWCHAIN:
+		i = STAT_CHAIN;
+		c = nftnl_chain_alloc();
+		ret = nftnl_chain_nlmsg_parse(nlh, c);
+		nftnl_chain_free(c);
+		break;
+	case NFT_MSG_NEWSET:
+		i = STAT_SET;
+		if (st->set != NULL)
+			nftnl_set_free(st->set);
+		st->set = nftnl_set_alloc();
+		ret = nftnl_set_nlmsg_parse(nlh, st->set);
+		break;
+	case NFT_MSG_NEWSETELEM:
+		i = STAT_SETELEM;
+		if (st->set != NULL)
+			ret = nftnl_set_elems_nlmsg_parse(nlh, st->set);
+		break;
+	default:
+		i = STAT_RULE;
+		r = nftnl_rule_alloc();
+		ret = nftnl_rule_nlmsg_parse(nlh, r);
+		nftnl_rule_free(r);
+		break;
+	}
+	st->time[i] += now() - start;
+	st->msgs[i]++;
+	st->bytes[i] += nlh->nlmsg_len;
+
+	return ret < 0 ? -1 : 0;
+}
+
+static int replay(const struct nftnl_capture_file *f, struct stats *st)
+{
+	int ret;
+
+	ret = nftnl_capture_foreach(f, replay_cb, st);
+	if (st->set != NULL) {
+		nftnl_set_free(st->set);
+		st->set = NULL;
+	}
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t rules = RULES_DEFAULT, elems = ELEMS_DEFAULT;
+	uint32_t rounds = ROUNDS_DEFAULT, i;
+	struct nftnl_capture_file *f;
+	struct stats st = {};
+	struct nftnl_gen *gen;
+	double start, total;
+	int opt, fd;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "n:e:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rules = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			elems = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n rules] [-e elements] "
+				"[-r rounds] [capture]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY);
+	} else {
+		fp = capture_generate(rules, elems);
+		fd = fp != NULL ? dup(fileno(fp)) : -1;
+		if (fp != NULL)
+			fclose(fp);
+	}
+	if (fd < 0) {
+		perror("capture");
+		exit(EXIT_FAILURE);
+	}
+
+	start = now();
+	f = nftnl_capture_open(fd);
+	close(fd);
+	if (f == NULL) {
+		perror("nftnl_capture_open");
+		exit(EXIT_FAILURE);
+	}
+	printf("%u messages, opened in %.3f ms", nftnl_capture_count(f),
+	       (now() - start) * 1e3);
+	gen = nftnl_gen_alloc();
+	if (gen != NULL && nftnl_capture_gen(f, gen) == 0)
+		printf(", generation %u", nftnl_gen_get_u32(gen, NFTNL_GEN_ID));
+	printf("\n");
+	nftnl_gen_free(gen);
+
+	for (i = 0; i < rounds; i++) {
+		if (replay(f, &st) < 0) {
+			fprintf(stderr, "cannot parse the capture\n");
+			nftnl_capture_close(f);
+			exit(EXIT_FAILURE);
+		}
+	}
+	nftnl_capture_close(f);
+
+	total = 0;
+	for (i = 0; i < STAT_MAX; i++) {
+		if (st.msgs[i] == 0)
+			continue;
+		total += st.time[i];
+		printf("%-14s %10.3f ms %12.0f msgs/s %10.1f MB/s\n",
+		       stat_name[i], st.time[i] * 1e3 / rounds,
+		       st.msgs[i] / st.time[i], st.bytes[i] / st.time[i] / 1e6);
+	}
+	printf("%-14s %10.3f ms per round\n", "total", total * 1e3 / rounds);
+
+	return EXIT_SUCCESS;
+}
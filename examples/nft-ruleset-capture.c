@@ -0,0 +1,254 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Saves the messages of a full ruleset dump to a file, so that it can be
+ * replayed later on, see nft-capture-bench. The generation is fetched
+ * before the dump and again after it, the dump is retried if the ruleset
+ * changed in between.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/capture.h>
+#include <libnftnl/gen.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/set.h>
+#include <libnftnl/rule.h>
+
+#define CAPTURE_RETRIES	10
+
+static int seq;
+
+static int
+mnl_talk(struct mnl_socket *nf_sock, const void *data, unsigned int len,
+	 int (*cb)(const struct nlmsghdr *nlh, void *data), void *cb_data)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	uint32_t portid = mnl_socket_get_portid(nf_sock);
+	int ret;
+
+	if (mnl_socket_sendto(nf_sock, data, len) < 0)
+		return -1;
+
+	ret = mnl_socket_recvfrom(nf_sock, buf, sizeof(buf));
+	while (ret > 0) {
+		ret = mnl_cb_run(buf, ret, seq, portid, cb, cb_data);
+		if (ret <= 0)
+			goto out;
+
+		ret = mnl_socket_recvfrom(nf_sock, buf, sizeof(buf));
+	}
+out:
+	if (ret < 0 && errno == EAGAIN)
+		return 0;
+
+	return ret;
+}
+
+static int gen_cb(const struct nlmsghdr *nlh, void *data)
+{
+	if (nftnl_gen_nlmsg_parse(nlh, data) < 0)
+		return MNL_CB_ERROR;
+
+	return MNL_CB_OK;
+}
+
+static int mnl_gen_get(struct mnl_socket *nf_sock, struct nftnl_gen *gen)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	int ret;
+
+	nlh = nftnl_gen_nlmsg_build_hdr(buf, NFT_MSG_GETGEN, NFPROTO_UNSPEC,
+					0, ++seq);
+
+	/* not a dump, the reply is a single message */
+	if (mnl_socket_sendto(nf_sock, nlh, nlh->nlmsg_len) < 0)
+		return -1;
+
+	ret = mnl_socket_recvfrom(nf_sock, buf, sizeof(buf));
+	if (ret < 0)
+		return -1;
+
+	return mnl_cb_run(buf, ret, seq, mnl_socket_get_portid(nf_sock),
+			  gen_cb, gen);
+}
+
+struct capture_ctx {
+	struct nftnl_capture	*cap;
+	struct nftnl_set_list	*sets;
+};
+
+static int capture_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct capture_ctx *ctx = data;
+
+	if (nftnl_capture_nlmsg(ctx->cap, nlh) < 0)
+		return MNL_CB_ERROR;
+
+	return MNL_CB_OK;
+}
+
+/* the sets are also kept, their elements are dumped one set at a time */
+static int set_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct capture_ctx *ctx = data;
+	struct nftnl_set *s;
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		return MNL_CB_ERROR;
+
+	if (nftnl_set_nlmsg_parse(nlh, s) < 0) {
+		nftnl_set_free(s);
+		return MNL_CB_ERROR;
+	}
+	nftnl_set_list_add_tail(s, ctx->sets);
+
+	return capture_cb(nlh, data);
+}
+
+static int mnl_dump(struct mnl_socket *nf_sock, uint16_t type,
+		    int (*cb)(const struct nlmsghdr *nlh, void *data),
+		    struct capture_ctx *ctx)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+
+	nlh = nftnl_nlmsg_build_hdr(buf, type, NFPROTO_UNSPEC, NLM_F_DUMP,
+				    ++seq);
+
+	return mnl_talk(nf_sock, nlh, nlh->nlmsg_len, cb, ctx);
+}
+
+static int mnl_elems_dump(struct mnl_socket *nf_sock, struct nftnl_set *s,
+			  struct capture_ctx *ctx)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+
+	nlh = nftnl_set_nlmsg_build_hdr(buf, NFT_MSG_GETSETELEM,
+				nftnl_set_get_u32(s, NFTNL_SET_FAMILY),
+				NLM_F_DUMP, ++seq);
+	nftnl_set_elems_nlmsg_build_payload(nlh, s);
+
+	return mnl_talk(nf_sock, nlh, nlh->nlmsg_len, capture_cb, ctx);
+}
+
+static int capture(struct mnl_socket *nf_sock, FILE *fp, struct nftnl_gen *gen)
+{
+	struct capture_ctx ctx = {};
+	struct nftnl_set_list_iter *iter;
+	struct nftnl_set *s;
+	int ret = -1;
+
+	ctx.cap = nftnl_capture_alloc(fp, gen);
+	ctx.sets = nftnl_set_list_alloc();
+	if (ctx.cap == NULL || ctx.sets == NULL)
+		goto out;
+
+	if (mnl_dump(nf_sock, NFT_MSG_GETTABLE, capture_cb, &ctx) < 0 ||
+	    mnl_dump(nf_sock, NFT_MSG_GETCHAIN, capture_cb, &ctx) < 0 ||
+	    mnl_dump(nf_sock, NFT_MSG_GETSET, set_cb, &ctx) < 0)
+		goto out;
+
+	iter = nftnl_set_list_iter_create(ctx.sets);
+	if (iter == NULL)
+		goto out;
+	s = nftnl_set_list_iter_next(iter);
+	while (s != NULL) {
+		if (mnl_elems_dump(nf_sock, s, &ctx) < 0)
+			break;
+		s = nftnl_set_list_iter_next(iter);
+	}
+	nftnl_set_list_iter_destroy(iter);
+	if (s != NULL)
+		goto out;
+
+	if (mnl_dump(nf_sock, NFT_MSG_GETRULE, capture_cb, &ctx) < 0)
+		goto out;
+
+	ret = nftnl_capture_end(ctx.cap);
+out:
+	if (ctx.sets != NULL)
+		nftnl_set_list_free(ctx.sets);
+	if (ctx.cap != NULL)
+		nftnl_capture_free(ctx.cap);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_gen *gen, *gen_after;
+	struct mnl_socket *nl;
+	int i, ret = -1;
+	FILE *fp;
+
+	if (argc != 2) {
+		fprintf(stderr, "%s <file>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	nl = mnl_socket_open(NETLINK_NETFILTER);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+
+	gen = nftnl_gen_alloc();
+	gen_after = nftnl_gen_alloc();
+	fp = fopen(argv[1], "w");
+	if (gen == NULL || gen_after == NULL || fp == NULL) {
+		perror("setup");
+		exit(EXIT_FAILURE);
+	}
+
+	seq = time(NULL);
+	for (i = 0; i < CAPTURE_RETRIES; i++) {
+		if (mnl_gen_get(nl, gen) < 0 ||
+		    ftruncate(fileno(fp), 0) < 0)
+			break;
+		rewind(fp);
+
+		ret = capture(nl, fp, gen);
+		if (ret < 0 || mnl_gen_get(nl, gen_after) < 0)
+			break;
+
+		if (nftnl_gen_get_u32(gen, NFTNL_GEN_ID) ==
+		    nftnl_gen_get_u32(gen_after, NFTNL_GEN_ID))
+			break;
+		ret = -1;
+		errno = EINTR;
+	}
+	if (ret < 0)
+		perror("capture");
+	else
+		printf("generation %u captured\n",
+		       nftnl_gen_get_u32(gen, NFTNL_GEN_ID));
+
+	fclose(fp);
+	nftnl_gen_free(gen_after);
+	nftnl_gen_free(gen);
+	mnl_socket_close(nl);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Compares two ways of printing a ruleset dump in JSON: parsing every
+ * message into objects and printing the whole ruleset at the end, and
+ * printing each message as it comes with nftnl_ruleset_export_nlmsg().
+ * The dump is a set with many elements plus some rules, its messages are
+ * generated on the fly. Each run is done in a child process so that its
+ * peak resident set size can be reported on its own.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+#define ELEMS_DEFAULT	1000000
+#define ELEMS_PER_MSG	1000
+#define RULES		10000
+
+static uint32_t nelems = ELEMS_DEFAULT;
+
+/* emulates a dump: each message is passed to @cb right after building it */
+static int dump(int (*cb)(const struct nlmsghdr *nlh, void *data), void *data)
+{
+	static char buf[1 << 16];
+	struct nftnl_set_elem *e;
+	struct nftnl_expr *expr;
+	struct nlmsghdr *nlh;
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+	struct nftnl_set *s;
+	uint32_t i, key;
+
+	t = nftnl_table_alloc();
+	nftnl_table_set(t, NFTNL_TABLE_NAME, "filter");
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWTABLE, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_table_nlmsg_build_payload(nlh, t);
+	nftnl_table_free(t);
+	if (cb(nlh, data) < 0)
+		return -1;
+
+	c = nftnl_chain_alloc();
+	nftnl_chain_set(c, NFTNL_CHAIN_TABLE, "filter");
+	nftnl_chain_set(c, NFTNL_CHAIN_NAME, "input");
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWCHAIN, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_chain_nlmsg_build_payload(nlh, c);
+	nftnl_chain_free(c);
+	if (cb(nlh, data) < 0)
+		return -1;
+
+	s = nftnl_set_alloc();
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, "addrs");
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_TYPE, 7);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, 4);
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWSET, NFPROTO_IPV4,
+				    NLM_F_MULTI, 0);
+	nftnl_set_nlmsg_build_payload(nlh, s);
+	nftnl_set_free(s);
+	if (cb(nlh, data) < 0)
+		return -1;
+
+	for (i = 0; i < nelems; i++) {
+		if (i % ELEMS_PER_MSG == 0) {
+			s = nftnl_set_alloc();
+			nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+			nftnl_set_set(s, NFTNL_SET_NAME, "addrs");
+		}
+
+		e = nftnl_set_elem_alloc();
+		key = htonl(0x0a000000 + i);
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+		nftnl_set_elem_add(s, e);
+
+		if (i % ELEMS_PER_MSG == ELEMS_PER_MSG - 1 || i == nelems - 1) {
+			nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWSETELEM,
+						    NFPROTO_IPV4, NLM_F_MULTI,
+						    0);
+			nftnl_set_elems_nlmsg_build_payload(nlh, s);
+			nftnl_set_free(s);
+			if (cb(nlh, data) < 0)
+				return -1;
+		}
+	}
+
+	for (i = 0; i < RULES; i++) {
+		r = nftnl_rule_alloc();
+		nftnl_rule_set(r, NFTNL_RULE_TABLE, "filter");
+		nftnl_rule_set(r, NFTNL_RULE_CHAIN, "input");
+		nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, i + 2);
+
+		expr = nftnl_expr_alloc("payload");
+		nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+		nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_BASE,
+				   NFT_PAYLOAD_NETWORK_HEADER);
+		nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_OFFSET, 12);
+		nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_LEN, 4);
+		nftnl_rule_add_expr(r, expr);
+
+		expr = nftnl_expr_alloc("lookup");
+		nftnl_expr_set_u32(expr, NFTNL_EXPR_LOOKUP_SREG, NFT_REG_1);
+		nftnl_expr_set_str(expr, NFTNL_EXPR_LOOKUP_SET, "addrs");
+		nftnl_rule_add_expr(r, expr);
+
+		expr = nftnl_expr_alloc("counter");
+		nftnl_rule_add_expr(r, expr);
+
+		nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWRULE, NFPROTO_IPV4,
+					    NLM_F_MULTI, 0);
+		nftnl_rule_nlmsg_build_payload(nlh, r);
+		nftnl_rule_free(r);
+		if (cb(nlh, data) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+struct objs {
+	struct nftnl_table_list	*tl;
+	struct nftnl_chain_list	*cl;
+	struct nftnl_set_list	*sl;
+	struct nftnl_rule_list	*rl;
+	struct nftnl_set	*set;
+};
+
+static int objs_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct objs *o = data;
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+
+	switch (nlh->nlmsg_type & 0xff) {
+	case NFT_MSG_NEWTABLE:
+		t = nftnl_table_alloc();
+		if (t == NULL || nftnl_table_nlmsg_parse(nlh, t) < 0)
+			return -1;
+		nftnl_table_list_add_tail(t, o->tl);
+		break;
+	case NFT_MSG_NEWCHAIN:
+		c = nftnl_chain_alloc();
+		if (c == NULL || nftnl_chain_nlmsg_parse(nlh, c) < 0)
+			return -1;
+		nftnl_chain_list_add_tail(c, o->cl);
+		break;
+	case NFT_MSG_NEWSET:
+		o->set = nftnl_set_alloc();
+		if (o->set == NULL || nftnl_set_nlmsg_parse(nlh, o->set) < 0)
+			return -1;
+		nftnl_set_list_add_tail(o->set, o->sl);
+		break;
+	case NFT_MSG_NEWSETELEM:
+		if (nftnl_set_elems_nlmsg_parse(nlh, o->set) < 0)
+			return -1;
+		break;
+	case NFT_MSG_NEWRULE:
+		r = nftnl_rule_alloc();
+		if (r == NULL || nftnl_rule_nlmsg_parse(nlh, r) < 0)
+			return -1;
+		nftnl_rule_list_add_tail(r, o->rl);
+		break;
+	}
+	return 0;
+}
+
+static int run_objs(FILE *fp)
+{
+	struct nftnl_ruleset *rs = nftnl_ruleset_alloc();
+	struct objs o = {
+		.tl	= nftnl_table_list_alloc(),
+		.cl	= nftnl_chain_list_alloc(),
+		.sl	= nftnl_set_list_alloc(),
+		.rl	= nftnl_rule_list_alloc(),
+	};
+
+	if (rs == NULL || o.tl == NULL || o.cl == NULL || o.sl == NULL ||
+	    o.rl == NULL)
+		return -1;
+
+	nftnl_ruleset_set(rs, NFTNL_RULESET_TABLELIST, o.tl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_CHAINLIST, o.cl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_SETLIST, o.sl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_RULELIST, o.rl);
+
+	if (dump(objs_cb, &o) < 0 ||
+	    nftnl_ruleset_fprintf(fp, rs, NFTNL_OUTPUT_JSON, 0) < 0)
+		return -1;
+
+	nftnl_ruleset_free(rs);
+	return 0;
+}
+
+static int export_cb(const struct nlmsghdr *nlh, void *data)
+{
+	return nftnl_ruleset_export_nlmsg(data, nlh);
+}
+
+static int run_export(FILE *fp)
+{
+	struct nftnl_ruleset_export *exp;
+	int ret;
+
+	exp = nftnl_ruleset_export_alloc(fp, NFTNL_OUTPUT_JSON, 0);
+	if (exp == NULL)
+		return -1;
+
+	ret = dump(export_cb, exp);
+	if (ret == 0)
+		ret = nftnl_ruleset_export_end(exp);
+
+	nftnl_ruleset_export_free(exp);
+	return ret;
+}
+
+struct result {
+	double		secs;
+	long		maxrss;		/* KiB */
+	long		bytes;
+};
+
+static int run(int (*fn)(FILE *fp), struct result *res)
+{
+	struct timespec start, stop;
+	struct rusage ru;
+	int pipefd[2], status;
+	pid_t pid;
+	FILE *fp;
+
+	if (pipe(pipefd) < 0)
+		return -1;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (pid == 0) {
+		close(pipefd[0]);
+		memset(res, 0, sizeof(*res));
+		fp = tmpfile();
+		if (fp == NULL)
+			_exit(EXIT_FAILURE);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (fn(fp) < 0 || fflush(fp) != 0)
+			_exit(EXIT_FAILURE);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		res->secs = (stop.tv_sec - start.tv_sec) +
+			    (stop.tv_nsec - start.tv_nsec) / 1e9;
+		res->bytes = ftell(fp);
+		if (write(pipefd[1], res, sizeof(*res)) != sizeof(*res))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(pipefd[1]);
+	if (read(pipefd[0], res, sizeof(*res)) != sizeof(*res))
+		memset(res, 0, sizeof(*res));
+	close(pipefd[0]);
+
+	if (wait4(pid, &status, 0, &ru) < 0)
+		return -1;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+		return -1;
+
+	res->maxrss = ru.ru_maxrss;
+	return 0;
+}
+
+static void print_result(const char *name, const struct result *res)
+{
+	printf("%-20s %12ld bytes %9.3f s %9ld KiB\n", name, res->bytes,
+	       res->secs, res->maxrss);
+}
+
+int main(int argc, char *argv[])
+{
+	struct result objs, exp;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nelems = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n elements]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("%u elements, %u rules\n", nelems, RULES);
+	if (run(run_objs, &objs) < 0 || run(run_export, &exp) < 0) {
+		fprintf(stderr, "export failed\n");
+		exit(EXIT_FAILURE);
+	}
+	print_result("objects + fprintf", &objs);
+	print_result("export", &exp);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Times the import of a JSON ruleset with an increasing number of decoding
+ * threads, from the sequential parser up to one thread per online CPU.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libnftnl/ruleset.h>
+
+#define RULES_DEFAULT	200000
+#define SETS		1000
+
+static FILE *ruleset_generate(uint32_t rules)
+{
+	FILE *fp;
+	uint32_t i;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	fputs("{\"nftables\":[{\"add\":[{\"table\":{\"name\":\"filter\","
+	      "\"family\":\"ip\",\"flags\":0,\"use\":0}},\n{\"chain\":"
+	      "{\"name\":\"input\",\"handle\":1,\"bytes\":0,\"packets\":0,"
+	      "\"table\":\"filter\",\"family\":\"ip\"}}", fp);
+	for (i = 0; i < SETS; i++)
+		fprintf(fp, ",\n{\"set\":{\"name\":\"set%u\",\"table\":"
+			"\"filter\",\"flags\":0,\"family\":\"ip\","
+			"\"key_type\":7,\"key_len\":4}}", i);
+	for (i = 0; i < rules; i++)
+		fprintf(fp, ",\n{\"rule\":{\"family\":\"ip\",\"table\":"
+			"\"filter\",\"chain\":\"input\",\"handle\":%u,"
+			"\"expr\":[{\"type\":\"payload\",\"dreg\":1,"
+			"\"offset\":9,\"len\":1,\"base\":\"network\"},"
+			"{\"type\":\"cmp\",\"sreg\":1,\"op\":\"eq\",\"data\":"
+			"{\"reg\":{\"type\":\"value\",\"len\":1,\"data0\":"
+			"\"0x00000006\"}}},{\"type\":\"payload\",\"dreg\":1,"
+			"\"offset\":12,\"len\":4,\"base\":\"network\"},"
+			"{\"type\":\"lookup\",\"set\":\"set%u\",\"sreg\":1,"
+			"\"dreg\":0},{\"type\":\"counter\",\"pkts\":0,"
+			"\"bytes\":0},{\"type\":\"immediate\",\"dreg\":0,"
+			"\"data\":{\"reg\":{\"type\":\"verdict\",\"verdict\":"
+			"\"accept\"}}}]}}", i + 2, i % SETS);
+	fputs("]}]}\n", fp);
+
+	if (fflush(fp) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static int count_cb(const struct nftnl_parse_ctx *ctx)
+{
+	uint32_t *objs = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+
+	(*objs)++;
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t rules = RULES_DEFAULT, objs;
+	unsigned int threads, cpus;
+	struct timespec start, stop;
+	struct nftnl_parse_err *err;
+	double secs, base = 0;
+	FILE *fp;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rules = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n rules]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		perror("OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	fp = ruleset_generate(rules);
+	if (fp == NULL) {
+		perror("ruleset");
+		exit(EXIT_FAILURE);
+	}
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 2)
+		cpus = 2;
+
+	printf("%u sets, %u rules, %ld online cpus\n", SETS, rules,
+	       sysconf(_SC_NPROCESSORS_ONLN));
+	for (threads = 1; threads <= cpus; threads *= 2) {
+		objs = 0;
+		rewind(fp);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (nftnl_ruleset_parse_file_cb_threads(NFTNL_PARSE_JSON, fp,
+							err, &objs, count_cb,
+							threads) < 0) {
+			nftnl_parse_perror("parse", err);
+			exit(EXIT_FAILURE);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+
+		secs = (stop.tv_sec - start.tv_sec) +
+		       (stop.tv_nsec - start.tv_nsec) / 1e9;
+		if (threads == 1)
+			base = secs;
+		printf("%3u threads %9u objs %9.3f s %12.0f objs/s %6.2fx\n",
+		       threads, objs, secs, objs / secs, base / secs);
+	}
+
+	fclose(fp);
+	nftnl_parse_err_free(err);
+	return EXIT_SUCCESS;
+}
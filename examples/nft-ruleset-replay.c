@@ -0,0 +1,540 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Replays the packets of a pcap capture through the base chains of a
+ * ruleset file, evaluated in user space, and reports the throughput, the
+ * verdicts, the number of rules each packet went through per chain and the
+ * hit count of every rule. Nothing is sent to the kernel.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/eval.h>
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAP_HDRLEN		24
+#define PCAP_RECLEN		16
+
+#define LINKTYPE_ETHERNET	1
+#define LINKTYPE_RAW		101
+#define LINKTYPE_LINUX_SLL	113
+#define LINKTYPE_IPV4		228
+#define LINKTYPE_IPV6		229
+
+#define DEPTH_BUCKETS		33
+
+struct packet {
+	const uint8_t	*ll;
+	uint32_t	ll_len;
+	const uint8_t	*data;
+	uint32_t	len;
+	uint64_t	tstamp;
+	uint16_t	protocol;
+	uint8_t		family;
+};
+
+struct capture {
+	uint8_t		*buf;
+	struct packet	*pkts;
+	uint32_t	num;
+	uint32_t	skipped;
+};
+
+struct rule_hits {
+	const struct nftnl_rule	*rule;
+	uint64_t		hits;
+};
+
+struct base_chain {
+	const char	*name;
+	const char	*table;
+	uint32_t	family;
+	int		chain;
+	uint64_t	pkts;
+	uint64_t	verdicts[NF_MAX_VERDICT + 2];
+	uint64_t	depth[DEPTH_BUCKETS];
+};
+
+static uint32_t get_u32(const uint8_t *p, int swap)
+{
+	uint32_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return swap ? __builtin_bswap32(val) : val;
+}
+
+static uint16_t get_be16(const uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static int ip_family(const uint8_t *data, uint32_t len, uint16_t *protocol)
+{
+	if (len == 0)
+		return -1;
+
+	switch (data[0] >> 4) {
+	case 4:
+		*protocol = 0x0800;
+		return NFPROTO_IPV4;
+	case 6:
+		*protocol = 0x86dd;
+		return NFPROTO_IPV6;
+	}
+	return -1;
+}
+
+/* Locate the network header of a captured frame, -1 if it is not IP. */
+static int packet_setup(struct packet *pkt, uint32_t linktype,
+			const uint8_t *data, uint32_t len)
+{
+	uint32_t off;
+	uint16_t type;
+	int family;
+
+	switch (linktype) {
+	case LINKTYPE_ETHERNET:
+		off = 12;
+		if (len < off + 2)
+			return -1;
+		type = get_be16(data + off);
+		while ((type == 0x8100 || type == 0x88a8) && len >= off + 6) {
+			off += 4;
+			type = get_be16(data + off);
+		}
+		off += 2;
+		break;
+	case LINKTYPE_LINUX_SLL:
+		off = 16;
+		if (len < off)
+			return -1;
+		type = get_be16(data + 14);
+		break;
+	case LINKTYPE_RAW:
+	case LINKTYPE_IPV4:
+	case LINKTYPE_IPV6:
+		family = ip_family(data, len, &pkt->protocol);
+		if (family < 0)
+			return -1;
+		pkt->family = family;
+		pkt->data = data;
+		pkt->len = len;
+		return 0;
+	default:
+		return -1;
+	}
+
+	switch (type) {
+	case 0x0800:
+		pkt->family = NFPROTO_IPV4;
+		break;
+	case 0x86dd:
+		pkt->family = NFPROTO_IPV6;
+		break;
+	default:
+		return -1;
+	}
+	pkt->protocol = type;
+	pkt->ll = data;
+	pkt->ll_len = off;
+	pkt->data = data + off;
+	pkt->len = len - off;
+	return 0;
+}
+
+static int capture_load(struct capture *cap, const char *filename)
+{
+	uint32_t magic, linktype, caplen, alloc = 0;
+	uint8_t *buf = NULL, *p, *end;
+	int swap, nsec;
+	size_t size = 0, ret;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return -1;
+
+	do {
+		p = realloc(buf, size + 65536);
+		if (p == NULL) {
+			fclose(fp);
+			free(buf);
+			return -1;
+		}
+		buf = p;
+		ret = fread(buf + size, 1, 65536, fp);
+		size += ret;
+	} while (ret == 65536);
+	fclose(fp);
+
+	cap->buf = buf;
+	if (size < PCAP_HDRLEN)
+		goto einval;
+
+	memcpy(&magic, buf, sizeof(magic));
+	swap = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC;
+	if (swap)
+		magic = __builtin_bswap32(magic);
+	if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC)
+		goto einval;
+	nsec = magic == PCAP_MAGIC_NSEC;
+	linktype = get_u32(buf + 20, swap) & 0x0fffffff;
+
+	end = buf + size;
+	for (p = buf + PCAP_HDRLEN; end - p >= PCAP_RECLEN; p += caplen) {
+		struct packet *pkt;
+
+		caplen = get_u32(p + 8, swap);
+		p += PCAP_RECLEN;
+		if ((size_t)(end - p) < caplen)
+			break;
+
+		if (cap->num == alloc) {
+			alloc = alloc ? alloc * 2 : 1024;
+			pkt = realloc(cap->pkts, alloc * sizeof(*pkt));
+			if (pkt == NULL)
+				return -1;
+			cap->pkts = pkt;
+		}
+		pkt = &cap->pkts[cap->num];
+		memset(pkt, 0, sizeof(*pkt));
+		if (packet_setup(pkt, linktype, p, caplen) < 0) {
+			cap->skipped++;
+			continue;
+		}
+		pkt->tstamp = get_u32(p - PCAP_RECLEN, swap) * 1000000000ULL +
+			      get_u32(p - PCAP_RECLEN + 4, swap) *
+			      (nsec ? 1 : 1000ULL);
+		cap->num++;
+	}
+	return 0;
+einval:
+	errno = EINVAL;
+	return -1;
+}
+
+static int rule_hits_cmp(const void *a, const void *b)
+{
+	const struct rule_hits *ha = a, *hb = b;
+
+	if (ha->rule == hb->rule)
+		return 0;
+	return ha->rule < hb->rule ? -1 : 1;
+}
+
+static uint32_t depth_bucket(uint32_t rules)
+{
+	uint32_t b = 0;
+
+	while (rules) {
+		rules >>= 1;
+		b++;
+	}
+	return b;
+}
+
+static bool family_match(uint32_t chain_family, uint8_t family)
+{
+	return chain_family == family || chain_family == NFPROTO_INET;
+}
+
+static const char *verdict_name(int verdict)
+{
+	switch (verdict) {
+	case NF_ACCEPT:
+		return "accept";
+	case NF_DROP:
+		return "drop";
+	case NF_QUEUE:
+		return "queue";
+	case NF_STOLEN:
+		return "stolen";
+	case NFT_CONTINUE:
+		return "policy";
+	}
+	return "unknown";
+}
+
+static int verdict_index(int verdict)
+{
+	if (verdict >= 0 && verdict <= NF_MAX_VERDICT)
+		return verdict;
+	return NF_MAX_VERDICT + 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c chain] [-n loops] <json|xml> "
+		"<ruleset file> <pcap file>\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_eval_meta meta = {
+		.present = 1 << NFT_META_PROTOCOL,
+	};
+	struct nftnl_eval_pkt epkt = {};
+	struct nftnl_eval_result res;
+	struct nftnl_parse_err *err;
+	struct nftnl_ruleset *rs;
+	struct nftnl_rule_list *rules;
+	struct nftnl_chain_list *chains;
+	struct nftnl_set_list *sets;
+	struct nftnl_rule_list_iter *riter;
+	struct nftnl_chain_list_iter *citer;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+	struct nftnl_eval *ev;
+	struct capture cap = {};
+	struct base_chain *base = NULL;
+	struct rule_hits *hits = NULL, key, *h;
+	struct timespec start, stop;
+	uint32_t i, j, k, num_base = 0, num_rules = 0, loops = 1;
+	const char *only = NULL;
+	uint64_t evals = 0;
+	double elapsed;
+	enum nftnl_parse_type type;
+	FILE *fp;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+		switch (opt) {
+		case 'c':
+			only = optarg;
+			break;
+		case 'n':
+			loops = strtoul(optarg, NULL, 10);
+			if (loops == 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 3)
+		usage(argv[0]);
+
+	if (strcmp(argv[optind], "json") == 0)
+		type = NFTNL_PARSE_JSON;
+	else if (strcmp(argv[optind], "xml") == 0)
+		type = NFTNL_PARSE_XML;
+	else
+		usage(argv[0]);
+
+	fp = fopen(argv[optind + 1], "r");
+	if (fp == NULL) {
+		fprintf(stderr, "unable to open file %s: %s\n",
+			argv[optind + 1], strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	rs = nftnl_ruleset_alloc();
+	err = nftnl_parse_err_alloc();
+	if (rs == NULL || err == NULL) {
+		perror("OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	if (nftnl_ruleset_parse_file(rs, type, fp, err) < 0) {
+		nftnl_parse_perror("fail", err);
+		exit(EXIT_FAILURE);
+	}
+	fclose(fp);
+
+	if (capture_load(&cap, argv[optind + 2]) < 0) {
+		fprintf(stderr, "unable to load capture %s: %s\n",
+			argv[optind + 2], strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	rules = nftnl_ruleset_get(rs, NFTNL_RULESET_RULELIST);
+	chains = nftnl_ruleset_get(rs, NFTNL_RULESET_CHAINLIST);
+	sets = nftnl_ruleset_get(rs, NFTNL_RULESET_SETLIST);
+	if (rules == NULL || chains == NULL) {
+		fprintf(stderr, "ruleset has no chains or rules\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ev = nftnl_eval_alloc(rules, sets);
+	if (ev == NULL) {
+		perror("cannot compile ruleset");
+		exit(EXIT_FAILURE);
+	}
+
+	citer = nftnl_chain_list_iter_create(chains);
+	for (c = nftnl_chain_list_iter_next(citer); c != NULL;
+	     c = nftnl_chain_list_iter_next(citer)) {
+		struct base_chain *b;
+		uint32_t family;
+
+		if (!nftnl_chain_is_set(c, NFTNL_CHAIN_HOOKNUM))
+			continue;
+		if (only && strcmp(only, nftnl_chain_get_str(c,
+						NFTNL_CHAIN_NAME)) != 0)
+			continue;
+		family = nftnl_chain_get_u32(c, NFTNL_CHAIN_FAMILY);
+		if (family != NFPROTO_IPV4 && family != NFPROTO_IPV6 &&
+		    family != NFPROTO_INET)
+			continue;
+
+		b = realloc(base, (num_base + 1) * sizeof(*base));
+		if (b == NULL) {
+			perror("OOM");
+			exit(EXIT_FAILURE);
+		}
+		base = b;
+		b = &base[num_base];
+		memset(b, 0, sizeof(*b));
+		b->name = nftnl_chain_get_str(c, NFTNL_CHAIN_NAME);
+		b->table = nftnl_chain_get_str(c, NFTNL_CHAIN_TABLE);
+		b->family = family;
+		b->chain = nftnl_eval_chain(ev, family, b->table, b->name);
+		if (b->chain < 0)
+			continue;	/* no rules, the policy applies */
+		num_base++;
+	}
+	nftnl_chain_list_iter_destroy(citer);
+
+	if (num_base == 0) {
+		fprintf(stderr, "no ip, ip6 or inet base chain with rules\n");
+		exit(EXIT_FAILURE);
+	}
+
+	riter = nftnl_rule_list_iter_create(rules);
+	for (r = nftnl_rule_list_iter_next(riter); r != NULL;
+	     r = nftnl_rule_list_iter_next(riter)) {
+		h = realloc(hits, (num_rules + 1) * sizeof(*hits));
+		if (h == NULL) {
+			perror("OOM");
+			exit(EXIT_FAILURE);
+		}
+		hits = h;
+		hits[num_rules].rule = r;
+		hits[num_rules++].hits = 0;
+	}
+	nftnl_rule_list_iter_destroy(riter);
+	qsort(hits, num_rules, sizeof(*hits), rule_hits_cmp);
+
+	epkt.meta = &meta;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (k = 0; k < loops; k++) {
+		for (i = 0; i < cap.num; i++) {
+			const struct packet *pkt = &cap.pkts[i];
+
+			epkt.family = pkt->family;
+			epkt.data = pkt->data;
+			epkt.len = pkt->len;
+			epkt.ll = pkt->ll;
+			epkt.ll_len = pkt->ll_len;
+			epkt.tstamp = pkt->tstamp;
+			meta.protocol = htons(pkt->protocol);
+
+			for (j = 0; j < num_base; j++) {
+				struct base_chain *b = &base[j];
+
+				if (!family_match(b->family, pkt->family))
+					continue;
+				if (nftnl_eval_run(ev, b->chain, &epkt,
+						   &res) < 0) {
+					perror("evaluation failed");
+					exit(EXIT_FAILURE);
+				}
+				evals++;
+				b->pkts++;
+				b->verdicts[verdict_index(res.verdict)]++;
+				b->depth[depth_bucket(res.rules)]++;
+				if (res.rule == NULL)
+					continue;
+
+				key.rule = res.rule;
+				h = bsearch(&key, hits, num_rules,
+					    sizeof(*hits), rule_hits_cmp);
+				if (h != NULL)
+					h->hits++;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	elapsed = (stop.tv_sec - start.tv_sec) +
+		  (stop.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%u packets (%u skipped), %u loops, %llu evaluations "
+	       "in %.3f s\n", cap.num, cap.skipped, loops,
+	       (unsigned long long)evals, elapsed);
+	if (elapsed > 0)
+		printf("%.0f packets/s, %.0f evaluations/s\n",
+		       (double)cap.num * loops / elapsed, evals / elapsed);
+
+	for (j = 0; j < num_base; j++) {
+		struct base_chain *b = &base[j];
+		int v;
+
+		printf("\nchain %s %s (family %u): %llu packets\n",
+		       b->table, b->name, b->family,
+		       (unsigned long long)b->pkts);
+		for (v = 0; v <= NF_MAX_VERDICT + 1; v++) {
+			if (b->verdicts[v] == 0)
+				continue;
+			printf("  %-8s %llu\n", v <= NF_MAX_VERDICT ?
+			       verdict_name(v) : verdict_name(NFT_CONTINUE),
+			       (unsigned long long)b->verdicts[v]);
+		}
+		printf("  rules evaluated:\n");
+		for (i = 0; i < DEPTH_BUCKETS; i++) {
+			if (b->depth[i] == 0)
+				continue;
+			if (i < 2)
+				printf("  %10u %llu\n", i,
+				       (unsigned long long)b->depth[i]);
+			else
+				printf("  %4u-%-5u %llu\n", 1U << (i - 1),
+				       (uint32_t)((1ULL << i) - 1),
+				       (unsigned long long)b->depth[i]);
+		}
+	}
+
+	printf("\nrule hits:\n");
+	riter = nftnl_rule_list_iter_create(rules);
+	for (r = nftnl_rule_list_iter_next(riter); r != NULL;
+	     r = nftnl_rule_list_iter_next(riter)) {
+		key.rule = r;
+		h = bsearch(&key, hits, num_rules, sizeof(*hits),
+			    rule_hits_cmp);
+		printf("  %s %s handle %llu: %llu\n",
+		       nftnl_rule_get_str(r, NFTNL_RULE_TABLE),
+		       nftnl_rule_get_str(r, NFTNL_RULE_CHAIN),
+		       (unsigned long long)nftnl_rule_get_u64(r,
+						NFTNL_RULE_HANDLE),
+		       (unsigned long long)h->hits);
+	}
+	nftnl_rule_list_iter_destroy(riter);
+
+	nftnl_eval_free(ev);
+	free(hits);
+	free(base);
+	free(cap.pkts);
+	free(cap.buf);
+	nftnl_parse_err_free(err);
+	nftnl_ruleset_free(rs);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Compares the streaming XML ruleset parser against loading the whole
+ * document as an mxml tree, which is what the parser used to do before
+ * delivering the first object. Each run is done in a child process so that
+ * its peak resident set size can be reported on its own.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#ifdef XML_PARSING
+#include <mxml.h>
+#endif
+
+#include <libnftnl/ruleset.h>
+
+#define RULES_DEFAULT	100000
+
+static const char rule_fmt[] =
+	"<rule><family>ip</family><table>filter</table><chain>input</chain>"
+	"<handle>%u</handle><expr type=\"payload\"><dreg>1</dreg>"
+	"<offset>12</offset><len>4</len><base>network</base></expr>"
+	"<expr type=\"cmp\"><sreg>1</sreg><op>eq</op><data>"
+	"<reg type=\"value\"><len>4</len><data0>0x%08x</data0></reg></data>"
+	"</expr><expr type=\"counter\"><pkts>0</pkts><bytes>0</bytes></expr>"
+	"<expr type=\"immediate\"><dreg>0</dreg><data><reg type=\"verdict\">"
+	"<verdict>accept</verdict></reg></data></expr></rule>\n";
+
+/* same layout as tests/xmlfiles/75-ruleset.xml, with @rules rules */
+static FILE *ruleset_generate(uint32_t rules)
+{
+	FILE *fp;
+	uint32_t i;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	fputs("<nftables><add>\n<table><name>filter</name><family>ip</family>"
+	      "<flags>0</flags><use>0</use></table>\n<chain><name>input"
+	      "</name><handle>1</handle><bytes>0</bytes><packets>0</packets>"
+	      "<table>filter</table><family>ip</family></chain>\n", fp);
+	for (i = 0; i < rules; i++)
+		fprintf(fp, rule_fmt, i + 2, 0x0a000000 + i);
+	fputs("</add></nftables>\n", fp);
+
+	if (fflush(fp) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static int count_cb(const struct nftnl_parse_ctx *ctx)
+{
+	uint32_t *objs = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+
+	(*objs)++;
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+static int run_stream(FILE *fp, uint32_t *objs)
+{
+	struct nftnl_parse_err *err;
+	int ret;
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL)
+		return -1;
+
+	ret = nftnl_ruleset_parse_file_cb(NFTNL_PARSE_XML, fp, err, objs,
+					  count_cb);
+	if (ret < 0)
+		nftnl_parse_perror("stream", err);
+
+	nftnl_parse_err_free(err);
+	return ret;
+}
+
+static int run_tree(FILE *fp, uint32_t *objs)
+{
+#ifdef XML_PARSING
+	mxml_node_t *tree, *cmd, *node;
+
+	tree = mxmlLoadFile(NULL, fp, MXML_OPAQUE_CALLBACK);
+	if (tree == NULL)
+		return -1;
+
+	for (cmd = mxmlFindElement(tree, tree, NULL, NULL, NULL,
+				   MXML_DESCEND_FIRST);
+	     cmd != NULL;
+	     cmd = mxmlFindElement(cmd, tree, NULL, NULL, NULL,
+				   MXML_NO_DESCEND)) {
+		for (node = mxmlFindElement(cmd, cmd, NULL, NULL, NULL,
+					    MXML_DESCEND_FIRST);
+		     node != NULL;
+		     node = mxmlFindElement(node, cmd, NULL, NULL, NULL,
+					    MXML_NO_DESCEND))
+			(*objs)++;
+	}
+
+	mxmlDelete(tree);
+	return 0;
+#else
+	errno = EOPNOTSUPP;
+	return -1;
+#endif
+}
+
+struct result {
+	double		secs;
+	long		maxrss;		/* KiB */
+	uint32_t	objs;
+};
+
+static int run(FILE *fp, int (*fn)(FILE *fp, uint32_t *objs),
+	       struct result *res)
+{
+	struct timespec start, stop;
+	struct rusage ru;
+	int pipefd[2], status;
+	pid_t pid;
+
+	if (pipe(pipefd) < 0)
+		return -1;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (pid == 0) {
+		close(pipefd[0]);
+		rewind(fp);
+		memset(res, 0, sizeof(*res));
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (fn(fp, &res->objs) < 0)
+			_exit(EXIT_FAILURE);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		res->secs = (stop.tv_sec - start.tv_sec) +
+			    (stop.tv_nsec - start.tv_nsec) / 1e9;
+		if (write(pipefd[1], res, sizeof(*res)) != sizeof(*res))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(pipefd[1]);
+	if (read(pipefd[0], res, sizeof(*res)) != sizeof(*res))
+		memset(res, 0, sizeof(*res));
+	close(pipefd[0]);
+
+	if (wait4(pid, &status, 0, &ru) < 0)
+		return -1;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+		return -1;
+
+	res->maxrss = ru.ru_maxrss;
+	return 0;
+}
+
+static void print_result(const char *name, const struct result *res)
+{
+	printf("%-24s %10u objs %9.3f s %12.0f objs/s %9ld KiB\n", name,
+	       res->objs, res->secs, res->objs / res->secs, res->maxrss);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t rules = RULES_DEFAULT;
+	struct result stream, tree;
+	FILE *fp;
+	long size;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rules = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n rules] [file]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind < argc)
+		fp = fopen(argv[optind], "r");
+	else
+		fp = ruleset_generate(rules);
+	if (fp == NULL) {
+		perror("ruleset");
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	printf("document: %ld bytes\n", size);
+
+	if (run(fp, run_stream, &stream) < 0) {
+		fprintf(stderr, "streaming parser failed\n");
+		fclose(fp);
+		exit(EXIT_FAILURE);
+	}
+	print_result("stream, parse objects", &stream);
+
+	if (run(fp, run_tree, &tree) < 0)
+		printf("%-24s unavailable\n", "mxml tree, load only");
+	else
+		print_result("mxml tree, load only", &tree);
+
+	fclose(fp);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,476 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Builds synthetic sets, asks nftnl_set_advise() for the cost of each
+ * kernel backend and times lookups in user space replicas of the hash,
+ * rbtree and bitmap backends, to check that the model ranks the backends
+ * in the order they actually perform.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/set.h>
+
+#define KEY_MAX		16
+#define LOOKUPS		(1 << 20)
+
+struct bench_set {
+	const char	*name;
+	uint32_t	key_len;
+	uint32_t	num;
+	uint32_t	run;	/* keys per range, intervals if > 1 */
+};
+
+static const struct bench_set bench_sets[] = {
+	{ "ports, 64 keys",		2,	64,		1 },
+	{ "ports, 4096 keys",		2,	4096,		1 },
+	{ "port ranges, 32 x 512",	2,	32,		512 },
+	{ "ipv4, 100 keys",		4,	100,		1 },
+	{ "ipv4, 100000 keys",		4,	100000,		1 },
+	{ "ipv4, 1000000 keys",		4,	1000000,	1 },
+	{ "ipv4, 2000 /24 prefixes",	4,	2000,		256 },
+	{ "ipv6, 10000 keys",		16,	10000,		1 },
+};
+
+static const char *backend_names[] = {
+	[NFTNL_SET_BACKEND_HASH]	= "hash",
+	[NFTNL_SET_BACKEND_RBTREE]	= "rbtree",
+	[NFTNL_SET_BACKEND_BITMAP]	= "bitmap",
+};
+
+struct key {
+	uint8_t		val[KEY_MAX];
+	uint8_t		end;
+};
+
+struct hash_node {
+	struct hash_node	*next;
+	uint8_t			key[KEY_MAX];
+};
+
+struct tree_node {
+	struct tree_node	*left;
+	struct tree_node	*right;
+	uint8_t			key[KEY_MAX];
+	uint8_t			end;
+};
+
+struct replica {
+	uint32_t		key_len;
+	struct hash_node	**buckets;
+	uint32_t		mask;
+	struct tree_node	*root;
+	struct tree_node	**nodes;
+	uint32_t		num_nodes;
+	uint8_t			*bitmap;
+};
+
+static uint32_t key_len_cmp;
+
+static int key_cmp(const void *a, const void *b)
+{
+	const struct key *k1 = a, *k2 = b;
+	int ret;
+
+	ret = memcmp(k1->val, k2->val, key_len_cmp);
+	if (ret != 0)
+		return ret;
+	return (int)k2->end - (int)k1->end;
+}
+
+static void key_set(uint8_t *val, uint32_t len, uint64_t v)
+{
+	int i;
+
+	memset(val, 0, KEY_MAX);
+	if (len > 8) {
+		for (i = 7; i >= 0; i--, v >>= 8)
+			val[i] = v;
+		val[len - 1] = 1;
+		return;
+	}
+	for (i = len - 1; i >= 0; i--, v >>= 8)
+		val[i] = v;
+}
+
+static uint64_t key_value(const struct bench_set *b, uint32_t i,
+			  uint32_t off)
+{
+	uint64_t v = (uint64_t)i * 0x9e3779b97f4a7c15ULL;
+	uint32_t bits = b->key_len > 8 ? 64 : b->key_len * 8;
+	uint64_t ranges = bits < 64 ? (1ULL << bits) / b->run : 0;
+
+	/* odd multipliers permute the power of two number of range slots */
+	if (ranges)
+		v %= ranges;
+	else
+		v /= b->run;
+	return v * b->run + off;
+}
+
+static uint32_t hash_key(const uint8_t *key, uint32_t len)
+{
+	uint32_t h = 0x9747b28c, i, w;
+
+	for (i = 0; i < len; i += 4) {
+		memcpy(&w, key + i, sizeof(w));
+		w *= 0xcc9e2d51;
+		w = w << 15 | w >> 17;
+		h ^= w * 0x1b873593;
+		h = (h << 13 | h >> 19) * 5 + 0xe6546b64;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
+
+static void shuffle(uint32_t *idx, uint32_t num)
+{
+	uint32_t i, j, tmp;
+
+	for (i = num; i > 1; i--) {
+		j = random() % i;
+		tmp = idx[i - 1];
+		idx[i - 1] = idx[j];
+		idx[j] = tmp;
+	}
+}
+
+static uint32_t *order(uint32_t num)
+{
+	uint32_t *idx = malloc(num * sizeof(*idx)), i;
+
+	for (i = 0; i < num; i++)
+		idx[i] = i;
+	shuffle(idx, num);
+	return idx;
+}
+
+static void hash_build(struct replica *r, const struct key *keys,
+		       uint32_t num)
+{
+	uint32_t buckets = 4, *idx = order(num), i, h;
+	struct hash_node *n;
+
+	while ((uint64_t)buckets * 3 < (uint64_t)num * 4)
+		buckets <<= 1;
+	r->buckets = calloc(buckets, sizeof(*r->buckets));
+	r->mask = buckets - 1;
+
+	/* insertion in random order spreads the chains over the heap */
+	for (i = 0; i < num; i++) {
+		n = malloc(sizeof(*n));
+		memcpy(n->key, keys[idx[i]].val, KEY_MAX);
+		h = hash_key(n->key, r->key_len) & r->mask;
+		n->next = r->buckets[h];
+		r->buckets[h] = n;
+	}
+	free(idx);
+}
+
+static bool hash_lookup(const struct replica *r, const uint8_t *key)
+{
+	const struct hash_node *n;
+
+	n = r->buckets[hash_key(key, r->key_len) & r->mask];
+	for (; n != NULL; n = n->next) {
+		if (memcmp(n->key, key, r->key_len) == 0)
+			return true;
+	}
+	return false;
+}
+
+static struct tree_node *tree_build(struct replica *r, const struct key *keys,
+				    int lo, int hi, uint32_t *next)
+{
+	struct tree_node *n;
+	int mid;
+
+	if (lo > hi)
+		return NULL;
+
+	mid = lo + (hi - lo) / 2;
+	n = r->nodes[(*next)++];
+	memcpy(n->key, keys[mid].val, KEY_MAX);
+	n->end = keys[mid].end;
+	n->left = tree_build(r, keys, lo, mid - 1, next);
+	n->right = tree_build(r, keys, mid + 1, hi, next);
+	return n;
+}
+
+static void rbtree_build(struct replica *r, const struct key *keys,
+			 uint32_t num)
+{
+	uint32_t *idx = order(num), i, next = 0;
+
+	/* allocated in random order, as if the elements came unsorted */
+	r->nodes = calloc(num, sizeof(*r->nodes));
+	for (i = 0; i < num; i++)
+		r->nodes[idx[i]] = malloc(sizeof(struct tree_node));
+	r->num_nodes = num;
+	r->root = tree_build(r, keys, 0, num - 1, &next);
+	free(idx);
+}
+
+/* closest element not greater than the key, as nft_rbtree_lookup() */
+static bool rbtree_lookup(const struct replica *r, const uint8_t *key)
+{
+	const struct tree_node *n = r->root, *best = NULL;
+
+	while (n != NULL) {
+		if (memcmp(n->key, key, r->key_len) <= 0) {
+			best = n;
+			n = n->right;
+		} else {
+			n = n->left;
+		}
+	}
+	return best != NULL && !best->end;
+}
+
+static void bitmap_build(struct replica *r, const struct key *keys,
+			 uint32_t num)
+{
+	uint32_t i, k;
+
+	r->bitmap = calloc((1 << (r->key_len * 8)) * 2 / 8, 1);
+	for (i = 0; i < num; i++) {
+		k = r->key_len == 1 ? keys[i].val[0] :
+				      keys[i].val[0] << 8 | keys[i].val[1];
+		k *= 2;
+		r->bitmap[k / 8] |= 1 << (k % 8);
+	}
+}
+
+static bool bitmap_lookup(const struct replica *r, const uint8_t *key)
+{
+	uint32_t k = r->key_len == 1 ? key[0] : key[0] << 8 | key[1];
+
+	k *= 2;
+	return r->bitmap[k / 8] & (1 << (k % 8));
+}
+
+static void replica_free(struct replica *r)
+{
+	struct hash_node *n, *next;
+	uint32_t i;
+
+	if (r->buckets != NULL) {
+		for (i = 0; i <= r->mask; i++) {
+			for (n = r->buckets[i]; n != NULL; n = next) {
+				next = n->next;
+				free(n);
+			}
+		}
+		free(r->buckets);
+	}
+	for (i = 0; i < r->num_nodes; i++)
+		free(r->nodes[i]);
+	free(r->nodes);
+	free(r->bitmap);
+	memset(r, 0, sizeof(*r));
+}
+
+static double bench(const struct replica *r, uint32_t backend,
+		    const struct key *lookups)
+{
+	struct timespec start, stop;
+	uint32_t i, found = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < LOOKUPS; i++) {
+		switch (backend) {
+		case NFTNL_SET_BACKEND_HASH:
+			found += hash_lookup(r, lookups[i].val);
+			break;
+		case NFTNL_SET_BACKEND_RBTREE:
+			found += rbtree_lookup(r, lookups[i].val);
+			break;
+		case NFTNL_SET_BACKEND_BITMAP:
+			found += bitmap_lookup(r, lookups[i].val);
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	if (found != LOOKUPS)
+		fprintf(stderr, "%s: %u lookups missed\n",
+			backend_names[backend], LOOKUPS - found);
+
+	return ((stop.tv_sec - start.tv_sec) * 1e9 +
+		(stop.tv_nsec - start.tv_nsec)) / LOOKUPS;
+}
+
+/* backends sorted by cost, unusable ones left out */
+static uint32_t rank(const double *cost, const bool *usable, uint32_t *out)
+{
+	uint32_t i, j, n = 0, tmp;
+
+	for (i = 0; i <= NFTNL_SET_BACKEND_MAX; i++) {
+		if (usable[i])
+			out[n++] = i;
+	}
+	for (i = 1; i < n; i++) {
+		for (j = i; j > 0 && cost[out[j]] < cost[out[j - 1]]; j--) {
+			tmp = out[j];
+			out[j] = out[j - 1];
+			out[j - 1] = tmp;
+		}
+	}
+	return n;
+}
+
+static struct nftnl_set *set_build(const struct bench_set *b,
+				   struct key **exact, uint32_t *num_exact,
+				   struct key **ivs, uint32_t *num_ivs)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nftnl_set_elem *e;
+	uint32_t i, j, n = 0;
+	uint64_t v;
+
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, "bench");
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, b->key_len);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS,
+			  b->run > 1 ? NFT_SET_INTERVAL : 0);
+
+	*exact = calloc((size_t)b->num * b->run, sizeof(**exact));
+	*ivs = calloc((size_t)b->num * 2, sizeof(**ivs));
+	*num_ivs = 0;
+	for (i = 0; i < b->num; i++) {
+		v = key_value(b, i, 0);
+		for (j = 0; j < b->run; j++)
+			key_set((*exact)[n++].val, b->key_len, v + j);
+
+		e = nftnl_set_elem_alloc();
+		key_set((*ivs)[*num_ivs].val, b->key_len, v);
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY,
+				   (*ivs)[(*num_ivs)++].val, b->key_len);
+		nftnl_set_elem_add(s, e);
+		if (b->run == 1)
+			continue;
+
+		e = nftnl_set_elem_alloc();
+		key_set((*ivs)[*num_ivs].val, b->key_len, v + b->run);
+		(*ivs)[*num_ivs].end = 1;
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY,
+				   (*ivs)[(*num_ivs)++].val, b->key_len);
+		nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_FLAGS,
+				       NFT_SET_ELEM_INTERVAL_END);
+		nftnl_set_elem_add(s, e);
+	}
+	*num_exact = n;
+
+	key_len_cmp = b->key_len;
+	qsort(*exact, *num_exact, sizeof(**exact), key_cmp);
+	qsort(*ivs, *num_ivs, sizeof(**ivs), key_cmp);
+
+	return s;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, b, n, model_rank[NFTNL_SET_BACKEND_MAX + 1],
+		 real_rank[NFTNL_SET_BACKEND_MAX + 1], agree = 0, first = 0;
+	double model[NFTNL_SET_BACKEND_MAX + 1],
+	       real[NFTNL_SET_BACKEND_MAX + 1];
+	bool usable[NFTNL_SET_BACKEND_MAX + 1];
+	struct key *exact, *ivs, *lookups;
+	uint32_t num_exact, num_ivs;
+	struct nftnl_set_advice adv;
+	struct nftnl_set *s;
+	struct replica r;
+
+	srandom(1);
+	lookups = calloc(LOOKUPS, sizeof(*lookups));
+
+	for (i = 0; i < sizeof(bench_sets) / sizeof(bench_sets[0]); i++) {
+		const struct bench_set *bs = &bench_sets[i];
+
+		s = set_build(bs, &exact, &num_exact, &ivs, &num_ivs);
+		if (nftnl_set_advise(s, &adv) < 0) {
+			perror("nftnl_set_advise");
+			exit(EXIT_FAILURE);
+		}
+		for (n = 0; n < LOOKUPS; n++)
+			lookups[n] = exact[random() % num_exact];
+
+		printf("%s: %llu keys, %u ranges, recommended %s%s, "
+		       "policy %s, size %u, kernel picks %s\n", bs->name,
+		       (unsigned long long)adv.keys, adv.ranges,
+		       backend_names[adv.backend],
+		       adv.interval ? " with intervals" : "",
+		       adv.policy == NFT_SET_POL_MEMORY ?
+		       "memory" : "performance", adv.size,
+		       backend_names[adv.selected]);
+
+		for (b = 0; b <= NFTNL_SET_BACKEND_MAX; b++) {
+			const struct nftnl_set_backend_cost *c = &adv.cost[b];
+
+			usable[b] = c->usable;
+			if (!c->usable)
+				continue;
+
+			memset(&r, 0, sizeof(r));
+			r.key_len = bs->key_len;
+			switch (b) {
+			case NFTNL_SET_BACKEND_HASH:
+				hash_build(&r, exact, num_exact);
+				break;
+			case NFTNL_SET_BACKEND_RBTREE:
+				if (c->interval)
+					rbtree_build(&r, ivs, num_ivs);
+				else
+					rbtree_build(&r, exact, num_exact);
+				break;
+			case NFTNL_SET_BACKEND_BITMAP:
+				bitmap_build(&r, exact, num_exact);
+				break;
+			}
+			model[b] = c->lookup;
+			real[b] = bench(&r, b, lookups);
+			replica_free(&r);
+
+			printf("  %-7s %8u elements %10llu bytes "
+			       "model %6.1f ns measured %6.1f ns\n",
+			       backend_names[b], c->elements,
+			       (unsigned long long)c->memory, model[b],
+			       real[b]);
+		}
+
+		n = rank(model, usable, model_rank);
+		rank(real, usable, real_rank);
+		if (memcmp(model_rank, real_rank, n * sizeof(uint32_t)) == 0)
+			agree++;
+		if (model_rank[0] == real_rank[0])
+			first++;
+		printf("  ranking %s\n\n",
+		       memcmp(model_rank, real_rank,
+			      n * sizeof(uint32_t)) == 0 ?
+		       "matches" : "differs");
+
+		free(exact);
+		free(ivs);
+		nftnl_set_free(s);
+	}
+
+	printf("model ranking matches on %u of %zu sets, "
+	       "fastest backend on %u\n", agree,
+	       sizeof(bench_sets) / sizeof(bench_sets[0]), first);
+
+	free(lookups);
+	return EXIT_SUCCESS;
+}
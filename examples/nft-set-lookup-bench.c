@@ -0,0 +1,206 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Parses synthetic rulesets with a growing number of sets and a fixed
+ * number of rules, each with a lookup expression. Resolving the set of a
+ * lookup costs the same whatever the number of sets, so the time per rule
+ * should stay flat along the runs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libnftnl/ruleset.h>
+
+#define RULES_DEFAULT	100000
+
+static const uint32_t set_counts[] = { 1000, 2000, 5000, 10000, 20000 };
+
+static void json_set(FILE *fp, uint32_t set)
+{
+	fprintf(fp, "{\"set\":{\"name\":\"set%u\",\"table\":\"filter\","
+		"\"flags\":0,\"family\":\"ip\",\"key_type\":7,"
+		"\"key_len\":4}}", set);
+}
+
+static void json_rule(FILE *fp, uint32_t handle, uint32_t set)
+{
+	fprintf(fp, "{\"rule\":{\"family\":\"ip\",\"table\":\"filter\","
+		"\"chain\":\"input\",\"handle\":%u,\"expr\":[{\"type\":"
+		"\"payload\",\"dreg\":1,\"offset\":12,\"len\":4,\"base\":"
+		"\"network\"},{\"type\":\"lookup\",\"set\":\"set%u\","
+		"\"sreg\":1,\"dreg\":0}]}}", handle, set);
+}
+
+static void xml_set(FILE *fp, uint32_t set)
+{
+	fprintf(fp, "<set><family>ip</family><table>filter</table><name>"
+		"set%u</name><flags>0</flags><key_type>7</key_type><key_len>4"
+		"</key_len><data_type>0</data_type><data_len>0</data_len>"
+		"</set>", set);
+}
+
+static void xml_rule(FILE *fp, uint32_t handle, uint32_t set)
+{
+	fprintf(fp, "<rule><family>ip</family><table>filter</table><chain>"
+		"input</chain><handle>%u</handle><expr type=\"payload\">"
+		"<dreg>1</dreg><offset>12</offset><len>4</len><base>network"
+		"</base></expr><expr type=\"lookup\"><set>set%u</set><sreg>1"
+		"</sreg><dreg>0</dreg></expr></rule>", handle, set);
+}
+
+struct bench_format {
+	const char	*name;
+	uint32_t	type;
+	const char	*head;
+	void		(*set)(FILE *fp, uint32_t set);
+	void		(*rule)(FILE *fp, uint32_t handle, uint32_t set);
+	const char	*sep;
+	const char	*tail;
+};
+
+static const struct bench_format formats[] = {
+	{
+		.name	= "json",
+		.type	= NFTNL_PARSE_JSON,
+		.head	= "{\"nftables\":[{\"add\":[{\"table\":{\"name\":"
+			  "\"filter\",\"family\":\"ip\",\"flags\":0,\"use\":0}}"
+			  ",\n{\"chain\":{\"name\":\"input\",\"handle\":1,"
+			  "\"bytes\":0,\"packets\":0,\"table\":\"filter\","
+			  "\"family\":\"ip\"}}",
+		.set	= json_set,
+		.rule	= json_rule,
+		.sep	= ",\n",
+		.tail	= "]}]}\n",
+	},
+	{
+		.name	= "xml",
+		.type	= NFTNL_PARSE_XML,
+		.head	= "<nftables><add><table><name>filter</name><family>ip"
+			  "</family><flags>0</flags><use>0</use></table>\n"
+			  "<chain><name>input</name><handle>1</handle><bytes>0"
+			  "</bytes><packets>0</packets><table>filter</table>"
+			  "<family>ip</family></chain>",
+		.set	= xml_set,
+		.rule	= xml_rule,
+		.sep	= "\n",
+		.tail	= "</add></nftables>\n",
+	},
+};
+
+static FILE *ruleset_generate(const struct bench_format *f, uint32_t sets,
+			      uint32_t rules)
+{
+	FILE *fp;
+	uint32_t i;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	fputs(f->head, fp);
+	for (i = 0; i < sets; i++) {
+		fputs(f->sep, fp);
+		f->set(fp, i);
+	}
+	/* spread the lookups over all the sets */
+	for (i = 0; i < rules; i++) {
+		fputs(f->sep, fp);
+		f->rule(fp, i + 2, (i * 2654435761U) % sets);
+	}
+	fputs(f->tail, fp);
+
+	if (fflush(fp) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	rewind(fp);
+	return fp;
+}
+
+struct counts {
+	uint32_t	sets;
+	uint32_t	rules;
+};
+
+static int count_cb(const struct nftnl_parse_ctx *ctx)
+{
+	struct counts *c = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+
+	switch (nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE)) {
+	case NFTNL_RULESET_SET:
+		c->sets++;
+		break;
+	case NFTNL_RULESET_RULE:
+		c->rules++;
+		break;
+	}
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct bench_format *f = &formats[0];
+	uint32_t rules = RULES_DEFAULT, i;
+	struct timespec start, stop;
+	struct nftnl_parse_err *err;
+	struct counts c;
+	double secs;
+	FILE *fp;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:x")) != -1) {
+		switch (opt) {
+		case 'n':
+			rules = strtoul(optarg, NULL, 10);
+			break;
+		case 'x':
+			f = &formats[1];
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-x] [-n rules]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		perror("OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%s, %u rules with a lookup\n", f->name, rules);
+	for (i = 0; i < sizeof(set_counts) / sizeof(set_counts[0]); i++) {
+		fp = ruleset_generate(f, set_counts[i], rules);
+		if (fp == NULL) {
+			perror("ruleset");
+			exit(EXIT_FAILURE);
+		}
+
+		memset(&c, 0, sizeof(c));
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (nftnl_ruleset_parse_file_cb(f->type, fp, err, &c,
+						count_cb) < 0) {
+			nftnl_parse_perror("parse", err);
+			exit(EXIT_FAILURE);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		fclose(fp);
+
+		secs = (stop.tv_sec - start.tv_sec) +
+		       (stop.tv_nsec - start.tv_nsec) / 1e9;
+		printf("%6u sets %8u rules %9.3f s %9.0f ns/rule\n",
+		       c.sets, c.rules, secs, secs * 1e9 / c.rules);
+	}
+
+	nftnl_parse_err_free(err);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Compares the cold start of a ruleset from its JSON document and from a
+ * snapshot of it: the whole ruleset parsed from JSON, the whole ruleset read
+ * from the snapshot, and the snapshot opened to fetch a single rule.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/ruleset.h>
+#include <libnftnl/snapshot.h>
+#include <libnftnl/rule.h>
+
+#define RULES_DEFAULT	100000
+#define ELEMS_DEFAULT	100000
+
+static FILE *ruleset_generate(uint32_t rules, uint32_t elems)
+{
+	FILE *fp;
+	uint32_t i;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	fputs("{\"nftables\":[{\"add\":[{\"table\":{\"name\":\"filter\","
+	      "\"family\":\"ip\",\"flags\":0,\"use\":0}},\n{\"chain\":"
+	      "{\"name\":\"input\",\"handle\":1,\"bytes\":0,\"packets\":0,"
+	      "\"table\":\"filter\",\"family\":\"ip\"}},\n{\"set\":{\"name\":"
+	      "\"addrs\",\"table\":\"filter\",\"flags\":0,\"family\":\"ip\","
+	      "\"key_type\":7,\"key_len\":4,\"set_elem\":[", fp);
+	for (i = 0; i < elems; i++)
+		fprintf(fp, "%s{\"flags\":0,\"key\":{\"reg\":{\"type\":"
+			"\"value\",\"len\":4,\"data0\":\"0x%08x\"}}}",
+			i ? "," : "", 0x0a000000 + i);
+	fputs("]}}", fp);
+	for (i = 0; i < rules; i++)
+		fprintf(fp, ",\n{\"rule\":{\"family\":\"ip\",\"table\":"
+			"\"filter\",\"chain\":\"input\",\"handle\":%u,"
+			"\"expr\":[{\"type\":\"payload\",\"dreg\":1,"
+			"\"offset\":9,\"len\":1,\"base\":\"network\"},"
+			"{\"type\":\"cmp\",\"sreg\":1,\"op\":\"eq\",\"data\":"
+			"{\"reg\":{\"type\":\"value\",\"len\":1,\"data0\":"
+			"\"0x00000006\"}}},{\"type\":\"payload\",\"dreg\":1,"
+			"\"offset\":12,\"len\":4,\"base\":\"network\"},"
+			"{\"type\":\"cmp\",\"sreg\":1,\"op\":\"eq\",\"data\":"
+			"{\"reg\":{\"type\":\"value\",\"len\":4,\"data0\":"
+			"\"0x%08x\"}}},{\"type\":\"counter\",\"pkts\":0,"
+			"\"bytes\":0},{\"type\":\"immediate\",\"dreg\":0,"
+			"\"data\":{\"reg\":{\"type\":\"verdict\",\"verdict\":"
+			"\"accept\"}}}]}}", i + 2, 0x0a000000 + i);
+	fputs("]}]}\n", fp);
+
+	if (fflush(fp) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_parse(const char *name, FILE *fp, enum nftnl_parse_type type,
+		     struct nftnl_parse_err *err)
+{
+	struct nftnl_ruleset *rs;
+	double start;
+
+	rs = nftnl_ruleset_alloc();
+	if (rs == NULL)
+		return -1;
+
+	rewind(fp);
+	start = now();
+	if (nftnl_ruleset_parse_file(rs, type, fp, err) < 0) {
+		nftnl_parse_perror(name, err);
+		nftnl_ruleset_free(rs);
+		return -1;
+	}
+	printf("%-24s %10.3f ms\n", name, (now() - start) * 1e3);
+
+	nftnl_ruleset_free(rs);
+	return 0;
+}
+
+static int run_lazy(const char *name, FILE *fp)
+{
+	struct nftnl_snapshot *snap;
+	struct nftnl_rule *r;
+	double start;
+
+	start = now();
+	snap = nftnl_snapshot_open(fileno(fp));
+	if (snap == NULL) {
+		perror(name);
+		return -1;
+	}
+	r = nftnl_snapshot_get_rule(snap,
+			nftnl_snapshot_count(snap, NFTNL_RULESET_RULE) / 2);
+	printf("%-24s %10.3f ms\n", name, (now() - start) * 1e3);
+
+	if (r != NULL)
+		nftnl_rule_free(r);
+	nftnl_snapshot_close(snap);
+	return r != NULL ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t rules = RULES_DEFAULT, elems = ELEMS_DEFAULT;
+	struct nftnl_parse_err *err;
+	struct nftnl_ruleset *rs;
+	FILE *json, *snap;
+	int opt, ret = EXIT_FAILURE;
+	long json_len;
+
+	while ((opt = getopt(argc, argv, "n:e:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rules = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			elems = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n rules] [-e elements]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	err = nftnl_parse_err_alloc();
+	rs = nftnl_ruleset_alloc();
+	json = ruleset_generate(rules, elems);
+	snap = tmpfile();
+	if (err == NULL || rs == NULL || json == NULL || snap == NULL) {
+		perror("setup");
+		exit(EXIT_FAILURE);
+	}
+
+	json_len = ftell(json);
+	rewind(json);
+	if (nftnl_ruleset_parse_file(rs, NFTNL_PARSE_JSON, json, err) < 0 ||
+	    nftnl_ruleset_fprintf(snap, rs, NFTNL_OUTPUT_SNAPSHOT, 0) < 0 ||
+	    fflush(snap) != 0) {
+		perror("snapshot");
+		goto out;
+	}
+
+	printf("%u rules, %u elements: %ld bytes of JSON, %ld of snapshot\n",
+	       rules, elems, json_len, ftell(snap));
+	if (run_parse("json", json, NFTNL_PARSE_JSON, err) < 0 ||
+	    run_parse("snapshot", snap, NFTNL_PARSE_SNAPSHOT, err) < 0 ||
+	    run_lazy("snapshot, one rule", snap) < 0)
+		goto out;
+
+	ret = EXIT_SUCCESS;
+out:
+	fclose(snap);
+	fclose(json);
+	nftnl_ruleset_free(rs);
+	nftnl_parse_err_free(err);
+	return ret;
+}
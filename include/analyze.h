@@ -0,0 +1,65 @@
+#ifndef _LIBNFTNL_ANALYZE_INTERNAL_H_
+#define _LIBNFTNL_ANALYZE_INTERNAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/netfilter/nf_tables.h>
+
+/*
+ * Match space of a rule: for each packet field it inspects, the set of
+ * values for which the rule goes on, as a sorted list of disjoint inclusive
+ * intervals. Values are compared with memcmp(), as nft_cmp does, so that
+ * ordering is the one of big endian numbers of the field length.
+ */
+#define NFTNL_FIELD_MAXLEN	NFT_REG_SIZE
+
+enum nftnl_field_type {
+	NFTNL_FIELD_PAYLOAD,
+	NFTNL_FIELD_META,
+	NFTNL_FIELD_CT,
+};
+
+struct nftnl_field {
+	uint32_t	type;
+	uint32_t	key;		/* payload base, meta or ct key */
+	uint32_t	offset;		/* payload offset, ct direction */
+	uint32_t	len;
+	uint8_t		mask[NFTNL_FIELD_MAXLEN];
+};
+
+struct nftnl_interval {
+	uint8_t		lo[NFTNL_FIELD_MAXLEN];
+	uint8_t		hi[NFTNL_FIELD_MAXLEN];
+};
+
+struct nftnl_dim {
+	struct nftnl_field	field;
+	struct nftnl_interval	*iv;
+	uint32_t		num;	/* no intervals: never matches */
+};
+
+struct nftnl_space {
+	struct nftnl_dim	*dim;
+	uint32_t		num;
+	/* exact: the rule reaches its action iff all dimensions match */
+	bool			exact;
+	bool			terminal;
+	/* mangle: the rule may change state that later rules match on */
+	bool			mangle;
+	struct nftnl_expr	*action;
+};
+
+struct nftnl_rule;
+struct nftnl_set_list;
+
+bool nftnl_field_equal(const struct nftnl_field *f1,
+		       const struct nftnl_field *f2);
+bool nftnl_value_inc(uint8_t *v, uint32_t len);
+bool nftnl_value_dec(uint8_t *v, uint32_t len);
+
+int nftnl_space_build(struct nftnl_space *s, struct nftnl_rule *r,
+		      struct nftnl_set_list *sets);
+void nftnl_space_free(struct nftnl_space *s);
+bool nftnl_space_empty(const struct nftnl_space *s);
+
+#endif
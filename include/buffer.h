@@ -1,6 +1,7 @@
 #ifndef _NFTNL_BUFFER_H_
 #define _NFTNL_BUFFER_H_
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -10,6 +11,9 @@ struct nftnl_buf {
 	size_t		len;
 	uint32_t	off;
 	bool		fail;
+	FILE		*fp;
+	uint32_t	written;
+	bool		nul;
 };
 
 #define NFTNL_BUF_INIT(__b, __buf, __len)			\
@@ -18,8 +22,27 @@ struct nftnl_buf {
 		.len	= __len,			\
 	};
 
+/*
+ * The output goes to @__fp as it is printed, @__buf only holds what is not
+ * written yet. Call nftnl_buf_flush() once done.
+ */
+#define NFTNL_BUF_INIT_FILE(__b, __buf, __len, __fp)		\
+	struct nftnl_buf __b = {				\
+		.buf	= __buf,			\
+		.len	= __len,			\
+		.fp	= __fp,				\
+	};
+
 int nftnl_buf_update(struct nftnl_buf *b, int ret);
 int nftnl_buf_done(struct nftnl_buf *b);
+int nftnl_buf_flush(struct nftnl_buf *b);
+
+int nftnl_buf_put(struct nftnl_buf *b, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void nftnl_buf_unput(struct nftnl_buf *b);
+int nftnl_buf_obj(struct nftnl_buf *b, void *obj, uint32_t cmd, uint32_t type,
+		  uint32_t flags, int (*snprintf_cb)(char *buf, size_t bufsiz,
+		  void *obj, uint32_t cmd, uint32_t type, uint32_t flags));
 
 union nftnl_data_reg;
 
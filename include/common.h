@@ -20,6 +20,8 @@ enum nftnl_parse_input {
 
 #include <stdio.h>
 
+struct nftnl_buf;
+
 int nftnl_cmd_header_snprintf(char *buf, size_t bufsize, uint32_t cmd,
 			   uint32_t format, uint32_t flags);
 int nftnl_cmd_header_fprintf(FILE *fp, uint32_t cmd, uint32_t format,
@@ -28,5 +30,9 @@ int nftnl_cmd_footer_snprintf(char *buf, size_t bufsize, uint32_t cmd,
 			   uint32_t format, uint32_t flags);
 int nftnl_cmd_footer_fprintf(FILE *fp, uint32_t cmd, uint32_t format,
 			  uint32_t flags);
+int nftnl_cmd_header_buf(struct nftnl_buf *b, uint32_t cmd, uint32_t format,
+			 uint32_t flags);
+int nftnl_cmd_footer_buf(struct nftnl_buf *b, uint32_t cmd, uint32_t format,
+			 uint32_t flags);
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <linux/netfilter/nf_tables.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 
 enum {
@@ -29,5 +30,9 @@ struct nlattr;
 
 int nftnl_parse_data(union nftnl_data_reg *data, struct nlattr *attr, int *type);
 void nftnl_free_verdict(union nftnl_data_reg *data);
+uint32_t nftnl_data_reg_hash(const union nftnl_data_reg *reg, int reg_type,
+			     uint32_t hash);
+bool nftnl_data_reg_cmp(const union nftnl_data_reg *r1,
+			const union nftnl_data_reg *r2, int reg_type);
 
 #endif
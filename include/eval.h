@@ -0,0 +1,16 @@
+#ifndef _LIBNFTNL_EVAL_INTERNAL_H_
+#define _LIBNFTNL_EVAL_INTERNAL_H_
+
+struct nftnl_eval_pkt;
+struct nftnl_field;
+
+/*
+ * Load packet fields as the payload, meta and ct expressions do, masked and
+ * zero padded to NFTNL_FIELD_MAXLEN bytes. present[i] is false if loading
+ * field i would make a rule stop.
+ */
+void nftnl_eval_fields(const struct nftnl_eval_pkt *pkt,
+		       const struct nftnl_field *fields, uint32_t num,
+		       uint8_t (*val)[NFTNL_FIELD_MAXLEN], bool *present);
+
+#endif
@@ -15,5 +15,29 @@ struct nlmsghdr;
 void nftnl_expr_build_payload(struct nlmsghdr *nlh, struct nftnl_expr *expr);
 struct nftnl_expr *nftnl_expr_parse(struct nlattr *attr);
 
+struct nftnl_expr *nftnl_expr_cache_alloc(struct expr_ops *ops);
+void nftnl_expr_cache_free(struct nftnl_expr *e);
+void nftnl_expr_cache_thread_exit(void);
+
+bool nftnl_expr_is(const struct nftnl_expr *e, const char *name);
+
+/*
+ * Registers in 32-bit words: the verdict register covers words 0-3,
+ * NFT_REG_1 to NFT_REG_4 and NFT_REG32_00 to NFT_REG32_15 alias words 4-19.
+ */
+#define NFTNL_REG_WORDS		(4 + 16)
+
+static inline uint32_t nftnl_reg_word(uint32_t reg)
+{
+	if (reg >= NFT_REG32_00)
+		return 4 + reg - NFT_REG32_00;
+
+	return reg * NFT_REG_SIZE / NFT_REG32_SIZE;
+}
+
+static inline uint32_t nftnl_reg_words(uint32_t len)
+{
+	return (len + NFT_REG32_SIZE - 1) / NFT_REG32_SIZE;
+}
 
 #endif
@@ -2,6 +2,7 @@
 #define _EXPR_OPS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "internal.h"
 
 struct nlattr;
@@ -22,6 +23,9 @@ struct expr_ops {
 			     struct nftnl_parse_err *err);
 	int	(*json_parse)(struct nftnl_expr *e, json_t *data,
 			      struct nftnl_parse_err *err);
+	uint32_t (*hash)(const struct nftnl_expr *e, uint32_t hash);
+	bool	(*cmp)(const struct nftnl_expr *e1, const struct nftnl_expr *e2);
+	uint32_t cache_id;	/* object cache slot, see expr_cache.c */
 };
 
 struct expr_ops *nftnl_expr_ops_lookup(const char *name);
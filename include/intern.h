@@ -0,0 +1,16 @@
+#ifndef _LIBNFTNL_INTERN_INTERNAL_H_
+#define _LIBNFTNL_INTERN_INTERNAL_H_
+
+/*
+ * Pool of the table, chain and set names held by objects. Each name is
+ * stored once, with a reference per holder, so two interned names are equal
+ * if and only if they are the same pointer. Only strings returned by
+ * nftnl_intern() or nftnl_intern_get() may be passed to the other functions,
+ * which also accept NULL. nftnl_intern() returns NULL if it runs out of
+ * memory, callers leave the attribute unset then.
+ */
+const char *nftnl_intern(const char *str);
+const char *nftnl_intern_get(const char *str);
+void nftnl_intern_put(const char *str);
+
+#endif
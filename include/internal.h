@@ -9,10 +9,15 @@
 #include "xml.h"
 #include "json.h"
 #include "linux_list.h"
+#include "rule.h"
 #include "set.h"
 #include "set_elem.h"
 #include "expr.h"
 #include "expr_ops.h"
 #include "buffer.h"
+#include "analyze.h"
+#include "eval.h"
+#include "snapshot.h"
+#include "intern.h"
 
 #endif /* _LIBNFTNL_INTERNAL_H_ */
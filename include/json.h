@@ -3,6 +3,7 @@
 
 #ifdef JSON_PARSING
 #include <jansson.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include "common.h"
 
@@ -51,6 +52,31 @@ int nftnl_jansson_parse_elem(struct nftnl_set *s, json_t *tree,
 
 int nftnl_data_reg_json_parse(union nftnl_data_reg *reg, json_t *data,
 			    struct nftnl_parse_err *err);
+
+struct nftnl_json_stream {
+	FILE			*fp;
+	const char		*data;
+	size_t			len;
+	size_t			off;
+	char			*buf;
+	int			line;
+	int			column;
+	char			*str;
+	size_t			str_len;
+	size_t			str_size;
+	struct nftnl_parse_err	*err;
+};
+
+int nftnl_json_stream_init(struct nftnl_json_stream *js, const void *data,
+			   enum nftnl_parse_input input,
+			   struct nftnl_parse_err *err);
+void nftnl_json_stream_fini(struct nftnl_json_stream *js);
+int nftnl_json_stream_peek(struct nftnl_json_stream *js);
+int nftnl_json_stream_expect(struct nftnl_json_stream *js, int c);
+int nftnl_json_stream_next(struct nftnl_json_stream *js, int close);
+int nftnl_json_stream_end(struct nftnl_json_stream *js);
+const char *nftnl_json_stream_key(struct nftnl_json_stream *js);
+json_t *nftnl_json_stream_value(struct nftnl_json_stream *js);
 #else
 #define json_t void
 #endif
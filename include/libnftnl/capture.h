@@ -0,0 +1,43 @@
+#ifndef _LIBNFTNL_CAPTURE_H_
+#define _LIBNFTNL_CAPTURE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <libnftnl/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Captures of the raw message stream of a ruleset dump. The NEWTABLE,
+ * NEWCHAIN, NEWSET, NEWSETELEM and NEWRULE messages are stored as they came
+ * from the kernel, along with the generation the dump was taken at. A
+ * capture is read back by mapping the file, its messages can be handed to
+ * the nftnl_*_nlmsg_parse() functions straight from the mapping.
+ */
+struct nftnl_capture;
+struct nftnl_capture_file;
+struct nftnl_gen;
+struct nlmsghdr;
+
+struct nftnl_capture *nftnl_capture_alloc(FILE *fp, struct nftnl_gen *gen);
+void nftnl_capture_free(struct nftnl_capture *cap);
+int nftnl_capture_nlmsg(struct nftnl_capture *cap, const struct nlmsghdr *nlh);
+int nftnl_capture_end(struct nftnl_capture *cap);
+
+struct nftnl_capture_file *nftnl_capture_open(int fd);
+void nftnl_capture_close(struct nftnl_capture_file *f);
+uint32_t nftnl_capture_count(const struct nftnl_capture_file *f);
+int nftnl_capture_gen(const struct nftnl_capture_file *f,
+		      struct nftnl_gen *gen);
+int nftnl_capture_foreach(const struct nftnl_capture_file *f,
+			  int (*cb)(const struct nlmsghdr *nlh, void *data),
+			  void *data);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _LIBNFTNL_CAPTURE_H_ */
@@ -14,6 +14,7 @@ enum nftnl_output_type {
 	NFTNL_OUTPUT_DEFAULT	= 0,
 	NFTNL_OUTPUT_XML,
 	NFTNL_OUTPUT_JSON,
+	NFTNL_OUTPUT_SNAPSHOT,
 };
 
 enum nftnl_output_flags {
@@ -36,6 +37,7 @@ enum nftnl_parse_type {
 	NFTNL_PARSE_NONE		= 0,
 	NFTNL_PARSE_XML,
 	NFTNL_PARSE_JSON,
+	NFTNL_PARSE_SNAPSHOT,
 	NFTNL_PARSE_MAX,
 };
 
@@ -0,0 +1,155 @@
+#ifndef _LIBNFTNL_EVAL_H_
+#define _LIBNFTNL_EVAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libnftnl/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct nftnl_rule;
+struct nftnl_rule_list;
+struct nftnl_set_list;
+
+/*
+ * Packet metadata. Keys whose bit (1 << NFT_META_*) is not set in present
+ * are not available, rules loading them do not match.
+ */
+struct nftnl_eval_meta {
+	uint32_t	present;
+	uint16_t	protocol;	/* ethertype, network byte order */
+	uint32_t	priority;
+	uint32_t	mark;
+	uint32_t	iif;
+	uint32_t	oif;
+	char		iifname[16];
+	char		oifname[16];
+	uint16_t	iiftype;
+	uint16_t	oiftype;
+	uint32_t	skuid;
+	uint32_t	skgid;
+	uint32_t	nftrace;
+	uint32_t	rtclassid;
+	uint32_t	secmark;
+	char		bri_iifname[16];
+	char		bri_oifname[16];
+	uint8_t		pkttype;
+	uint32_t	cpu;
+	uint32_t	iifgroup;
+	uint32_t	oifgroup;
+	uint32_t	cgroup;
+};
+
+/* Conntrack entry of the packet, in the layout the ct expression loads. */
+struct nftnl_eval_ct {
+	uint32_t	state;			/* NF_CT_STATE_*_BIT */
+	uint8_t		direction;		/* IP_CT_DIR_* of the packet */
+	uint32_t	status;
+	uint32_t	mark;
+	uint32_t	secmark;
+	uint32_t	expiration;		/* ms */
+	char		helper[16];
+	uint8_t		l3protocol;
+	uint8_t		protocol;
+	struct {
+		uint8_t		src[16];
+		uint8_t		dst[16];
+		uint16_t	proto_src;	/* network byte order */
+		uint16_t	proto_dst;	/* network byte order */
+	} tuple[2];
+	uint8_t		labels[16];
+};
+
+/*
+ * data points to the network header of a packet of family NFPROTO_IPV4 or
+ * NFPROTO_IPV6, ll optionally to its link layer header. tstamp is the
+ * arrival time in nanoseconds, it drives the limit expression. A NULL ct
+ * stands for a packet without conntrack entry.
+ */
+struct nftnl_eval_pkt {
+	uint8_t				family;
+	const uint8_t			*data;
+	uint32_t			len;
+	const uint8_t			*ll;
+	uint32_t			ll_len;
+	uint64_t			tstamp;
+	const struct nftnl_eval_meta	*meta;
+	const struct nftnl_eval_ct	*ct;
+};
+
+/*
+ * verdict is NF_ACCEPT, NF_DROP, NF_QUEUE or NF_STOLEN, NFT_CONTINUE if the
+ * packet fell off the base chain so its policy applies, in which case rule
+ * is NULL. rules is the number of rules the packet was evaluated against.
+ */
+struct nftnl_eval_result {
+	int				verdict;
+	const struct nftnl_rule		*rule;
+	uint64_t			handle;
+	uint32_t			rules;
+	uint32_t			mark;
+};
+
+struct nftnl_eval;
+
+struct nftnl_eval *nftnl_eval_alloc(struct nftnl_rule_list *rules,
+				    struct nftnl_set_list *sets);
+void nftnl_eval_free(struct nftnl_eval *ev);
+
+int nftnl_eval_chain(const struct nftnl_eval *ev, uint32_t family,
+		     const char *table, const char *chain);
+int nftnl_eval_run(struct nftnl_eval *ev, int chain,
+		   const struct nftnl_eval_pkt *pkt,
+		   struct nftnl_eval_result *res);
+void nftnl_eval_sync_counters(struct nftnl_eval *ev);
+
+/*
+ * Decision tree classifier
+ *
+ * Finds the first rule of a chain whose match space contains the packet,
+ * jumps are not followed. If the rule does not only inspect the fields it
+ * is classified on, exact is false: it may still not match the packet.
+ */
+struct nftnl_classify_result {
+	const struct nftnl_rule		*rule;
+	uint64_t			handle;
+	bool				exact;
+	uint32_t			depth;
+	uint32_t			checked;
+};
+
+struct nftnl_classify_stats {
+	uint32_t			rules;
+	uint32_t			inexact;
+	uint32_t			fields;
+	uint32_t			nodes;
+	uint32_t			leaves;
+	uint32_t			depth;
+	uint64_t			refs;
+	uint64_t			memory;
+	uint64_t			build_ns;
+};
+
+struct nftnl_classifier;
+
+struct nftnl_classifier *nftnl_classifier_build(struct nftnl_rule_list *list,
+						struct nftnl_set_list *sets,
+						uint32_t family,
+						const char *table,
+						const char *chain);
+void nftnl_classifier_free(struct nftnl_classifier *c);
+
+int nftnl_classifier_lookup(const struct nftnl_classifier *c,
+			    const struct nftnl_eval_pkt *pkt,
+			    struct nftnl_classify_result *res);
+void nftnl_classifier_stats(const struct nftnl_classifier *c,
+			    struct nftnl_classify_stats *stats);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _LIBNFTNL_EVAL_H_ */
@@ -36,8 +36,52 @@ uint32_t nftnl_expr_get_u32(const struct nftnl_expr *expr, uint16_t type);
 uint64_t nftnl_expr_get_u64(const struct nftnl_expr *expr, uint16_t type);
 const char *nftnl_expr_get_str(const struct nftnl_expr *expr, uint16_t type);
 
+uint32_t nftnl_expr_hash(const struct nftnl_expr *expr, uint32_t hash);
+bool nftnl_expr_cmp(const struct nftnl_expr *e1, const struct nftnl_expr *e2);
+
 int nftnl_expr_snprintf(char *buf, size_t buflen, struct nftnl_expr *expr, uint32_t type, uint32_t flags);
 
+/*
+ * Out-of-tree expression types. The ops are copied on registration, which is
+ * not thread-safe and should happen before any expression is allocated.
+ * hash and cmp are optional, the private area is compared bytewise otherwise.
+ */
+struct nlattr;
+struct nlmsghdr;
+
+struct nftnl_expr_ops {
+	const char	*name;
+	uint32_t	alloc_len;
+	int		max_attr;
+	void		(*free)(struct nftnl_expr *e);
+	int		(*set)(struct nftnl_expr *e, uint16_t type, const void *data, uint32_t data_len);
+	const void	*(*get)(const struct nftnl_expr *e, uint16_t type, uint32_t *data_len);
+	int		(*parse)(struct nftnl_expr *e, struct nlattr *attr);
+	void		(*build)(struct nlmsghdr *nlh, struct nftnl_expr *e);
+	int		(*snprintf)(char *buf, size_t len, uint32_t type, uint32_t flags, struct nftnl_expr *e);
+	uint32_t	(*hash)(const struct nftnl_expr *e, uint32_t hash);
+	bool		(*cmp)(const struct nftnl_expr *e1, const struct nftnl_expr *e2);
+};
+
+int nftnl_expr_ops_register(const struct nftnl_expr_ops *ops);
+void *nftnl_expr_priv(const struct nftnl_expr *expr);
+
+/*
+ * Expression objects are recycled through per type caches. The counters
+ * cover all threads, cached counts the objects held by the shared cache and
+ * the caches of all threads. nftnl_expr_cache_flush() frees the shared cache
+ * and the cache of the calling thread only.
+ */
+struct nftnl_expr_cache_stats {
+	uint64_t	alloc;
+	uint64_t	free;
+	uint64_t	hit;
+	uint64_t	cached;
+};
+
+int nftnl_expr_cache_stats(const char *name, struct nftnl_expr_cache_stats *stats);
+void nftnl_expr_cache_flush(void);
+
 enum {
 	NFTNL_EXPR_PAYLOAD_DREG	= NFTNL_EXPR_BASE,
 	NFTNL_EXPR_PAYLOAD_BASE,
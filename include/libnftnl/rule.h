@@ -63,6 +63,12 @@ int nftnl_rule_fprintf(FILE *fp, struct nftnl_rule *r, uint32_t type, uint32_t f
 
 #define nftnl_rule_nlmsg_build_hdr	nftnl_nlmsg_build_hdr
 int nftnl_rule_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_rule *t);
+int nftnl_rule_nlmsg_snprintf(char *buf, size_t size,
+			      const struct nlmsghdr *nlh, uint32_t type,
+			      uint32_t flags);
+
+uint32_t nftnl_rule_hash(const struct nftnl_rule *r);
+bool nftnl_rule_cmp(const struct nftnl_rule *r1, const struct nftnl_rule *r2);
 
 int nftnl_expr_foreach(struct nftnl_rule *r,
 			  int (*cb)(struct nftnl_expr *e, void *data),
@@ -83,14 +89,80 @@ void nftnl_rule_list_add(struct nftnl_rule *r, struct nftnl_rule_list *list);
 void nftnl_rule_list_add_tail(struct nftnl_rule *r, struct nftnl_rule_list *list);
 void nftnl_rule_list_del(struct nftnl_rule *r);
 int nftnl_rule_list_foreach(struct nftnl_rule_list *rule_list, int (*cb)(struct nftnl_rule *t, void *data), void *data);
+int nftnl_rule_list_index(struct nftnl_rule_list *list);
+struct nftnl_rule *nftnl_rule_list_lookup_handle(struct nftnl_rule_list *list, uint64_t handle);
 
 struct nftnl_rule_list_iter;
 
 struct nftnl_rule_list_iter *nftnl_rule_list_iter_create(struct nftnl_rule_list *l);
+struct nftnl_rule_list_iter *nftnl_rule_list_iter_create_chain(struct nftnl_rule_list *l, uint32_t family, const char *table, const char *chain);
 struct nftnl_rule *nftnl_rule_list_iter_cur(struct nftnl_rule_list_iter *iter);
 struct nftnl_rule *nftnl_rule_list_iter_next(struct nftnl_rule_list_iter *iter);
 void nftnl_rule_list_iter_destroy(struct nftnl_rule_list_iter *iter);
 
+struct nftnl_batch;
+
+int nftnl_rule_list_reconcile(struct nftnl_batch *batch, uint32_t *seq,
+			      struct nftnl_rule_list *cur,
+			      struct nftnl_rule_list *want);
+
+/*
+ * Optimization passes
+ */
+
+struct nftnl_set_list;
+
+/*
+ * Rules that keep state, like limits, quotas and counters, are not folded
+ * into one rule, as it would share that state. With
+ * NFTNL_OPTIMIZE_F_MERGE_COUNTERS, rules with counters are folded and the
+ * folded rule counts the packets of all of them.
+ */
+enum {
+	NFTNL_OPTIMIZE_F_MERGE_COUNTERS	= (1 << 0),
+};
+
+int nftnl_rule_list_consolidate(struct nftnl_rule_list *list,
+				struct nftnl_set_list *sets, uint32_t *set_id,
+				uint32_t flags);
+int nftnl_rule_list_verdict_map(struct nftnl_rule_list *list,
+				struct nftnl_set_list *sets, uint32_t *set_id,
+				uint32_t flags);
+int nftnl_rule_coalesce_payload(struct nftnl_rule *r);
+int nftnl_rule_simplify(struct nftnl_rule *r);
+
+/*
+ * xtables compat translation
+ */
+
+int nftnl_rule_xt_translate(struct nftnl_rule *r,
+			    void (*cb)(const struct nftnl_rule *r,
+				       const struct nftnl_expr *e, int err,
+				       void *data),
+			    void *data);
+int nftnl_rule_list_xt_translate(struct nftnl_rule_list *list,
+				 void (*cb)(const struct nftnl_rule *r,
+					    const struct nftnl_expr *e,
+					    int err, void *data),
+				 void *data);
+
+/*
+ * Ruleset analysis
+ */
+
+enum nftnl_rule_redundancy {
+	NFTNL_RULE_SHADOWED,
+	NFTNL_RULE_DUPLICATE,
+};
+
+int nftnl_rule_list_redundant(struct nftnl_rule_list *list,
+			      struct nftnl_set_list *sets,
+			      void (*cb)(const struct nftnl_rule *r,
+					 const struct nftnl_rule *by,
+					 enum nftnl_rule_redundancy type,
+					 void *data),
+			      void *data);
+
 /*
  * Compat
  */
@@ -14,6 +14,7 @@ extern "C" {
 #endif
 
 struct nftnl_ruleset;
+struct nlmsghdr;
 
 struct nftnl_ruleset *nftnl_ruleset_alloc(void);
 void nftnl_ruleset_free(struct nftnl_ruleset *r);
@@ -60,6 +61,10 @@ uint32_t nftnl_ruleset_ctx_get_u32(const struct nftnl_parse_ctx *ctx,
 int nftnl_ruleset_parse_file_cb(enum nftnl_parse_type type, FILE *fp,
 			      struct nftnl_parse_err *err, void *data,
 			      int (*cb)(const struct nftnl_parse_ctx *ctx));
+int nftnl_ruleset_parse_file_cb_threads(enum nftnl_parse_type type, FILE *fp,
+				struct nftnl_parse_err *err, void *data,
+				int (*cb)(const struct nftnl_parse_ctx *ctx),
+				unsigned int threads);
 int nftnl_ruleset_parse_buffer_cb(enum nftnl_parse_type type, const char *buffer,
 				struct nftnl_parse_err *err, void *data,
 				int (*cb)(const struct nftnl_parse_ctx *ctx));
@@ -70,6 +75,15 @@ int nftnl_ruleset_parse_file(struct nftnl_ruleset *rs, enum nftnl_parse_type typ
 int nftnl_ruleset_snprintf(char *buf, size_t size, const struct nftnl_ruleset *rs, uint32_t type, uint32_t flags);
 int nftnl_ruleset_fprintf(FILE *fp, const struct nftnl_ruleset *rs, uint32_t type, uint32_t flags);
 
+struct nftnl_ruleset_export;
+struct nftnl_ruleset_export *nftnl_ruleset_export_alloc(FILE *fp,
+							uint32_t type,
+							uint32_t flags);
+void nftnl_ruleset_export_free(struct nftnl_ruleset_export *exp);
+int nftnl_ruleset_export_nlmsg(struct nftnl_ruleset_export *exp,
+			       const struct nlmsghdr *nlh);
+int nftnl_ruleset_export_end(struct nftnl_ruleset_export *exp);
+
 /*
  * Compat
  */
@@ -140,6 +140,43 @@ void nftnl_set_elems_iter_destroy(struct nftnl_set_elems_iter *iter);
 int nftnl_set_elems_nlmsg_build_payload_iter(struct nlmsghdr *nlh,
 					   struct nftnl_set_elems_iter *iter);
 
+/*
+ * Backend cost model
+ *
+ * Estimates the memory and the lookup cost in nanoseconds of the set in
+ * each kernel backend, and recommends the backend, whether to use
+ * intervals, the policy and the size description for it. selected is the
+ * backend the kernel instantiates with that policy and size.
+ */
+enum nftnl_set_backend {
+	NFTNL_SET_BACKEND_HASH,
+	NFTNL_SET_BACKEND_RBTREE,
+	NFTNL_SET_BACKEND_BITMAP,
+	__NFTNL_SET_BACKEND_MAX
+};
+#define NFTNL_SET_BACKEND_MAX (__NFTNL_SET_BACKEND_MAX - 1)
+
+struct nftnl_set_backend_cost {
+	bool		usable;
+	bool		interval;	/* costs of the interval layout */
+	uint32_t	elements;	/* interval ends included */
+	uint64_t	memory;
+	double		lookup;
+};
+
+struct nftnl_set_advice {
+	struct nftnl_set_backend_cost	cost[__NFTNL_SET_BACKEND_MAX];
+	uint64_t			keys;
+	uint32_t			ranges;
+	uint32_t			backend;
+	uint32_t			selected;
+	bool				interval;
+	uint32_t			policy;
+	uint32_t			size;
+};
+
+int nftnl_set_advise(const struct nftnl_set *s, struct nftnl_set_advice *adv);
+
 /*
  * Compat
  */
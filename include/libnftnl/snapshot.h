@@ -0,0 +1,53 @@
+#ifndef _LIBNFTNL_SNAPSHOT_H_
+#define _LIBNFTNL_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <libnftnl/common.h>
+#include <libnftnl/ruleset.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary ruleset snapshots, written by nftnl_ruleset_fprintf() with
+ * NFTNL_OUTPUT_SNAPSHOT and read back by mapping the file. Objects are only
+ * built when they are asked for, they do not refer to the mapping so they
+ * outlive nftnl_snapshot_close().
+ *
+ * nftnl_snapshot_open() maps the snapshot at the start of @fd, whatever the
+ * file offset. nftnl_ruleset_parse_file() with NFTNL_PARSE_SNAPSHOT reads
+ * the snapshot at the position of the stream instead, which has to be a
+ * multiple of 8, and leaves the stream right after it.
+ *
+ * Snapshots are not authenticated. Opening one checks its bounds, and a
+ * checksum of each rule catches accidental damage, but a crafted file can
+ * pass these checks. Only open snapshots that come from a trusted source.
+ */
+struct nftnl_snapshot;
+struct nftnl_table;
+struct nftnl_chain;
+struct nftnl_set;
+struct nftnl_rule;
+
+struct nftnl_snapshot *nftnl_snapshot_open(int fd);
+void nftnl_snapshot_close(struct nftnl_snapshot *snap);
+
+uint32_t nftnl_snapshot_count(const struct nftnl_snapshot *snap,
+			      enum nftnl_ruleset_type type);
+
+struct nftnl_table *nftnl_snapshot_get_table(const struct nftnl_snapshot *snap,
+					     uint32_t index);
+struct nftnl_chain *nftnl_snapshot_get_chain(const struct nftnl_snapshot *snap,
+					     uint32_t index);
+struct nftnl_set *nftnl_snapshot_get_set(const struct nftnl_snapshot *snap,
+					 uint32_t index);
+struct nftnl_rule *nftnl_snapshot_get_rule(const struct nftnl_snapshot *snap,
+					   uint32_t index);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _LIBNFTNL_SNAPSHOT_H_ */
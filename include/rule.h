@@ -0,0 +1,42 @@
+#ifndef _LIBNFTNL_RULE_INTERNAL_H_
+#define _LIBNFTNL_RULE_INTERNAL_H_
+
+struct nftnl_rule {
+	struct list_head head;
+	struct hlist_node handle_node;	/* nftnl_rule_list handle index */
+	struct list_head chain_head;	/* nftnl_rule_list chain index */
+
+	uint32_t	flags;
+	uint32_t	family;
+	const char	*table;
+	const char	*chain;
+	uint64_t	handle;
+	uint64_t	position;
+	struct {
+			void		*data;
+			uint32_t	len;
+	} user;
+	struct {
+			uint32_t	flags;
+			uint32_t	proto;
+	} compat;
+
+	struct list_head expr_list;
+};
+
+struct nftnl_rule_index;
+
+struct nftnl_rule_list {
+	struct list_head	list;
+	struct nftnl_rule_index	*index;
+};
+
+bool nftnl_rule_cmp_attr(const struct nftnl_rule *r1,
+			 const struct nftnl_rule *r2);
+
+struct nlattr;
+
+/* add the expressions of the NFTA_RULE_EXPRESSIONS attribute @nest to @r */
+int nftnl_rule_parse_expr(struct nlattr *nest, struct nftnl_rule *r);
+
+#endif
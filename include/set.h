@@ -28,7 +28,19 @@ struct nftnl_set {
 
 struct nftnl_set_list;
 struct nftnl_expr;
+/*
+ * Index the sets of @list by name for nftnl_set_lookup_id(). The index
+ * follows nftnl_set_list_add() and nftnl_set_list_add_tail(), it does not
+ * see nftnl_set_list_del() nor set renames: only use it on lists that grow.
+ */
+int nftnl_set_list_index(struct nftnl_set_list *list);
 int nftnl_set_lookup_id(struct nftnl_expr *e, struct nftnl_set_list *set_list,
 		      uint32_t *set_id);
+/*
+ * Print the opening of the JSON object of @s and its attributes, up to where
+ * the "set_elem" array goes, for the dump renderer in ruleset.c.
+ */
+int nftnl_set_snprintf_json_head(char *buf, size_t size,
+				 const struct nftnl_set *s);
 
 #endif
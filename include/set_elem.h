@@ -18,4 +18,13 @@ struct nftnl_set_elem {
 	} user;
 };
 
+struct nlmsghdr;
+struct nftnl_set;
+
+bool nftnl_set_elems_nlmsg_match(const struct nlmsghdr *nlh,
+				 const struct nftnl_set *s);
+int nftnl_set_elems_nlmsg_snprintf(char *buf, size_t size,
+				   const struct nlmsghdr *nlh, uint32_t type,
+				   uint32_t flags);
+
 #endif
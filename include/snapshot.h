@@ -0,0 +1,30 @@
+#ifndef _LIBNFTNL_SNAPSHOT_INTERNAL_H_
+#define _LIBNFTNL_SNAPSHOT_INTERNAL_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+struct nftnl_snapshot;
+struct nftnl_table_list;
+struct nftnl_chain_list;
+struct nftnl_set_list;
+struct nftnl_rule_list;
+
+/*
+ * Write the objects of the lists, any of them may be NULL, as a snapshot
+ * to @fp. Backend of nftnl_ruleset_fprintf() for NFTNL_OUTPUT_SNAPSHOT.
+ */
+int nftnl_snapshot_fprintf(FILE *fp, struct nftnl_table_list *tl,
+			   struct nftnl_chain_list *cl,
+			   struct nftnl_set_list *sl,
+			   struct nftnl_rule_list *rl);
+
+/*
+ * Map the snapshot that starts at @offset of @fd, which has to be a multiple
+ * of 8. Data after the snapshot is ignored, nftnl_snapshot_size() tells
+ * where the snapshot ends.
+ */
+struct nftnl_snapshot *nftnl_snapshot_open_at(int fd, off_t offset);
+size_t nftnl_snapshot_size(const struct nftnl_snapshot *snap);
+
+#endif
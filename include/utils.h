@@ -11,8 +11,10 @@
 #ifdef HAVE_VISIBILITY_HIDDEN
 #	define __visible	__attribute__((visibility("default")))
 #	define EXPORT_SYMBOL(x, y)	typeof(x) (x) __visible; __typeof (y) y __attribute ((alias (#x), visibility ("default")))
+#	define EXPORT_SYMBOL_NOALIAS(x)	typeof(x) (x) __visible
 #else
 #	define EXPORT_SYMBOL
+#	define EXPORT_SYMBOL_NOALIAS(x)
 #endif
 
 #define __noreturn	__attribute__((__noreturn__))
@@ -75,6 +77,14 @@ uint32_t nftnl_str2cmd(const char *cmd);
 
 enum nftnl_cmd_type nftnl_flag2cmd(uint32_t flags);
 
+#define NFTNL_HASH_INIT		2166136261U
+
+uint32_t nftnl_hash_data(uint32_t hash, const void *data, size_t len);
+uint32_t nftnl_hash_str(uint32_t hash, const char *str);
+
+#define nftnl_hash_val(hash, val)	\
+	nftnl_hash_data(hash, &(val), sizeof(val))
+
 int nftnl_fprintf(FILE *fp, void *obj, uint32_t cmd, uint32_t type,
 		uint32_t flags, int (*snprintf_cb)(char *buf, size_t bufsiz,
 		void *obj, uint32_t cmd, uint32_t type, uint32_t flags));
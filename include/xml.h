@@ -18,6 +18,9 @@ union nftnl_data_reg;
 
 mxml_node_t *nftnl_mxml_build_tree(const void *data, const char *treename,
 				 struct nftnl_parse_err *err, enum nftnl_parse_input input);
+int nftnl_mxml_sax_load(const void *data, enum nftnl_parse_input input,
+			mxml_sax_cb_t cb, void *cb_data,
+			struct nftnl_parse_err *err);
 struct nftnl_expr *nftnl_mxml_expr_parse(mxml_node_t *node,
 					  struct nftnl_parse_err *err,
 					  struct nftnl_set_list *set_list);
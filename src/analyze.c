@@ -0,0 +1,875 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/set.h>
+
+bool nftnl_field_equal(const struct nftnl_field *f1,
+		       const struct nftnl_field *f2)
+{
+	return f1->type == f2->type && f1->key == f2->key &&
+	       f1->offset == f2->offset && f1->len == f2->len &&
+	       memcmp(f1->mask, f2->mask, f1->len) == 0;
+}
+
+/* a mask made of leading ones only, as in address prefixes */
+static bool nftnl_mask_is_prefix(const uint8_t *mask, uint32_t len)
+{
+	bool ones = true;
+	uint32_t i;
+	int bit;
+
+	for (i = 0; i < len; i++) {
+		for (bit = 7; bit >= 0; bit--) {
+			if (mask[i] & (1 << bit)) {
+				if (!ones)
+					return false;
+			} else {
+				ones = false;
+			}
+		}
+	}
+	return true;
+}
+
+/* big endian increment and decrement, false on wrap around */
+bool nftnl_value_inc(uint8_t *v, uint32_t len)
+{
+	while (len-- > 0) {
+		if (++v[len] != 0)
+			return true;
+	}
+	return false;
+}
+
+bool nftnl_value_dec(uint8_t *v, uint32_t len)
+{
+	while (len-- > 0) {
+		if (v[len]-- != 0)
+			return true;
+	}
+	return false;
+}
+
+/* bytes beyond the field length are zero, so the whole bound can be compared */
+static int nftnl_interval_cmp(const void *a, const void *b)
+{
+	const struct nftnl_interval *i1 = a, *i2 = b;
+
+	return memcmp(i1->lo, i2->lo, NFTNL_FIELD_MAXLEN);
+}
+
+/* sort and merge overlapping or adjacent intervals */
+static void nftnl_dim_normalize(struct nftnl_dim *d)
+{
+	uint32_t len = d->field.len, i, n = 0;
+	uint8_t next[NFTNL_FIELD_MAXLEN];
+
+	if (d->num == 0)
+		return;
+
+	qsort(d->iv, d->num, sizeof(d->iv[0]), nftnl_interval_cmp);
+
+	for (i = 1; i < d->num; i++) {
+		memcpy(next, d->iv[n].hi, len);
+		if (nftnl_value_inc(next, len) &&
+		    memcmp(d->iv[i].lo, next, len) > 0) {
+			d->iv[++n] = d->iv[i];
+			continue;
+		}
+		if (memcmp(d->iv[i].hi, d->iv[n].hi, len) > 0)
+			memcpy(d->iv[n].hi, d->iv[i].hi, len);
+	}
+	d->num = n + 1;
+}
+
+static int nftnl_dim_add(struct nftnl_dim *d, const uint8_t *lo,
+			 const uint8_t *hi)
+{
+	struct nftnl_interval *iv;
+
+	iv = realloc(d->iv, (d->num + 1) * sizeof(*iv));
+	if (iv == NULL)
+		return -1;
+
+	d->iv = iv;
+	memset(&iv[d->num], 0, sizeof(*iv));
+	memcpy(iv[d->num].lo, lo, d->field.len);
+	memcpy(iv[d->num].hi, hi, d->field.len);
+	d->num++;
+	return 0;
+}
+
+static int nftnl_dim_add_full(struct nftnl_dim *d)
+{
+	static const uint8_t zero[NFTNL_FIELD_MAXLEN];
+	uint8_t max[NFTNL_FIELD_MAXLEN];
+
+	memset(max, 0xff, sizeof(max));
+	return nftnl_dim_add(d, zero, max);
+}
+
+/* is every value of @d1 also in @d2? both must be normalized */
+static bool nftnl_dim_subset(const struct nftnl_dim *d1,
+			     const struct nftnl_dim *d2)
+{
+	uint32_t len = d1->field.len, i, j = 0;
+
+	for (i = 0; i < d1->num; i++) {
+		while (j < d2->num &&
+		       memcmp(d2->iv[j].hi, d1->iv[i].lo, len) < 0)
+			j++;
+		if (j == d2->num ||
+		    memcmp(d2->iv[j].lo, d1->iv[i].lo, len) > 0 ||
+		    memcmp(d2->iv[j].hi, d1->iv[i].hi, len) < 0)
+			return false;
+	}
+	return true;
+}
+
+/* @d = @d & @c, both normalized */
+static int nftnl_dim_intersect(struct nftnl_dim *d, const struct nftnl_dim *c)
+{
+	struct nftnl_dim res = { .field = d->field };
+	uint32_t len = d->field.len, i = 0, j = 0;
+	const uint8_t *lo, *hi;
+
+	while (i < d->num && j < c->num) {
+		lo = memcmp(d->iv[i].lo, c->iv[j].lo, len) > 0 ?
+		     d->iv[i].lo : c->iv[j].lo;
+		hi = memcmp(d->iv[i].hi, c->iv[j].hi, len) < 0 ?
+		     d->iv[i].hi : c->iv[j].hi;
+
+		if (memcmp(lo, hi, len) <= 0 &&
+		    nftnl_dim_add(&res, lo, hi) < 0) {
+			xfree(res.iv);
+			return -1;
+		}
+
+		if (memcmp(d->iv[i].hi, c->iv[j].hi, len) < 0)
+			i++;
+		else
+			j++;
+	}
+
+	xfree(d->iv);
+	d->iv = res.iv;
+	d->num = res.num;
+	return 0;
+}
+
+static struct nftnl_dim *nftnl_space_find(struct nftnl_space *s,
+					  const struct nftnl_field *f)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->num; i++) {
+		if (nftnl_field_equal(&s->dim[i].field, f))
+			return &s->dim[i];
+	}
+	return NULL;
+}
+
+/* restrict field @c->field of @s to the values of @c, consumes @c */
+static int nftnl_space_restrict(struct nftnl_space *s, struct nftnl_dim *c)
+{
+	struct nftnl_dim *d, *dim;
+	int ret;
+
+	nftnl_dim_normalize(c);
+
+	d = nftnl_space_find(s, &c->field);
+	if (d != NULL) {
+		ret = nftnl_dim_intersect(d, c);
+		xfree(c->iv);
+		return ret;
+	}
+
+	dim = realloc(s->dim, (s->num + 1) * sizeof(*dim));
+	if (dim == NULL) {
+		xfree(c->iv);
+		return -1;
+	}
+	s->dim = dim;
+	s->dim[s->num++] = *c;
+	return 0;
+}
+
+/* loads may fail, which stops the rule as a mismatch would */
+static int nftnl_space_load(struct nftnl_space *s, const struct nftnl_field *f)
+{
+	struct nftnl_dim c = { .field = *f };
+
+	if (nftnl_dim_add_full(&c) < 0)
+		return -1;
+
+	return nftnl_space_restrict(s, &c);
+}
+
+void nftnl_space_free(struct nftnl_space *s)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->num; i++)
+		xfree(s->dim[i].iv);
+	xfree(s->dim);
+}
+
+/*
+ * cmp of @f against @data. Equality on a prefix mask is an interval of the
+ * unmasked field, so that e.g. 10.0.0.0/8 covers 10.1.2.0/24.
+ */
+static int nftnl_cmp_dim(struct nftnl_dim *c, const struct nftnl_field *f,
+			 uint32_t op, const uint8_t *data)
+{
+	uint8_t min[NFTNL_FIELD_MAXLEN] = {}, max[NFTNL_FIELD_MAXLEN];
+	uint8_t lo[NFTNL_FIELD_MAXLEN], hi[NFTNL_FIELD_MAXLEN];
+	uint32_t len = f->len, i;
+	bool empty = false;
+
+	c->field = *f;
+	memset(max, 0xff, sizeof(max));
+	memcpy(lo, data, len);
+	memcpy(hi, data, len);
+
+	if ((op == NFT_CMP_EQ || op == NFT_CMP_NEQ) &&
+	    nftnl_mask_is_prefix(f->mask, len)) {
+		memset(c->field.mask, 0xff, sizeof(c->field.mask));
+		for (i = 0; i < len; i++) {
+			empty |= (lo[i] & ~f->mask[i]) != 0;
+			hi[i] |= ~f->mask[i];
+		}
+	}
+
+	switch (op) {
+	case NFT_CMP_EQ:
+		return empty ? 0 : nftnl_dim_add(c, lo, hi);
+	case NFT_CMP_NEQ:
+		if (empty)
+			return nftnl_dim_add(c, min, max);
+		if (nftnl_value_dec(lo, len) && nftnl_dim_add(c, min, lo) < 0)
+			return -1;
+		if (nftnl_value_inc(hi, len) && nftnl_dim_add(c, hi, max) < 0)
+			return -1;
+		return 0;
+	case NFT_CMP_LTE:
+		return nftnl_dim_add(c, min, hi);
+	case NFT_CMP_GTE:
+		return nftnl_dim_add(c, lo, max);
+	case NFT_CMP_LT:
+		if (!nftnl_value_dec(hi, len))
+			return 0;
+		return nftnl_dim_add(c, min, hi);
+	case NFT_CMP_GT:
+		if (!nftnl_value_inc(lo, len))
+			return 0;
+		return nftnl_dim_add(c, lo, max);
+	}
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+/* symbolic register contents: the field a data register word holds */
+struct nftnl_space_reg {
+	bool			valid;
+	bool			used;
+	struct nftnl_field	field;
+};
+
+struct nftnl_space_ctx {
+	struct nftnl_space	*space;
+	const struct nftnl_rule	*rule;
+	struct nftnl_set_list	*sets;
+	struct nftnl_space_reg	reg[NFTNL_REG_WORDS];
+};
+
+static void nftnl_space_reg_set(struct nftnl_space_ctx *ctx, uint32_t reg,
+				uint32_t len, const struct nftnl_field *f)
+{
+	uint32_t word = nftnl_reg_word(reg), words = nftnl_reg_words(len), i;
+
+	for (i = word; i < word + words && i < NFTNL_REG_WORDS; i++)
+		ctx->reg[i].valid = false;
+
+	if (f != NULL && word < NFTNL_REG_WORDS) {
+		ctx->reg[word].valid = true;
+		ctx->reg[word].used = false;
+		ctx->reg[word].field = *f;
+	}
+}
+
+/*
+ * Field held in @reg, read with length @len. meta and ct loads do not tell
+ * their length, it is taken from the first expression reading them.
+ */
+static struct nftnl_field *nftnl_space_reg_get(struct nftnl_space_ctx *ctx,
+					       uint32_t reg, uint32_t len)
+{
+	uint32_t word = nftnl_reg_word(reg);
+	struct nftnl_space_reg *r;
+
+	if (word >= NFTNL_REG_WORDS || len > NFTNL_FIELD_MAXLEN)
+		return NULL;
+
+	r = &ctx->reg[word];
+	if (!r->valid)
+		return NULL;
+	if (r->field.len == 0)
+		r->field.len = len;
+	if (r->field.len != len)
+		return NULL;
+
+	r->used = true;
+	return &r->field;
+}
+
+static int nftnl_space_payload(struct nftnl_space_ctx *ctx,
+			       const struct nftnl_expr *e)
+{
+	struct nftnl_field f = {
+		.type	= NFTNL_FIELD_PAYLOAD,
+		.key	= nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_BASE),
+		.offset	= nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET),
+		.len	= nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_LEN),
+	};
+	uint32_t dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_DREG);
+
+	if (f.len == 0 || f.len > NFTNL_FIELD_MAXLEN) {
+		nftnl_space_reg_set(ctx, dreg, f.len, NULL);
+		ctx->space->exact = false;
+		return 0;
+	}
+
+	memset(f.mask, 0xff, sizeof(f.mask));
+	nftnl_space_reg_set(ctx, dreg, f.len, &f);
+	return nftnl_space_load(ctx->space, &f);
+}
+
+static void nftnl_space_key(struct nftnl_space_ctx *ctx, uint32_t type,
+			    uint32_t key, uint32_t offset, uint32_t dreg)
+{
+	struct nftnl_field f = {
+		.type	= type,
+		.key	= key,
+		.offset	= offset,
+	};
+
+	memset(f.mask, 0xff, sizeof(f.mask));
+	nftnl_space_reg_set(ctx, dreg, NFT_REG32_SIZE, &f);
+}
+
+static void nftnl_space_bitwise(struct nftnl_space_ctx *ctx,
+				const struct nftnl_expr *e)
+{
+	uint32_t len = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN);
+	uint32_t sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_SREG);
+	uint32_t dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_DREG);
+	const uint8_t *mask, *xor;
+	struct nftnl_field *src, f;
+	uint32_t mlen, xlen, i;
+
+	src = nftnl_space_reg_get(ctx, sreg, len);
+	mask = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_MASK, &mlen);
+	xor = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_XOR, &xlen);
+	if (src == NULL || mask == NULL || xor == NULL ||
+	    mlen < len || xlen < len) {
+		nftnl_space_reg_set(ctx, dreg, len, NULL);
+		return;
+	}
+
+	f = *src;
+	for (i = 0; i < len; i++) {
+		if (xor[i] != 0) {
+			nftnl_space_reg_set(ctx, dreg, len, NULL);
+			return;
+		}
+		f.mask[i] &= mask[i];
+	}
+	nftnl_space_reg_set(ctx, dreg, len, &f);
+}
+
+static int nftnl_space_cmp(struct nftnl_space_ctx *ctx,
+			   const struct nftnl_expr *e)
+{
+	uint32_t sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_CMP_SREG);
+	struct nftnl_dim c = {};
+	const struct nftnl_field *f;
+	const void *data;
+	uint32_t len;
+
+	data = nftnl_expr_get(e, NFTNL_EXPR_CMP_DATA, &len);
+	f = nftnl_space_reg_get(ctx, sreg, len);
+	if (f == NULL || data == NULL) {
+		ctx->space->exact = false;
+		return 0;
+	}
+
+	if (nftnl_cmp_dim(&c, f, nftnl_expr_get_u32(e, NFTNL_EXPR_CMP_OP),
+			  data) < 0) {
+		xfree(c.iv);
+		if (errno != EOPNOTSUPP)
+			return -1;
+
+		ctx->space->exact = false;
+		return 0;
+	}
+	return nftnl_space_restrict(ctx->space, &c);
+}
+
+static struct nftnl_set *nftnl_space_set(struct nftnl_space_ctx *ctx,
+					 const char *name)
+{
+	struct nftnl_set_list_iter *iter;
+	const struct nftnl_rule *r = ctx->rule;
+	struct nftnl_set *s;
+
+	if (ctx->sets == NULL)
+		return NULL;
+
+	iter = nftnl_set_list_iter_create(ctx->sets);
+	if (iter == NULL)
+		return NULL;
+
+	while ((s = nftnl_set_list_iter_next(iter)) != NULL) {
+		if (strcmp(s->name, name) == 0 && s->family == r->family &&
+		    (r->table == NULL || s->table == r->table))
+			break;
+	}
+	nftnl_set_list_iter_destroy(iter);
+
+	return s;
+}
+
+struct nftnl_space_point {
+	uint8_t		key[NFTNL_FIELD_MAXLEN];
+	bool		end;
+};
+
+static int nftnl_space_point_cmp(const void *a, const void *b)
+{
+	return memcmp(((const struct nftnl_space_point *)a)->key,
+		      ((const struct nftnl_space_point *)b)->key,
+		      NFTNL_FIELD_MAXLEN);
+}
+
+/*
+ * Interval sets match a key against the closest element not greater than
+ * it, which opens an interval unless it is flagged as interval end.
+ */
+static int nftnl_set_dim(struct nftnl_dim *c, const struct nftnl_set *s)
+{
+	uint8_t max[NFTNL_FIELD_MAXLEN], hi[NFTNL_FIELD_MAXLEN];
+	struct nftnl_space_point *p;
+	struct nftnl_set_elem *elem;
+	uint32_t len = c->field.len, n = 0, i;
+	int ret = 0;
+
+	list_for_each_entry(elem, &s->element_list, head)
+		n++;
+
+	p = calloc(n + 1, sizeof(*p));
+	if (p == NULL)
+		return -1;
+
+	n = 0;
+	list_for_each_entry(elem, &s->element_list, head) {
+		memcpy(p[n].key, elem->key.val, len);
+		p[n++].end = elem->set_elem_flags & NFT_SET_ELEM_INTERVAL_END;
+	}
+
+	memset(max, 0xff, sizeof(max));
+	if (s->set_flags & NFT_SET_INTERVAL)
+		qsort(p, n, sizeof(*p), nftnl_space_point_cmp);
+
+	for (i = 0; i < n && ret == 0; i++) {
+		if (!(s->set_flags & NFT_SET_INTERVAL)) {
+			ret = nftnl_dim_add(c, p[i].key, p[i].key);
+			continue;
+		}
+		if (p[i].end)
+			continue;
+
+		memcpy(hi, p[i + 1].key, len);
+		if (i + 1 == n || !nftnl_value_dec(hi, len))
+			ret = nftnl_dim_add(c, p[i].key, max);
+		else if (memcmp(hi, p[i].key, len) >= 0)
+			ret = nftnl_dim_add(c, p[i].key, hi);
+	}
+	xfree(p);
+
+	return ret;
+}
+
+/* only sets whose contents cannot change are part of the match space */
+static int nftnl_space_lookup(struct nftnl_space_ctx *ctx,
+			      const struct nftnl_expr *e)
+{
+	uint32_t sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_LOOKUP_SREG);
+	const char *name = nftnl_expr_get_str(e, NFTNL_EXPR_LOOKUP_SET);
+	const struct nftnl_field *f;
+	struct nftnl_dim c = {};
+	struct nftnl_set *s;
+
+	s = name ? nftnl_space_set(ctx, name) : NULL;
+	if (s == NULL || !(s->set_flags & NFT_SET_CONSTANT)) {
+		ctx->space->exact = false;
+		return 0;
+	}
+
+	f = nftnl_space_reg_get(ctx, sreg, s->key_len);
+	if (f == NULL) {
+		ctx->space->exact = false;
+		return 0;
+	}
+
+	c.field = *f;
+	if (nftnl_set_dim(&c, s) < 0) {
+		xfree(c.iv);
+		return -1;
+	}
+	return nftnl_space_restrict(ctx->space, &c);
+}
+
+/*
+ * Feed the match part of a rule into its space. Returns 1 if @e was
+ * consumed, 0 if it starts the action part of the rule.
+ */
+static int nftnl_space_expr(struct nftnl_space_ctx *ctx,
+			    const struct nftnl_expr *e)
+{
+	uint32_t dreg;
+
+	if (nftnl_expr_is(e, "payload")) {
+		if (nftnl_space_payload(ctx, e) < 0)
+			return -1;
+	} else if (nftnl_expr_is(e, "meta")) {
+		if (!nftnl_expr_is_set(e, NFTNL_EXPR_META_DREG))
+			return 0;
+
+		nftnl_space_key(ctx, NFTNL_FIELD_META,
+				nftnl_expr_get_u32(e, NFTNL_EXPR_META_KEY), 0,
+				nftnl_expr_get_u32(e, NFTNL_EXPR_META_DREG));
+	} else if (nftnl_expr_is(e, "ct")) {
+		if (!nftnl_expr_is_set(e, NFTNL_EXPR_CT_DREG))
+			return 0;
+
+		nftnl_space_key(ctx, NFTNL_FIELD_CT,
+				nftnl_expr_get_u32(e, NFTNL_EXPR_CT_KEY),
+				nftnl_expr_is_set(e, NFTNL_EXPR_CT_DIR) ?
+				nftnl_expr_get_u8(e, NFTNL_EXPR_CT_DIR) :
+				UINT32_MAX,
+				nftnl_expr_get_u32(e, NFTNL_EXPR_CT_DREG));
+	} else if (nftnl_expr_is(e, "bitwise")) {
+		nftnl_space_bitwise(ctx, e);
+	} else if (nftnl_expr_is(e, "byteorder")) {
+		dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_DREG);
+		nftnl_space_reg_set(ctx, dreg,
+			nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_LEN), NULL);
+	} else if (nftnl_expr_is(e, "immediate")) {
+		dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG);
+		if (dreg == NFT_REG_VERDICT)
+			return 0;
+
+		nftnl_space_reg_set(ctx, dreg, NFT_REG_SIZE, NULL);
+	} else if (nftnl_expr_is(e, "cmp")) {
+		if (nftnl_space_cmp(ctx, e) < 0)
+			return -1;
+	} else if (nftnl_expr_is(e, "lookup")) {
+		if (nftnl_expr_is_set(e, NFTNL_EXPR_LOOKUP_DREG))
+			return 0;
+		if (nftnl_space_lookup(ctx, e) < 0)
+			return -1;
+	} else if (!nftnl_expr_is(e, "counter") && !nftnl_expr_is(e, "log")) {
+		return 0;
+	}
+	return 1;
+}
+
+static bool nftnl_expr_is_terminal(const struct nftnl_expr *e)
+{
+	if (nftnl_expr_is(e, "reject"))
+		return true;
+	if (!nftnl_expr_is(e, "immediate") ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG) != NFT_REG_VERDICT)
+		return false;
+
+	switch ((int)nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_VERDICT)) {
+	case NF_ACCEPT:
+	case NF_DROP:
+	case NFT_GOTO:
+	case NFT_RETURN:
+		return true;
+	}
+	return false;
+}
+
+/* the action part is terminal if it always ends evaluation of the chain */
+static bool nftnl_space_terminal(const struct nftnl_rule *r,
+				 const struct nftnl_expr *action)
+{
+	const struct nftnl_expr *e = action;
+
+	while (&e->head != &r->expr_list) {
+		if (nftnl_expr_is_terminal(e))
+			return e->head.next == &r->expr_list;
+		if (!nftnl_expr_is(e, "counter") && !nftnl_expr_is(e, "log"))
+			return false;
+
+		e = list_entry(e->head.next, struct nftnl_expr, head);
+	}
+	return false;
+}
+
+/*
+ * Setting the mark, translating addresses or jumping to a chain that may do
+ * so changes what later rules match on, so earlier rules no longer tell
+ * which packets reach them.
+ */
+static bool nftnl_expr_mangles(const struct nftnl_expr *e)
+{
+	if (nftnl_expr_is(e, "meta"))
+		return nftnl_expr_is_set(e, NFTNL_EXPR_META_SREG);
+	if (nftnl_expr_is(e, "ct"))
+		return nftnl_expr_is_set(e, NFTNL_EXPR_CT_SREG);
+	if (nftnl_expr_is(e, "immediate"))
+		return nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG) ==
+			NFT_REG_VERDICT &&
+		       nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_VERDICT) ==
+			(uint32_t)NFT_JUMP;
+
+	return nftnl_expr_is(e, "nat") || nftnl_expr_is(e, "masq") ||
+	       nftnl_expr_is(e, "redir") || nftnl_expr_is(e, "dynset") ||
+	       nftnl_expr_is(e, "target");
+}
+
+int nftnl_space_build(struct nftnl_space *s, struct nftnl_rule *r,
+		      struct nftnl_set_list *sets)
+{
+	struct nftnl_space_ctx ctx = {
+		.space	= s,
+		.rule	= r,
+		.sets	= sets,
+	};
+	struct nftnl_expr *e;
+	uint32_t i;
+	int ret;
+
+	s->exact = true;
+	s->action = NULL;
+	list_for_each_entry(e, &r->expr_list, head) {
+		ret = nftnl_space_expr(&ctx, e);
+		if (ret < 0)
+			return -1;
+		if (ret == 0) {
+			s->action = e;
+			break;
+		}
+	}
+
+	/* an unchecked meta or ct load might fail, and we lack its length */
+	for (i = 0; i < NFTNL_REG_WORDS; i++) {
+		if (ctx.reg[i].valid && !ctx.reg[i].used &&
+		    ctx.reg[i].field.type != NFTNL_FIELD_PAYLOAD)
+			s->exact = false;
+	}
+
+	s->terminal = s->action && nftnl_space_terminal(r, s->action);
+
+	s->mangle = false;
+	for (e = s->action; e != NULL && &e->head != &r->expr_list;
+	     e = list_entry(e->head.next, struct nftnl_expr, head)) {
+		if (nftnl_expr_mangles(e))
+			s->mangle = true;
+	}
+	return 0;
+}
+
+bool nftnl_space_empty(const struct nftnl_space *s)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->num; i++) {
+		if (s->dim[i].num == 0)
+			return true;
+	}
+	return false;
+}
+
+/* does every packet in @s1 also match @s2? */
+static bool nftnl_space_subset(struct nftnl_space *s1, struct nftnl_space *s2)
+{
+	struct nftnl_dim *d;
+	uint32_t i;
+
+	for (i = 0; i < s2->num; i++) {
+		d = nftnl_space_find(s1, &s2->dim[i].field);
+		if (d == NULL || !nftnl_dim_subset(d, &s2->dim[i]))
+			return false;
+	}
+	return true;
+}
+
+static struct nftnl_expr *nftnl_expr_skip_counters(const struct nftnl_rule *r,
+						   struct list_head *pos)
+{
+	struct nftnl_expr *e;
+
+	for (; pos != &r->expr_list; pos = pos->next) {
+		e = list_entry(pos, struct nftnl_expr, head);
+		if (!nftnl_expr_is(e, "counter"))
+			return e;
+	}
+	return NULL;
+}
+
+/* compare two expression sequences, counter values do not matter */
+static bool nftnl_expr_seq_equal(const struct nftnl_rule *r1,
+				 struct nftnl_expr *e1,
+				 const struct nftnl_rule *r2,
+				 struct nftnl_expr *e2)
+{
+	e1 = e1 ? nftnl_expr_skip_counters(r1, &e1->head) : NULL;
+	e2 = e2 ? nftnl_expr_skip_counters(r2, &e2->head) : NULL;
+
+	while (e1 != NULL && e2 != NULL) {
+		if (!nftnl_expr_cmp(e1, e2))
+			return false;
+
+		e1 = nftnl_expr_skip_counters(r1, e1->head.next);
+		e2 = nftnl_expr_skip_counters(r2, e2->head.next);
+	}
+	return e1 == NULL && e2 == NULL;
+}
+
+static struct nftnl_expr *nftnl_rule_first_expr(const struct nftnl_rule *r)
+{
+	if (list_empty(&r->expr_list))
+		return NULL;
+
+	return list_entry(r->expr_list.next, struct nftnl_expr, head);
+}
+
+static bool nftnl_rule_duplicate(struct nftnl_rule *r1, struct nftnl_space *s1,
+				 struct nftnl_rule *r2, struct nftnl_space *s2)
+{
+	if (s1->exact && s2->exact &&
+	    nftnl_space_subset(s1, s2) && nftnl_space_subset(s2, s1))
+		return nftnl_expr_seq_equal(r1, s1->action, r2, s2->action);
+
+	return nftnl_expr_seq_equal(r1, nftnl_rule_first_expr(r1),
+				    r2, nftnl_rule_first_expr(r2));
+}
+
+static bool nftnl_rule_same_chain(const struct nftnl_rule *r1,
+				  const struct nftnl_rule *r2)
+{
+	/* names are interned, equal names are the same string */
+	return r1->family == r2->family &&
+	       r1->table == r2->table && r1->chain == r2->chain;
+}
+
+/*
+ * Only rules since the last one in the same chain that changes state are
+ * compared with rule @i, that rule included: its match still sees the
+ * packet as the earlier rules did.
+ */
+static uint32_t nftnl_rule_first_candidate(struct nftnl_rule **rule,
+					   const struct nftnl_space *space,
+					   uint32_t i)
+{
+	uint32_t j;
+
+	for (j = i; j > 0; j--) {
+		if (space[j - 1].mangle &&
+		    nftnl_rule_same_chain(rule[j - 1], rule[i]))
+			return j - 1;
+	}
+	return 0;
+}
+
+int nftnl_rule_list_redundant(struct nftnl_rule_list *list,
+			      struct nftnl_set_list *sets,
+			      void (*cb)(const struct nftnl_rule *r,
+					 const struct nftnl_rule *by,
+					 enum nftnl_rule_redundancy type,
+					 void *data),
+			      void *data)
+{
+	struct nftnl_space *space;
+	struct nftnl_rule **rule, *r;
+	uint32_t n = 0, i, j;
+	int ret = -1, found = 0;
+
+	list_for_each_entry(r, &list->list, head)
+		n++;
+
+	rule = calloc(n + 1, sizeof(*rule));
+	space = calloc(n + 1, sizeof(*space));
+	if (rule == NULL || space == NULL)
+		goto err;
+
+	n = 0;
+	list_for_each_entry(r, &list->list, head) {
+		rule[n] = r;
+		if (nftnl_space_build(&space[n++], r, sets) < 0)
+			goto err;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (nftnl_space_empty(&space[i])) {
+			if (cb != NULL)
+				cb(rule[i], NULL, NFTNL_RULE_SHADOWED, data);
+			found++;
+			continue;
+		}
+
+		for (j = nftnl_rule_first_candidate(rule, space, i); j < i;
+		     j++) {
+			if (!nftnl_rule_same_chain(rule[j], rule[i]))
+				continue;
+
+			/* a copy after one that falls through runs again */
+			if (space[j].terminal &&
+			    nftnl_rule_duplicate(rule[j], &space[j],
+						 rule[i], &space[i])) {
+				if (cb != NULL)
+					cb(rule[i], rule[j],
+					   NFTNL_RULE_DUPLICATE, data);
+				break;
+			}
+			if (space[j].exact && space[j].terminal &&
+			    nftnl_space_subset(&space[i], &space[j])) {
+				if (cb != NULL)
+					cb(rule[i], rule[j],
+					   NFTNL_RULE_SHADOWED, data);
+				break;
+			}
+		}
+		if (j < i)
+			found++;
+	}
+	ret = found;
+err:
+	for (i = 0; space != NULL && i < n; i++)
+		nftnl_space_free(&space[i]);
+	xfree(space);
+	xfree(rule);
+
+	return ret;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_redundant);
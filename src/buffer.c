@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include <inttypes.h>
@@ -46,19 +47,152 @@ int nftnl_buf_done(struct nftnl_buf *b)
 	return b->off;
 }
 
-static int nftnl_buf_put(struct nftnl_buf *b, const char *fmt, ...)
+/*
+ * Room that is made in the buffer of a FILE-backed nftnl_buf before each
+ * piece of output, pieces that fit are printed in place and only once.
+ */
+#define NFTNL_BUF_ROOM(b)	(((b)->size + (b)->len) / 2)
+
+/* As for a string, the output ends at the first nul byte */
+static void nftnl_buf_write(struct nftnl_buf *b, const char *data, size_t len)
+{
+	size_t n;
+
+	if (b->nul)
+		return;
+
+	n = strnlen(data, len);
+	if (n < len)
+		b->nul = true;
+
+	if (n > 0 && fwrite(data, 1, n, b->fp) != n)
+		b->fail = true;
+
+	b->written += n;
+}
+
+/*
+ * Write out the buffer but its last @keep bytes, so that a trailing comma
+ * can still be removed from the output.
+ */
+static void nftnl_buf_drain(struct nftnl_buf *b, size_t keep)
+{
+	size_t len;
+
+	if (b->size <= keep)
+		return;
+
+	len = b->size - keep;
+	nftnl_buf_write(b, b->buf, len);
+	memmove(b->buf, b->buf + len, keep);
+	b->size = keep;
+	b->len += len;
+}
+
+/* Returns the length of the output, or what was written of it to a file */
+int nftnl_buf_flush(struct nftnl_buf *b)
 {
+	if (b->fail)
+		return -1;
+
+	if (b->fp == NULL)
+		return b->off;
+
+	nftnl_buf_drain(b, 0);
+
+	return b->fail ? -1 : (int)b->written;
+}
+
+/*
+ * Append the output of @snprintf_cb on @obj. Returns its length, as
+ * snprintf() would, even if it was truncated.
+ */
+int nftnl_buf_obj(struct nftnl_buf *b, void *obj, uint32_t cmd, uint32_t type,
+		  uint32_t flags, int (*snprintf_cb)(char *buf, size_t bufsiz,
+		  void *obj, uint32_t cmd, uint32_t type, uint32_t flags))
+{
+	char *buf;
 	int ret;
+
+	if (b->fp != NULL && b->len < NFTNL_BUF_ROOM(b))
+		nftnl_buf_drain(b, 1);
+
+	ret = snprintf_cb(b->buf + b->size, b->len, obj, cmd, type, flags);
+	if (b->fp == NULL || ret < 0 || (size_t)ret < b->len) {
+		nftnl_buf_update(b, ret);
+		return ret;
+	}
+
+	/* Larger than the buffer, this piece is printed twice */
+	buf = malloc(ret + 1);
+	if (buf == NULL) {
+		b->fail = true;
+		return -1;
+	}
+
+	ret = snprintf_cb(buf, ret + 1, obj, cmd, type, flags);
+	if (ret > 0) {
+		nftnl_buf_drain(b, 0);
+		nftnl_buf_write(b, buf, ret - 1);
+		b->buf[0] = buf[ret - 1];
+		b->size = 1;
+		b->len--;
+		b->off += ret;
+	} else {
+		nftnl_buf_update(b, ret);
+	}
+	xfree(buf);
+
+	return ret;
+}
+
+struct nftnl_buf_fmt {
+	const char	*fmt;
+	va_list		ap;
+};
+
+static int nftnl_buf_vsnprintf(char *buf, size_t size, void *data,
+			       uint32_t cmd, uint32_t type, uint32_t flags)
+{
+	struct nftnl_buf_fmt *f = data;
 	va_list ap;
+	int ret;
 
-	va_start(ap, fmt);
-	ret = vsnprintf(b->buf + b->off, b->len, fmt, ap);
-	ret = nftnl_buf_update(b, ret);
+	va_copy(ap, f->ap);
+	ret = vsnprintf(buf, size, f->fmt, ap);
 	va_end(ap);
 
 	return ret;
 }
 
+int nftnl_buf_put(struct nftnl_buf *b, const char *fmt, ...)
+{
+	struct nftnl_buf_fmt f = {
+		.fmt	= fmt,
+	};
+	int ret;
+
+	va_start(f.ap, fmt);
+	ret = nftnl_buf_obj(b, &f, 0, 0, 0, nftnl_buf_vsnprintf);
+	va_end(f.ap);
+
+	return ret;
+}
+
+/* Remove the last byte of the output, which is a trailing comma */
+void nftnl_buf_unput(struct nftnl_buf *b)
+{
+	if (b->off == 0)
+		return;
+
+	/* the byte is only there if the output was not truncated */
+	if (b->fp != NULL || b->size == b->off) {
+		b->size--;
+		b->len++;
+	}
+	b->off--;
+}
+
 int nftnl_buf_open(struct nftnl_buf *b, int type, const char *tag)
 {
 	switch (type) {
@@ -162,23 +296,38 @@ int nftnl_buf_str(struct nftnl_buf *b, int type, const char *str, const char *ta
 	}
 }
 
+struct nftnl_buf_reg {
+	union nftnl_data_reg	*reg;
+	int			reg_type;
+};
+
+static int nftnl_buf_reg_snprintf(char *buf, size_t size, void *data,
+				  uint32_t cmd, uint32_t type, uint32_t flags)
+{
+	struct nftnl_buf_reg *r = data;
+
+	return nftnl_data_reg_snprintf(buf, size, r->reg, type, flags,
+				       r->reg_type);
+}
+
 int nftnl_buf_reg(struct nftnl_buf *b, int type, union nftnl_data_reg *reg,
 		int reg_type, const char *tag)
 {
-	int ret;
+	struct nftnl_buf_reg r = {
+		.reg		= reg,
+		.reg_type	= reg_type,
+	};
 
 	switch (type) {
 	case NFTNL_OUTPUT_XML:
-		ret = nftnl_buf_put(b, "<%s>", tag);
-		ret = nftnl_data_reg_snprintf(b->buf + b->off, b->len, reg,
-                                    NFTNL_OUTPUT_XML, 0, reg_type);
-		nftnl_buf_update(b, ret);
+		nftnl_buf_put(b, "<%s>", tag);
+		nftnl_buf_obj(b, &r, 0, NFTNL_OUTPUT_XML, 0,
+			      nftnl_buf_reg_snprintf);
 		return nftnl_buf_put(b, "</%s>", tag);
 	case NFTNL_OUTPUT_JSON:
 		nftnl_buf_put(b, "\"%s\":{", tag);
-		ret = nftnl_data_reg_snprintf(b->buf + b->off, b->len, reg,
-					    NFTNL_OUTPUT_JSON, 0, reg_type);
-		nftnl_buf_update(b, ret);
+		nftnl_buf_obj(b, &r, 0, NFTNL_OUTPUT_JSON, 0,
+			      nftnl_buf_reg_snprintf);
 		return nftnl_buf_put(b, "},");
 	}
 	return 0;
@@ -0,0 +1,285 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libnftnl/gen.h>
+#include <libnftnl/capture.h>
+
+/*
+ * A capture is a header followed by the messages of the dump exactly as
+ * they were received, each one padded to NLMSG_ALIGNTO so that the next
+ * header is aligned, and a NLMSG_DONE message that closes the stream. The
+ * framing is that of netlink itself: a capture without its NLMSG_DONE was
+ * cut short and is refused. Integers are in host byte order, as netlink
+ * headers are, the header records it so that a capture from another
+ * architecture is refused.
+ */
+#define NFTNL_CAPTURE_MAGIC		"NFTNLCAP"
+#define NFTNL_CAPTURE_VERSION		1
+#define NFTNL_CAPTURE_BYTEORDER		0x01020304
+
+enum {
+	NFTNL_CAPTURE_F_GEN	= (1 << 0),
+};
+
+struct nftnl_capture_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byteorder;
+	uint32_t	flags;
+	uint32_t	gen_id;
+};
+
+struct nftnl_capture {
+	FILE		*fp;
+	uint32_t	count;
+};
+
+struct nftnl_capture_file {
+	void		*map;
+	size_t		size;
+	uint32_t	count;
+};
+
+static bool nftnl_capture_msg_valid(const struct nlmsghdr *nlh)
+{
+	if (NFNL_SUBSYS_ID(nlh->nlmsg_type) != NFNL_SUBSYS_NFTABLES ||
+	    nlh->nlmsg_len < NLMSG_HDRLEN + sizeof(struct nfgenmsg))
+		return false;
+
+	switch (NFNL_MSG_TYPE(nlh->nlmsg_type)) {
+	case NFT_MSG_NEWTABLE:
+	case NFT_MSG_NEWCHAIN:
+	case NFT_MSG_NEWSET:
+	case NFT_MSG_NEWSETELEM:
+	case NFT_MSG_NEWRULE:
+		return true;
+	}
+	return false;
+}
+
+static int nftnl_capture_write(FILE *fp, const void *data, size_t len)
+{
+	static const char pad[NLMSG_ALIGNTO];
+	size_t padlen = MNL_ALIGN(len) - len;
+
+	if (fwrite(data, 1, len, fp) != len)
+		return -1;
+	if (padlen > 0 && fwrite(pad, 1, padlen, fp) != padlen)
+		return -1;
+
+	return 0;
+}
+
+struct nftnl_capture *nftnl_capture_alloc(FILE *fp, struct nftnl_gen *gen)
+{
+	struct nftnl_capture_hdr hdr = {
+		.magic		= NFTNL_CAPTURE_MAGIC,
+		.version	= NFTNL_CAPTURE_VERSION,
+		.byteorder	= NFTNL_CAPTURE_BYTEORDER,
+	};
+	struct nftnl_capture *cap;
+
+	if (gen != NULL && nftnl_gen_is_set(gen, NFTNL_GEN_ID)) {
+		hdr.flags |= NFTNL_CAPTURE_F_GEN;
+		hdr.gen_id = nftnl_gen_get_u32(gen, NFTNL_GEN_ID);
+	}
+
+	cap = calloc(1, sizeof(struct nftnl_capture));
+	if (cap == NULL)
+		return NULL;
+
+	if (nftnl_capture_write(fp, &hdr, sizeof(hdr)) < 0) {
+		xfree(cap);
+		return NULL;
+	}
+	cap->fp = fp;
+
+	return cap;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_alloc);
+
+void nftnl_capture_free(struct nftnl_capture *cap)
+{
+	xfree(cap);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_free);
+
+int nftnl_capture_nlmsg(struct nftnl_capture *cap, const struct nlmsghdr *nlh)
+{
+	if (!nftnl_capture_msg_valid(nlh)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (cap->count == UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	if (nftnl_capture_write(cap->fp, nlh, nlh->nlmsg_len) < 0)
+		return -1;
+
+	cap->count++;
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_nlmsg);
+
+int nftnl_capture_end(struct nftnl_capture *cap)
+{
+	char buf[MNL_NLMSG_HDRLEN + MNL_ALIGN(sizeof(int))];
+	struct nlmsghdr *nlh;
+
+	/* the same message the kernel ends its dumps with */
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_flags = NLM_F_MULTI;
+	mnl_nlmsg_put_extra_header(nlh, sizeof(int));
+
+	if (nftnl_capture_write(cap->fp, nlh, nlh->nlmsg_len) < 0 ||
+	    fflush(cap->fp) != 0)
+		return -1;
+
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_end);
+
+static int nftnl_capture_check(struct nftnl_capture_file *f)
+{
+	const struct nftnl_capture_hdr *hdr = f->map;
+	const struct nlmsghdr *nlh;
+	size_t off, left, len;
+
+	if (memcmp(hdr->magic, NFTNL_CAPTURE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != NFTNL_CAPTURE_VERSION ||
+	    hdr->byteorder != NFTNL_CAPTURE_BYTEORDER ||
+	    hdr->flags & ~NFTNL_CAPTURE_F_GEN)
+		return -1;
+
+	for (off = sizeof(*hdr); off < f->size; off += len) {
+		nlh = (const struct nlmsghdr *)((const char *)f->map + off);
+		left = f->size - off;
+
+		if (left < sizeof(struct nlmsghdr))
+			return -1;
+		len = MNL_ALIGN((size_t)nlh->nlmsg_len);
+		if (nlh->nlmsg_len < sizeof(struct nlmsghdr) || len > left)
+			return -1;
+
+		/* the stream ends with its NLMSG_DONE, and the file too */
+		if (nlh->nlmsg_type == NLMSG_DONE)
+			return len == left ? 0 : -1;
+
+		if (!nftnl_capture_msg_valid(nlh) || f->count == UINT32_MAX)
+			return -1;
+		f->count++;
+	}
+
+	return -1;
+}
+
+struct nftnl_capture_file *nftnl_capture_open(int fd)
+{
+	struct nftnl_capture_file *f;
+	struct stat st;
+
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	if (st.st_size < (off_t)sizeof(struct nftnl_capture_hdr)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	f = calloc(1, sizeof(struct nftnl_capture_file));
+	if (f == NULL)
+		return NULL;
+
+	f->size = st.st_size;
+	f->map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (f->map == MAP_FAILED) {
+		xfree(f);
+		return NULL;
+	}
+
+	if (nftnl_capture_check(f) < 0) {
+		nftnl_capture_close(f);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return f;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_open);
+
+void nftnl_capture_close(struct nftnl_capture_file *f)
+{
+	munmap(f->map, f->size);
+	xfree(f);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_close);
+
+uint32_t nftnl_capture_count(const struct nftnl_capture_file *f)
+{
+	return f->count;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_count);
+
+int nftnl_capture_gen(const struct nftnl_capture_file *f,
+		      struct nftnl_gen *gen)
+{
+	const struct nftnl_capture_hdr *hdr = f->map;
+
+	if (!(hdr->flags & NFTNL_CAPTURE_F_GEN)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	nftnl_gen_set_u32(gen, NFTNL_GEN_ID, hdr->gen_id);
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_gen);
+
+/*
+ * The messages were checked at open, so this only walks them. They are
+ * passed as they lie in the mapping, @cb must not keep them after
+ * nftnl_capture_close().
+ */
+int nftnl_capture_foreach(const struct nftnl_capture_file *f,
+			  int (*cb)(const struct nlmsghdr *nlh, void *data),
+			  void *data)
+{
+	const struct nlmsghdr *nlh;
+	uint32_t i;
+	size_t off;
+	int ret;
+
+	off = sizeof(struct nftnl_capture_hdr);
+	for (i = 0; i < f->count; i++) {
+		nlh = (const struct nlmsghdr *)((const char *)f->map + off);
+
+		ret = cb(nlh, data);
+		if (ret < 0)
+			return ret;
+
+		off += MNL_ALIGN((size_t)nlh->nlmsg_len);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_capture_foreach);
@@ -95,8 +95,7 @@ EXPORT_SYMBOL(nftnl_chain_alloc, nft_chain_alloc);
 
 void nftnl_chain_free(struct nftnl_chain *c)
 {
-	if (c->table != NULL)
-		xfree(c->table);
+	nftnl_intern_put(c->table);
 	if (c->type != NULL)
 		xfree(c->type);
 	if (c->dev != NULL)
@@ -119,10 +118,8 @@ void nftnl_chain_unset(struct nftnl_chain *c, uint16_t attr)
 
 	switch (attr) {
 	case NFTNL_CHAIN_TABLE:
-		if (c->table) {
-			xfree(c->table);
-			c->table = NULL;
-		}
+		nftnl_intern_put(c->table);
+		c->table = NULL;
 		break;
 	case NFTNL_CHAIN_USE:
 		break;
@@ -178,10 +175,12 @@ void nftnl_chain_set_data(struct nftnl_chain *c, uint16_t attr,
 		strncpy(c->name, data, NFT_CHAIN_MAXNAMELEN);
 		break;
 	case NFTNL_CHAIN_TABLE:
-		if (c->table)
-			xfree(c->table);
-
-		c->table = strdup(data);
+		nftnl_intern_put(c->table);
+		c->table = nftnl_intern(data);
+		if (c->table == NULL) {
+			c->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_CHAIN_HOOKNUM:
 		memcpy(&c->hooknum, data, sizeof(c->hooknum));
@@ -535,8 +534,12 @@ int nftnl_chain_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_chain *c)
 		c->flags |= (1 << NFTNL_CHAIN_NAME);
 	}
 	if (tb[NFTA_CHAIN_TABLE]) {
-		xfree(c->table);
-		c->table = strdup(mnl_attr_get_str(tb[NFTA_CHAIN_TABLE]));
+		nftnl_intern_put(c->table);
+		c->table = nftnl_intern(mnl_attr_get_str(tb[NFTA_CHAIN_TABLE]));
+		if (c->table == NULL) {
+			c->flags &= ~(1 << NFTNL_CHAIN_TABLE);
+			return -1;
+		}
 		c->flags |= (1 << NFTNL_CHAIN_TABLE);
 	}
 	if (tb[NFTA_CHAIN_HOOK]) {
@@ -0,0 +1,608 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <libnftnl/eval.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+
+/*
+ * HyperSplit style decision tree over the match spaces of the rules of a
+ * chain: inner nodes split the values of one field in two halves, leaves
+ * hold the few rules that may match in their region, in chain order.
+ */
+#define NFTNL_CLASSIFY_FIELDS	64
+#define NFTNL_CLASSIFY_BINTH	8	/* rules per leaf */
+#define NFTNL_CLASSIFY_DEPTH	48
+#define NFTNL_CLASSIFY_LEAF	(1U << 31)
+
+struct nftnl_classify_rule {
+	const struct nftnl_rule	*rule;
+	uint64_t		handle;
+	struct nftnl_space	space;
+	uint32_t		*field;	/* field index of each dimension */
+};
+
+struct nftnl_classify_node {
+	uint32_t		field;
+	uint32_t		child[2];
+	uint8_t			split[NFTNL_FIELD_MAXLEN];
+};
+
+struct nftnl_classify_leaf {
+	uint32_t		first;
+	uint32_t		num;
+};
+
+struct nftnl_classifier {
+	struct nftnl_field		*fields;
+	uint32_t			num_fields;
+	struct nftnl_classify_rule	*rules;
+	uint32_t			num_rules;
+	struct nftnl_classify_node	*nodes;
+	uint32_t			num_nodes;
+	uint32_t			size_nodes;
+	struct nftnl_classify_leaf	*leaves;
+	uint32_t			num_leaves;
+	uint32_t			size_leaves;
+	uint32_t			*refs;
+	uint32_t			num_refs;
+	uint32_t			size_refs;
+	uint32_t			root;
+	uint32_t			depth;
+	uint64_t			build_ns;
+};
+
+struct nftnl_classify_value {
+	uint8_t			v[NFTNL_FIELD_MAXLEN];
+};
+
+static void *nftnl_classify_grow(void *array, uint32_t *size, uint32_t num,
+				 size_t len)
+{
+	uint32_t n = *size ? *size : 64;
+
+	if (num <= *size)
+		return array;
+
+	while (n < num)
+		n *= 2;
+
+	array = realloc(array, n * len);
+	if (array != NULL)
+		*size = n;
+
+	return array;
+}
+
+static int nftnl_classify_value_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, NFTNL_FIELD_MAXLEN);
+}
+
+/* number of sorted values not greater than @v */
+static uint32_t nftnl_classify_count(const struct nftnl_classify_value *vals,
+				     uint32_t num, const uint8_t *v)
+{
+	uint32_t lo = 0, hi = num, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(vals[mid].v, v, NFTNL_FIELD_MAXLEN) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* first interval of @d ending at or after @v */
+static uint32_t nftnl_classify_iv(const struct nftnl_dim *d, const uint8_t *v)
+{
+	uint32_t lo = 0, hi = d->num, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(d->iv[mid].hi, v, NFTNL_FIELD_MAXLEN) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static const struct nftnl_dim *
+nftnl_classify_dim(const struct nftnl_classify_rule *cr, uint32_t field)
+{
+	uint32_t i;
+
+	for (i = 0; i < cr->space.num; i++) {
+		if (cr->field[i] == field)
+			return &cr->space.dim[i];
+	}
+	return NULL;
+}
+
+/*
+ * Values of @d within [@lo, @hi]: false if there are none, otherwise their
+ * smallest and largest one in @min and @max.
+ */
+static bool nftnl_classify_hull(const struct nftnl_dim *d, const uint8_t *lo,
+				const uint8_t *hi, uint8_t *min, uint8_t *max)
+{
+	uint32_t i = nftnl_classify_iv(d, lo), j;
+
+	if (i == d->num || memcmp(d->iv[i].lo, hi, NFTNL_FIELD_MAXLEN) > 0)
+		return false;
+
+	j = nftnl_classify_iv(d, hi);
+	if (j == d->num || memcmp(d->iv[j].lo, hi, NFTNL_FIELD_MAXLEN) > 0)
+		j--;
+
+	if (min != NULL)
+		memcpy(min, memcmp(d->iv[i].lo, lo, NFTNL_FIELD_MAXLEN) > 0 ?
+			    d->iv[i].lo : lo, NFTNL_FIELD_MAXLEN);
+	if (max != NULL)
+		memcpy(max, memcmp(d->iv[j].hi, hi, NFTNL_FIELD_MAXLEN) < 0 ?
+			    d->iv[j].hi : hi, NFTNL_FIELD_MAXLEN);
+	return true;
+}
+
+/* does the rule match every packet of the region? */
+static bool nftnl_classify_covers(const struct nftnl_classify_rule *cr,
+				  const struct nftnl_interval *region)
+{
+	const struct nftnl_interval *r;
+	const struct nftnl_dim *d;
+	uint32_t i, k;
+
+	if (!cr->space.exact)
+		return false;
+
+	for (i = 0; i < cr->space.num; i++) {
+		d = &cr->space.dim[i];
+		r = &region[cr->field[i]];
+		k = nftnl_classify_iv(d, r->lo);
+		if (k == d->num ||
+		    memcmp(d->iv[k].lo, r->lo, NFTNL_FIELD_MAXLEN) > 0 ||
+		    memcmp(d->iv[k].hi, r->hi, NFTNL_FIELD_MAXLEN) < 0)
+			return false;
+	}
+	return true;
+}
+
+static int nftnl_classify_leaf(struct nftnl_classifier *c,
+			       const uint32_t *cand, uint32_t num,
+			       uint32_t *idx)
+{
+	struct nftnl_classify_leaf *leaves;
+	uint32_t *refs;
+
+	leaves = nftnl_classify_grow(c->leaves, &c->size_leaves,
+				     c->num_leaves + 1, sizeof(*leaves));
+	if (leaves == NULL)
+		return -1;
+	c->leaves = leaves;
+
+	refs = nftnl_classify_grow(c->refs, &c->size_refs, c->num_refs + num,
+				   sizeof(*refs));
+	if (refs == NULL)
+		return -1;
+	c->refs = refs;
+
+	c->leaves[c->num_leaves].first = c->num_refs;
+	c->leaves[c->num_leaves].num = num;
+	memcpy(&c->refs[c->num_refs], cand, num * sizeof(*cand));
+	c->num_refs += num;
+
+	*idx = NFTNL_CLASSIFY_LEAF | c->num_leaves++;
+	return 0;
+}
+
+struct nftnl_classify_split {
+	uint32_t		field;
+	uint8_t			split[NFTNL_FIELD_MAXLEN];
+	uint32_t		left;
+	uint32_t		right;
+};
+
+/*
+ * Candidate split points are the bounds of the rules within the region.
+ * The best one replicates the fewest rules into both halves, then is the
+ * most balanced one.
+ */
+static void nftnl_classify_split_field(struct nftnl_classifier *c,
+				      const struct nftnl_interval *region,
+				      const uint32_t *cand, uint32_t num,
+				      uint32_t field,
+				      struct nftnl_classify_value *lo,
+				      struct nftnl_classify_value *hi,
+				      struct nftnl_classify_split *best)
+{
+	const struct nftnl_interval *r = &region[field];
+	uint32_t len = c->fields[field].len, m = 0, i, k, nl, nr, any;
+	struct nftnl_classify_value s;
+	const struct nftnl_dim *d;
+
+	for (i = 0; i < num; i++) {
+		d = nftnl_classify_dim(&c->rules[cand[i]], field);
+		if (d != NULL &&
+		    nftnl_classify_hull(d, r->lo, r->hi, lo[m].v, hi[m].v))
+			m++;
+	}
+	if (m == 0)
+		return;
+
+	any = num - m;
+	qsort(lo, m, sizeof(*lo), nftnl_classify_value_cmp);
+	qsort(hi, m, sizeof(*hi), nftnl_classify_value_cmp);
+
+	for (i = 0; i < 2 * m; i++) {
+		/* split right below a lower bound or at an upper bound */
+		k = i / 2;
+		if (i % 2 == 0) {
+			s = lo[k];
+			if (memcmp(s.v, r->lo, NFTNL_FIELD_MAXLEN) <= 0 ||
+			    !nftnl_value_dec(s.v, len))
+				continue;
+		} else {
+			s = hi[k];
+			if (memcmp(s.v, r->hi, NFTNL_FIELD_MAXLEN) >= 0)
+				continue;
+		}
+
+		nl = any + nftnl_classify_count(lo, m, s.v);
+		nr = any + m - nftnl_classify_count(hi, m, s.v);
+		if (nl + nr > best->left + best->right ||
+		    (nl + nr == best->left + best->right &&
+		     (nl > nr ? nl : nr) >= (best->left > best->right ?
+					     best->left : best->right)))
+			continue;
+
+		best->field = field;
+		best->left = nl;
+		best->right = nr;
+		memcpy(best->split, s.v, NFTNL_FIELD_MAXLEN);
+	}
+}
+
+static int nftnl_classify_build(struct nftnl_classifier *c,
+				struct nftnl_interval *region,
+				const uint32_t *cand, uint32_t num,
+				uint32_t depth, uint32_t *idx);
+
+static int nftnl_classify_node(struct nftnl_classifier *c,
+			       struct nftnl_interval *region,
+			       const uint32_t *cand, uint32_t num,
+			       const struct nftnl_classify_split *best,
+			       uint32_t depth, uint32_t *idx)
+{
+	struct nftnl_interval *r = &region[best->field], save = *r;
+	struct nftnl_classify_node *nodes;
+	uint32_t *sub, n, i, node, child;
+	const struct nftnl_dim *d;
+	int side, ret = 0;
+
+	nodes = nftnl_classify_grow(c->nodes, &c->size_nodes,
+				    c->num_nodes + 1, sizeof(*nodes));
+	if (nodes == NULL)
+		return -1;
+	c->nodes = nodes;
+
+	node = c->num_nodes++;
+	c->nodes[node].field = best->field;
+	memcpy(c->nodes[node].split, best->split, NFTNL_FIELD_MAXLEN);
+
+	sub = calloc(num, sizeof(*sub));
+	if (sub == NULL)
+		return -1;
+
+	for (side = 0; side < 2 && ret == 0; side++) {
+		if (side == 0) {
+			memcpy(r->hi, best->split, NFTNL_FIELD_MAXLEN);
+		} else {
+			*r = save;
+			memcpy(r->lo, best->split, NFTNL_FIELD_MAXLEN);
+			nftnl_value_inc(r->lo, c->fields[best->field].len);
+		}
+
+		for (i = 0, n = 0; i < num; i++) {
+			d = nftnl_classify_dim(&c->rules[cand[i]], best->field);
+			if (d == NULL ||
+			    nftnl_classify_hull(d, r->lo, r->hi, NULL, NULL))
+				sub[n++] = cand[i];
+		}
+		ret = nftnl_classify_build(c, region, sub, n, depth + 1,
+					   &child);
+		c->nodes[node].child[side] = child;
+	}
+	*r = save;
+	xfree(sub);
+
+	*idx = node;
+	return ret;
+}
+
+static int nftnl_classify_build(struct nftnl_classifier *c,
+				struct nftnl_interval *region,
+				const uint32_t *cand, uint32_t num,
+				uint32_t depth, uint32_t *idx)
+{
+	struct nftnl_classify_split best = {};
+	struct nftnl_classify_value *lo, *hi;
+	uint32_t i;
+
+	if (depth > c->depth)
+		c->depth = depth;
+
+	/* rules after one covering the whole region are never reached */
+	for (i = 0; i < num; i++) {
+		if (nftnl_classify_covers(&c->rules[cand[i]], region)) {
+			num = i + 1;
+			break;
+		}
+	}
+	if (num <= NFTNL_CLASSIFY_BINTH || depth == NFTNL_CLASSIFY_DEPTH)
+		return nftnl_classify_leaf(c, cand, num, idx);
+
+	lo = calloc(num, sizeof(*lo));
+	hi = calloc(num, sizeof(*hi));
+	if (lo == NULL || hi == NULL) {
+		xfree(lo);
+		xfree(hi);
+		return -1;
+	}
+	best.left = best.right = num;
+	for (i = 0; i < c->num_fields; i++)
+		nftnl_classify_split_field(c, region, cand, num, i, lo, hi,
+					   &best);
+	xfree(lo);
+	xfree(hi);
+
+	if (best.left == num && best.right == num)
+		return nftnl_classify_leaf(c, cand, num, idx);
+
+	return nftnl_classify_node(c, region, cand, num, &best, depth, idx);
+}
+
+static int nftnl_classify_field(struct nftnl_classifier *c,
+				const struct nftnl_field *f)
+{
+	uint32_t i;
+
+	for (i = 0; i < c->num_fields; i++) {
+		if (nftnl_field_equal(&c->fields[i], f))
+			return i;
+	}
+	if (c->num_fields == NFTNL_CLASSIFY_FIELDS) {
+		errno = E2BIG;
+		return -1;
+	}
+	c->fields[c->num_fields] = *f;
+
+	return c->num_fields++;
+}
+
+static bool nftnl_classify_rule_in_chain(const struct nftnl_rule *r,
+					 uint32_t family, const char *table,
+					 const char *chain)
+{
+	return r->family == family && r->table != NULL && r->chain != NULL &&
+	       strcmp(r->chain, chain) == 0 && strcmp(r->table, table) == 0;
+}
+
+static int nftnl_classify_rules(struct nftnl_classifier *c,
+				struct nftnl_rule_list *list,
+				struct nftnl_set_list *sets, uint32_t family,
+				const char *table, const char *chain)
+{
+	struct nftnl_classify_rule *cr;
+	struct nftnl_rule *r;
+	uint32_t n = 0, i;
+	int field;
+
+	list_for_each_entry(r, &list->list, head) {
+		if (nftnl_classify_rule_in_chain(r, family, table, chain))
+			n++;
+	}
+
+	c->fields = calloc(NFTNL_CLASSIFY_FIELDS, sizeof(*c->fields));
+	c->rules = calloc(n + 1, sizeof(*c->rules));
+	if (c->fields == NULL || c->rules == NULL)
+		return -1;
+
+	list_for_each_entry(r, &list->list, head) {
+		if (!nftnl_classify_rule_in_chain(r, family, table, chain))
+			continue;
+
+		cr = &c->rules[c->num_rules++];
+		cr->rule = r;
+		cr->handle = nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE);
+		if (nftnl_space_build(&cr->space, r, sets) < 0)
+			return -1;
+
+		cr->field = calloc(cr->space.num + 1, sizeof(uint32_t));
+		if (cr->field == NULL)
+			return -1;
+
+		for (i = 0; i < cr->space.num; i++) {
+			field = nftnl_classify_field(c,
+						     &cr->space.dim[i].field);
+			if (field < 0)
+				return -1;
+			cr->field[i] = field;
+		}
+	}
+	return 0;
+}
+
+struct nftnl_classifier *nftnl_classifier_build(struct nftnl_rule_list *list,
+						struct nftnl_set_list *sets,
+						uint32_t family,
+						const char *table,
+						const char *chain)
+{
+	struct nftnl_interval region[NFTNL_CLASSIFY_FIELDS] = {};
+	struct timespec start, end;
+	struct nftnl_classifier *c;
+	uint32_t *cand, i, n = 0;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return NULL;
+
+	if (nftnl_classify_rules(c, list, sets, family, table, chain) < 0)
+		goto err;
+
+	cand = calloc(c->num_rules + 1, sizeof(*cand));
+	if (cand == NULL)
+		goto err;
+
+	/* rules that cannot match are left out of the tree */
+	for (i = 0; i < c->num_rules; i++) {
+		if (!nftnl_space_empty(&c->rules[i].space))
+			cand[n++] = i;
+	}
+	for (i = 0; i < c->num_fields; i++)
+		memset(region[i].hi, 0xff, c->fields[i].len);
+
+	ret = nftnl_classify_build(c, region, cand, n, 0, &c->root);
+	xfree(cand);
+	if (ret < 0)
+		goto err;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	c->build_ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+		      end.tv_nsec - start.tv_nsec;
+
+	return c;
+err:
+	nftnl_classifier_free(c);
+	return NULL;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_classifier_build);
+
+void nftnl_classifier_free(struct nftnl_classifier *c)
+{
+	int err = errno;
+	uint32_t i;
+
+	for (i = 0; i < c->num_rules; i++) {
+		nftnl_space_free(&c->rules[i].space);
+		xfree(c->rules[i].field);
+	}
+	xfree(c->rules);
+	xfree(c->fields);
+	xfree(c->nodes);
+	xfree(c->leaves);
+	xfree(c->refs);
+	xfree(c);
+	errno = err;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_classifier_free);
+
+static bool nftnl_classify_match(const struct nftnl_classify_rule *cr,
+				 uint8_t (*val)[NFTNL_FIELD_MAXLEN],
+				 const bool *present)
+{
+	const struct nftnl_dim *d;
+	const uint8_t *v;
+	uint32_t i, k;
+
+	for (i = 0; i < cr->space.num; i++) {
+		if (!present[cr->field[i]])
+			return false;
+
+		d = &cr->space.dim[i];
+		v = val[cr->field[i]];
+		k = nftnl_classify_iv(d, v);
+		if (k == d->num ||
+		    memcmp(d->iv[k].lo, v, NFTNL_FIELD_MAXLEN) > 0)
+			return false;
+	}
+	return true;
+}
+
+int nftnl_classifier_lookup(const struct nftnl_classifier *c,
+			    const struct nftnl_eval_pkt *pkt,
+			    struct nftnl_classify_result *res)
+{
+	uint8_t val[NFTNL_CLASSIFY_FIELDS][NFTNL_FIELD_MAXLEN];
+	const struct nftnl_classify_node *node;
+	const struct nftnl_classify_leaf *leaf;
+	const struct nftnl_classify_rule *cr;
+	bool present[NFTNL_CLASSIFY_FIELDS];
+	uint32_t idx = c->root, i;
+
+	memset(res, 0, sizeof(*res));
+	nftnl_eval_fields(pkt, c->fields, c->num_fields, val, present);
+
+	/* a missing field fails every rule loading it, either side will do */
+	while (!(idx & NFTNL_CLASSIFY_LEAF)) {
+		node = &c->nodes[idx];
+		idx = node->child[memcmp(val[node->field], node->split,
+					 NFTNL_FIELD_MAXLEN) > 0];
+		res->depth++;
+	}
+
+	leaf = &c->leaves[idx & ~NFTNL_CLASSIFY_LEAF];
+	for (i = leaf->first; i < leaf->first + leaf->num; i++) {
+		cr = &c->rules[c->refs[i]];
+		res->checked++;
+		if (nftnl_classify_match(cr, val, present)) {
+			res->rule = cr->rule;
+			res->handle = cr->handle;
+			res->exact = cr->space.exact;
+			return 1;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_classifier_lookup);
+
+void nftnl_classifier_stats(const struct nftnl_classifier *c,
+			    struct nftnl_classify_stats *stats)
+{
+	const struct nftnl_classify_rule *cr;
+	uint32_t i, j;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->rules = c->num_rules;
+	stats->fields = c->num_fields;
+	stats->nodes = c->num_nodes;
+	stats->leaves = c->num_leaves;
+	stats->depth = c->depth;
+	stats->refs = c->num_refs;
+	stats->build_ns = c->build_ns;
+
+	stats->memory = sizeof(*c) +
+			NFTNL_CLASSIFY_FIELDS * sizeof(*c->fields) +
+			(c->num_rules + 1) * sizeof(*c->rules) +
+			c->size_nodes * sizeof(*c->nodes) +
+			c->size_leaves * sizeof(*c->leaves) +
+			c->size_refs * sizeof(*c->refs);
+	for (i = 0; i < c->num_rules; i++) {
+		cr = &c->rules[i];
+		if (!cr->space.exact)
+			stats->inexact++;
+		stats->memory += cr->space.num * (sizeof(*cr->space.dim) +
+						  sizeof(*cr->field));
+		for (j = 0; j < cr->space.num; j++)
+			stats->memory += cr->space.dim[j].num *
+					 sizeof(*cr->space.dim[j].iv);
+	}
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_classifier_stats);
@@ -123,6 +123,13 @@ int nftnl_cmd_header_fprintf(FILE *fp, uint32_t cmd, uint32_t type,
 			   nftnl_cmd_header_fprintf_cb);
 }
 
+int nftnl_cmd_header_buf(struct nftnl_buf *b, uint32_t cmd, uint32_t type,
+			 uint32_t flags)
+{
+	return nftnl_buf_obj(b, NULL, cmd, type, flags,
+			     nftnl_cmd_header_fprintf_cb);
+}
+
 int nftnl_cmd_footer_snprintf(char *buf, size_t size, uint32_t cmd, uint32_t type,
 			    uint32_t flags)
 {
@@ -156,6 +163,13 @@ int nftnl_cmd_footer_fprintf(FILE *fp, uint32_t cmd, uint32_t type,
 			   nftnl_cmd_footer_fprintf_cb);
 }
 
+int nftnl_cmd_footer_buf(struct nftnl_buf *b, uint32_t cmd, uint32_t type,
+			 uint32_t flags)
+{
+	return nftnl_buf_obj(b, NULL, cmd, type, flags,
+			     nftnl_cmd_footer_fprintf_cb);
+}
+
 static void nftnl_batch_build_hdr(char *buf, uint16_t type, uint32_t seq)
 {
 	struct nlmsghdr *nlh;
@@ -0,0 +1,1506 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <netinet/in.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/eval.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/set.h>
+
+/*
+ * Rules are compiled into flat arrays of operations, grouped per chain, so
+ * that evaluating a packet does not go through the expression attribute
+ * accessors. Registers, verdicts and the jump stack follow nft_do_chain().
+ */
+#define NFTNL_EVAL_REGS		(NFTNL_REG_WORDS * NFT_REG32_SIZE)
+#define NFTNL_EVAL_STACK	16	/* NFT_JUMP_STACK_SIZE */
+#define NFTNL_EVAL_NSEC		1000000000ULL
+
+#define NF_CT_STATE_INVALID_BIT	(1 << 0)
+
+#ifndef IFNAMSIZ
+#define IFNAMSIZ	16
+#endif
+
+enum nftnl_eval_type {
+	NFTNL_EVAL_PAYLOAD,
+	NFTNL_EVAL_CMP,
+	NFTNL_EVAL_BITWISE,
+	NFTNL_EVAL_BYTEORDER,
+	NFTNL_EVAL_IMMEDIATE,
+	NFTNL_EVAL_VERDICT,
+	NFTNL_EVAL_META,
+	NFTNL_EVAL_META_SET,
+	NFTNL_EVAL_CT,
+	NFTNL_EVAL_CT_SET,
+	NFTNL_EVAL_EXTHDR,
+	NFTNL_EVAL_LOOKUP,
+	NFTNL_EVAL_COUNTER,
+	NFTNL_EVAL_LIMIT,
+};
+
+struct nftnl_eval_elem {
+	uint8_t		key[NFT_DATA_VALUE_MAXLEN];
+	uint8_t		data[NFT_DATA_VALUE_MAXLEN];
+	int		verdict;
+	int		chain;
+	bool		end;
+};
+
+struct nftnl_eval_set {
+	const struct nftnl_set	*set;
+	uint32_t		key_len;
+	uint32_t		data_len;
+	bool			interval;
+	bool			verdict;
+	struct nftnl_eval_elem	*elem;
+	uint32_t		num;
+	uint32_t		*hash;	/* element index + 1, 0 if empty */
+	uint32_t		mask;
+};
+
+struct nftnl_eval_op {
+	uint8_t			type;
+	uint8_t			op;	/* cmp and byteorder op, payload base */
+	uint8_t			size;
+	uint16_t		sreg;	/* byte offsets in the register file */
+	uint16_t		dreg;
+	uint32_t		len;
+	uint32_t		key;
+	uint32_t		offset;
+	union {
+		uint8_t			data[NFT_DATA_VALUE_MAXLEN];
+		struct {
+			uint8_t		mask[NFT_DATA_VALUE_MAXLEN];
+			uint8_t		xor[NFT_DATA_VALUE_MAXLEN];
+		};
+		struct {
+			int		verdict;
+			int		chain;
+		};
+		struct {
+			uint64_t	pkts;
+			uint64_t	bytes;
+		} ctr;
+		struct {
+			uint64_t	tokens;
+			uint64_t	tokens_max;
+			uint64_t	nsecs;
+			uint64_t	rate;
+			uint64_t	last;
+			bool		started;
+		} limit;
+		struct nftnl_eval_set	*set;
+	};
+	struct nftnl_expr	*expr;
+};
+
+struct nftnl_eval_rule {
+	const struct nftnl_rule	*rule;
+	uint64_t		handle;
+	uint32_t		chain;
+	uint32_t		op;
+	uint32_t		num;
+};
+
+struct nftnl_eval_chain {
+	uint32_t		family;
+	char			*table;
+	char			*name;
+	uint32_t		first;
+	uint32_t		num;
+	uint8_t			color;
+};
+
+struct nftnl_eval {
+	struct nftnl_eval_chain	*chains;
+	uint32_t		num_chains;
+	struct nftnl_eval_rule	*rules;
+	uint32_t		num_rules;
+	struct nftnl_eval_op	*ops;
+	uint32_t		num_ops;
+	struct nftnl_eval_set	**sets;
+	uint32_t		num_sets;
+	struct nftnl_set_list	*set_list;
+};
+
+struct nftnl_eval_state {
+	const struct nftnl_eval_pkt	*pkt;
+	int32_t				thoff;	/* no transport header if < 0 */
+	int32_t				l4proto;
+	uint32_t			mark;
+	uint32_t			priority;
+	uint32_t			ct_mark;
+	int				code;
+	int				chain;
+	union {
+		uint32_t		w[NFTNL_REG_WORDS];
+		uint8_t			b[NFTNL_EVAL_REGS];
+	} regs;
+};
+
+static int nftnl_eval_chain_get(struct nftnl_eval *ev, uint32_t family,
+				const char *table, const char *name)
+{
+	struct nftnl_eval_chain *c;
+	uint32_t i;
+
+	if (table == NULL || name == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < ev->num_chains; i++) {
+		c = &ev->chains[i];
+		if (c->family == family && strcmp(c->name, name) == 0 &&
+		    strcmp(c->table, table) == 0)
+			return i;
+	}
+
+	c = realloc(ev->chains, (ev->num_chains + 1) * sizeof(*c));
+	if (c == NULL)
+		return -1;
+	ev->chains = c;
+
+	c = &ev->chains[ev->num_chains];
+	memset(c, 0, sizeof(*c));
+	c->family = family;
+	c->table = strdup(table);
+	c->name = strdup(name);
+	if (c->table == NULL || c->name == NULL) {
+		xfree(c->table);
+		xfree(c->name);
+		return -1;
+	}
+
+	return ev->num_chains++;
+}
+
+static int nftnl_eval_verdict(struct nftnl_eval *ev, uint32_t family,
+			      const char *table, int verdict,
+			      const char *chain)
+{
+	switch (verdict) {
+	case NFT_JUMP:
+	case NFT_GOTO:
+		return nftnl_eval_chain_get(ev, family, table, chain);
+	case NF_ACCEPT:
+	case NF_DROP:
+	case NF_QUEUE:
+	case NF_STOLEN:
+	case NFT_CONTINUE:
+	case NFT_BREAK:
+	case NFT_RETURN:
+		return 0;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static int nftnl_eval_elem_cmp(const void *a, const void *b)
+{
+	const struct nftnl_eval_elem *e1 = a, *e2 = b;
+	int ret;
+
+	ret = memcmp(e1->key, e2->key, sizeof(e1->key));
+	if (ret != 0)
+		return ret;
+
+	/* an interval end sorts before a start of the same key */
+	return (int)e2->end - (int)e1->end;
+}
+
+static int nftnl_eval_set_hash(struct nftnl_eval_set *es)
+{
+	uint32_t size = 1, i, h;
+
+	while (size < es->num * 2)
+		size <<= 1;
+
+	es->hash = calloc(size, sizeof(uint32_t));
+	if (es->hash == NULL)
+		return -1;
+	es->mask = size - 1;
+
+	for (i = 0; i < es->num; i++) {
+		if (es->elem[i].end)
+			continue;
+		h = nftnl_hash_data(NFTNL_HASH_INIT, es->elem[i].key,
+				    es->key_len) & es->mask;
+		while (es->hash[h] != 0)
+			h = (h + 1) & es->mask;
+		es->hash[h] = i + 1;
+	}
+	return 0;
+}
+
+static void nftnl_eval_set_free(struct nftnl_eval_set *es)
+{
+	xfree(es->elem);
+	xfree(es->hash);
+	xfree(es);
+}
+
+static struct nftnl_eval_set *
+nftnl_eval_set_build(struct nftnl_eval *ev, const struct nftnl_set *s)
+{
+	struct nftnl_set_elem *elem;
+	struct nftnl_eval_elem *p;
+	struct nftnl_eval_set *es;
+	uint32_t n = 0;
+	int chain;
+
+	es = calloc(1, sizeof(*es));
+	if (es == NULL)
+		return NULL;
+
+	es->set = s;
+	es->key_len = s->key_len;
+	es->interval = s->set_flags & NFT_SET_INTERVAL;
+	if (s->set_flags & NFT_SET_MAP) {
+		if (s->data_type == NFT_DATA_VERDICT)
+			es->verdict = true;
+		else
+			es->data_len = s->data_len;
+	}
+	if (es->key_len == 0 || es->key_len > NFT_DATA_VALUE_MAXLEN ||
+	    es->data_len > NFT_DATA_VALUE_MAXLEN) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	list_for_each_entry(elem, &s->element_list, head)
+		n++;
+
+	es->elem = calloc(n + 1, sizeof(*es->elem));
+	if (es->elem == NULL)
+		goto err;
+
+	list_for_each_entry(elem, &s->element_list, head) {
+		p = &es->elem[es->num++];
+		memcpy(p->key, elem->key.val, es->key_len);
+		p->end = elem->set_elem_flags & NFT_SET_ELEM_INTERVAL_END;
+		if (p->end)
+			continue;
+
+		memcpy(p->data, elem->data.val, es->data_len);
+		if (!es->verdict)
+			continue;
+
+		p->verdict = elem->data.verdict;
+		chain = nftnl_eval_verdict(ev, s->family, s->table, p->verdict,
+					   elem->data.chain);
+		if (chain < 0)
+			goto err;
+		p->chain = chain;
+	}
+
+	if (es->interval)
+		qsort(es->elem, es->num, sizeof(*es->elem),
+		      nftnl_eval_elem_cmp);
+	else if (nftnl_eval_set_hash(es) < 0)
+		goto err;
+
+	return es;
+err:
+	nftnl_eval_set_free(es);
+	return NULL;
+}
+
+static struct nftnl_eval_set *nftnl_eval_set_get(struct nftnl_eval *ev,
+						 const struct nftnl_rule *r,
+						 const char *name)
+{
+	struct nftnl_set_list_iter *iter;
+	struct nftnl_eval_set *es, **sets;
+	struct nftnl_set *s = NULL;
+	uint32_t i;
+
+	if (ev->set_list != NULL) {
+		iter = nftnl_set_list_iter_create(ev->set_list);
+		if (iter == NULL)
+			return NULL;
+
+		while ((s = nftnl_set_list_iter_next(iter)) != NULL) {
+			if (strcmp(s->name, name) == 0 &&
+			    s->family == r->family &&
+			    s->table == r->table)
+				break;
+		}
+		nftnl_set_list_iter_destroy(iter);
+	}
+	if (s == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	for (i = 0; i < ev->num_sets; i++) {
+		if (ev->sets[i]->set == s)
+			return ev->sets[i];
+	}
+
+	sets = realloc(ev->sets, (ev->num_sets + 1) * sizeof(*sets));
+	if (sets == NULL)
+		return NULL;
+	ev->sets = sets;
+
+	es = nftnl_eval_set_build(ev, s);
+	if (es == NULL)
+		return NULL;
+	ev->sets[ev->num_sets++] = es;
+
+	return es;
+}
+
+static int nftnl_eval_reg(struct nftnl_expr *e, uint16_t attr, uint32_t len,
+			  uint16_t *off)
+{
+	uint32_t reg = nftnl_expr_get_u32(e, attr);
+
+	if (reg < NFT_REG_1 || (reg > NFT_REG_4 && reg < NFT_REG32_00) ||
+	    reg > NFT_REG32_15 || len == 0 ||
+	    nftnl_reg_word(reg) * NFT_REG32_SIZE + len > NFTNL_EVAL_REGS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*off = nftnl_reg_word(reg) * NFT_REG32_SIZE;
+	return 0;
+}
+
+static int nftnl_eval_data(struct nftnl_expr *e, uint16_t attr, uint8_t *buf,
+			   uint32_t len)
+{
+	const void *data;
+	uint32_t data_len;
+
+	data = nftnl_expr_get(e, attr, &data_len);
+	if (data == NULL || data_len < len || len > NFT_DATA_VALUE_MAXLEN) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(buf, data, len);
+
+	return 0;
+}
+
+static uint32_t nftnl_eval_meta_len(uint32_t key)
+{
+	switch (key) {
+	case NFT_META_IIFNAME:
+	case NFT_META_OIFNAME:
+	case NFT_META_BRI_IIFNAME:
+	case NFT_META_BRI_OIFNAME:
+		return IFNAMSIZ;
+	}
+	return sizeof(uint32_t);
+}
+
+static uint32_t nftnl_eval_ct_len(uint32_t key)
+{
+	switch (key) {
+	case NFT_CT_HELPER:
+	case NFT_CT_SRC:
+	case NFT_CT_DST:
+	case NFT_CT_LABELS:
+		return 16;
+	}
+	return sizeof(uint32_t);
+}
+
+static int nftnl_eval_compile_meta(struct nftnl_expr *e,
+				   struct nftnl_eval_op *op)
+{
+	op->key = nftnl_expr_get_u32(e, NFTNL_EXPR_META_KEY);
+
+	if (nftnl_expr_is_set(e, NFTNL_EXPR_META_SREG)) {
+		op->type = NFTNL_EVAL_META_SET;
+		switch (op->key) {
+		case NFT_META_MARK:
+		case NFT_META_PRIORITY:
+			return nftnl_eval_reg(e, NFTNL_EXPR_META_SREG,
+					      sizeof(uint32_t), &op->sreg);
+		case NFT_META_NFTRACE:
+			/* tracing does not change the verdict */
+			return 0;
+		}
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	op->type = NFTNL_EVAL_META;
+	if (op->key > NFT_META_CGROUP) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	return nftnl_eval_reg(e, NFTNL_EXPR_META_DREG,
+			      nftnl_eval_meta_len(op->key), &op->dreg);
+}
+
+static int nftnl_eval_compile_ct(struct nftnl_expr *e,
+				 struct nftnl_eval_op *op)
+{
+	op->key = nftnl_expr_get_u32(e, NFTNL_EXPR_CT_KEY);
+
+	if (nftnl_expr_is_set(e, NFTNL_EXPR_CT_SREG)) {
+		op->type = NFTNL_EVAL_CT_SET;
+		if (op->key != NFT_CT_MARK) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+		return nftnl_eval_reg(e, NFTNL_EXPR_CT_SREG, sizeof(uint32_t),
+				      &op->sreg);
+	}
+
+	op->type = NFTNL_EVAL_CT;
+	if (op->key > NFT_CT_LABELS) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	/* without direction, tuples are the ones of the packet direction */
+	if (nftnl_expr_is_set(e, NFTNL_EXPR_CT_DIR)) {
+		op->op = 1;
+		op->offset = nftnl_expr_get_u8(e, NFTNL_EXPR_CT_DIR) & 1;
+	}
+	return nftnl_eval_reg(e, NFTNL_EXPR_CT_DREG, nftnl_eval_ct_len(op->key),
+			      &op->dreg);
+}
+
+static int nftnl_eval_compile_limit(struct nftnl_expr *e,
+				    struct nftnl_eval_op *op)
+{
+	uint64_t unit = nftnl_expr_get_u64(e, NFTNL_EXPR_LIMIT_UNIT);
+	uint32_t burst = nftnl_expr_get_u32(e, NFTNL_EXPR_LIMIT_BURST);
+
+	op->type = NFTNL_EVAL_LIMIT;
+	op->key = nftnl_expr_get_u32(e, NFTNL_EXPR_LIMIT_TYPE);
+	op->limit.rate = nftnl_expr_get_u64(e, NFTNL_EXPR_LIMIT_RATE);
+	op->limit.nsecs = unit * NFTNL_EVAL_NSEC;
+	if (op->limit.rate == 0 || op->limit.nsecs < unit ||
+	    (op->key != NFT_LIMIT_PKTS && op->key != NFT_LIMIT_PKT_BYTES)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* the bucket holds the tokens of rate + burst packets, as nft_limit */
+	op->limit.tokens_max = op->limit.nsecs * (op->limit.rate + burst) /
+			       op->limit.rate;
+	op->limit.tokens = op->limit.tokens_max;
+
+	return 0;
+}
+
+/* Returns 1 if an operation was emitted, 0 if the expression is a no-op. */
+static int nftnl_eval_compile_expr(struct nftnl_eval *ev,
+				   const struct nftnl_rule *r,
+				   struct nftnl_expr *e,
+				   struct nftnl_eval_op *op)
+{
+	const char *name = nftnl_expr_get_str(e, NFTNL_EXPR_NAME);
+	uint32_t len = 0;
+	int ret = 0;
+
+	memset(op, 0, sizeof(*op));
+	op->expr = e;
+
+	if (strcmp(name, "payload") == 0) {
+		op->type = NFTNL_EVAL_PAYLOAD;
+		op->op = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_BASE);
+		op->offset = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET);
+		op->len = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_LEN);
+		if (op->op > NFT_PAYLOAD_TRANSPORT_HEADER) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+		ret = nftnl_eval_reg(e, NFTNL_EXPR_PAYLOAD_DREG, op->len,
+				     &op->dreg);
+	} else if (strcmp(name, "cmp") == 0) {
+		op->type = NFTNL_EVAL_CMP;
+		op->op = nftnl_expr_get_u32(e, NFTNL_EXPR_CMP_OP);
+		nftnl_expr_get(e, NFTNL_EXPR_CMP_DATA, &len);
+		op->len = len;
+		ret = nftnl_eval_reg(e, NFTNL_EXPR_CMP_SREG, op->len,
+				     &op->sreg);
+		if (ret == 0)
+			ret = nftnl_eval_data(e, NFTNL_EXPR_CMP_DATA, op->data,
+					      op->len);
+	} else if (strcmp(name, "bitwise") == 0) {
+		op->type = NFTNL_EVAL_BITWISE;
+		op->len = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN);
+		/* bitwise works on whole words, trailing bytes end up zero */
+		len = nftnl_reg_words(op->len) * NFT_REG32_SIZE;
+		if (nftnl_eval_reg(e, NFTNL_EXPR_BITWISE_SREG, len,
+				   &op->sreg) < 0 ||
+		    nftnl_eval_reg(e, NFTNL_EXPR_BITWISE_DREG, len,
+				   &op->dreg) < 0 ||
+		    nftnl_eval_data(e, NFTNL_EXPR_BITWISE_MASK, op->mask,
+				    op->len) < 0 ||
+		    nftnl_eval_data(e, NFTNL_EXPR_BITWISE_XOR, op->xor,
+				    op->len) < 0)
+			return -1;
+		op->len = len;
+	} else if (strcmp(name, "byteorder") == 0) {
+		op->type = NFTNL_EVAL_BYTEORDER;
+		op->op = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_OP);
+		op->size = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_SIZE);
+		op->len = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_LEN);
+		if (op->size != 2 && op->size != 4 && op->size != 8) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (nftnl_eval_reg(e, NFTNL_EXPR_BYTEORDER_SREG, op->len,
+				   &op->sreg) < 0 ||
+		    nftnl_eval_reg(e, NFTNL_EXPR_BYTEORDER_DREG, op->len,
+				   &op->dreg) < 0)
+			return -1;
+	} else if (strcmp(name, "immediate") == 0) {
+		if (nftnl_expr_is_set(e, NFTNL_EXPR_IMM_VERDICT)) {
+			op->type = NFTNL_EVAL_VERDICT;
+			op->verdict = nftnl_expr_get_u32(e,
+						NFTNL_EXPR_IMM_VERDICT);
+			op->chain = nftnl_eval_verdict(ev, r->family, r->table,
+					op->verdict,
+					nftnl_expr_get_str(e,
+							NFTNL_EXPR_IMM_CHAIN));
+			return op->chain < 0 ? -1 : 1;
+		}
+		op->type = NFTNL_EVAL_IMMEDIATE;
+		nftnl_expr_get(e, NFTNL_EXPR_IMM_DATA, &len);
+		op->len = len;
+		ret = nftnl_eval_reg(e, NFTNL_EXPR_IMM_DREG, op->len,
+				     &op->dreg);
+		if (ret == 0)
+			ret = nftnl_eval_data(e, NFTNL_EXPR_IMM_DATA, op->data,
+					      op->len);
+	} else if (strcmp(name, "meta") == 0) {
+		ret = nftnl_eval_compile_meta(e, op);
+		if (ret == 0 && op->type == NFTNL_EVAL_META_SET &&
+		    op->key == NFT_META_NFTRACE)
+			return 0;
+	} else if (strcmp(name, "ct") == 0) {
+		ret = nftnl_eval_compile_ct(e, op);
+	} else if (strcmp(name, "exthdr") == 0) {
+		op->type = NFTNL_EVAL_EXTHDR;
+		op->key = nftnl_expr_get_u8(e, NFTNL_EXPR_EXTHDR_TYPE);
+		op->offset = nftnl_expr_get_u32(e, NFTNL_EXPR_EXTHDR_OFFSET);
+		op->len = nftnl_expr_get_u32(e, NFTNL_EXPR_EXTHDR_LEN);
+		ret = nftnl_eval_reg(e, NFTNL_EXPR_EXTHDR_DREG, op->len,
+				     &op->dreg);
+	} else if (strcmp(name, "lookup") == 0) {
+		op->type = NFTNL_EVAL_LOOKUP;
+		op->set = nftnl_eval_set_get(ev, r,
+				nftnl_expr_get_str(e, NFTNL_EXPR_LOOKUP_SET));
+		if (op->set == NULL ||
+		    nftnl_eval_reg(e, NFTNL_EXPR_LOOKUP_SREG, op->set->key_len,
+				   &op->sreg) < 0)
+			return -1;
+		if (!nftnl_expr_is_set(e, NFTNL_EXPR_LOOKUP_DREG))
+			return 1;
+		if (nftnl_expr_get_u32(e, NFTNL_EXPR_LOOKUP_DREG) ==
+		    NFT_REG_VERDICT) {
+			if (!op->set->verdict) {
+				errno = EINVAL;
+				return -1;
+			}
+			op->op = 1;
+			return 1;
+		}
+		ret = nftnl_eval_reg(e, NFTNL_EXPR_LOOKUP_DREG,
+				     op->set->data_len, &op->dreg);
+	} else if (strcmp(name, "counter") == 0) {
+		op->type = NFTNL_EVAL_COUNTER;
+		op->ctr.pkts = nftnl_expr_get_u64(e, NFTNL_EXPR_CTR_PACKETS);
+		op->ctr.bytes = nftnl_expr_get_u64(e, NFTNL_EXPR_CTR_BYTES);
+	} else if (strcmp(name, "limit") == 0) {
+		ret = nftnl_eval_compile_limit(e, op);
+	} else if (strcmp(name, "log") == 0 || strcmp(name, "dup") == 0) {
+		return 0;
+	} else if (strcmp(name, "reject") == 0 || strcmp(name, "queue") == 0 ||
+		   strcmp(name, "nat") == 0 || strcmp(name, "masq") == 0 ||
+		   strcmp(name, "redir") == 0) {
+		/* only the verdict is issued, the packet is left untouched */
+		op->type = NFTNL_EVAL_VERDICT;
+		if (strcmp(name, "reject") == 0)
+			op->verdict = NF_DROP;
+		else if (strcmp(name, "queue") == 0)
+			op->verdict = NF_QUEUE;
+		else
+			op->verdict = NF_ACCEPT;
+	} else {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	return ret < 0 ? -1 : 1;
+}
+
+static int nftnl_eval_compile_rule(struct nftnl_eval *ev,
+				   struct nftnl_rule *r,
+				   struct nftnl_eval_rule *er)
+{
+	struct nftnl_expr *e;
+	int ret;
+
+	er->rule = r;
+	er->handle = nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE);
+	er->op = ev->num_ops;
+
+	list_for_each_entry(e, &r->expr_list, head) {
+		ret = nftnl_eval_compile_expr(ev, r, e,
+					      &ev->ops[ev->num_ops]);
+		if (ret < 0)
+			return -1;
+		ev->num_ops += ret;
+	}
+	er->num = ev->num_ops - er->op;
+
+	return 0;
+}
+
+/* Chains must not reach themselves, as the kernel checks on load. */
+static int nftnl_eval_check_chain(struct nftnl_eval *ev, uint32_t c);
+
+static int nftnl_eval_check_target(struct nftnl_eval *ev, int verdict,
+				   uint32_t c)
+{
+	if (verdict != NFT_JUMP && verdict != NFT_GOTO)
+		return 0;
+
+	if (ev->chains[c].color == 1) {
+		errno = ELOOP;
+		return -1;
+	}
+	if (ev->chains[c].color == 0)
+		return nftnl_eval_check_chain(ev, c);
+
+	return 0;
+}
+
+static int nftnl_eval_check_chain(struct nftnl_eval *ev, uint32_t c)
+{
+	struct nftnl_eval_chain *chain = &ev->chains[c];
+	struct nftnl_eval_rule *er;
+	struct nftnl_eval_op *op;
+	uint32_t i, j, k;
+
+	chain->color = 1;
+	for (i = chain->first; i < chain->first + chain->num; i++) {
+		er = &ev->rules[i];
+		for (j = er->op; j < er->op + er->num; j++) {
+			op = &ev->ops[j];
+			if (op->type == NFTNL_EVAL_VERDICT &&
+			    nftnl_eval_check_target(ev, op->verdict,
+						    op->chain) < 0)
+				return -1;
+			if (op->type != NFTNL_EVAL_LOOKUP || !op->set->verdict)
+				continue;
+			for (k = 0; k < op->set->num; k++) {
+				if (op->set->elem[k].end)
+					continue;
+				if (nftnl_eval_check_target(ev,
+						op->set->elem[k].verdict,
+						op->set->elem[k].chain) < 0)
+					return -1;
+			}
+		}
+	}
+	ev->chains[c].color = 2;
+
+	return 0;
+}
+
+static int nftnl_eval_compile(struct nftnl_eval *ev,
+			      struct nftnl_rule_list *list)
+{
+	struct nftnl_eval_rule *rules;
+	uint32_t num_ops = 0, i, *pos;
+	struct nftnl_expr *e;
+	struct nftnl_rule *r;
+	int chain = -1;
+
+	list_for_each_entry(r, &list->list, head) {
+		ev->num_rules++;
+		list_for_each_entry(e, &r->expr_list, head)
+			num_ops++;
+	}
+
+	rules = calloc(ev->num_rules + 1, sizeof(*rules));
+	ev->ops = calloc(num_ops + 1, sizeof(*ev->ops));
+	if (rules == NULL || ev->ops == NULL) {
+		xfree(rules);
+		return -1;
+	}
+
+	i = 0;
+	list_for_each_entry(r, &list->list, head) {
+		if (chain < 0 || ev->chains[chain].family != r->family ||
+		    r->table == NULL || r->chain == NULL ||
+		    strcmp(ev->chains[chain].name, r->chain) != 0 ||
+		    strcmp(ev->chains[chain].table, r->table) != 0)
+			chain = nftnl_eval_chain_get(ev, r->family, r->table,
+						     r->chain);
+		if (chain < 0 ||
+		    nftnl_eval_compile_rule(ev, r, &rules[i]) < 0) {
+			xfree(rules);
+			return -1;
+		}
+		rules[i++].chain = chain;
+	}
+
+	/* group the rules per chain, keeping their order */
+	pos = calloc(ev->num_chains + 1, sizeof(uint32_t));
+	ev->rules = calloc(ev->num_rules + 1, sizeof(*ev->rules));
+	if (pos == NULL || ev->rules == NULL) {
+		xfree(pos);
+		xfree(rules);
+		return -1;
+	}
+	for (i = 0; i < ev->num_rules; i++)
+		ev->chains[rules[i].chain].num++;
+	for (i = 1; i < ev->num_chains; i++) {
+		ev->chains[i].first = ev->chains[i - 1].first +
+				      ev->chains[i - 1].num;
+	}
+	for (i = 0; i < ev->num_rules; i++) {
+		chain = rules[i].chain;
+		ev->rules[ev->chains[chain].first + pos[chain]++] = rules[i];
+	}
+	xfree(pos);
+	xfree(rules);
+
+	for (i = 0; i < ev->num_chains; i++) {
+		if (ev->chains[i].color == 0 &&
+		    nftnl_eval_check_chain(ev, i) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+struct nftnl_eval *nftnl_eval_alloc(struct nftnl_rule_list *rules,
+				    struct nftnl_set_list *sets)
+{
+	struct nftnl_eval *ev;
+
+	ev = calloc(1, sizeof(*ev));
+	if (ev == NULL)
+		return NULL;
+
+	ev->set_list = sets;
+	if (nftnl_eval_compile(ev, rules) < 0) {
+		nftnl_eval_free(ev);
+		return NULL;
+	}
+	ev->set_list = NULL;
+
+	return ev;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_eval_alloc);
+
+void nftnl_eval_free(struct nftnl_eval *ev)
+{
+	int err = errno;
+	uint32_t i;
+
+	for (i = 0; i < ev->num_chains; i++) {
+		xfree(ev->chains[i].table);
+		xfree(ev->chains[i].name);
+	}
+	for (i = 0; i < ev->num_sets; i++)
+		nftnl_eval_set_free(ev->sets[i]);
+
+	xfree(ev->chains);
+	xfree(ev->rules);
+	xfree(ev->ops);
+	xfree(ev->sets);
+	xfree(ev);
+	errno = err;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_eval_free);
+
+int nftnl_eval_chain(const struct nftnl_eval *ev, uint32_t family,
+		     const char *table, const char *chain)
+{
+	const struct nftnl_eval_chain *c;
+	uint32_t i;
+
+	for (i = 0; i < ev->num_chains; i++) {
+		c = &ev->chains[i];
+		if (c->family == family && strcmp(c->name, chain) == 0 &&
+		    strcmp(c->table, table) == 0)
+			return i;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_eval_chain);
+
+void nftnl_eval_sync_counters(struct nftnl_eval *ev)
+{
+	struct nftnl_eval_op *op;
+	uint32_t i;
+
+	for (i = 0; i < ev->num_ops; i++) {
+		op = &ev->ops[i];
+		if (op->type != NFTNL_EVAL_COUNTER)
+			continue;
+		nftnl_expr_set_u64(op->expr, NFTNL_EXPR_CTR_PACKETS,
+				   op->ctr.pkts);
+		nftnl_expr_set_u64(op->expr, NFTNL_EXPR_CTR_BYTES,
+				   op->ctr.bytes);
+	}
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_eval_sync_counters);
+
+/*
+ * Walks the IPv6 extension headers up to the one of the given type, or up
+ * to the transport header if type is negative, as ipv6_find_hdr() does.
+ * Non-first fragments have no transport header.
+ */
+static int nftnl_eval_ipv6_hdr(const struct nftnl_eval_pkt *pkt, int type,
+			       int32_t *off, int32_t *proto)
+{
+	const uint8_t *p = pkt->data;
+	uint32_t start = 40, hlen;
+	bool frag = false;
+	uint8_t next;
+
+	if (pkt->len < 40 || (p[0] >> 4) != 6)
+		return -1;
+
+	next = p[6];
+	while (next != type) {
+		switch (next) {
+		case IPPROTO_HOPOPTS:
+		case IPPROTO_ROUTING:
+		case IPPROTO_DSTOPTS:
+			if (start + 2 > pkt->len)
+				return -1;
+			hlen = (p[start + 1] + 1) * 8;
+			break;
+		case IPPROTO_FRAGMENT:
+			if (start + 8 > pkt->len)
+				return -1;
+			frag = ((p[start + 2] << 8 | p[start + 3]) & ~7) != 0;
+			hlen = 8;
+			break;
+		case IPPROTO_AH:
+			if (start + 2 > pkt->len)
+				return -1;
+			hlen = (p[start + 1] + 2) * 4;
+			break;
+		case IPPROTO_NONE:
+			return -1;
+		default:
+			if (type >= 0)
+				return -1;
+			*off = start;
+			*proto = next;
+			return 0;
+		}
+		if (start + hlen > pkt->len)
+			return -1;
+
+		next = p[start];
+		start += hlen;
+		if (frag) {
+			if (type >= 0)
+				return -1;
+			*off = -1;
+			*proto = next;
+			return 0;
+		}
+	}
+	*off = start;
+	*proto = next;
+
+	return 0;
+}
+
+static void nftnl_eval_pkt_init(struct nftnl_eval_state *st)
+{
+	const struct nftnl_eval_pkt *pkt = st->pkt;
+	const uint8_t *p = pkt->data;
+	uint32_t hlen;
+
+	st->thoff = -1;
+	st->l4proto = -1;
+
+	switch (pkt->family) {
+	case NFPROTO_IPV4:
+		if (pkt->len < 20 || (p[0] >> 4) != 4)
+			return;
+		hlen = (p[0] & 0x0f) * 4;
+		if (hlen < 20 || hlen > pkt->len)
+			return;
+		st->l4proto = p[9];
+		if (((p[6] << 8 | p[7]) & 0x1fff) == 0)
+			st->thoff = hlen;
+		break;
+	case NFPROTO_IPV6:
+		nftnl_eval_ipv6_hdr(pkt, -1, &st->thoff, &st->l4proto);
+		break;
+	}
+}
+
+static inline void nftnl_eval_load(struct nftnl_eval_state *st, uint32_t dreg,
+				   const void *data, uint32_t len)
+{
+	if (len % NFT_REG32_SIZE)
+		st->regs.w[(dreg + len) / NFT_REG32_SIZE] = 0;
+	memcpy(&st->regs.b[dreg], data, len);
+}
+
+static inline bool nftnl_eval_payload(struct nftnl_eval_state *st,
+				      const struct nftnl_eval_op *op)
+{
+	const struct nftnl_eval_pkt *pkt = st->pkt;
+	const uint8_t *base;
+	uint32_t len;
+
+	switch (op->op) {
+	case NFT_PAYLOAD_LL_HEADER:
+		base = pkt->ll;
+		len = pkt->ll_len;
+		break;
+	case NFT_PAYLOAD_NETWORK_HEADER:
+		base = pkt->data;
+		len = pkt->len;
+		break;
+	default:
+		if (st->thoff < 0)
+			return false;
+		base = pkt->data + st->thoff;
+		len = pkt->len - st->thoff;
+		break;
+	}
+	if (base == NULL || op->offset > len || op->len > len - op->offset)
+		return false;
+
+	nftnl_eval_load(st, op->dreg, base + op->offset, op->len);
+	return true;
+}
+
+static inline bool nftnl_eval_cmp(const struct nftnl_eval_state *st,
+				  const struct nftnl_eval_op *op)
+{
+	int d = memcmp(&st->regs.b[op->sreg], op->data, op->len);
+
+	switch (op->op) {
+	case NFT_CMP_EQ:
+		return d == 0;
+	case NFT_CMP_NEQ:
+		return d != 0;
+	case NFT_CMP_LT:
+		return d < 0;
+	case NFT_CMP_LTE:
+		return d <= 0;
+	case NFT_CMP_GT:
+		return d > 0;
+	case NFT_CMP_GTE:
+		return d >= 0;
+	}
+	return false;
+}
+
+static inline void nftnl_eval_byteorder(struct nftnl_eval_state *st,
+					const struct nftnl_eval_op *op)
+{
+	uint8_t buf[NFTNL_EVAL_REGS];
+	uint32_t i, j;
+
+	memcpy(buf, &st->regs.b[op->sreg], op->len);
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	/* both conversions swap the bytes of each element */
+	for (i = 0; i + op->size <= op->len; i += op->size) {
+		for (j = 0; j < op->size; j++)
+			st->regs.b[op->dreg + i + j] =
+				buf[i + op->size - 1 - j];
+	}
+#else
+	memcpy(&st->regs.b[op->dreg], buf, op->len);
+#endif
+}
+
+static inline void nftnl_eval_u16(uint32_t *dest, uint16_t val)
+{
+	*dest = 0;
+	memcpy(dest, &val, sizeof(val));
+}
+
+static inline void nftnl_eval_str(uint32_t *dest, const char *str)
+{
+	memset(dest, 0, IFNAMSIZ);
+	strncpy((char *)dest, str, IFNAMSIZ);
+}
+
+static bool nftnl_eval_meta(struct nftnl_eval_state *st,
+			    const struct nftnl_eval_op *op)
+{
+	const struct nftnl_eval_meta *meta = st->pkt->meta;
+	uint32_t *dest = &st->regs.w[op->dreg / NFT_REG32_SIZE];
+
+	switch (op->key) {
+	case NFT_META_LEN:
+		*dest = st->pkt->len;
+		return true;
+	case NFT_META_NFPROTO:
+		*dest = st->pkt->family;
+		return true;
+	case NFT_META_L4PROTO:
+		if (st->l4proto < 0)
+			return false;
+		*dest = st->l4proto;
+		return true;
+	case NFT_META_MARK:
+		*dest = st->mark;
+		return true;
+	case NFT_META_PRIORITY:
+		*dest = st->priority;
+		return true;
+	case NFT_META_PROTOCOL:
+		if (meta != NULL && meta->present & (1 << NFT_META_PROTOCOL))
+			nftnl_eval_u16(dest, meta->protocol);
+		else if (st->pkt->family == NFPROTO_IPV4)
+			nftnl_eval_u16(dest, htons(0x0800));
+		else if (st->pkt->family == NFPROTO_IPV6)
+			nftnl_eval_u16(dest, htons(0x86dd));
+		else
+			return false;
+		return true;
+	}
+
+	if (meta == NULL || !(meta->present & (1 << op->key)))
+		return false;
+
+	switch (op->key) {
+	case NFT_META_IIF:
+		*dest = meta->iif;
+		break;
+	case NFT_META_OIF:
+		*dest = meta->oif;
+		break;
+	case NFT_META_IIFNAME:
+		nftnl_eval_str(dest, meta->iifname);
+		break;
+	case NFT_META_OIFNAME:
+		nftnl_eval_str(dest, meta->oifname);
+		break;
+	case NFT_META_IIFTYPE:
+		nftnl_eval_u16(dest, meta->iiftype);
+		break;
+	case NFT_META_OIFTYPE:
+		nftnl_eval_u16(dest, meta->oiftype);
+		break;
+	case NFT_META_SKUID:
+		*dest = meta->skuid;
+		break;
+	case NFT_META_SKGID:
+		*dest = meta->skgid;
+		break;
+	case NFT_META_NFTRACE:
+		*dest = meta->nftrace;
+		break;
+	case NFT_META_RTCLASSID:
+		*dest = meta->rtclassid;
+		break;
+	case NFT_META_SECMARK:
+		*dest = meta->secmark;
+		break;
+	case NFT_META_BRI_IIFNAME:
+		nftnl_eval_str(dest, meta->bri_iifname);
+		break;
+	case NFT_META_BRI_OIFNAME:
+		nftnl_eval_str(dest, meta->bri_oifname);
+		break;
+	case NFT_META_PKTTYPE:
+		*dest = meta->pkttype;
+		break;
+	case NFT_META_CPU:
+		*dest = meta->cpu;
+		break;
+	case NFT_META_IIFGROUP:
+		*dest = meta->iifgroup;
+		break;
+	case NFT_META_OIFGROUP:
+		*dest = meta->oifgroup;
+		break;
+	case NFT_META_CGROUP:
+		*dest = meta->cgroup;
+		break;
+	}
+	return true;
+}
+
+static bool nftnl_eval_ct(struct nftnl_eval_state *st,
+			  const struct nftnl_eval_op *op)
+{
+	const struct nftnl_eval_ct *ct = st->pkt->ct;
+	uint32_t *dest = &st->regs.w[op->dreg / NFT_REG32_SIZE];
+	uint32_t dir;
+
+	if (op->key == NFT_CT_STATE) {
+		*dest = ct != NULL ? ct->state : NF_CT_STATE_INVALID_BIT;
+		return true;
+	}
+	if (ct == NULL)
+		return false;
+
+	dir = op->op ? op->offset : ct->direction & 1;
+	switch (op->key) {
+	case NFT_CT_DIRECTION:
+		*dest = ct->direction;
+		break;
+	case NFT_CT_STATUS:
+		*dest = ct->status;
+		break;
+	case NFT_CT_MARK:
+		*dest = st->ct_mark;
+		break;
+	case NFT_CT_SECMARK:
+		*dest = ct->secmark;
+		break;
+	case NFT_CT_EXPIRATION:
+		*dest = ct->expiration;
+		break;
+	case NFT_CT_HELPER:
+		if (ct->helper[0] == '\0')
+			return false;
+		nftnl_eval_str(dest, ct->helper);
+		break;
+	case NFT_CT_L3PROTOCOL:
+		*dest = ct->l3protocol;
+		break;
+	case NFT_CT_SRC:
+		memcpy(dest, ct->tuple[dir].src,
+		       ct->l3protocol == NFPROTO_IPV4 ? 4 : 16);
+		break;
+	case NFT_CT_DST:
+		memcpy(dest, ct->tuple[dir].dst,
+		       ct->l3protocol == NFPROTO_IPV4 ? 4 : 16);
+		break;
+	case NFT_CT_PROTOCOL:
+		*dest = ct->protocol;
+		break;
+	case NFT_CT_PROTO_SRC:
+		nftnl_eval_u16(dest, ct->tuple[dir].proto_src);
+		break;
+	case NFT_CT_PROTO_DST:
+		nftnl_eval_u16(dest, ct->tuple[dir].proto_dst);
+		break;
+	case NFT_CT_LABELS:
+		memcpy(dest, ct->labels, sizeof(ct->labels));
+		break;
+	}
+	return true;
+}
+
+static bool nftnl_eval_exthdr(struct nftnl_eval_state *st,
+			      const struct nftnl_eval_op *op)
+{
+	const struct nftnl_eval_pkt *pkt = st->pkt;
+	int32_t off, proto;
+
+	if (pkt->family != NFPROTO_IPV6 ||
+	    nftnl_eval_ipv6_hdr(pkt, op->key, &off, &proto) < 0 ||
+	    op->offset > pkt->len - off ||
+	    op->len > pkt->len - off - op->offset)
+		return false;
+
+	nftnl_eval_load(st, op->dreg, pkt->data + off + op->offset, op->len);
+	return true;
+}
+
+static const struct nftnl_eval_elem *
+nftnl_eval_set_find(const struct nftnl_eval_set *es, const uint8_t *key)
+{
+	const struct nftnl_eval_elem *elem;
+	uint32_t h, lo = 0, hi = es->num, mid;
+
+	if (!es->interval) {
+		h = nftnl_hash_data(NFTNL_HASH_INIT, key, es->key_len) &
+		    es->mask;
+		while (es->hash[h] != 0) {
+			elem = &es->elem[es->hash[h] - 1];
+			if (memcmp(elem->key, key, es->key_len) == 0)
+				return elem;
+			h = (h + 1) & es->mask;
+		}
+		return NULL;
+	}
+
+	/* closest element not greater than the key */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (memcmp(es->elem[mid].key, key, es->key_len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0 || es->elem[lo - 1].end)
+		return NULL;
+
+	return &es->elem[lo - 1];
+}
+
+static bool nftnl_eval_lookup(struct nftnl_eval_state *st,
+			      const struct nftnl_eval_op *op)
+{
+	const struct nftnl_eval_set *es = op->set;
+	const struct nftnl_eval_elem *elem;
+
+	elem = nftnl_eval_set_find(es, &st->regs.b[op->sreg]);
+	if (elem == NULL)
+		return false;
+
+	if (op->op) {
+		st->code = elem->verdict;
+		st->chain = elem->chain;
+	} else if (es->data_len) {
+		nftnl_eval_load(st, op->dreg, elem->data, es->data_len);
+	}
+	return true;
+}
+
+static bool nftnl_eval_limit(struct nftnl_eval_op *op, uint64_t now,
+			     uint64_t cost)
+{
+	uint64_t tokens;
+
+	if (!op->limit.started) {
+		op->limit.started = true;
+		op->limit.last = now;
+	}
+	if (now < op->limit.last)
+		now = op->limit.last;
+
+	tokens = op->limit.tokens + now - op->limit.last;
+	if (tokens > op->limit.tokens_max)
+		tokens = op->limit.tokens_max;
+	op->limit.last = now;
+
+	if (tokens >= cost) {
+		op->limit.tokens = tokens - cost;
+		return true;
+	}
+	op->limit.tokens = tokens;
+
+	return false;
+}
+
+static inline void nftnl_eval_op(struct nftnl_eval_state *st,
+				 struct nftnl_eval_op *op)
+{
+	const struct nftnl_eval_pkt *pkt = st->pkt;
+	bool match = true;
+	uint64_t cost;
+	uint32_t i;
+
+	switch (op->type) {
+	case NFTNL_EVAL_PAYLOAD:
+		match = nftnl_eval_payload(st, op);
+		break;
+	case NFTNL_EVAL_CMP:
+		match = nftnl_eval_cmp(st, op);
+		break;
+	case NFTNL_EVAL_BITWISE:
+		for (i = 0; i < op->len; i++)
+			st->regs.b[op->dreg + i] =
+				(st->regs.b[op->sreg + i] & op->mask[i]) ^
+				op->xor[i];
+		break;
+	case NFTNL_EVAL_BYTEORDER:
+		nftnl_eval_byteorder(st, op);
+		break;
+	case NFTNL_EVAL_IMMEDIATE:
+		nftnl_eval_load(st, op->dreg, op->data, op->len);
+		break;
+	case NFTNL_EVAL_VERDICT:
+		st->code = op->verdict;
+		st->chain = op->chain;
+		break;
+	case NFTNL_EVAL_META:
+		match = nftnl_eval_meta(st, op);
+		break;
+	case NFTNL_EVAL_META_SET:
+		if (op->key == NFT_META_MARK)
+			st->mark = st->regs.w[op->sreg / NFT_REG32_SIZE];
+		else
+			st->priority = st->regs.w[op->sreg / NFT_REG32_SIZE];
+		break;
+	case NFTNL_EVAL_CT:
+		match = nftnl_eval_ct(st, op);
+		break;
+	case NFTNL_EVAL_CT_SET:
+		st->ct_mark = st->regs.w[op->sreg / NFT_REG32_SIZE];
+		break;
+	case NFTNL_EVAL_EXTHDR:
+		match = nftnl_eval_exthdr(st, op);
+		break;
+	case NFTNL_EVAL_LOOKUP:
+		match = nftnl_eval_lookup(st, op);
+		break;
+	case NFTNL_EVAL_COUNTER:
+		op->ctr.pkts++;
+		op->ctr.bytes += pkt->len;
+		break;
+	case NFTNL_EVAL_LIMIT:
+		cost = op->limit.nsecs / op->limit.rate;
+		if (op->key == NFT_LIMIT_PKT_BYTES)
+			cost = op->limit.nsecs * pkt->len / op->limit.rate;
+		match = nftnl_eval_limit(op, pkt->tstamp, cost);
+		break;
+	}
+
+	if (!match)
+		st->code = NFT_BREAK;
+}
+
+void nftnl_eval_fields(const struct nftnl_eval_pkt *pkt,
+		       const struct nftnl_field *fields, uint32_t num,
+		       uint8_t (*val)[NFTNL_FIELD_MAXLEN], bool *present)
+{
+	struct nftnl_eval_op op = {
+		.dreg	= NFTNL_EVAL_REGS - NFTNL_FIELD_MAXLEN,
+	};
+	const struct nftnl_field *f;
+	struct nftnl_eval_state st;
+	uint32_t i, j;
+
+	st.pkt = pkt;
+	st.mark = pkt->meta != NULL ? pkt->meta->mark : 0;
+	st.priority = pkt->meta != NULL ? pkt->meta->priority : 0;
+	st.ct_mark = pkt->ct != NULL ? pkt->ct->mark : 0;
+	nftnl_eval_pkt_init(&st);
+
+	for (i = 0; i < num; i++) {
+		f = &fields[i];
+		op.key = f->key;
+		op.len = f->len;
+		switch (f->type) {
+		case NFTNL_FIELD_PAYLOAD:
+			op.op = f->key;
+			op.offset = f->offset;
+			present[i] = nftnl_eval_payload(&st, &op);
+			break;
+		case NFTNL_FIELD_META:
+			present[i] = f->key <= NFT_META_CGROUP &&
+				     nftnl_eval_meta(&st, &op);
+			break;
+		case NFTNL_FIELD_CT:
+			op.op = f->offset != UINT32_MAX;
+			op.offset = f->offset & 1;
+			present[i] = f->key <= NFT_CT_LABELS &&
+				     nftnl_eval_ct(&st, &op);
+			break;
+		default:
+			present[i] = false;
+			break;
+		}
+
+		memset(val[i], 0, NFTNL_FIELD_MAXLEN);
+		if (!present[i])
+			continue;
+		for (j = 0; j < f->len; j++)
+			val[i][j] = st.regs.b[op.dreg + j] & f->mask[j];
+	}
+}
+
+int nftnl_eval_run(struct nftnl_eval *ev, int chain,
+		   const struct nftnl_eval_pkt *pkt,
+		   struct nftnl_eval_result *res)
+{
+	struct {
+		uint32_t	rule;
+		uint32_t	end;
+	} stack[NFTNL_EVAL_STACK];
+	struct nftnl_eval_state st;
+	struct nftnl_eval_rule *er;
+	uint32_t rule, end, depth = 0, i;
+
+	if (chain < 0 || (uint32_t)chain >= ev->num_chains) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(&st.regs, 0, sizeof(st.regs));
+	st.pkt = pkt;
+	st.mark = pkt->meta != NULL ? pkt->meta->mark : 0;
+	st.priority = pkt->meta != NULL ? pkt->meta->priority : 0;
+	st.ct_mark = pkt->ct != NULL ? pkt->ct->mark : 0;
+	nftnl_eval_pkt_init(&st);
+
+	memset(res, 0, sizeof(*res));
+	rule = ev->chains[chain].first;
+	end = rule + ev->chains[chain].num;
+
+	for (;;) {
+		if (rule == end) {
+			if (depth == 0)
+				break;
+			depth--;
+			rule = stack[depth].rule;
+			end = stack[depth].end;
+			continue;
+		}
+
+		er = &ev->rules[rule++];
+		res->rules++;
+
+		st.code = NFT_CONTINUE;
+		for (i = er->op; i < er->op + er->num; i++) {
+			nftnl_eval_op(&st, &ev->ops[i]);
+			if (st.code != NFT_CONTINUE)
+				break;
+		}
+
+		switch (st.code) {
+		case NFT_CONTINUE:
+		case NFT_BREAK:
+			continue;
+		case NFT_JUMP:
+			if (depth == NFTNL_EVAL_STACK) {
+				errno = ELOOP;
+				return -1;
+			}
+			stack[depth].rule = rule;
+			stack[depth].end = end;
+			depth++;
+			/* fall through */
+		case NFT_GOTO:
+			rule = ev->chains[st.chain].first;
+			end = rule + ev->chains[st.chain].num;
+			continue;
+		case NFT_RETURN:
+			rule = end;
+			continue;
+		}
+
+		res->verdict = st.code;
+		res->rule = er->rule;
+		res->handle = er->handle;
+		break;
+	}
+
+	if (res->rule == NULL)
+		res->verdict = NFT_CONTINUE;
+	res->mark = st.mark;
+
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_eval_run);
@@ -33,7 +33,7 @@ struct nftnl_expr *nftnl_expr_alloc(const char *name)
 	if (ops == NULL)
 		return NULL;
 
-	expr = calloc(1, sizeof(struct nftnl_expr) + ops->alloc_len);
+	expr = nftnl_expr_cache_alloc(ops);
 	if (expr == NULL)
 		return NULL;
 
@@ -50,7 +50,7 @@ void nftnl_expr_free(struct nftnl_expr *expr)
 	if (expr->ops->free)
 		expr->ops->free(expr);
 
-	xfree(expr);
+	nftnl_expr_cache_free(expr);
 }
 EXPORT_SYMBOL(nftnl_expr_free, nft_rule_expr_free);
 
@@ -60,6 +60,11 @@ bool nftnl_expr_is_set(const struct nftnl_expr *expr, uint16_t type)
 }
 EXPORT_SYMBOL(nftnl_expr_is_set, nft_rule_expr_is_set);
 
+bool nftnl_expr_is(const struct nftnl_expr *e, const char *name)
+{
+	return strcmp(e->ops->name, name) == 0;
+}
+
 void
 nftnl_expr_set(struct nftnl_expr *expr, uint16_t type,
 		  const void *data, uint32_t data_len)
@@ -243,7 +248,8 @@ struct nftnl_expr *nftnl_expr_parse(struct nlattr *attr)
 	struct nlattr *tb[NFTA_EXPR_MAX+1] = {};
 	struct nftnl_expr *expr;
 
-	if (mnl_attr_parse_nested(attr, nftnl_rule_parse_expr_cb, tb) < 0)
+	if (mnl_attr_parse_nested(attr, nftnl_rule_parse_expr_cb, tb) < 0 ||
+	    tb[NFTA_EXPR_NAME] == NULL)
 		goto err1;
 
 	expr = nftnl_expr_alloc(mnl_attr_get_str(tb[NFTA_EXPR_NAME]));
@@ -257,11 +263,41 @@ struct nftnl_expr *nftnl_expr_parse(struct nlattr *attr)
 	return expr;
 
 err2:
-	xfree(expr);
+	nftnl_expr_free(expr);
 err1:
 	return NULL;
 }
 
+void *nftnl_expr_priv(const struct nftnl_expr *expr)
+{
+	return nftnl_expr_data(expr);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_expr_priv);
+
+uint32_t nftnl_expr_hash(const struct nftnl_expr *expr, uint32_t hash)
+{
+	hash = nftnl_hash_str(hash, expr->ops->name);
+
+	if (expr->ops->hash == NULL)
+		return nftnl_hash_data(hash, expr->data, expr->ops->alloc_len);
+
+	return expr->ops->hash(expr, hash);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_expr_hash);
+
+bool nftnl_expr_cmp(const struct nftnl_expr *e1, const struct nftnl_expr *e2)
+{
+	if (strcmp(e1->ops->name, e2->ops->name) != 0)
+		return false;
+
+	if (e1->ops->cmp == NULL)
+		return e1->flags == e2->flags &&
+		       memcmp(e1->data, e2->data, e1->ops->alloc_len) == 0;
+
+	return e1->ops->cmp(e1, e2);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_expr_cmp);
+
 int nftnl_expr_snprintf(char *buf, size_t size, struct nftnl_expr *expr,
 			   uint32_t type, uint32_t flags)
 {
@@ -310,6 +310,36 @@ nftnl_expr_bitwise_snprintf(char *buf, size_t size, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_bitwise_hash(const struct nftnl_expr *e,
+					uint32_t hash)
+{
+	struct nftnl_expr_bitwise *bitwise = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, bitwise->sreg);
+	hash = nftnl_hash_val(hash, bitwise->dreg);
+	hash = nftnl_hash_val(hash, bitwise->len);
+	hash = nftnl_data_reg_hash(&bitwise->mask, DATA_VALUE, hash);
+	hash = nftnl_data_reg_hash(&bitwise->xor, DATA_VALUE, hash);
+
+	return hash;
+}
+
+static bool nftnl_expr_bitwise_cmp(const struct nftnl_expr *e1,
+				   const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_bitwise *b1 = nftnl_expr_data(e1);
+	struct nftnl_expr_bitwise *b2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return b1->sreg == b2->sreg &&
+	       b1->dreg == b2->dreg &&
+	       b1->len == b2->len &&
+	       nftnl_data_reg_cmp(&b1->mask, &b2->mask, DATA_VALUE) &&
+	       nftnl_data_reg_cmp(&b1->xor, &b2->xor, DATA_VALUE);
+}
+
 struct expr_ops expr_ops_bitwise = {
 	.name		= "bitwise",
 	.alloc_len	= sizeof(struct nftnl_expr_bitwise),
@@ -321,4 +351,6 @@ struct expr_ops expr_ops_bitwise = {
 	.snprintf	= nftnl_expr_bitwise_snprintf,
 	.xml_parse	= nftnl_expr_bitwise_xml_parse,
 	.json_parse	= nftnl_expr_bitwise_json_parse,
+	.hash		= nftnl_expr_bitwise_hash,
+	.cmp		= nftnl_expr_bitwise_cmp,
 };
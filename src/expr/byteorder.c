@@ -326,6 +326,36 @@ nftnl_expr_byteorder_snprintf(char *buf, size_t size, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_byteorder_hash(const struct nftnl_expr *e,
+					  uint32_t hash)
+{
+	struct nftnl_expr_byteorder *byteorder = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, byteorder->sreg);
+	hash = nftnl_hash_val(hash, byteorder->dreg);
+	hash = nftnl_hash_val(hash, byteorder->op);
+	hash = nftnl_hash_val(hash, byteorder->len);
+	hash = nftnl_hash_val(hash, byteorder->size);
+
+	return hash;
+}
+
+static bool nftnl_expr_byteorder_cmp(const struct nftnl_expr *e1,
+				     const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_byteorder *b1 = nftnl_expr_data(e1);
+	struct nftnl_expr_byteorder *b2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return b1->sreg == b2->sreg &&
+	       b1->dreg == b2->dreg &&
+	       b1->op == b2->op &&
+	       b1->len == b2->len &&
+	       b1->size == b2->size;
+}
+
 struct expr_ops expr_ops_byteorder = {
 	.name		= "byteorder",
 	.alloc_len	= sizeof(struct nftnl_expr_byteorder),
@@ -337,4 +367,6 @@ struct expr_ops expr_ops_byteorder = {
 	.snprintf	= nftnl_expr_byteorder_snprintf,
 	.xml_parse	= nftnl_expr_byteorder_xml_parse,
 	.json_parse	= nftnl_expr_byteorder_json_parse,
+	.hash		= nftnl_expr_byteorder_hash,
+	.cmp		= nftnl_expr_byteorder_cmp,
 };
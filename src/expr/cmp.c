@@ -293,6 +293,31 @@ nftnl_expr_cmp_snprintf(char *buf, size_t size, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_cmp_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_cmp *cmp = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, cmp->sreg);
+	hash = nftnl_hash_val(hash, cmp->op);
+	hash = nftnl_data_reg_hash(&cmp->data, DATA_VALUE, hash);
+
+	return hash;
+}
+
+static bool nftnl_expr_cmp_cmp(const struct nftnl_expr *e1,
+			       const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_cmp *c1 = nftnl_expr_data(e1);
+	struct nftnl_expr_cmp *c2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return c1->sreg == c2->sreg &&
+	       c1->op == c2->op &&
+	       nftnl_data_reg_cmp(&c1->data, &c2->data, DATA_VALUE);
+}
+
 struct expr_ops expr_ops_cmp = {
 	.name		= "cmp",
 	.alloc_len	= sizeof(struct nftnl_expr_cmp),
@@ -304,4 +329,6 @@ struct expr_ops expr_ops_cmp = {
 	.snprintf	= nftnl_expr_cmp_snprintf,
 	.xml_parse	= nftnl_expr_cmp_xml_parse,
 	.json_parse	= nftnl_expr_cmp_json_parse,
+	.hash		= nftnl_expr_cmp_hash,
+	.cmp		= nftnl_expr_cmp_cmp,
 };
@@ -198,6 +198,19 @@ static int nftnl_expr_counter_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+/* Packet and byte counters are volatile, they never tell rules apart. */
+static uint32_t nftnl_expr_counter_hash(const struct nftnl_expr *e,
+					uint32_t hash)
+{
+	return hash;
+}
+
+static bool nftnl_expr_counter_cmp(const struct nftnl_expr *e1,
+				   const struct nftnl_expr *e2)
+{
+	return true;
+}
+
 struct expr_ops expr_ops_counter = {
 	.name		= "counter",
 	.alloc_len	= sizeof(struct nftnl_expr_counter),
@@ -209,4 +222,6 @@ struct expr_ops expr_ops_counter = {
 	.snprintf	= nftnl_expr_counter_snprintf,
 	.xml_parse	= nftnl_expr_counter_xml_parse,
 	.json_parse	= nftnl_expr_counter_json_parse,
+	.hash		= nftnl_expr_counter_hash,
+	.cmp		= nftnl_expr_counter_cmp,
 };
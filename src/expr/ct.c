@@ -369,6 +369,33 @@ nftnl_expr_ct_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_ct_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_ct *ct = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, ct->key);
+	hash = nftnl_hash_val(hash, ct->dreg);
+	hash = nftnl_hash_val(hash, ct->sreg);
+	hash = nftnl_hash_val(hash, ct->dir);
+
+	return hash;
+}
+
+static bool nftnl_expr_ct_cmp(const struct nftnl_expr *e1,
+			      const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_ct *c1 = nftnl_expr_data(e1);
+	struct nftnl_expr_ct *c2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return c1->key == c2->key &&
+	       c1->dreg == c2->dreg &&
+	       c1->sreg == c2->sreg &&
+	       c1->dir == c2->dir;
+}
+
 struct expr_ops expr_ops_ct = {
 	.name		= "ct",
 	.alloc_len	= sizeof(struct nftnl_expr_ct),
@@ -380,4 +407,6 @@ struct expr_ops expr_ops_ct = {
 	.snprintf	= nftnl_expr_ct_snprintf,
 	.xml_parse	= nftnl_expr_ct_xml_parse,
 	.json_parse	= nftnl_expr_ct_json_parse,
+	.hash		= nftnl_expr_ct_hash,
+	.cmp		= nftnl_expr_ct_cmp,
 };
@@ -50,7 +50,11 @@ static int nftnl_data_reg_verdict_json_parse(union nftnl_data_reg *reg, json_t *
 		if (chain == NULL)
 			return DATA_NONE;
 
-		reg->chain = strdup(chain);
+		reg->chain = nftnl_intern(chain);
+		if (reg->chain == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
 	}
 
 	return DATA_VERDICT;
@@ -122,10 +126,12 @@ static int nftnl_data_reg_verdict_xml_parse(union nftnl_data_reg *reg,
 	chain = nftnl_mxml_str_parse(tree, "chain", MXML_DESCEND_FIRST,
 				   NFTNL_XML_OPT, err);
 	if (chain != NULL) {
-		if (reg->chain)
-			xfree(reg->chain);
-
-		reg->chain = strdup(chain);
+		nftnl_intern_put(reg->chain);
+		reg->chain = nftnl_intern(chain);
+		if (reg->chain == NULL) {
+			errno = ENOMEM;
+			return DATA_NONE;
+		}
 	}
 
 	return DATA_VERDICT;
@@ -447,7 +453,10 @@ nftnl_parse_verdict(union nftnl_data_reg *data, const struct nlattr *attr, int *
 		if (!tb[NFTA_VERDICT_CHAIN])
 			return -1;
 
-		data->chain = strdup(mnl_attr_get_str(tb[NFTA_VERDICT_CHAIN]));
+		data->chain =
+			nftnl_intern(mnl_attr_get_str(tb[NFTA_VERDICT_CHAIN]));
+		if (data->chain == NULL)
+			return -1;
 		if (type)
 			*type = DATA_CHAIN;
 		break;
@@ -504,9 +513,41 @@ void nftnl_free_verdict(union nftnl_data_reg *data)
 	switch(data->verdict) {
 	case NFT_JUMP:
 	case NFT_GOTO:
-		xfree(data->chain);
+		nftnl_intern_put(data->chain);
 		break;
 	default:
 		break;
 	}
 }
+
+uint32_t nftnl_data_reg_hash(const union nftnl_data_reg *reg, int reg_type,
+			     uint32_t hash)
+{
+	switch(reg_type) {
+	case DATA_VALUE:
+		hash = nftnl_hash_val(hash, reg->len);
+		return nftnl_hash_data(hash, reg->val, reg->len);
+	case DATA_VERDICT:
+	case DATA_CHAIN:
+		hash = nftnl_hash_val(hash, reg->verdict);
+		return nftnl_hash_str(hash, reg->chain);
+	}
+	return hash;
+}
+
+bool nftnl_data_reg_cmp(const union nftnl_data_reg *r1,
+			const union nftnl_data_reg *r2, int reg_type)
+{
+	switch(reg_type) {
+	case DATA_VALUE:
+		return r1->len == r2->len &&
+		       memcmp(r1->val, r2->val, r1->len) == 0;
+	case DATA_VERDICT:
+	case DATA_CHAIN:
+		if (r1->verdict != r2->verdict)
+			return false;
+		/* chain names are interned, NULL only matches NULL */
+		return r1->chain == r2->chain;
+	}
+	return true;
+}
@@ -200,6 +200,29 @@ static int nftnl_expr_dup_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_dup_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_dup *dup = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, dup->sreg_addr);
+	hash = nftnl_hash_val(hash, dup->sreg_dev);
+
+	return hash;
+}
+
+static bool nftnl_expr_dup_cmp(const struct nftnl_expr *e1,
+			       const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_dup *d1 = nftnl_expr_data(e1);
+	struct nftnl_expr_dup *d2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return d1->sreg_addr == d2->sreg_addr &&
+	       d1->sreg_dev == d2->sreg_dev;
+}
+
 struct expr_ops expr_ops_dup = {
 	.name		= "dup",
 	.alloc_len	= sizeof(struct nftnl_expr_dup),
@@ -211,4 +234,6 @@ struct expr_ops expr_ops_dup = {
 	.snprintf	= nftnl_expr_dup_snprintf,
 	.xml_parse	= nftnl_expr_dup_xml_parse,
 	.json_parse	= nftnl_expr_dup_json_parse,
+	.hash		= nftnl_expr_dup_hash,
+	.cmp		= nftnl_expr_dup_cmp,
 };
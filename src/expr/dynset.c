@@ -361,6 +361,42 @@ nftnl_expr_dynset_snprintf(char *buf, size_t size, uint32_t type,
 	return -1;
 }
 
+/* The set ID is only meaningful within one batch, match by set name. */
+static uint32_t nftnl_expr_dynset_hash(const struct nftnl_expr *e,
+				       uint32_t hash)
+{
+	struct nftnl_expr_dynset *dynset = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, dynset->sreg_key);
+	hash = nftnl_hash_val(hash, dynset->sreg_data);
+	hash = nftnl_hash_val(hash, dynset->op);
+	hash = nftnl_hash_val(hash, dynset->timeout);
+	hash = nftnl_hash_str(hash, dynset->set_name);
+	if (dynset->expr)
+		hash = nftnl_expr_hash(dynset->expr, hash);
+
+	return hash;
+}
+
+static bool nftnl_expr_dynset_cmp(const struct nftnl_expr *e1,
+				  const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_dynset *d1 = nftnl_expr_data(e1);
+	struct nftnl_expr_dynset *d2 = nftnl_expr_data(e2);
+	uint32_t mask = ~(1 << NFTNL_EXPR_DYNSET_SET_ID);
+
+	if ((e1->flags & mask) != (e2->flags & mask))
+		return false;
+	if (d1->expr && !nftnl_expr_cmp(d1->expr, d2->expr))
+		return false;
+
+	return d1->sreg_key == d2->sreg_key &&
+	       d1->sreg_data == d2->sreg_data &&
+	       d1->op == d2->op &&
+	       d1->timeout == d2->timeout &&
+	       strcmp(d1->set_name, d2->set_name) == 0;
+}
+
 struct expr_ops expr_ops_dynset = {
 	.name		= "dynset",
 	.alloc_len	= sizeof(struct nftnl_expr_dynset),
@@ -372,4 +408,6 @@ struct expr_ops expr_ops_dynset = {
 	.snprintf	= nftnl_expr_dynset_snprintf,
 	.xml_parse	= nftnl_expr_dynset_xml_parse,
 	.json_parse	= nftnl_expr_dynset_json_parse,
+	.hash		= nftnl_expr_dynset_hash,
+	.cmp		= nftnl_expr_dynset_cmp,
 };
@@ -304,6 +304,34 @@ nftnl_expr_exthdr_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_exthdr_hash(const struct nftnl_expr *e,
+				       uint32_t hash)
+{
+	struct nftnl_expr_exthdr *exthdr = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, exthdr->dreg);
+	hash = nftnl_hash_val(hash, exthdr->offset);
+	hash = nftnl_hash_val(hash, exthdr->len);
+	hash = nftnl_hash_val(hash, exthdr->type);
+
+	return hash;
+}
+
+static bool nftnl_expr_exthdr_cmp(const struct nftnl_expr *e1,
+				  const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_exthdr *h1 = nftnl_expr_data(e1);
+	struct nftnl_expr_exthdr *h2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return h1->dreg == h2->dreg &&
+	       h1->offset == h2->offset &&
+	       h1->len == h2->len &&
+	       h1->type == h2->type;
+}
+
 struct expr_ops expr_ops_exthdr = {
 	.name		= "exthdr",
 	.alloc_len	= sizeof(struct nftnl_expr_exthdr),
@@ -315,4 +343,6 @@ struct expr_ops expr_ops_exthdr = {
 	.snprintf	= nftnl_expr_exthdr_snprintf,
 	.xml_parse	= nftnl_expr_exthdr_xml_parse,
 	.json_parse	= nftnl_expr_exthdr_json_parse,
+	.hash		= nftnl_expr_exthdr_hash,
+	.cmp		= nftnl_expr_exthdr_cmp,
 };
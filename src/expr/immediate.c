@@ -43,10 +43,10 @@ nftnl_expr_immediate_set(struct nftnl_expr *e, uint16_t type,
 		imm->data.verdict = *((uint32_t *)data);
 		break;
 	case NFTNL_EXPR_IMM_CHAIN:
-		if (imm->data.chain)
-			xfree(imm->data.chain);
-
-		imm->data.chain = strdup(data);
+		nftnl_intern_put(imm->data.chain);
+		imm->data.chain = nftnl_intern(data);
+		if (imm->data.chain == NULL)
+			return -1;
 		break;
 	default:
 		return -1;
@@ -317,6 +317,42 @@ static void nftnl_expr_immediate_free(struct nftnl_expr *e)
 		nftnl_free_verdict(&imm->data);
 }
 
+static int nftnl_expr_immediate_reg_type(const struct nftnl_expr *e)
+{
+	if (e->flags & (1 << NFTNL_EXPR_IMM_DATA))
+		return DATA_VALUE;
+	if (e->flags & (1 << NFTNL_EXPR_IMM_VERDICT))
+		return DATA_VERDICT;
+
+	return DATA_NONE;
+}
+
+static uint32_t nftnl_expr_immediate_hash(const struct nftnl_expr *e,
+					  uint32_t hash)
+{
+	struct nftnl_expr_immediate *imm = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, imm->dreg);
+	hash = nftnl_data_reg_hash(&imm->data,
+				   nftnl_expr_immediate_reg_type(e), hash);
+
+	return hash;
+}
+
+static bool nftnl_expr_immediate_cmp(const struct nftnl_expr *e1,
+				     const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_immediate *i1 = nftnl_expr_data(e1);
+	struct nftnl_expr_immediate *i2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return i1->dreg == i2->dreg &&
+	       nftnl_data_reg_cmp(&i1->data, &i2->data,
+				  nftnl_expr_immediate_reg_type(e1));
+}
+
 struct expr_ops expr_ops_immediate = {
 	.name		= "immediate",
 	.alloc_len	= sizeof(struct nftnl_expr_immediate),
@@ -329,4 +365,6 @@ struct expr_ops expr_ops_immediate = {
 	.snprintf	= nftnl_expr_immediate_snprintf,
 	.xml_parse	= nftnl_expr_immediate_xml_parse,
 	.json_parse	= nftnl_expr_immediate_json_parse,
+	.hash		= nftnl_expr_immediate_hash,
+	.cmp		= nftnl_expr_immediate_cmp,
 };
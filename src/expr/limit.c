@@ -268,6 +268,33 @@ nftnl_expr_limit_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_limit_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_limit *limit = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, limit->rate);
+	hash = nftnl_hash_val(hash, limit->unit);
+	hash = nftnl_hash_val(hash, limit->burst);
+	hash = nftnl_hash_val(hash, limit->type);
+
+	return hash;
+}
+
+static bool nftnl_expr_limit_cmp(const struct nftnl_expr *e1,
+				 const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_limit *l1 = nftnl_expr_data(e1);
+	struct nftnl_expr_limit *l2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return l1->rate == l2->rate &&
+	       l1->unit == l2->unit &&
+	       l1->burst == l2->burst &&
+	       l1->type == l2->type;
+}
+
 struct expr_ops expr_ops_limit = {
 	.name		= "limit",
 	.alloc_len	= sizeof(struct nftnl_expr_limit),
@@ -279,4 +306,6 @@ struct expr_ops expr_ops_limit = {
 	.snprintf	= nftnl_expr_limit_snprintf,
 	.xml_parse	= nftnl_expr_limit_xml_parse,
 	.json_parse	= nftnl_expr_limit_json_parse,
+	.hash		= nftnl_expr_limit_hash,
+	.cmp		= nftnl_expr_limit_cmp,
 };
@@ -332,6 +332,38 @@ static void nftnl_expr_log_free(struct nftnl_expr *e)
 	xfree(log->prefix);
 }
 
+static uint32_t nftnl_expr_log_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_log *log = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, log->snaplen);
+	hash = nftnl_hash_val(hash, log->group);
+	hash = nftnl_hash_val(hash, log->qthreshold);
+	hash = nftnl_hash_val(hash, log->level);
+	hash = nftnl_hash_val(hash, log->flags);
+	hash = nftnl_hash_str(hash, log->prefix);
+
+	return hash;
+}
+
+static bool nftnl_expr_log_cmp(const struct nftnl_expr *e1,
+			       const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_log *l1 = nftnl_expr_data(e1);
+	struct nftnl_expr_log *l2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return l1->snaplen == l2->snaplen &&
+	       l1->group == l2->group &&
+	       l1->qthreshold == l2->qthreshold &&
+	       l1->level == l2->level &&
+	       l1->flags == l2->flags &&
+	       (!(e1->flags & (1 << NFTNL_EXPR_LOG_PREFIX)) ||
+		strcmp(l1->prefix, l2->prefix) == 0);
+}
+
 struct expr_ops expr_ops_log = {
 	.name		= "log",
 	.alloc_len	= sizeof(struct nftnl_expr_log),
@@ -344,4 +376,6 @@ struct expr_ops expr_ops_log = {
 	.snprintf	= nftnl_expr_log_snprintf,
 	.xml_parse	= nftnl_expr_log_xml_parse,
 	.json_parse	= nftnl_expr_log_json_parse,
+	.hash		= nftnl_expr_log_hash,
+	.cmp		= nftnl_expr_log_cmp,
 };
@@ -258,6 +258,34 @@ nftnl_expr_lookup_snprintf(char *buf, size_t size, uint32_t type,
 	return -1;
 }
 
+/* The set ID is only meaningful within one batch, match by set name. */
+static uint32_t nftnl_expr_lookup_hash(const struct nftnl_expr *e,
+				       uint32_t hash)
+{
+	struct nftnl_expr_lookup *lookup = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, lookup->sreg);
+	hash = nftnl_hash_val(hash, lookup->dreg);
+	hash = nftnl_hash_str(hash, lookup->set_name);
+
+	return hash;
+}
+
+static bool nftnl_expr_lookup_cmp(const struct nftnl_expr *e1,
+				  const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_lookup *l1 = nftnl_expr_data(e1);
+	struct nftnl_expr_lookup *l2 = nftnl_expr_data(e2);
+	uint32_t mask = ~(1 << NFTNL_EXPR_LOOKUP_SET_ID);
+
+	if ((e1->flags & mask) != (e2->flags & mask))
+		return false;
+
+	return l1->sreg == l2->sreg &&
+	       l1->dreg == l2->dreg &&
+	       strcmp(l1->set_name, l2->set_name) == 0;
+}
+
 struct expr_ops expr_ops_lookup = {
 	.name		= "lookup",
 	.alloc_len	= sizeof(struct nftnl_expr_lookup),
@@ -269,4 +297,6 @@ struct expr_ops expr_ops_lookup = {
 	.snprintf	= nftnl_expr_lookup_snprintf,
 	.xml_parse	= nftnl_expr_lookup_xml_parse,
 	.json_parse	= nftnl_expr_lookup_json_parse,
+	.hash		= nftnl_expr_lookup_hash,
+	.cmp		= nftnl_expr_lookup_cmp,
 };
@@ -172,6 +172,27 @@ static int nftnl_expr_masq_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_masq_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_masq *masq = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, masq->flags);
+
+	return hash;
+}
+
+static bool nftnl_expr_masq_cmp(const struct nftnl_expr *e1,
+				const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_masq *m1 = nftnl_expr_data(e1);
+	struct nftnl_expr_masq *m2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return m1->flags == m2->flags;
+}
+
 struct expr_ops expr_ops_masq = {
 	.name		= "masq",
 	.alloc_len	= sizeof(struct nftnl_expr_masq),
@@ -183,4 +204,6 @@ struct expr_ops expr_ops_masq = {
 	.snprintf	= nftnl_expr_masq_snprintf,
 	.xml_parse	= nftnl_expr_masq_xml_parse,
 	.json_parse	= nftnl_expr_masq_json_parse,
+	.hash		= nftnl_expr_masq_hash,
+	.cmp		= nftnl_expr_masq_cmp,
 };
@@ -240,6 +240,33 @@ static void nftnl_expr_match_free(struct nftnl_expr *e)
 	xfree(match->data);
 }
 
+static uint32_t nftnl_expr_match_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_match *mt = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, mt->rev);
+	hash = nftnl_hash_val(hash, mt->data_len);
+	hash = nftnl_hash_str(hash, mt->name);
+	hash = nftnl_hash_data(hash, mt->data, mt->data_len);
+
+	return hash;
+}
+
+static bool nftnl_expr_match_cmp(const struct nftnl_expr *e1,
+				 const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_match *m1 = nftnl_expr_data(e1);
+	struct nftnl_expr_match *m2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return m1->rev == m2->rev &&
+	       m1->data_len == m2->data_len &&
+	       strcmp(m1->name, m2->name) == 0 &&
+	       memcmp(m1->data, m2->data, m1->data_len) == 0;
+}
+
 struct expr_ops expr_ops_match = {
 	.name		= "match",
 	.alloc_len	= sizeof(struct nftnl_expr_match),
@@ -252,4 +279,6 @@ struct expr_ops expr_ops_match = {
 	.snprintf	= nftnl_expr_match_snprintf,
 	.xml_parse 	= nftnl_expr_match_xml_parse,
 	.json_parse 	= nftnl_expr_match_json_parse,
+	.hash		= nftnl_expr_match_hash,
+	.cmp		= nftnl_expr_match_cmp,
 };
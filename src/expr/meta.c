@@ -295,6 +295,31 @@ nftnl_expr_meta_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_meta_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_meta *meta = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, meta->key);
+	hash = nftnl_hash_val(hash, meta->dreg);
+	hash = nftnl_hash_val(hash, meta->sreg);
+
+	return hash;
+}
+
+static bool nftnl_expr_meta_cmp(const struct nftnl_expr *e1,
+				const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_meta *m1 = nftnl_expr_data(e1);
+	struct nftnl_expr_meta *m2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return m1->key == m2->key &&
+	       m1->dreg == m2->dreg &&
+	       m1->sreg == m2->sreg;
+}
+
 struct expr_ops expr_ops_meta = {
 	.name		= "meta",
 	.alloc_len	= sizeof(struct nftnl_expr_meta),
@@ -306,4 +331,6 @@ struct expr_ops expr_ops_meta = {
 	.snprintf	= nftnl_expr_meta_snprintf,
 	.xml_parse 	= nftnl_expr_meta_xml_parse,
 	.json_parse 	= nftnl_expr_meta_json_parse,
+	.hash		= nftnl_expr_meta_hash,
+	.cmp		= nftnl_expr_meta_cmp,
 };
@@ -404,6 +404,39 @@ nftnl_expr_nat_snprintf(char *buf, size_t size, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_nat_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_nat *nat = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, nat->sreg_addr_min);
+	hash = nftnl_hash_val(hash, nat->sreg_addr_max);
+	hash = nftnl_hash_val(hash, nat->sreg_proto_min);
+	hash = nftnl_hash_val(hash, nat->sreg_proto_max);
+	hash = nftnl_hash_val(hash, nat->family);
+	hash = nftnl_hash_val(hash, nat->type);
+	hash = nftnl_hash_val(hash, nat->flags);
+
+	return hash;
+}
+
+static bool nftnl_expr_nat_cmp(const struct nftnl_expr *e1,
+			       const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_nat *n1 = nftnl_expr_data(e1);
+	struct nftnl_expr_nat *n2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return n1->sreg_addr_min == n2->sreg_addr_min &&
+	       n1->sreg_addr_max == n2->sreg_addr_max &&
+	       n1->sreg_proto_min == n2->sreg_proto_min &&
+	       n1->sreg_proto_max == n2->sreg_proto_max &&
+	       n1->family == n2->family &&
+	       n1->type == n2->type &&
+	       n1->flags == n2->flags;
+}
+
 struct expr_ops expr_ops_nat = {
 	.name		= "nat",
 	.alloc_len	= sizeof(struct nftnl_expr_nat),
@@ -415,4 +448,6 @@ struct expr_ops expr_ops_nat = {
 	.snprintf	= nftnl_expr_nat_snprintf,
 	.xml_parse	= nftnl_expr_nat_xml_parse,
 	.json_parse	= nftnl_expr_nat_json_parse,
+	.hash		= nftnl_expr_nat_hash,
+	.cmp		= nftnl_expr_nat_cmp,
 };
@@ -285,6 +285,34 @@ nftnl_expr_payload_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_payload_hash(const struct nftnl_expr *e,
+					uint32_t hash)
+{
+	struct nftnl_expr_payload *payload = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, payload->dreg);
+	hash = nftnl_hash_val(hash, payload->base);
+	hash = nftnl_hash_val(hash, payload->offset);
+	hash = nftnl_hash_val(hash, payload->len);
+
+	return hash;
+}
+
+static bool nftnl_expr_payload_cmp(const struct nftnl_expr *e1,
+				   const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_payload *p1 = nftnl_expr_data(e1);
+	struct nftnl_expr_payload *p2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return p1->dreg == p2->dreg &&
+	       p1->base == p2->base &&
+	       p1->offset == p2->offset &&
+	       p1->len == p2->len;
+}
+
 struct expr_ops expr_ops_payload = {
 	.name		= "payload",
 	.alloc_len	= sizeof(struct nftnl_expr_payload),
@@ -296,4 +324,6 @@ struct expr_ops expr_ops_payload = {
 	.snprintf	= nftnl_expr_payload_snprintf,
 	.xml_parse	= nftnl_expr_payload_xml_parse,
 	.json_parse	= nftnl_expr_payload_json_parse,
+	.hash		= nftnl_expr_payload_hash,
+	.cmp		= nftnl_expr_payload_cmp,
 };
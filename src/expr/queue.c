@@ -243,6 +243,31 @@ nftnl_expr_queue_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_queue_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_queue *queue = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, queue->queuenum);
+	hash = nftnl_hash_val(hash, queue->queues_total);
+	hash = nftnl_hash_val(hash, queue->flags);
+
+	return hash;
+}
+
+static bool nftnl_expr_queue_cmp(const struct nftnl_expr *e1,
+				 const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_queue *q1 = nftnl_expr_data(e1);
+	struct nftnl_expr_queue *q2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return q1->queuenum == q2->queuenum &&
+	       q1->queues_total == q2->queues_total &&
+	       q1->flags == q2->flags;
+}
+
 struct expr_ops expr_ops_queue = {
 	.name		= "queue",
 	.alloc_len	= sizeof(struct nftnl_expr_queue),
@@ -254,4 +279,6 @@ struct expr_ops expr_ops_queue = {
 	.snprintf	= nftnl_expr_queue_snprintf,
 	.xml_parse	= nftnl_expr_queue_xml_parse,
 	.json_parse	= nftnl_expr_queue_json_parse,
+	.hash		= nftnl_expr_queue_hash,
+	.cmp		= nftnl_expr_queue_cmp,
 };
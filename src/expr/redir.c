@@ -242,6 +242,31 @@ nftnl_expr_redir_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_redir_hash(const struct nftnl_expr *e, uint32_t hash)
+{
+	struct nftnl_expr_redir *redir = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, redir->sreg_proto_min);
+	hash = nftnl_hash_val(hash, redir->sreg_proto_max);
+	hash = nftnl_hash_val(hash, redir->flags);
+
+	return hash;
+}
+
+static bool nftnl_expr_redir_cmp(const struct nftnl_expr *e1,
+				 const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_redir *r1 = nftnl_expr_data(e1);
+	struct nftnl_expr_redir *r2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return r1->sreg_proto_min == r2->sreg_proto_min &&
+	       r1->sreg_proto_max == r2->sreg_proto_max &&
+	       r1->flags == r2->flags;
+}
+
 struct expr_ops expr_ops_redir = {
 	.name		= "redir",
 	.alloc_len	= sizeof(struct nftnl_expr_redir),
@@ -253,4 +278,6 @@ struct expr_ops expr_ops_redir = {
 	.snprintf	= nftnl_expr_redir_snprintf,
 	.xml_parse	= nftnl_expr_redir_xml_parse,
 	.json_parse	= nftnl_expr_redir_json_parse,
+	.hash		= nftnl_expr_redir_hash,
+	.cmp		= nftnl_expr_redir_cmp,
 };
@@ -199,6 +199,30 @@ nftnl_expr_reject_snprintf(char *buf, size_t len, uint32_t type,
 	return -1;
 }
 
+static uint32_t nftnl_expr_reject_hash(const struct nftnl_expr *e,
+				       uint32_t hash)
+{
+	struct nftnl_expr_reject *reject = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, reject->type);
+	hash = nftnl_hash_val(hash, reject->icmp_code);
+
+	return hash;
+}
+
+static bool nftnl_expr_reject_cmp(const struct nftnl_expr *e1,
+				  const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_reject *r1 = nftnl_expr_data(e1);
+	struct nftnl_expr_reject *r2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return r1->type == r2->type &&
+	       r1->icmp_code == r2->icmp_code;
+}
+
 struct expr_ops expr_ops_reject = {
 	.name		= "reject",
 	.alloc_len	= sizeof(struct nftnl_expr_reject),
@@ -210,4 +234,6 @@ struct expr_ops expr_ops_reject = {
 	.snprintf	= nftnl_expr_reject_snprintf,
 	.xml_parse	= nftnl_expr_reject_xml_parse,
 	.json_parse	= nftnl_expr_reject_json_parse,
+	.hash		= nftnl_expr_reject_hash,
+	.cmp		= nftnl_expr_reject_cmp,
 };
@@ -241,6 +241,34 @@ static void nftnl_expr_target_free(struct nftnl_expr *e)
 	xfree(target->data);
 }
 
+static uint32_t nftnl_expr_target_hash(const struct nftnl_expr *e,
+				       uint32_t hash)
+{
+	struct nftnl_expr_target *tg = nftnl_expr_data(e);
+
+	hash = nftnl_hash_val(hash, tg->rev);
+	hash = nftnl_hash_val(hash, tg->data_len);
+	hash = nftnl_hash_str(hash, tg->name);
+	hash = nftnl_hash_data(hash, tg->data, tg->data_len);
+
+	return hash;
+}
+
+static bool nftnl_expr_target_cmp(const struct nftnl_expr *e1,
+				  const struct nftnl_expr *e2)
+{
+	struct nftnl_expr_target *t1 = nftnl_expr_data(e1);
+	struct nftnl_expr_target *t2 = nftnl_expr_data(e2);
+
+	if (e1->flags != e2->flags)
+		return false;
+
+	return t1->rev == t2->rev &&
+	       t1->data_len == t2->data_len &&
+	       strcmp(t1->name, t2->name) == 0 &&
+	       memcmp(t1->data, t2->data, t1->data_len) == 0;
+}
+
 struct expr_ops expr_ops_target = {
 	.name		= "target",
 	.alloc_len	= sizeof(struct nftnl_expr_target),
@@ -253,4 +281,6 @@ struct expr_ops expr_ops_target = {
 	.snprintf	= nftnl_expr_target_snprintf,
 	.xml_parse	= nftnl_expr_target_xml_parse,
 	.json_parse	= nftnl_expr_target_json_parse,
+	.hash		= nftnl_expr_target_hash,
+	.cmp		= nftnl_expr_target_cmp,
 };
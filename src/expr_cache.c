@@ -0,0 +1,247 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <libnftnl/expr.h>
+
+/*
+ * Per expression type object caches. Objects of one type always have the
+ * same size, so released expressions are kept on a freelist and handed out
+ * again by the next nftnl_expr_alloc() of that type.
+ *
+ * Each thread has a small private freelist per type that needs no locking.
+ * When it runs empty, a batch is refilled from the shared per type freelist;
+ * when it grows too long, half of it is moved there. Objects left in the
+ * private freelist of an exiting thread are not reclaimed, which bounds the
+ * loss to NFTNL_EXPR_CACHE_LOCAL objects per type and thread. The worker
+ * threads of the library hand them over with nftnl_expr_cache_thread_exit().
+ *
+ * The shared freelists and the binding of types to slots are protected by
+ * one mutex. It is only taken to move a batch, so it is rarely contended.
+ */
+#define NFTNL_EXPR_CACHE_TYPES	64
+#define NFTNL_EXPR_CACHE_LOCAL	64
+#define NFTNL_EXPR_CACHE_BATCH	(NFTNL_EXPR_CACHE_LOCAL / 2)
+#define NFTNL_EXPR_CACHE_SHARED	4096
+
+/* the list_head of a cached expression is reused as freelist link */
+struct expr_cache_list {
+	struct list_head	*first;
+	uint32_t		count;
+};
+
+/*
+ * Objects in the caches of all threads are those released and not handed
+ * out again or dropped: free - hit - drop.
+ */
+struct expr_cache {
+	struct expr_ops		*ops;
+	struct expr_cache_list	shared;
+	uint64_t		alloc;
+	uint64_t		free;
+	uint64_t		hit;
+	uint64_t		drop;
+};
+
+static struct expr_cache expr_cache[NFTNL_EXPR_CACHE_TYPES];
+static uint32_t expr_cache_types;
+static pthread_mutex_t expr_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct expr_cache_list expr_cache_local[NFTNL_EXPR_CACHE_TYPES];
+
+static struct nftnl_expr *expr_cache_pop(struct expr_cache_list *l)
+{
+	struct list_head *h = l->first;
+
+	l->first = h->next;
+	/* the count of a shared freelist is peeked at without the lock */
+	__atomic_store_n(&l->count, l->count - 1, __ATOMIC_RELAXED);
+
+	return list_entry(h, struct nftnl_expr, head);
+}
+
+static void expr_cache_push(struct expr_cache_list *l, struct nftnl_expr *e)
+{
+	e->head.next = l->first;
+	l->first = &e->head;
+	__atomic_store_n(&l->count, l->count + 1, __ATOMIC_RELAXED);
+}
+
+/* move or free the objects of @l until @keep are left in it */
+static void expr_cache_drain(struct expr_cache *c, struct expr_cache_list *l,
+			     uint32_t keep)
+{
+	struct nftnl_expr *e;
+
+	while (l->count > keep) {
+		e = expr_cache_pop(l);
+		if (c->shared.count < NFTNL_EXPR_CACHE_SHARED) {
+			expr_cache_push(&c->shared, e);
+		} else {
+			__sync_fetch_and_add(&c->drop, 1);
+			xfree(e);
+		}
+	}
+}
+
+/* Bind @ops to a cache slot, or return NULL if all of them are in use. */
+static struct expr_cache *expr_cache_get(struct expr_ops *ops)
+{
+	uint32_t id = __atomic_load_n(&ops->cache_id, __ATOMIC_ACQUIRE);
+
+	if (id == 0) {
+		pthread_mutex_lock(&expr_cache_lock);
+		id = ops->cache_id;
+		if (id == 0) {
+			if (expr_cache_types < NFTNL_EXPR_CACHE_TYPES) {
+				id = ++expr_cache_types;
+				expr_cache[id - 1].ops = ops;
+			} else {
+				id = UINT32_MAX;
+			}
+			__atomic_store_n(&ops->cache_id, id, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&expr_cache_lock);
+	}
+
+	if (id > NFTNL_EXPR_CACHE_TYPES)
+		return NULL;
+
+	return &expr_cache[id - 1];
+}
+
+struct nftnl_expr *nftnl_expr_cache_alloc(struct expr_ops *ops)
+{
+	size_t size = sizeof(struct nftnl_expr) + ops->alloc_len;
+	struct expr_cache_list *local;
+	struct expr_cache *c;
+	struct nftnl_expr *e;
+
+	c = expr_cache_get(ops);
+	if (c == NULL)
+		return calloc(1, size);
+
+	__sync_fetch_and_add(&c->alloc, 1);
+
+	local = &expr_cache_local[c - expr_cache];
+	if (local->count == 0 &&
+	    __atomic_load_n(&c->shared.count, __ATOMIC_RELAXED) > 0) {
+		pthread_mutex_lock(&expr_cache_lock);
+		while (c->shared.count > 0 &&
+		       local->count < NFTNL_EXPR_CACHE_BATCH)
+			expr_cache_push(local, expr_cache_pop(&c->shared));
+		pthread_mutex_unlock(&expr_cache_lock);
+	}
+
+	if (local->count == 0)
+		return calloc(1, size);
+
+	__sync_fetch_and_add(&c->hit, 1);
+	e = expr_cache_pop(local);
+	memset(e, 0, size);
+
+	return e;
+}
+
+void nftnl_expr_cache_free(struct nftnl_expr *e)
+{
+	uint32_t id = __atomic_load_n(&e->ops->cache_id, __ATOMIC_ACQUIRE);
+	struct expr_cache_list *local;
+	struct expr_cache *c;
+
+	if (id == 0 || id > NFTNL_EXPR_CACHE_TYPES) {
+		xfree(e);
+		return;
+	}
+
+	c = &expr_cache[id - 1];
+	__sync_fetch_and_add(&c->free, 1);
+
+	local = &expr_cache_local[id - 1];
+	expr_cache_push(local, e);
+	if (local->count <= NFTNL_EXPR_CACHE_LOCAL)
+		return;
+
+	pthread_mutex_lock(&expr_cache_lock);
+	expr_cache_drain(c, local, NFTNL_EXPR_CACHE_BATCH);
+	pthread_mutex_unlock(&expr_cache_lock);
+}
+
+void nftnl_expr_cache_thread_exit(void)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&expr_cache_lock);
+	for (i = 0; i < NFTNL_EXPR_CACHE_TYPES; i++)
+		expr_cache_drain(&expr_cache[i], &expr_cache_local[i], 0);
+	pthread_mutex_unlock(&expr_cache_lock);
+}
+
+static void expr_cache_list_flush(struct expr_cache *c,
+				  struct expr_cache_list *l)
+{
+	while (l->count > 0) {
+		__sync_fetch_and_add(&c->drop, 1);
+		xfree(expr_cache_pop(l));
+	}
+}
+
+void nftnl_expr_cache_flush(void)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&expr_cache_lock);
+	for (i = 0; i < NFTNL_EXPR_CACHE_TYPES; i++) {
+		expr_cache_list_flush(&expr_cache[i], &expr_cache_local[i]);
+		expr_cache_list_flush(&expr_cache[i], &expr_cache[i].shared);
+	}
+	pthread_mutex_unlock(&expr_cache_lock);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_expr_cache_flush);
+
+int nftnl_expr_cache_stats(const char *name,
+			   struct nftnl_expr_cache_stats *stats)
+{
+	struct expr_ops *ops = NULL;
+	uint32_t i;
+
+	if (name != NULL) {
+		ops = nftnl_expr_ops_lookup(name);
+		if (ops == NULL) {
+			errno = ENOENT;
+			return -1;
+		}
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	pthread_mutex_lock(&expr_cache_lock);
+	for (i = 0; i < expr_cache_types; i++) {
+		struct expr_cache *c = &expr_cache[i];
+		uint64_t free, hit, drop;
+
+		if (ops != NULL && c->ops != ops)
+			continue;
+
+		/* an object is freed before it is handed out or dropped */
+		hit = __atomic_load_n(&c->hit, __ATOMIC_ACQUIRE);
+		drop = __atomic_load_n(&c->drop, __ATOMIC_ACQUIRE);
+		free = __atomic_load_n(&c->free, __ATOMIC_ACQUIRE);
+		stats->alloc += __atomic_load_n(&c->alloc, __ATOMIC_RELAXED);
+		stats->free += free;
+		stats->hit += hit;
+		stats->cached += free - hit - drop;
+	}
+	pthread_mutex_unlock(&expr_cache_lock);
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_expr_cache_stats);
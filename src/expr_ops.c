@@ -1,8 +1,12 @@
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <linux_list.h>
 
 #include "expr_ops.h"
 
+#include <libnftnl/expr.h>
+
 /* Unfortunately, __attribute__((constructor)) breaks library static linking */
 extern struct expr_ops expr_ops_bitwise;
 extern struct expr_ops expr_ops_byteorder;
@@ -26,40 +30,118 @@ extern struct expr_ops expr_ops_queue;
 extern struct expr_ops expr_ops_target;
 extern struct expr_ops expr_ops_dynset;
 
-static struct expr_ops *expr_ops[] = {
-	&expr_ops_bitwise,
-	&expr_ops_byteorder,
-	&expr_ops_cmp,
-	&expr_ops_counter,
-	&expr_ops_ct,
-	&expr_ops_dup,
-	&expr_ops_exthdr,
-	&expr_ops_immediate,
-	&expr_ops_limit,
-	&expr_ops_log,
-	&expr_ops_lookup,
-	&expr_ops_masq,
-	&expr_ops_match,
-	&expr_ops_meta,
-	&expr_ops_nat,
-	&expr_ops_payload,
-	&expr_ops_redir,
-	&expr_ops_reject,
-	&expr_ops_queue,
-	&expr_ops_target,
-	&expr_ops_dynset,
-	NULL,
+/*
+ * Built-in expressions, dispatched on the first character of the name so
+ * that a lookup costs at most a couple of string comparisons.
+ */
+#define EXPR_OPS_SLOT(c)	((c) - 'a')
+
+static struct expr_ops **expr_ops[EXPR_OPS_SLOT('z') + 1] = {
+	[EXPR_OPS_SLOT('b')] = (struct expr_ops *[]) {
+		&expr_ops_bitwise, &expr_ops_byteorder, NULL,
+	},
+	[EXPR_OPS_SLOT('c')] = (struct expr_ops *[]) {
+		&expr_ops_cmp, &expr_ops_counter, &expr_ops_ct, NULL,
+	},
+	[EXPR_OPS_SLOT('d')] = (struct expr_ops *[]) {
+		&expr_ops_dup, &expr_ops_dynset, NULL,
+	},
+	[EXPR_OPS_SLOT('e')] = (struct expr_ops *[]) {
+		&expr_ops_exthdr, NULL,
+	},
+	[EXPR_OPS_SLOT('i')] = (struct expr_ops *[]) {
+		&expr_ops_immediate, NULL,
+	},
+	[EXPR_OPS_SLOT('l')] = (struct expr_ops *[]) {
+		&expr_ops_limit, &expr_ops_log, &expr_ops_lookup, NULL,
+	},
+	[EXPR_OPS_SLOT('m')] = (struct expr_ops *[]) {
+		&expr_ops_masq, &expr_ops_match, &expr_ops_meta, NULL,
+	},
+	[EXPR_OPS_SLOT('n')] = (struct expr_ops *[]) {
+		&expr_ops_nat, NULL,
+	},
+	[EXPR_OPS_SLOT('p')] = (struct expr_ops *[]) {
+		&expr_ops_payload, NULL,
+	},
+	[EXPR_OPS_SLOT('q')] = (struct expr_ops *[]) {
+		&expr_ops_queue, NULL,
+	},
+	[EXPR_OPS_SLOT('r')] = (struct expr_ops *[]) {
+		&expr_ops_redir, &expr_ops_reject, NULL,
+	},
+	[EXPR_OPS_SLOT('t')] = (struct expr_ops *[]) {
+		&expr_ops_target, NULL,
+	},
 };
 
+/* Expressions registered at runtime through nftnl_expr_ops_register() */
+struct expr_ops_ext {
+	struct list_head	head;
+	struct expr_ops		ops;
+};
+
+static LIST_HEAD(expr_ops_ext_list);
+
 struct expr_ops *nftnl_expr_ops_lookup(const char *name)
 {
-	int i = 0;
+	struct expr_ops_ext *ext;
+	struct expr_ops **ops;
 
-	while (expr_ops[i] != NULL) {
-		if (strcmp(expr_ops[i]->name, name) == 0)
-			return expr_ops[i];
+	if (name[0] >= 'a' && name[0] <= 'z') {
+		ops = expr_ops[EXPR_OPS_SLOT(name[0])];
+		while (ops != NULL && *ops != NULL) {
+			if (strcmp((*ops)->name + 1, name + 1) == 0)
+				return *ops;
+			ops++;
+		}
+	}
 
-		i++;
+	list_for_each_entry(ext, &expr_ops_ext_list, head) {
+		if (strcmp(ext->ops.name, name) == 0)
+			return &ext->ops;
 	}
 	return NULL;
 }
+
+int nftnl_expr_ops_register(const struct nftnl_expr_ops *ops)
+{
+	struct expr_ops_ext *ext;
+
+	if (ops->name == NULL || ops->set == NULL || ops->get == NULL ||
+	    ops->parse == NULL || ops->build == NULL ||
+	    ops->snprintf == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (nftnl_expr_ops_lookup(ops->name) != NULL) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	ext = calloc(1, sizeof(struct expr_ops_ext));
+	if (ext == NULL)
+		return -1;
+
+	ext->ops.name = strdup(ops->name);
+	if (ext->ops.name == NULL) {
+		xfree(ext);
+		return -1;
+	}
+	ext->ops.alloc_len	= ops->alloc_len;
+	ext->ops.max_attr	= ops->max_attr;
+	ext->ops.free		= ops->free;
+	ext->ops.set		= ops->set;
+	ext->ops.get		= ops->get;
+	ext->ops.parse		= ops->parse;
+	ext->ops.build		= ops->build;
+	ext->ops.snprintf	= ops->snprintf;
+	ext->ops.hash		= ops->hash;
+	ext->ops.cmp		= ops->cmp;
+
+	list_add_tail(&ext->head, &expr_ops_ext_list);
+
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_expr_ops_register);
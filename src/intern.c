@@ -0,0 +1,182 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * A dump names the same few tables, chains and sets in every rule, set and
+ * element, so names are kept once in a global hash table of refcounted
+ * strings. Objects are parsed from several threads by
+ * nftnl_ruleset_parse_file_cb_threads(), and these mostly look up the same
+ * names, so finding a name only takes the read lock and references are
+ * counted atomically. The write lock is only held to add a name, and to
+ * remove one once its last reference is gone. A name whose count dropped
+ * to zero is never referenced again: lookups skip it, and it is removed by
+ * the thread that released it.
+ */
+#define NFTNL_INTERN_SIZE_MIN	256
+
+struct nftnl_intern_str {
+	struct hlist_node	hnode;
+	uint32_t		hash;
+	uint32_t		refcnt;
+	char			str[];
+};
+
+static struct {
+	pthread_rwlock_t	lock;
+	struct hlist_head	*hash;
+	uint32_t		size;
+	uint32_t		count;
+} pool = {
+	.lock	= PTHREAD_RWLOCK_INITIALIZER,
+};
+
+static struct nftnl_intern_str *nftnl_intern_entry(const char *str)
+{
+	return (struct nftnl_intern_str *)
+		(str - offsetof(struct nftnl_intern_str, str));
+}
+
+static int nftnl_intern_grow(void)
+{
+	struct hlist_head *hash, *old = pool.hash;
+	uint32_t i, size, old_size = pool.size;
+	struct nftnl_intern_str *s;
+	struct hlist_node *pos, *tmp;
+
+	size = old_size ? old_size * 2 : NFTNL_INTERN_SIZE_MIN;
+	hash = calloc(size, sizeof(struct hlist_head));
+	if (hash == NULL)
+		return -1;
+
+	for (i = 0; i < old_size; i++) {
+		hlist_for_each_entry_safe(s, pos, tmp, &old[i], hnode) {
+			hlist_del(&s->hnode);
+			hlist_add_head(&s->hnode, &hash[s->hash & (size - 1)]);
+		}
+	}
+	xfree(old);
+	pool.hash = hash;
+	pool.size = size;
+
+	return 0;
+}
+
+/* take a reference, unless the last one was already released */
+static bool nftnl_intern_ref(struct nftnl_intern_str *s)
+{
+	uint32_t refcnt = __atomic_load_n(&s->refcnt, __ATOMIC_RELAXED), old;
+
+	while (refcnt > 0) {
+		old = __sync_val_compare_and_swap(&s->refcnt, refcnt,
+						  refcnt + 1);
+		if (old == refcnt)
+			return true;
+		refcnt = old;
+	}
+	return false;
+}
+
+/* called with the lock held, for reading or writing */
+static struct nftnl_intern_str *nftnl_intern_find(const char *str,
+						  uint32_t hash)
+{
+	struct nftnl_intern_str *s;
+	struct hlist_node *pos;
+
+	if (pool.size == 0)
+		return NULL;
+
+	hlist_for_each_entry(s, pos, &pool.hash[hash & (pool.size - 1)],
+			     hnode) {
+		if (s->hash == hash && strcmp(s->str, str) == 0 &&
+		    nftnl_intern_ref(s))
+			return s;
+	}
+	return NULL;
+}
+
+const char *nftnl_intern(const char *str)
+{
+	struct nftnl_intern_str *s;
+	uint32_t hash;
+	size_t len;
+
+	len = strlen(str);
+	hash = nftnl_hash_data(NFTNL_HASH_INIT, str, len);
+
+	pthread_rwlock_rdlock(&pool.lock);
+	s = nftnl_intern_find(str, hash);
+	pthread_rwlock_unlock(&pool.lock);
+	if (s != NULL)
+		return s->str;
+
+	/* another thread may have added it since */
+	pthread_rwlock_wrlock(&pool.lock);
+	s = nftnl_intern_find(str, hash);
+	if (s != NULL)
+		goto out;
+
+	/* a full table still works, only with longer chains */
+	if (pool.count >= pool.size && nftnl_intern_grow() < 0 &&
+	    pool.size == 0) {
+		s = NULL;
+		goto out;
+	}
+
+	s = malloc(sizeof(struct nftnl_intern_str) + len + 1);
+	if (s == NULL)
+		goto out;
+
+	memcpy(s->str, str, len + 1);
+	s->hash = hash;
+	s->refcnt = 1;
+	hlist_add_head(&s->hnode, &pool.hash[hash & (pool.size - 1)]);
+	pool.count++;
+out:
+	pthread_rwlock_unlock(&pool.lock);
+
+	return s != NULL ? s->str : NULL;
+}
+
+const char *nftnl_intern_get(const char *str)
+{
+	struct nftnl_intern_str *s;
+
+	if (str == NULL)
+		return NULL;
+
+	/* the caller holds a reference, the count cannot be zero */
+	s = nftnl_intern_entry(str);
+	__sync_fetch_and_add(&s->refcnt, 1);
+
+	return str;
+}
+
+void nftnl_intern_put(const char *str)
+{
+	struct nftnl_intern_str *s;
+
+	if (str == NULL)
+		return;
+
+	s = nftnl_intern_entry(str);
+	if (__sync_sub_and_fetch(&s->refcnt, 1) > 0)
+		return;
+
+	pthread_rwlock_wrlock(&pool.lock);
+	hlist_del(&s->hnode);
+	pool.count--;
+	pthread_rwlock_unlock(&pool.lock);
+	xfree(s);
+}
@@ -205,6 +205,13 @@ struct nftnl_expr *nftnl_jansson_expr_parse(json_t *root,
 		return NULL;
 	}
 
+	if (e->ops->json_parse == NULL) {
+		err->node_name = "type";
+		err->error = NFTNL_PARSE_EOPNOTSUPP;
+		nftnl_expr_free(e);
+		return NULL;
+	}
+
 	ret = e->ops->json_parse(e, root, err);
 
 	if (set_list != NULL &&
@@ -0,0 +1,476 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef JSON_PARSING
+
+/*
+ * Incremental JSON reader: the input is consumed a chunk at a time and the
+ * caller walks the outer structure token by token, only the values it asks
+ * for are built as jansson trees. Lines and columns count from 1, as in
+ * jansson error reports.
+ */
+#define NFTNL_JSON_STREAM_CHUNK	65536
+#define NFTNL_JSON_STREAM_DEPTH	2048
+
+static int nftnl_json_stream_error(struct nftnl_json_stream *js)
+{
+	js->err->error = NFTNL_PARSE_EBADINPUT;
+	js->err->line = js->line;
+	js->err->column = js->column;
+	js->err->node_name = NULL;
+	errno = EINVAL;
+	return -1;
+}
+
+static bool nftnl_json_stream_fill(struct nftnl_json_stream *js)
+{
+	if (js->off < js->len)
+		return true;
+	if (js->fp == NULL)
+		return false;
+
+	js->len = fread(js->buf, 1, NFTNL_JSON_STREAM_CHUNK, js->fp);
+	js->off = 0;
+	return js->len > 0;
+}
+
+static int nftnl_json_stream_getc(struct nftnl_json_stream *js)
+{
+	int c;
+
+	if (!nftnl_json_stream_fill(js))
+		return EOF;
+
+	c = (unsigned char)js->data[js->off++];
+	if (c == '\n') {
+		js->line++;
+		js->column = 0;
+	} else {
+		js->column++;
+	}
+	return c;
+}
+
+int nftnl_json_stream_init(struct nftnl_json_stream *js, const void *data,
+			   enum nftnl_parse_input input,
+			   struct nftnl_parse_err *err)
+{
+	memset(js, 0, sizeof(*js));
+	js->line = 1;
+	js->err = err;
+
+	switch (input) {
+	case NFTNL_PARSE_BUFFER:
+		js->data = data;
+		js->len = strlen(data);
+		break;
+	case NFTNL_PARSE_FILE:
+		js->fp = (FILE *)data;
+		js->buf = malloc(NFTNL_JSON_STREAM_CHUNK);
+		if (js->buf == NULL)
+			return -1;
+		js->data = js->buf;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+void nftnl_json_stream_fini(struct nftnl_json_stream *js)
+{
+	xfree(js->buf);
+	xfree(js->str);
+}
+
+int nftnl_json_stream_peek(struct nftnl_json_stream *js)
+{
+	int c;
+
+	while (nftnl_json_stream_fill(js)) {
+		c = (unsigned char)js->data[js->off];
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+			return c;
+		nftnl_json_stream_getc(js);
+	}
+	return EOF;
+}
+
+int nftnl_json_stream_expect(struct nftnl_json_stream *js, int c)
+{
+	if (nftnl_json_stream_peek(js) != c)
+		return nftnl_json_stream_error(js);
+
+	nftnl_json_stream_getc(js);
+	return 0;
+}
+
+int nftnl_json_stream_next(struct nftnl_json_stream *js, int close)
+{
+	int c = nftnl_json_stream_peek(js);
+
+	if (c != ',' && c != close)
+		return nftnl_json_stream_error(js);
+
+	nftnl_json_stream_getc(js);
+	return c == ',';
+}
+
+int nftnl_json_stream_end(struct nftnl_json_stream *js)
+{
+	if (nftnl_json_stream_peek(js) != EOF)
+		return nftnl_json_stream_error(js);
+
+	return 0;
+}
+
+static int nftnl_json_stream_putc(struct nftnl_json_stream *js, int c)
+{
+	char *str;
+
+	if (js->str_len + 1 >= js->str_size) {
+		str = realloc(js->str, js->str_size ? js->str_size * 2 : 256);
+		if (str == NULL)
+			return -1;
+		js->str = str;
+		js->str_size = js->str_size ? js->str_size * 2 : 256;
+	}
+	js->str[js->str_len++] = c;
+	js->str[js->str_len] = '\0';
+	return 0;
+}
+
+static int nftnl_json_stream_hex4(struct nftnl_json_stream *js)
+{
+	int i, c, val = 0;
+
+	for (i = 0; i < 4; i++) {
+		c = nftnl_json_stream_getc(js);
+		if (c >= '0' && c <= '9')
+			val = val << 4 | (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			val = val << 4 | (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			val = val << 4 | (c - 'A' + 10);
+		else
+			return -1;
+	}
+	return val;
+}
+
+static int nftnl_json_stream_utf8(struct nftnl_json_stream *js, int32_t cp)
+{
+	int ret;
+
+	if (cp < 0x80)
+		return nftnl_json_stream_putc(js, cp);
+	if (cp < 0x800) {
+		ret = nftnl_json_stream_putc(js, 0xc0 | cp >> 6);
+	} else if (cp < 0x10000) {
+		ret = nftnl_json_stream_putc(js, 0xe0 | cp >> 12);
+		ret |= nftnl_json_stream_putc(js, 0x80 | (cp >> 6 & 0x3f));
+	} else {
+		ret = nftnl_json_stream_putc(js, 0xf0 | cp >> 18);
+		ret |= nftnl_json_stream_putc(js, 0x80 | (cp >> 12 & 0x3f));
+		ret |= nftnl_json_stream_putc(js, 0x80 | (cp >> 6 & 0x3f));
+	}
+	return ret | nftnl_json_stream_putc(js, 0x80 | (cp & 0x3f));
+}
+
+static int nftnl_json_stream_escape(struct nftnl_json_stream *js)
+{
+	int32_t cp, low;
+	int c;
+
+	c = nftnl_json_stream_getc(js);
+	switch (c) {
+	case '"':
+	case '\\':
+	case '/':
+		return nftnl_json_stream_putc(js, c);
+	case 'b':
+		return nftnl_json_stream_putc(js, '\b');
+	case 'f':
+		return nftnl_json_stream_putc(js, '\f');
+	case 'n':
+		return nftnl_json_stream_putc(js, '\n');
+	case 'r':
+		return nftnl_json_stream_putc(js, '\r');
+	case 't':
+		return nftnl_json_stream_putc(js, '\t');
+	case 'u':
+		break;
+	default:
+		return -1;
+	}
+
+	cp = nftnl_json_stream_hex4(js);
+	if (cp <= 0 || (cp >= 0xdc00 && cp <= 0xdfff))
+		return -1;
+	if (cp >= 0xd800 && cp <= 0xdbff) {
+		if (nftnl_json_stream_getc(js) != '\\' ||
+		    nftnl_json_stream_getc(js) != 'u')
+			return -1;
+		low = nftnl_json_stream_hex4(js);
+		if (low < 0xdc00 || low > 0xdfff)
+			return -1;
+		cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+	}
+	return nftnl_json_stream_utf8(js, cp);
+}
+
+/* the string is left in js->str, until the next one is read */
+static int nftnl_json_stream_string(struct nftnl_json_stream *js)
+{
+	int c;
+
+	if (nftnl_json_stream_expect(js, '"') < 0)
+		return -1;
+
+	js->str_len = 0;
+	if (js->str == NULL && nftnl_json_stream_putc(js, '\0') < 0)
+		return -1;
+	js->str_len = 0;
+	js->str[0] = '\0';
+
+	while ((c = nftnl_json_stream_getc(js)) != '"') {
+		if (c == EOF || c < 0x20)
+			return nftnl_json_stream_error(js);
+		if (c == '\\') {
+			if (nftnl_json_stream_escape(js) < 0)
+				return nftnl_json_stream_error(js);
+			continue;
+		}
+		if (nftnl_json_stream_putc(js, c) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+const char *nftnl_json_stream_key(struct nftnl_json_stream *js)
+{
+	if (nftnl_json_stream_string(js) < 0 ||
+	    nftnl_json_stream_expect(js, ':') < 0)
+		return NULL;
+
+	return js->str;
+}
+
+static bool nftnl_json_stream_digits(const char **p)
+{
+	const char *start = *p;
+
+	while (**p >= '0' && **p <= '9')
+		(*p)++;
+	return *p > start;
+}
+
+/* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static bool nftnl_json_stream_valid_number(const char *p)
+{
+	if (*p == '-')
+		p++;
+	if (*p == '0')
+		p++;
+	else if (!nftnl_json_stream_digits(&p))
+		return false;
+
+	if (*p == '.') {
+		p++;
+		if (!nftnl_json_stream_digits(&p))
+			return false;
+	}
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		if (*p == '+' || *p == '-')
+			p++;
+		if (!nftnl_json_stream_digits(&p))
+			return false;
+	}
+	return *p == '\0';
+}
+
+static json_t *nftnl_json_stream_number(struct nftnl_json_stream *js)
+{
+	bool real = false;
+	json_int_t val;
+	uint32_t len = 0;
+	char num[64];
+	double d;
+	int c;
+
+	for (;;) {
+		c = nftnl_json_stream_fill(js) ?
+		    (unsigned char)js->data[js->off] : EOF;
+		if (c == '.' || c == 'e' || c == 'E')
+			real = true;
+		else if (!(c >= '0' && c <= '9') && c != '-' && c != '+')
+			break;
+		if (len + 1 >= sizeof(num))
+			goto err;
+		num[len++] = nftnl_json_stream_getc(js);
+	}
+	num[len] = '\0';
+
+	if (!nftnl_json_stream_valid_number(num))
+		goto err;
+
+	errno = 0;
+	if (real) {
+		d = strtod(num, NULL);
+		if (errno == ERANGE)
+			goto err;
+		return json_real(d);
+	}
+
+	val = strtoll(num, NULL, 10);
+	if (errno == ERANGE)
+		goto err;
+	return json_integer(val);
+err:
+	nftnl_json_stream_error(js);
+	return NULL;
+}
+
+static json_t *nftnl_json_stream_literal(struct nftnl_json_stream *js,
+					 const char *word, json_t *val)
+{
+	for (; *word != '\0'; word++) {
+		if (nftnl_json_stream_getc(js) != *word) {
+			json_decref(val);
+			nftnl_json_stream_error(js);
+			return NULL;
+		}
+	}
+	return val;
+}
+
+static json_t *nftnl_json_stream_parse(struct nftnl_json_stream *js,
+				       int depth);
+
+static json_t *nftnl_json_stream_object(struct nftnl_json_stream *js,
+					int depth)
+{
+	json_t *obj, *val;
+	char *key;
+	int ret;
+
+	nftnl_json_stream_getc(js);
+	obj = json_object();
+	if (obj == NULL)
+		return NULL;
+
+	if (nftnl_json_stream_peek(js) == '}') {
+		nftnl_json_stream_getc(js);
+		return obj;
+	}
+
+	do {
+		if (nftnl_json_stream_key(js) == NULL)
+			goto err;
+		key = strdup(js->str);
+		if (key == NULL)
+			goto err;
+
+		val = nftnl_json_stream_parse(js, depth + 1);
+		if (val == NULL) {
+			xfree(key);
+			goto err;
+		}
+		ret = json_object_set_new(obj, key, val);
+		xfree(key);
+		if (ret < 0)
+			goto err;
+	} while ((ret = nftnl_json_stream_next(js, '}')) > 0);
+
+	if (ret < 0)
+		goto err;
+
+	return obj;
+err:
+	json_decref(obj);
+	return NULL;
+}
+
+static json_t *nftnl_json_stream_array(struct nftnl_json_stream *js,
+				       int depth)
+{
+	json_t *array, *val;
+	int ret;
+
+	nftnl_json_stream_getc(js);
+	array = json_array();
+	if (array == NULL)
+		return NULL;
+
+	if (nftnl_json_stream_peek(js) == ']') {
+		nftnl_json_stream_getc(js);
+		return array;
+	}
+
+	do {
+		val = nftnl_json_stream_parse(js, depth + 1);
+		if (val == NULL || json_array_append_new(array, val) < 0)
+			goto err;
+	} while ((ret = nftnl_json_stream_next(js, ']')) > 0);
+
+	if (ret < 0)
+		goto err;
+
+	return array;
+err:
+	json_decref(array);
+	return NULL;
+}
+
+static json_t *nftnl_json_stream_parse(struct nftnl_json_stream *js,
+				       int depth)
+{
+	json_t *val;
+
+	if (depth > NFTNL_JSON_STREAM_DEPTH) {
+		nftnl_json_stream_error(js);
+		return NULL;
+	}
+
+	switch (nftnl_json_stream_peek(js)) {
+	case '{':
+		return nftnl_json_stream_object(js, depth);
+	case '[':
+		return nftnl_json_stream_array(js, depth);
+	case '"':
+		if (nftnl_json_stream_string(js) < 0)
+			return NULL;
+		/* json_string() rejects invalid UTF-8 */
+		val = json_string(js->str);
+		if (val == NULL)
+			nftnl_json_stream_error(js);
+		return val;
+	case 't':
+		return nftnl_json_stream_literal(js, "true", json_true());
+	case 'f':
+		return nftnl_json_stream_literal(js, "false", json_false());
+	case 'n':
+		return nftnl_json_stream_literal(js, "null", json_null());
+	default:
+		return nftnl_json_stream_number(js);
+	}
+}
+
+json_t *nftnl_json_stream_value(struct nftnl_json_stream *js)
+{
+	return nftnl_json_stream_parse(js, 0);
+}
+
+#endif
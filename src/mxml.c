@@ -58,11 +58,52 @@ err:
 	return NULL;
 }
 
+/*
+ * Parse the document in SAX mode: @cb sees every node and must retain the
+ * ones it needs. mxml returns NULL both on syntax errors and when nothing was
+ * retained, so load under a dummy top node that is returned on success.
+ */
+int nftnl_mxml_sax_load(const void *data, enum nftnl_parse_input input,
+			mxml_sax_cb_t cb, void *cb_data,
+			struct nftnl_parse_err *err)
+{
+	mxml_node_t *top, *tree;
+
+	top = mxmlNewElement(MXML_NO_PARENT, "nftnl");
+	if (top == NULL)
+		return -1;
+
+	switch (input) {
+	case NFTNL_PARSE_BUFFER:
+		tree = mxmlSAXLoadString(top, data, MXML_OPAQUE_CALLBACK,
+					 cb, cb_data);
+		break;
+	case NFTNL_PARSE_FILE:
+		tree = mxmlSAXLoadFile(top, (FILE *)data, MXML_OPAQUE_CALLBACK,
+				       cb, cb_data);
+		break;
+	default:
+		tree = NULL;
+		break;
+	}
+	mxmlDelete(top);
+
+	if (tree == NULL) {
+		err->error = NFTNL_PARSE_EBADINPUT;
+		err->line = 0;
+		err->column = 0;
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
 struct nftnl_expr *nftnl_mxml_expr_parse(mxml_node_t *node,
 					  struct nftnl_parse_err *err,
 					  struct nftnl_set_list *set_list)
 {
-	mxml_node_t *tree;
+	mxml_node_t *tree = NULL;
 	struct nftnl_expr *e;
 	const char *expr_name;
 	char *xml_text;
@@ -80,6 +121,11 @@ struct nftnl_expr *nftnl_mxml_expr_parse(mxml_node_t *node,
 	if (e == NULL)
 		goto err;
 
+	if (e->ops->xml_parse == NULL) {
+		err->error = NFTNL_PARSE_EOPNOTSUPP;
+		goto err_expr;
+	}
+
 	xml_text = mxmlSaveAllocString(node, MXML_NO_CALLBACK);
 	if (xml_text == NULL)
 		goto err_expr;
@@ -0,0 +1,1337 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/set.h>
+
+#define NFTNL_ANON_SET_NAME	"__set%d"
+
+static struct nftnl_expr *nftnl_rule_expr_at(const struct nftnl_rule *r,
+					     int pos)
+{
+	struct nftnl_expr *e;
+
+	list_for_each_entry(e, &r->expr_list, head) {
+		if (pos-- == 0)
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Rule consolidation: adjacent rules that only differ in the data of one
+ * equality cmp are folded into a single rule that looks the value up in an
+ * anonymous set.
+ */
+static bool nftnl_cmp_eq_same_key(const struct nftnl_expr *e1,
+				  const struct nftnl_expr *e2)
+{
+	uint32_t len1, len2;
+
+	if (!nftnl_expr_is(e1, "cmp") || !nftnl_expr_is(e2, "cmp") ||
+	    e1->flags != e2->flags)
+		return false;
+
+	if (nftnl_expr_get_u32(e1, NFTNL_EXPR_CMP_OP) != NFT_CMP_EQ ||
+	    nftnl_expr_get_u32(e2, NFTNL_EXPR_CMP_OP) != NFT_CMP_EQ ||
+	    nftnl_expr_get_u32(e1, NFTNL_EXPR_CMP_SREG) !=
+	    nftnl_expr_get_u32(e2, NFTNL_EXPR_CMP_SREG))
+		return false;
+
+	nftnl_expr_get(e1, NFTNL_EXPR_CMP_DATA, &len1);
+	nftnl_expr_get(e2, NFTNL_EXPR_CMP_DATA, &len2);
+
+	return len1 == len2;
+}
+
+/*
+ * Returns true if @r keeps state of its own that folding would share with
+ * the other rules: a limit or quota would be spent by all of them, a
+ * dynset would add all of their packets. A counter would count all of them,
+ * which is only accepted with NFTNL_OPTIMIZE_F_MERGE_COUNTERS. xtables
+ * matches may keep state too, as the limit and recent matches do.
+ */
+static bool nftnl_rule_stateful(const struct nftnl_rule *r, uint32_t flags)
+{
+	struct nftnl_expr *e;
+
+	list_for_each_entry(e, &r->expr_list, head) {
+		if (nftnl_expr_is(e, "counter")) {
+			if (!(flags & NFTNL_OPTIMIZE_F_MERGE_COUNTERS))
+				return true;
+		} else if (nftnl_expr_is(e, "limit") ||
+			   nftnl_expr_is(e, "quota") ||
+			   nftnl_expr_is(e, "dynset") ||
+			   nftnl_expr_is(e, "match")) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Returns true if @r1 and @r2 are equal but for the data of the cmp at
+ * position @pos. A negative @pos looks for the first difference and stores
+ * it there; identical rules are not considered foldable then. Rules that
+ * keep state are never foldable.
+ */
+static bool nftnl_rule_same_shape(const struct nftnl_rule *r1,
+				  const struct nftnl_rule *r2, int *pos,
+				  uint32_t flags)
+{
+	struct nftnl_expr *e1, *e2;
+	int i = 0;
+
+	if (!nftnl_rule_cmp_attr(r1, r2) || nftnl_rule_stateful(r1, flags))
+		return false;
+
+	e2 = list_entry(r2->expr_list.next, struct nftnl_expr, head);
+	list_for_each_entry(e1, &r1->expr_list, head) {
+		if (&e2->head == &r2->expr_list)
+			return false;
+
+		if (i == *pos || (*pos < 0 && !nftnl_expr_cmp(e1, e2))) {
+			if (!nftnl_cmp_eq_same_key(e1, e2))
+				return false;
+			*pos = i;
+		} else if (!nftnl_expr_cmp(e1, e2)) {
+			return false;
+		}
+		e2 = list_entry(e2->head.next, struct nftnl_expr, head);
+		i++;
+	}
+
+	return &e2->head == &r2->expr_list && *pos >= 0;
+}
+
+/*
+ * Returns true if @r ends evaluation whenever it matches, that is, if it
+ * ends in an accept, drop, goto or return verdict. A jump comes back to
+ * the next rule, so a later rule matching the same packet still runs.
+ */
+static bool nftnl_rule_ends_eval(const struct nftnl_rule *r)
+{
+	struct nftnl_expr *e;
+
+	if (list_empty(&r->expr_list))
+		return false;
+
+	e = list_entry(r->expr_list.prev, struct nftnl_expr, head);
+	if (!nftnl_expr_is(e, "immediate") ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG) != NFT_REG_VERDICT)
+		return false;
+
+	switch ((int)nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_VERDICT)) {
+	case NF_ACCEPT:
+	case NF_DROP:
+	case NFT_GOTO:
+	case NFT_RETURN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Returns the first rule from @first up to @end with @data at @pos. */
+static struct nftnl_rule *nftnl_consolidate_key_owner(struct nftnl_rule *first,
+						      struct nftnl_rule *end,
+						      int pos,
+						      const void *data,
+						      uint32_t len)
+{
+	struct nftnl_rule *r;
+	const void *key;
+	uint32_t key_len;
+
+	for (r = first; r != end;
+	     r = list_entry(r->head.next, struct nftnl_rule, head)) {
+		key = nftnl_expr_get(nftnl_rule_expr_at(r, pos),
+				     NFTNL_EXPR_CMP_DATA, &key_len);
+		if (key_len == len && memcmp(key, data, len) == 0)
+			return r;
+	}
+	return NULL;
+}
+
+/*
+ * A rule whose key was already matched by an earlier rule of the run only
+ * goes away in the set if that earlier rule ends evaluation, otherwise both
+ * run on the packet and the run cannot be folded.
+ */
+static bool nftnl_consolidate_dups_dead(struct nftnl_rule *first,
+					struct nftnl_rule *last, int pos)
+{
+	struct nftnl_rule *r, *owner;
+	const void *data;
+	uint32_t len;
+
+	for (r = first; r != last;) {
+		r = list_entry(r->head.next, struct nftnl_rule, head);
+		data = nftnl_expr_get(nftnl_rule_expr_at(r, pos),
+				      NFTNL_EXPR_CMP_DATA, &len);
+		owner = nftnl_consolidate_key_owner(first, r, pos, data, len);
+		if (owner != NULL && !nftnl_rule_ends_eval(owner))
+			return false;
+	}
+	return true;
+}
+
+static void nftnl_vmap_elem_set(struct nftnl_set_elem *elem,
+				const struct nftnl_expr *imm)
+{
+	uint32_t verdict = nftnl_expr_get_u32(imm, NFTNL_EXPR_IMM_VERDICT);
+	const char *chain;
+
+	nftnl_set_elem_set_u32(elem, NFTNL_SET_ELEM_VERDICT, verdict);
+	if (nftnl_expr_is_set(imm, NFTNL_EXPR_IMM_CHAIN)) {
+		chain = nftnl_expr_get_str(imm, NFTNL_EXPR_IMM_CHAIN);
+		nftnl_set_elem_set_str(elem, NFTNL_SET_ELEM_CHAIN, chain);
+	}
+}
+
+/*
+ * Builds the anonymous set holding the cmp data at @pos of the rules from
+ * @first to @last. For maps, the verdict of the immediate that follows the
+ * cmp becomes the element data.
+ */
+static struct nftnl_set *nftnl_consolidate_set(struct nftnl_rule *first,
+					       struct nftnl_rule *last,
+					       int pos, uint32_t id, bool map)
+{
+	struct nftnl_rule *r = first;
+	struct nftnl_set_elem *elem;
+	struct nftnl_expr *cmp, *imm;
+	struct nftnl_set *s;
+	const void *data;
+	uint32_t len;
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		return NULL;
+
+	cmp = nftnl_rule_expr_at(first, pos);
+	nftnl_expr_get(cmp, NFTNL_EXPR_CMP_DATA, &len);
+
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, first->table);
+	nftnl_set_set_str(s, NFTNL_SET_NAME, NFTNL_ANON_SET_NAME);
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, first->family);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS,
+			  NFT_SET_ANONYMOUS | NFT_SET_CONSTANT |
+			  (map ? NFT_SET_MAP : 0));
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, len);
+	if (map)
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, NFT_DATA_VERDICT);
+	nftnl_set_set_u32(s, NFTNL_SET_ID, id);
+
+	for (;; r = list_entry(r->head.next, struct nftnl_rule, head)) {
+		cmp = nftnl_rule_expr_at(r, pos);
+		data = nftnl_expr_get(cmp, NFTNL_EXPR_CMP_DATA, &len);
+
+		/* later duplicates are dead, see nftnl_consolidate_dups_dead() */
+		if (nftnl_consolidate_key_owner(first, r, pos, data, len) != NULL) {
+			if (r == last)
+				break;
+			continue;
+		}
+
+		elem = nftnl_set_elem_alloc();
+		if (elem == NULL) {
+			nftnl_set_free(s);
+			return NULL;
+		}
+		nftnl_set_elem_set(elem, NFTNL_SET_ELEM_KEY, data, len);
+		if (map) {
+			imm = nftnl_rule_expr_at(r, pos + 1);
+			nftnl_vmap_elem_set(elem, imm);
+		}
+		nftnl_set_elem_add(s, elem);
+
+		if (r == last)
+			break;
+	}
+
+	return s;
+}
+
+/*
+ * Replaces the cmp at @pos of @r by a lookup on @s. For maps, the lookup
+ * also yields the verdict, so the immediate that follows is dropped.
+ */
+static int nftnl_consolidate_rule(struct nftnl_rule *r, int pos,
+				  const struct nftnl_set *s, bool map)
+{
+	struct nftnl_expr *cmp, *lookup, *imm;
+
+	lookup = nftnl_expr_alloc("lookup");
+	if (lookup == NULL)
+		return -1;
+
+	cmp = nftnl_rule_expr_at(r, pos);
+	nftnl_expr_set_u32(lookup, NFTNL_EXPR_LOOKUP_SREG,
+			   nftnl_expr_get_u32(cmp, NFTNL_EXPR_CMP_SREG));
+	if (map)
+		nftnl_expr_set_u32(lookup, NFTNL_EXPR_LOOKUP_DREG,
+				   NFT_REG_VERDICT);
+	nftnl_expr_set_str(lookup, NFTNL_EXPR_LOOKUP_SET, s->name);
+	nftnl_expr_set_u32(lookup, NFTNL_EXPR_LOOKUP_SET_ID, s->id);
+
+	if (map) {
+		imm = nftnl_rule_expr_at(r, pos + 1);
+		list_del(&imm->head);
+		nftnl_expr_free(imm);
+	}
+	list_add(&lookup->head, &cmp->head);
+	list_del(&cmp->head);
+	nftnl_expr_free(cmp);
+
+	/* this is a new rule now, drop it from the handle index, if any */
+	hlist_del_init(&r->handle_node);
+	nftnl_rule_unset(r, NFTNL_RULE_HANDLE);
+	nftnl_rule_unset(r, NFTNL_RULE_POSITION);
+
+	return 0;
+}
+
+static void nftnl_consolidate_release(struct nftnl_rule *first,
+				      struct nftnl_rule *end)
+{
+	struct nftnl_rule *r, *tmp;
+
+	r = list_entry(first->head.next, struct nftnl_rule, head);
+	while (r != end) {
+		tmp = list_entry(r->head.next, struct nftnl_rule, head);
+		nftnl_rule_list_del(r);
+		nftnl_rule_free(r);
+		r = tmp;
+	}
+}
+
+int nftnl_rule_list_consolidate(struct nftnl_rule_list *list,
+				struct nftnl_set_list *sets, uint32_t *set_id,
+				uint32_t flags)
+{
+	struct nftnl_rule *first, *last, *next;
+	struct nftnl_set *s;
+	int pos, ret = 0;
+
+	first = list_entry(list->list.next, struct nftnl_rule, head);
+	while (&first->head != &list->list) {
+		next = list_entry(first->head.next, struct nftnl_rule, head);
+		pos = -1;
+		if (&next->head == &list->list ||
+		    !(first->flags & (1 << NFTNL_RULE_TABLE)) ||
+		    !nftnl_rule_same_shape(first, next, &pos, flags)) {
+			first = next;
+			continue;
+		}
+
+		do {
+			last = next;
+			next = list_entry(next->head.next, struct nftnl_rule,
+					  head);
+		} while (&next->head != &list->list &&
+			 nftnl_rule_same_shape(first, next, &pos, flags));
+
+		if (!nftnl_consolidate_dups_dead(first, last, pos)) {
+			first = next;
+			continue;
+		}
+
+		s = nftnl_consolidate_set(first, last, pos, *set_id, false);
+		if (s == NULL)
+			return -1;
+
+		if (nftnl_consolidate_rule(first, pos, s, false) < 0) {
+			nftnl_set_free(s);
+			return -1;
+		}
+		(*set_id)++;
+		nftnl_set_list_add_tail(s, sets);
+		ret++;
+
+		nftnl_consolidate_release(first, next);
+		first = next;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_consolidate);
+
+/*
+ * Verdict map synthesis: a ladder of adjacent rules ending in an equality
+ * cmp followed by a verdict, that are identical otherwise, is replaced by
+ * a single rule doing a lookup on an anonymous verdict map.
+ */
+static bool nftnl_expr_is_verdict(const struct nftnl_expr *e)
+{
+	return nftnl_expr_is(e, "immediate") &&
+	       nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG) == NFT_REG_VERDICT;
+}
+
+static int nftnl_rule_expr_count(const struct nftnl_rule *r)
+{
+	struct nftnl_expr *e;
+	int n = 0;
+
+	list_for_each_entry(e, &r->expr_list, head)
+		n++;
+
+	return n;
+}
+
+/*
+ * Returns the position of the key cmp if @r1 and @r2 are steps of the same
+ * ladder, that is, equal but for their trailing cmp data and verdict. As
+ * for consolidation, rules that keep state are never steps.
+ */
+static int nftnl_rule_ladder_step(const struct nftnl_rule *r1,
+				  const struct nftnl_rule *r2, uint32_t flags)
+{
+	struct nftnl_expr *e1, *e2;
+	int i = 0, n;
+
+	if (!nftnl_rule_cmp_attr(r1, r2) || nftnl_rule_stateful(r1, flags))
+		return -1;
+
+	n = nftnl_rule_expr_count(r1);
+	if (n < 2 || n != nftnl_rule_expr_count(r2))
+		return -1;
+
+	e2 = list_entry(r2->expr_list.next, struct nftnl_expr, head);
+	list_for_each_entry(e1, &r1->expr_list, head) {
+		if (i == n - 1) {
+			if (!nftnl_expr_is_verdict(e1) ||
+			    !nftnl_expr_is_verdict(e2))
+				return -1;
+		} else if (i == n - 2) {
+			if (!nftnl_cmp_eq_same_key(e1, e2))
+				return -1;
+		} else if (!nftnl_expr_cmp(e1, e2)) {
+			return -1;
+		}
+		e2 = list_entry(e2->head.next, struct nftnl_expr, head);
+		i++;
+	}
+
+	return n - 2;
+}
+
+static bool nftnl_verdict_equal(struct nftnl_set_elem *elem,
+				const struct nftnl_expr *imm)
+{
+	const char *chain = NULL, *imm_chain;
+
+	if (nftnl_set_elem_get_u32(elem, NFTNL_SET_ELEM_VERDICT) !=
+	    nftnl_expr_get_u32(imm, NFTNL_EXPR_IMM_VERDICT))
+		return false;
+
+	if (nftnl_set_elem_is_set(elem, NFTNL_SET_ELEM_CHAIN))
+		chain = nftnl_set_elem_get_str(elem, NFTNL_SET_ELEM_CHAIN);
+
+	if (!nftnl_expr_is_set(imm, NFTNL_EXPR_IMM_CHAIN))
+		return chain == NULL;
+
+	imm_chain = nftnl_expr_get_str(imm, NFTNL_EXPR_IMM_CHAIN);
+	/* chain names are interned */
+	return chain != NULL && chain == imm_chain;
+}
+
+/*
+ * Checks that looking up the key of any packet that one of the rules from
+ * @first to @last would match yields the verdict of the first rule that
+ * matches it, and that no other key is in the map, so that the rewritten
+ * chain behaves like the ladder. That only holds if any later rule with the
+ * same key is never reached, so the first rule must end evaluation.
+ */
+static bool nftnl_vmap_check(struct nftnl_rule *first, struct nftnl_rule *last,
+			     int pos, struct nftnl_set *s)
+{
+	struct nftnl_rule *r, *owner;
+	struct nftnl_set_elem *elem;
+	const void *data, *key;
+	uint32_t len, key_len;
+	int keys = 0, elems = 0;
+
+	list_for_each_entry(elem, &s->element_list, head)
+		elems++;
+
+	for (r = first;;
+	     r = list_entry(r->head.next, struct nftnl_rule, head)) {
+		data = nftnl_expr_get(nftnl_rule_expr_at(r, pos),
+				      NFTNL_EXPR_CMP_DATA, &len);
+
+		/* the first rule matching this key decides */
+		for (owner = first; owner != r;
+		     owner = list_entry(owner->head.next, struct nftnl_rule,
+					head)) {
+			key = nftnl_expr_get(nftnl_rule_expr_at(owner, pos),
+					     NFTNL_EXPR_CMP_DATA, &key_len);
+			if (key_len == len && memcmp(key, data, len) == 0)
+				break;
+		}
+		if (owner == r)
+			keys++;
+		else if (!nftnl_rule_ends_eval(owner))
+			return false;
+
+		list_for_each_entry(elem, &s->element_list, head) {
+			key = nftnl_set_elem_get(elem, NFTNL_SET_ELEM_KEY,
+						 &key_len);
+			if (key_len == len && memcmp(key, data, len) == 0)
+				break;
+		}
+		if (&elem->head == &s->element_list ||
+		    !nftnl_verdict_equal(elem,
+					 nftnl_rule_expr_at(owner, pos + 1)))
+			return false;
+
+		if (r == last)
+			break;
+	}
+
+	return keys == elems;
+}
+
+int nftnl_rule_list_verdict_map(struct nftnl_rule_list *list,
+				struct nftnl_set_list *sets, uint32_t *set_id,
+				uint32_t flags)
+{
+	struct nftnl_rule *first, *last, *next;
+	struct nftnl_set *s;
+	int pos, ret = 0;
+
+	first = list_entry(list->list.next, struct nftnl_rule, head);
+	while (&first->head != &list->list) {
+		next = list_entry(first->head.next, struct nftnl_rule, head);
+		if (&next->head == &list->list ||
+		    !(first->flags & (1 << NFTNL_RULE_TABLE)) ||
+		    (pos = nftnl_rule_ladder_step(first, next, flags)) < 0) {
+			first = next;
+			continue;
+		}
+
+		do {
+			last = next;
+			next = list_entry(next->head.next, struct nftnl_rule,
+					  head);
+		} while (&next->head != &list->list &&
+			 nftnl_rule_ladder_step(first, next, flags) == pos);
+
+		if (!nftnl_consolidate_dups_dead(first, last, pos)) {
+			first = next;
+			continue;
+		}
+
+		s = nftnl_consolidate_set(first, last, pos, *set_id, true);
+		if (s == NULL)
+			return -1;
+
+		if (!nftnl_vmap_check(first, last, pos, s)) {
+			nftnl_set_free(s);
+			first = next;
+			continue;
+		}
+
+		if (nftnl_consolidate_rule(first, pos, s, true) < 0) {
+			nftnl_set_free(s);
+			return -1;
+		}
+		(*set_id)++;
+		nftnl_set_list_add_tail(s, sets);
+		ret++;
+
+		nftnl_consolidate_release(first, next);
+		first = next;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_verdict_map);
+
+/* Register usage, tracked as a bitmask of 32-bit words. */
+#define NFTNL_REG_ALL		((1U << NFTNL_REG_WORDS) - 1)
+
+static uint32_t nftnl_reg_span(uint32_t reg, uint32_t len)
+{
+	uint32_t word = nftnl_reg_word(reg), words = nftnl_reg_words(len);
+
+	if (word >= NFTNL_REG_WORDS)
+		return 0;
+	if (words > NFTNL_REG_WORDS - word)
+		words = NFTNL_REG_WORDS - word;
+
+	return ((1U << words) - 1) << word;
+}
+
+static uint32_t nftnl_expr_reg_span(const struct nftnl_expr *e, uint16_t reg,
+				    uint32_t len)
+{
+	if (!nftnl_expr_is_set(e, reg))
+		return 0;
+
+	return nftnl_reg_span(nftnl_expr_get_u32(e, reg), len);
+}
+
+/*
+ * Registers @e may read, registers it surely overwrites and registers it
+ * may overwrite. Reads and writes of unknown length may span a whole
+ * NFT_REG_SIZE register, but only their first word is surely written.
+ * Expressions we know nothing about may read and write anything.
+ */
+static void nftnl_expr_reg_use(const struct nftnl_expr *e, uint32_t *reads,
+			       uint32_t *writes, uint32_t *clobbers)
+{
+	uint32_t len;
+
+	*reads = *writes = *clobbers = 0;
+
+	if (nftnl_expr_is(e, "cmp")) {
+		nftnl_expr_get(e, NFTNL_EXPR_CMP_DATA, &len);
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_CMP_SREG, len);
+	} else if (nftnl_expr_is(e, "bitwise")) {
+		len = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN);
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_BITWISE_SREG, len);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_BITWISE_DREG, len);
+	} else if (nftnl_expr_is(e, "byteorder")) {
+		len = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_LEN);
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_BYTEORDER_SREG, len);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_BYTEORDER_DREG,
+					      len);
+	} else if (nftnl_expr_is(e, "payload")) {
+		len = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_LEN);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_PAYLOAD_DREG, len);
+	} else if (nftnl_expr_is(e, "exthdr")) {
+		len = nftnl_expr_get_u32(e, NFTNL_EXPR_EXTHDR_LEN);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_EXTHDR_DREG, len);
+	} else if (nftnl_expr_is(e, "immediate")) {
+		len = NFT_REG32_SIZE;
+		if (nftnl_expr_is_set(e, NFTNL_EXPR_IMM_DATA))
+			nftnl_expr_get(e, NFTNL_EXPR_IMM_DATA, &len);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_IMM_DREG, len);
+	} else if (nftnl_expr_is(e, "meta")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_META_SREG,
+					     NFT_REG_SIZE);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_META_DREG,
+					      NFT_REG32_SIZE);
+		*clobbers = nftnl_expr_reg_span(e, NFTNL_EXPR_META_DREG,
+						NFT_REG_SIZE);
+	} else if (nftnl_expr_is(e, "ct")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_CT_SREG,
+					     NFT_REG_SIZE);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_CT_DREG,
+					      NFT_REG32_SIZE);
+		*clobbers = nftnl_expr_reg_span(e, NFTNL_EXPR_CT_DREG,
+						NFT_REG_SIZE);
+	} else if (nftnl_expr_is(e, "lookup")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_LOOKUP_SREG,
+					     NFT_REG_SIZE);
+		*writes = nftnl_expr_reg_span(e, NFTNL_EXPR_LOOKUP_DREG,
+					      NFT_REG32_SIZE);
+		*clobbers = nftnl_expr_reg_span(e, NFTNL_EXPR_LOOKUP_DREG,
+						NFT_REG_SIZE);
+	} else if (nftnl_expr_is(e, "dynset")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_DYNSET_SREG_KEY,
+					     NFT_REG_SIZE) |
+			 nftnl_expr_reg_span(e, NFTNL_EXPR_DYNSET_SREG_DATA,
+					     NFT_REG_SIZE);
+	} else if (nftnl_expr_is(e, "nat")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_NAT_REG_ADDR_MIN,
+					     NFT_REG_SIZE) |
+			 nftnl_expr_reg_span(e, NFTNL_EXPR_NAT_REG_ADDR_MAX,
+					     NFT_REG_SIZE) |
+			 nftnl_expr_reg_span(e, NFTNL_EXPR_NAT_REG_PROTO_MIN,
+					     NFT_REG_SIZE) |
+			 nftnl_expr_reg_span(e, NFTNL_EXPR_NAT_REG_PROTO_MAX,
+					     NFT_REG_SIZE);
+	} else if (nftnl_expr_is(e, "redir")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_REDIR_REG_PROTO_MIN,
+					     NFT_REG_SIZE) |
+			 nftnl_expr_reg_span(e, NFTNL_EXPR_REDIR_REG_PROTO_MAX,
+					     NFT_REG_SIZE);
+	} else if (nftnl_expr_is(e, "dup")) {
+		*reads = nftnl_expr_reg_span(e, NFTNL_EXPR_DUP_SREG_ADDR,
+					     NFT_REG_SIZE) |
+			 nftnl_expr_reg_span(e, NFTNL_EXPR_DUP_SREG_DEV,
+					     NFT_REG_SIZE);
+	} else if (!nftnl_expr_is(e, "counter") &&
+		   !nftnl_expr_is(e, "limit") &&
+		   !nftnl_expr_is(e, "log") &&
+		   !nftnl_expr_is(e, "reject") &&
+		   !nftnl_expr_is(e, "queue") &&
+		   !nftnl_expr_is(e, "masq") &&
+		   !nftnl_expr_is(e, "match") &&
+		   !nftnl_expr_is(e, "target")) {
+		*reads = *clobbers = NFTNL_REG_ALL;
+	}
+
+	*clobbers |= *writes;
+}
+
+/* Returns true if no expression after @e reads @live before overwriting it */
+static bool nftnl_reg_dead_after(const struct nftnl_rule *r,
+				 const struct nftnl_expr *e, uint32_t live)
+{
+	uint32_t reads, writes, clobbers;
+
+	list_for_each_entry_continue(e, &r->expr_list, head) {
+		if (live == 0)
+			break;
+
+		nftnl_expr_reg_use(e, &reads, &writes, &clobbers);
+		if (reads & live)
+			return false;
+		live &= ~writes;
+	}
+	return true;
+}
+
+/*
+ * Payload load coalescing: a payload load that is only compared for
+ * equality, possibly under a mask, is a match on a header byte range.
+ * Consecutive matches on adjacent or overlapping ranges of the same base
+ * are merged into one wider load, mask and cmp.
+ */
+struct nftnl_payload_match {
+	struct nftnl_expr	*payload;
+	struct nftnl_expr	*bitwise;
+	struct nftnl_expr	*cmp;
+	uint32_t		base;
+	uint32_t		offset;
+	uint32_t		len;
+	uint32_t		reg;
+	uint8_t			mask[NFT_REG_SIZE];
+	uint8_t			data[NFT_REG_SIZE];
+};
+
+static struct nftnl_expr *nftnl_expr_next(const struct nftnl_rule *r,
+					  const struct nftnl_expr *e)
+{
+	if (e == NULL || e->head.next == &r->expr_list)
+		return NULL;
+
+	return list_entry(e->head.next, struct nftnl_expr, head);
+}
+
+static bool nftnl_payload_match_parse(const struct nftnl_rule *r,
+				      struct nftnl_expr *e,
+				      struct nftnl_payload_match *m)
+{
+	const uint8_t *mask, *xor, *data;
+	uint32_t i, len;
+
+	memset(m, 0, sizeof(*m));
+
+	if (!nftnl_expr_is(e, "payload") ||
+	    !nftnl_expr_is_set(e, NFTNL_EXPR_PAYLOAD_DREG))
+		return false;
+
+	m->payload = e;
+	m->base = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_BASE);
+	m->offset = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET);
+	m->len = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_LEN);
+	m->reg = nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_DREG);
+	if (m->len == 0 || m->len > NFT_REG_SIZE)
+		return false;
+	memset(m->mask, 0xff, m->len);
+
+	e = nftnl_expr_next(r, e);
+	if (e != NULL && nftnl_expr_is(e, "bitwise")) {
+		if (nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_SREG) != m->reg ||
+		    nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_DREG) != m->reg ||
+		    nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN) != m->len)
+			return false;
+
+		mask = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_MASK, &len);
+		if (len != m->len)
+			return false;
+		xor = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_XOR, &len);
+		if (len != m->len)
+			return false;
+		for (i = 0; i < m->len; i++) {
+			if (xor[i] != 0)
+				return false;
+		}
+		memcpy(m->mask, mask, m->len);
+		m->bitwise = e;
+		e = nftnl_expr_next(r, e);
+	}
+
+	if (e == NULL || !nftnl_expr_is(e, "cmp") ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_CMP_SREG) != m->reg ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_CMP_OP) != NFT_CMP_EQ)
+		return false;
+
+	data = nftnl_expr_get(e, NFTNL_EXPR_CMP_DATA, &len);
+	if (len != m->len)
+		return false;
+
+	/* bits outside the mask never match, leave such rules alone */
+	for (i = 0; i < m->len; i++) {
+		if (data[i] & ~m->mask[i])
+			return false;
+	}
+	memcpy(m->data, data, m->len);
+	m->cmp = e;
+
+	return true;
+}
+
+/* Adds the bytes matched by @m to those in @mask and @data from @start */
+static bool nftnl_payload_match_fold(const struct nftnl_payload_match *m,
+				     uint32_t start, uint8_t *mask,
+				     uint8_t *data)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < m->len; i++) {
+		j = m->offset - start + i;
+		/* contradicting overlap: the rule never matches */
+		if ((data[j] ^ m->data[i]) & mask[j] & m->mask[i])
+			return false;
+		mask[j] |= m->mask[i];
+		data[j] |= m->data[i];
+	}
+	return true;
+}
+
+static bool nftnl_payload_match_merge(const struct nftnl_rule *r,
+				      struct nftnl_payload_match *m1,
+				      const struct nftnl_payload_match *m2)
+{
+	uint8_t mask[NFT_REG_SIZE] = {}, data[NFT_REG_SIZE] = {};
+	uint32_t start, end;
+
+	if (m1->base != m2->base ||
+	    m2->offset > m1->offset + m1->len ||
+	    m1->offset > m2->offset + m2->len)
+		return false;
+
+	start = m1->offset < m2->offset ? m1->offset : m2->offset;
+	end = m1->offset + m1->len > m2->offset + m2->len ?
+	      m1->offset + m1->len : m2->offset + m2->len;
+	if (end - start > NFT_REG_SIZE ||
+	    nftnl_reg_word(m1->reg) < 4 ||
+	    nftnl_reg_word(m1->reg) + nftnl_reg_words(end - start) >
+	    NFTNL_REG_WORDS)
+		return false;
+
+	if (!nftnl_payload_match_fold(m1, start, mask, data) ||
+	    !nftnl_payload_match_fold(m2, start, mask, data))
+		return false;
+
+	/* the old and new destination words must not be used afterwards */
+	if (!nftnl_reg_dead_after(r, m2->cmp,
+				  nftnl_reg_span(m1->reg, end - start) |
+				  nftnl_reg_span(m1->reg, m1->len) |
+				  nftnl_reg_span(m2->reg, m2->len)))
+		return false;
+
+	m1->offset = start;
+	m1->len = end - start;
+	memcpy(m1->mask, mask, sizeof(mask));
+	memcpy(m1->data, data, sizeof(data));
+
+	return true;
+}
+
+static int nftnl_payload_match_update(struct nftnl_payload_match *m)
+{
+	static const uint8_t zero[NFT_REG_SIZE];
+	bool masked = false;
+	uint32_t i;
+
+	for (i = 0; i < m->len; i++) {
+		if (m->mask[i] != 0xff)
+			masked = true;
+	}
+
+	if (masked && m->bitwise == NULL) {
+		m->bitwise = nftnl_expr_alloc("bitwise");
+		if (m->bitwise == NULL)
+			return -1;
+
+		nftnl_expr_set_u32(m->bitwise, NFTNL_EXPR_BITWISE_SREG, m->reg);
+		nftnl_expr_set_u32(m->bitwise, NFTNL_EXPR_BITWISE_DREG, m->reg);
+		list_add(&m->bitwise->head, &m->payload->head);
+	} else if (!masked && m->bitwise != NULL) {
+		list_del(&m->bitwise->head);
+		nftnl_expr_free(m->bitwise);
+		m->bitwise = NULL;
+	}
+
+	nftnl_expr_set_u32(m->payload, NFTNL_EXPR_PAYLOAD_OFFSET, m->offset);
+	nftnl_expr_set_u32(m->payload, NFTNL_EXPR_PAYLOAD_LEN, m->len);
+	if (m->bitwise != NULL) {
+		nftnl_expr_set_u32(m->bitwise, NFTNL_EXPR_BITWISE_LEN, m->len);
+		nftnl_expr_set(m->bitwise, NFTNL_EXPR_BITWISE_MASK, m->mask,
+			       m->len);
+		nftnl_expr_set(m->bitwise, NFTNL_EXPR_BITWISE_XOR, zero,
+			       m->len);
+	}
+	nftnl_expr_set(m->cmp, NFTNL_EXPR_CMP_DATA, m->data, m->len);
+
+	return 0;
+}
+
+static void nftnl_payload_match_release(struct nftnl_payload_match *m)
+{
+	list_del(&m->payload->head);
+	nftnl_expr_free(m->payload);
+	if (m->bitwise != NULL) {
+		list_del(&m->bitwise->head);
+		nftnl_expr_free(m->bitwise);
+	}
+	list_del(&m->cmp->head);
+	nftnl_expr_free(m->cmp);
+}
+
+int nftnl_rule_coalesce_payload(struct nftnl_rule *r)
+{
+	struct nftnl_payload_match m1, m2;
+	struct nftnl_expr *e, *next;
+	int ret = 0;
+
+	e = list_entry(r->expr_list.next, struct nftnl_expr, head);
+	while (&e->head != &r->expr_list) {
+		if (!nftnl_payload_match_parse(r, e, &m1)) {
+			e = list_entry(e->head.next, struct nftnl_expr, head);
+			continue;
+		}
+
+		next = nftnl_expr_next(r, m1.cmp);
+		while (next != NULL &&
+		       nftnl_payload_match_parse(r, next, &m2) &&
+		       nftnl_payload_match_merge(r, &m1, &m2)) {
+			next = nftnl_expr_next(r, m2.cmp);
+			nftnl_payload_match_release(&m2);
+			if (nftnl_payload_match_update(&m1) < 0)
+				return -1;
+			ret++;
+		}
+		e = list_entry(m1.cmp->head.next, struct nftnl_expr, head);
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_coalesce_payload);
+
+/*
+ * Register simplification: identity bitwise operations, byte order
+ * conversions undone by a later one, computations on constants and writes
+ * nobody reads are removed, and transforms that only feed an equality cmp
+ * are folded into its data.
+ */
+static void nftnl_expr_del(struct nftnl_expr *e)
+{
+	list_del(&e->head);
+	nftnl_expr_free(e);
+}
+
+static bool nftnl_bytes_are(const uint8_t *data, uint32_t len, uint8_t val)
+{
+	while (len-- > 0) {
+		if (data[len] != val)
+			return false;
+	}
+	return true;
+}
+
+/* a bitwise with an all ones mask, i.e. a move that may flip bits */
+static const uint8_t *nftnl_bitwise_move(const struct nftnl_expr *e)
+{
+	uint32_t len = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN);
+	const uint8_t *mask, *xor;
+	uint32_t mlen, xlen;
+
+	mask = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_MASK, &mlen);
+	xor = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_XOR, &xlen);
+	if (mask == NULL || xor == NULL || mlen < len || xlen < len ||
+	    !nftnl_bytes_are(mask, len, 0xff))
+		return NULL;
+
+	return xor;
+}
+
+/* byte order conversions are byte swaps or no-ops, both undo themselves */
+static bool nftnl_byteorder_swap(uint8_t *data, uint32_t len, uint32_t size)
+{
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+	uint32_t i;
+
+	if (size == 0 || len % size != 0)
+		return false;
+
+	for (i = 0; i < len; i += size) {
+		switch (size) {
+		case sizeof(v16):
+			memcpy(&v16, &data[i], size);
+			v16 = ntohs(v16);
+			memcpy(&data[i], &v16, size);
+			break;
+		case sizeof(v32):
+			memcpy(&v32, &data[i], size);
+			v32 = ntohl(v32);
+			memcpy(&data[i], &v32, size);
+			break;
+		case sizeof(v64):
+			memcpy(&v64, &data[i], size);
+			v64 = be64toh(v64);
+			memcpy(&data[i], &v64, size);
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool nftnl_byteorder_supported(const struct nftnl_expr *e)
+{
+	uint32_t len = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_LEN);
+	uint8_t data[NFT_REG_SIZE] = {};
+
+	return len <= NFT_REG_SIZE &&
+	       nftnl_byteorder_swap(data, len,
+			nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_SIZE));
+}
+
+static bool nftnl_bitwise_identity(const struct nftnl_expr *e)
+{
+	const uint8_t *xor = nftnl_bitwise_move(e);
+
+	return xor != NULL &&
+	       nftnl_bytes_are(xor, nftnl_expr_get_u32(e,
+					NFTNL_EXPR_BITWISE_LEN), 0) &&
+	       nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_SREG) ==
+	       nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_DREG);
+}
+
+/*
+ * @b converts back what @a converted: drop both if the source of @a is not
+ * overwritten in between and the intermediate register is not used later.
+ */
+static bool nftnl_byteorder_cancel(const struct nftnl_rule *r,
+				   struct nftnl_expr *a)
+{
+	uint32_t len = nftnl_expr_get_u32(a, NFTNL_EXPR_BYTEORDER_LEN);
+	uint32_t size = nftnl_expr_get_u32(a, NFTNL_EXPR_BYTEORDER_SIZE);
+	uint32_t sreg = nftnl_expr_get_u32(a, NFTNL_EXPR_BYTEORDER_SREG);
+	uint32_t dreg = nftnl_expr_get_u32(a, NFTNL_EXPR_BYTEORDER_DREG);
+	uint32_t src = nftnl_reg_span(sreg, len);
+	uint32_t tmp = nftnl_reg_span(dreg, len);
+	uint32_t reads, writes, clobbers;
+	struct nftnl_expr *b;
+
+	for (b = nftnl_expr_next(r, a); b != NULL; b = nftnl_expr_next(r, b)) {
+		if (nftnl_expr_is(b, "byteorder") &&
+		    nftnl_expr_get_u32(b, NFTNL_EXPR_BYTEORDER_SREG) == dreg &&
+		    nftnl_expr_get_u32(b, NFTNL_EXPR_BYTEORDER_DREG) == sreg &&
+		    nftnl_expr_get_u32(b, NFTNL_EXPR_BYTEORDER_LEN) == len &&
+		    nftnl_expr_get_u32(b, NFTNL_EXPR_BYTEORDER_SIZE) == size)
+			break;
+
+		nftnl_expr_reg_use(b, &reads, &writes, &clobbers);
+		if ((reads | clobbers) & tmp || clobbers & src)
+			return false;
+	}
+
+	if (b == NULL || !nftnl_reg_dead_after(r, b, tmp & ~src))
+		return false;
+
+	nftnl_expr_del(a);
+	nftnl_expr_del(b);
+	return true;
+}
+
+/*
+ * A move or byte order conversion whose result is only compared for
+ * equality: compare the source against the converted data instead.
+ */
+static bool nftnl_cmp_fold(const struct nftnl_rule *r, struct nftnl_expr *e)
+{
+	struct nftnl_expr *cmp = nftnl_expr_next(r, e);
+	uint32_t sreg, dreg, len, dlen, op, i;
+	uint8_t data[NFT_REG_SIZE];
+	const uint8_t *xor = NULL;
+	const void *cdata;
+
+	if (cmp == NULL || !nftnl_expr_is(cmp, "cmp"))
+		return false;
+
+	if (nftnl_expr_is(e, "bitwise")) {
+		xor = nftnl_bitwise_move(e);
+		if (xor == NULL)
+			return false;
+
+		sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_SREG);
+		dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_DREG);
+		len = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN);
+	} else {
+		sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_SREG);
+		dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_DREG);
+		len = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_LEN);
+	}
+
+	op = nftnl_expr_get_u32(cmp, NFTNL_EXPR_CMP_OP);
+	cdata = nftnl_expr_get(cmp, NFTNL_EXPR_CMP_DATA, &dlen);
+	if ((op != NFT_CMP_EQ && op != NFT_CMP_NEQ) ||
+	    nftnl_expr_get_u32(cmp, NFTNL_EXPR_CMP_SREG) != dreg ||
+	    cdata == NULL || dlen != len || len > NFT_REG_SIZE ||
+	    !nftnl_reg_dead_after(r, cmp, nftnl_reg_span(dreg, len)))
+		return false;
+
+	memcpy(data, cdata, len);
+	if (xor != NULL) {
+		for (i = 0; i < len; i++)
+			data[i] ^= xor[i];
+	} else if (!nftnl_byteorder_swap(data, len,
+			nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_SIZE))) {
+		return false;
+	}
+
+	nftnl_expr_set(cmp, NFTNL_EXPR_CMP_DATA, data, len);
+	nftnl_expr_set_u32(cmp, NFTNL_EXPR_CMP_SREG, sreg);
+	nftnl_expr_del(e);
+	return true;
+}
+
+/* known register contents, per byte */
+struct nftnl_fold_regs {
+	uint8_t		val[NFTNL_REG_WORDS * NFT_REG32_SIZE];
+	bool		known[NFTNL_REG_WORDS * NFT_REG32_SIZE];
+};
+
+static int nftnl_fold_off(uint32_t reg, uint32_t len)
+{
+	uint32_t off = nftnl_reg_word(reg) * NFT_REG32_SIZE;
+
+	if (off + len > NFTNL_REG_WORDS * NFT_REG32_SIZE)
+		return -1;
+
+	return off;
+}
+
+static bool nftnl_fold_get(const struct nftnl_fold_regs *regs, uint32_t reg,
+			   uint32_t len, uint8_t *data)
+{
+	int off = nftnl_fold_off(reg, len);
+
+	if (off < 0 || len > NFT_REG_SIZE ||
+	    memchr(&regs->known[off], false, len) != NULL)
+		return false;
+
+	memcpy(data, &regs->val[off], len);
+	return true;
+}
+
+/* store @len bytes of @data into @reg, or forget its contents if NULL */
+static void nftnl_fold_set(struct nftnl_fold_regs *regs, uint32_t reg,
+			   uint32_t len, const void *data)
+{
+	int off = nftnl_fold_off(reg, len);
+
+	if (off < 0) {
+		memset(regs->known, false, sizeof(regs->known));
+		return;
+	}
+
+	memset(&regs->known[off], data != NULL, len);
+	if (data != NULL)
+		memcpy(&regs->val[off], data, len);
+}
+
+/* forget whatever an expression we do not evaluate may write */
+static void nftnl_fold_clobber(struct nftnl_fold_regs *regs,
+			       const struct nftnl_expr *e)
+{
+	uint32_t reads, writes, clobbers, word;
+
+	nftnl_expr_reg_use(e, &reads, &writes, &clobbers);
+	for (word = 0; word < NFTNL_REG_WORDS; word++) {
+		if (clobbers & (1U << word))
+			memset(&regs->known[word * NFT_REG32_SIZE], false,
+			       NFT_REG32_SIZE);
+	}
+}
+
+static bool nftnl_cmp_eval(const struct nftnl_expr *e, const uint8_t *val)
+{
+	const void *data;
+	uint32_t len;
+	int d;
+
+	data = nftnl_expr_get(e, NFTNL_EXPR_CMP_DATA, &len);
+	d = memcmp(val, data, len);
+
+	switch (nftnl_expr_get_u32(e, NFTNL_EXPR_CMP_OP)) {
+	case NFT_CMP_EQ:
+		return d == 0;
+	case NFT_CMP_NEQ:
+		return d != 0;
+	case NFT_CMP_LT:
+		return d < 0;
+	case NFT_CMP_LTE:
+		return d <= 0;
+	case NFT_CMP_GT:
+		return d > 0;
+	case NFT_CMP_GTE:
+		return d >= 0;
+	}
+	return false;
+}
+
+static void nftnl_fold_bitwise(struct nftnl_fold_regs *regs,
+			       const struct nftnl_expr *e)
+{
+	uint32_t len = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_LEN);
+	uint32_t sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_SREG);
+	uint32_t dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BITWISE_DREG);
+	const uint8_t *mask, *xor;
+	uint8_t data[NFT_REG_SIZE];
+	uint32_t mlen, xlen, i;
+
+	mask = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_MASK, &mlen);
+	xor = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_XOR, &xlen);
+	if (mask == NULL || xor == NULL || mlen < len || xlen < len ||
+	    !nftnl_fold_get(regs, sreg, len, data)) {
+		nftnl_fold_set(regs, dreg, len, NULL);
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		data[i] = (data[i] & mask[i]) ^ xor[i];
+	nftnl_fold_set(regs, dreg, len, data);
+}
+
+static void nftnl_fold_byteorder(struct nftnl_fold_regs *regs,
+				 const struct nftnl_expr *e)
+{
+	uint32_t len = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_LEN);
+	uint32_t size = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_SIZE);
+	uint32_t sreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_SREG);
+	uint32_t dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_BYTEORDER_DREG);
+	uint8_t data[NFT_REG_SIZE];
+
+	if (!nftnl_fold_get(regs, sreg, len, data) ||
+	    !nftnl_byteorder_swap(data, len, size)) {
+		nftnl_fold_set(regs, dreg, len, NULL);
+		return;
+	}
+	nftnl_fold_set(regs, dreg, len, data);
+}
+
+/*
+ * Propagate constants loaded by immediate through bitwise and byteorder,
+ * and drop the cmp expressions they always satisfy.
+ */
+static int nftnl_fold_constants(struct nftnl_rule *r)
+{
+	struct nftnl_fold_regs regs = {};
+	struct nftnl_expr *e, *tmp;
+	uint8_t data[NFT_REG_SIZE];
+	uint32_t len, dreg;
+	const void *imm;
+	int ret = 0;
+
+	list_for_each_entry_safe(e, tmp, &r->expr_list, head) {
+		if (nftnl_expr_is(e, "immediate") &&
+		    nftnl_expr_is_set(e, NFTNL_EXPR_IMM_DATA)) {
+			imm = nftnl_expr_get(e, NFTNL_EXPR_IMM_DATA, &len);
+			dreg = nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG);
+			nftnl_fold_set(&regs, dreg, len, imm);
+		} else if (nftnl_expr_is(e, "bitwise")) {
+			nftnl_fold_bitwise(&regs, e);
+		} else if (nftnl_expr_is(e, "byteorder")) {
+			nftnl_fold_byteorder(&regs, e);
+		} else if (nftnl_expr_is(e, "cmp")) {
+			nftnl_expr_get(e, NFTNL_EXPR_CMP_DATA, &len);
+			if (nftnl_fold_get(&regs,
+					   nftnl_expr_get_u32(e,
+						NFTNL_EXPR_CMP_SREG),
+					   len, data) &&
+			    nftnl_cmp_eval(e, data)) {
+				nftnl_expr_del(e);
+				ret++;
+			}
+		} else {
+			nftnl_fold_clobber(&regs, e);
+		}
+	}
+	return ret;
+}
+
+/* register writes nobody reads, from expressions without side effects */
+static bool nftnl_expr_dead(const struct nftnl_rule *r,
+			    const struct nftnl_expr *e)
+{
+	uint32_t reads, writes, clobbers;
+
+	if (nftnl_expr_is(e, "immediate")) {
+		if (nftnl_expr_get_u32(e, NFTNL_EXPR_IMM_DREG) ==
+		    NFT_REG_VERDICT)
+			return false;
+	} else if (!nftnl_expr_is(e, "bitwise") &&
+		   !nftnl_expr_is(e, "byteorder")) {
+		return false;
+	}
+
+	nftnl_expr_reg_use(e, &reads, &writes, &clobbers);
+	return nftnl_reg_dead_after(r, e, writes);
+}
+
+static int nftnl_rule_simplify_once(struct nftnl_rule *r)
+{
+	struct nftnl_expr *e, *tmp;
+	int ret;
+
+	ret = nftnl_fold_constants(r);
+
+	list_for_each_entry_safe(e, tmp, &r->expr_list, head) {
+		if (nftnl_expr_dead(r, e) ||
+		    (nftnl_expr_is(e, "bitwise") &&
+		     nftnl_bitwise_identity(e))) {
+			nftnl_expr_del(e);
+			ret++;
+		} else if ((nftnl_expr_is(e, "bitwise") ||
+			    nftnl_expr_is(e, "byteorder")) &&
+			   nftnl_cmp_fold(r, e)) {
+			ret++;
+		} else if (nftnl_expr_is(e, "byteorder") &&
+			   nftnl_byteorder_supported(e) &&
+			   nftnl_byteorder_cancel(r, e)) {
+			ret += 2;
+			/* the pair partner may be the next expression */
+			return ret;
+		}
+	}
+	return ret;
+}
+
+int nftnl_rule_simplify(struct nftnl_rule *r)
+{
+	int ret, total = 0;
+
+	while ((ret = nftnl_rule_simplify_once(r)) > 0)
+		total += ret;
+
+	return total;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_simplify);
@@ -0,0 +1,385 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <endian.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/rule.h>
+#include <libnftnl/batch.h>
+
+/*
+ * Beyond this number of edits, the remaining unaligned rules are considered
+ * to be all different. The edit script is still correct, just not minimal,
+ * while memory usage of the alignment stays bounded.
+ */
+#define NFTNL_RECONCILE_MAX_EDITS	2048
+
+struct nftnl_reconcile {
+	struct nftnl_rule	**cur;
+	uint32_t		*cur_class;
+	int			*cur_match;
+	int			num_cur;
+
+	struct nftnl_rule	**want;
+	uint32_t		*want_class;
+	int			num_want;
+};
+
+static int nftnl_rule_list_to_array(struct nftnl_rule_list *list,
+				    struct nftnl_rule ***array)
+{
+	struct nftnl_rule *r;
+	int n = 0;
+
+	list_for_each_entry(r, &list->list, head)
+		n++;
+
+	*array = calloc(n + 1, sizeof(struct nftnl_rule *));
+	if (*array == NULL)
+		return -1;
+
+	n = 0;
+	list_for_each_entry(r, &list->list, head)
+		(*array)[n++] = r;
+
+	return n;
+}
+
+struct nftnl_reconcile_slot {
+	struct nftnl_rule	*r;
+	uint32_t		hash;
+	uint32_t		class;
+};
+
+/*
+ * Assign the same class number to rules with identical content, so the
+ * alignment below only compares integers.
+ */
+static int nftnl_reconcile_classify(struct nftnl_reconcile *rc)
+{
+	struct nftnl_reconcile_slot *slots, *slot;
+	uint32_t size = 16, mask, hash, next_class = 1;
+	struct nftnl_rule *r;
+	uint32_t *class;
+	int i;
+
+	while (size < 2 * (rc->num_cur + rc->num_want))
+		size <<= 1;
+	mask = size - 1;
+
+	slots = calloc(size, sizeof(struct nftnl_reconcile_slot));
+	if (slots == NULL)
+		return -1;
+
+	for (i = 0; i < rc->num_cur + rc->num_want; i++) {
+		if (i < rc->num_cur) {
+			r = rc->cur[i];
+			class = &rc->cur_class[i];
+		} else {
+			r = rc->want[i - rc->num_cur];
+			class = &rc->want_class[i - rc->num_cur];
+		}
+
+		hash = nftnl_rule_hash(r);
+		for (slot = &slots[hash & mask]; slot->r != NULL;
+		     slot = &slots[(slot - slots + 1) & mask]) {
+			if (slot->hash == hash && nftnl_rule_cmp(slot->r, r))
+				break;
+		}
+		if (slot->r == NULL) {
+			slot->r = r;
+			slot->hash = hash;
+			slot->class = next_class++;
+		}
+		*class = slot->class;
+	}
+
+	xfree(slots);
+	return 0;
+}
+
+/*
+ * Myers' O(ND) difference algorithm, it finds the longest common subsequence
+ * of a[] and b[], matches are stored in a_match[] as indexes of b[].
+ */
+static int nftnl_reconcile_align(const uint32_t *a, int n,
+				 const uint32_t *b, int m, int *a_match)
+{
+	int max = n + m, d, k, x, y, prev_k, prev_x, *vbuf, *v, **trace;
+	int ret = -1;
+
+	if (max > NFTNL_RECONCILE_MAX_EDITS)
+		max = NFTNL_RECONCILE_MAX_EDITS;
+
+	vbuf = calloc(2 * max + 3, sizeof(int));
+	trace = calloc(max + 1, sizeof(int *));
+	if (vbuf == NULL || trace == NULL)
+		goto err;
+
+	/* v[] is indexed by diagonal k = x - y */
+	v = vbuf + max + 1;
+
+	for (d = 0; d <= max; d++) {
+		for (k = -d; k <= d; k += 2) {
+			if (k == -d || (k != d && v[k - 1] < v[k + 1]))
+				x = v[k + 1];
+			else
+				x = v[k - 1] + 1;
+			y = x - k;
+
+			while (x < n && y < m && a[x] == b[y]) {
+				x++;
+				y++;
+			}
+			v[k] = x;
+
+			if (x >= n && y >= m)
+				goto found;
+		}
+
+		trace[d] = malloc((2 * d + 1) * sizeof(int));
+		if (trace[d] == NULL)
+			goto err;
+		memcpy(trace[d], &v[-d], (2 * d + 1) * sizeof(int));
+	}
+
+	/* Too many edits, give up on aligning anything. */
+	ret = 0;
+	goto err;
+
+found:
+	x = n;
+	y = m;
+	for (; d > 0; d--) {
+		/* trace[d - 1] holds diagonals -(d - 1) to d - 1 */
+		int *pv = trace[d - 1] + d - 1;
+
+		k = x - y;
+		if (k == -d || (k != d && pv[k - 1] < pv[k + 1]))
+			prev_k = k + 1;
+		else
+			prev_k = k - 1;
+
+		prev_x = pv[prev_k];
+		while (x > prev_x && x - k > prev_x - prev_k) {
+			x--;
+			y--;
+			a_match[x] = y;
+		}
+		x = prev_x;
+		y = prev_x - prev_k;
+	}
+	while (x > 0 && y > 0) {
+		x--;
+		y--;
+		a_match[x] = y;
+	}
+	ret = 0;
+err:
+	if (trace != NULL) {
+		for (k = 0; k <= max; k++)
+			xfree(trace[k]);
+		xfree(trace);
+	}
+	xfree(vbuf);
+	return ret;
+}
+
+static int nftnl_reconcile_match(struct nftnl_reconcile *rc)
+{
+	int i, pre = 0, post = 0;
+
+	for (i = 0; i < rc->num_cur; i++)
+		rc->cur_match[i] = -1;
+
+	/* Leading and trailing rules that did not change are trivial. */
+	while (pre < rc->num_cur && pre < rc->num_want &&
+	       rc->cur_class[pre] == rc->want_class[pre]) {
+		rc->cur_match[pre] = pre;
+		pre++;
+	}
+	while (post < rc->num_cur - pre && post < rc->num_want - pre &&
+	       rc->cur_class[rc->num_cur - post - 1] ==
+	       rc->want_class[rc->num_want - post - 1]) {
+		rc->cur_match[rc->num_cur - post - 1] = rc->num_want - post - 1;
+		post++;
+	}
+
+	if (nftnl_reconcile_align(rc->cur_class + pre,
+				  rc->num_cur - pre - post,
+				  rc->want_class + pre,
+				  rc->num_want - pre - post,
+				  rc->cur_match + pre) < 0)
+		return -1;
+
+	for (i = pre; i < rc->num_cur - post; i++) {
+		if (rc->cur_match[i] >= 0)
+			rc->cur_match[i] += pre;
+	}
+	return 0;
+}
+
+static int nftnl_reconcile_put(struct nftnl_batch *batch, uint32_t *seq,
+			       struct nftnl_rule *r, uint16_t type,
+			       uint16_t flags, uint64_t handle,
+			       uint64_t position)
+{
+	uint32_t saved = r->flags;
+	struct nlmsghdr *nlh;
+
+	nlh = nftnl_rule_nlmsg_build_hdr(nftnl_batch_buffer(batch), type,
+					 r->family, flags, (*seq)++);
+
+	if (type == NFT_MSG_DELRULE) {
+		mnl_attr_put_strz(nlh, NFTA_RULE_TABLE, r->table);
+		mnl_attr_put_strz(nlh, NFTA_RULE_CHAIN, r->chain);
+		mnl_attr_put_u64(nlh, NFTA_RULE_HANDLE, htobe64(handle));
+	} else {
+		/* Placement comes from the plan, not from the desired rule. */
+		r->flags &= ~((1 << NFTNL_RULE_HANDLE) |
+			      (1 << NFTNL_RULE_POSITION));
+		nftnl_rule_nlmsg_build_payload(nlh, r);
+		r->flags = saved;
+
+		if (flags & NLM_F_REPLACE)
+			mnl_attr_put_u64(nlh, NFTA_RULE_HANDLE,
+					 htobe64(handle));
+		if (position)
+			mnl_attr_put_u64(nlh, NFTA_RULE_POSITION,
+					 htobe64(position));
+	}
+
+	return nftnl_batch_update(batch);
+}
+
+/*
+ * Emit the edits needed for one run of unmatched rules: current rules in
+ * [ci, cend) and desired rules in [wi, wend). @anchor is the current rule
+ * that follows the run, if any.
+ */
+static int nftnl_reconcile_gap(struct nftnl_reconcile *rc,
+			       struct nftnl_batch *batch, uint32_t *seq,
+			       int ci, int cend, int wi, int wend,
+			       struct nftnl_rule *anchor)
+{
+	int num = 0;
+
+	/* Changed rules are replaced in place. */
+	for (; ci < cend && wi < wend; ci++, wi++, num++) {
+		if (nftnl_reconcile_put(batch, seq, rc->want[wi],
+					NFT_MSG_NEWRULE,
+					NLM_F_REPLACE | NLM_F_ACK,
+					rc->cur[ci]->handle, 0) < 0)
+			return -1;
+	}
+	for (; ci < cend; ci++, num++) {
+		if (nftnl_reconcile_put(batch, seq, rc->cur[ci],
+					NFT_MSG_DELRULE, NLM_F_ACK,
+					rc->cur[ci]->handle, 0) < 0)
+			return -1;
+	}
+	/* New rules go right before the next rule we keep, or at the end. */
+	for (; wi < wend; wi++, num++) {
+		if (nftnl_reconcile_put(batch, seq, rc->want[wi],
+					NFT_MSG_NEWRULE,
+					anchor ? NLM_F_CREATE | NLM_F_ACK :
+					NLM_F_APPEND | NLM_F_CREATE | NLM_F_ACK,
+					0, anchor ? anchor->handle : 0) < 0)
+			return -1;
+	}
+	return num;
+}
+
+static int nftnl_reconcile_emit(struct nftnl_reconcile *rc,
+				struct nftnl_batch *batch, uint32_t *seq)
+{
+	int ci = 0, wi = 0, cend, wend, ret, num = 0;
+	struct nftnl_rule *anchor;
+
+	while (ci < rc->num_cur || wi < rc->num_want) {
+		/* Find the next rule that we keep. */
+		for (cend = ci; cend < rc->num_cur; cend++) {
+			if (rc->cur_match[cend] >= 0)
+				break;
+		}
+		if (cend < rc->num_cur) {
+			wend = rc->cur_match[cend];
+			anchor = rc->cur[cend];
+		} else {
+			wend = rc->num_want;
+			anchor = NULL;
+		}
+
+		ret = nftnl_reconcile_gap(rc, batch, seq, ci, cend, wi, wend,
+					  anchor);
+		if (ret < 0)
+			return -1;
+		num += ret;
+
+		ci = cend + 1;
+		wi = wend + 1;
+	}
+	return num;
+}
+
+/*
+ * Append to @batch the rule messages that turn the chain dumped in @cur into
+ * @want. Rules in common are left untouched, changed rules are replaced by
+ * handle and new rules are placed relative to the handle of the next rule
+ * that is kept. Returns the number of messages, or -1 on error.
+ */
+int nftnl_rule_list_reconcile(struct nftnl_batch *batch, uint32_t *seq,
+			      struct nftnl_rule_list *cur,
+			      struct nftnl_rule_list *want)
+{
+	struct nftnl_reconcile rc = {};
+	int i, ret = -1;
+
+	rc.num_cur = nftnl_rule_list_to_array(cur, &rc.cur);
+	if (rc.num_cur < 0)
+		goto err;
+	rc.num_want = nftnl_rule_list_to_array(want, &rc.want);
+	if (rc.num_want < 0)
+		goto err;
+
+	/* Rules without handle can be neither kept nor deleted. */
+	for (i = 0; i < rc.num_cur; i++) {
+		if (!(rc.cur[i]->flags & (1 << NFTNL_RULE_HANDLE))) {
+			errno = EINVAL;
+			goto err;
+		}
+	}
+
+	rc.cur_class = calloc(rc.num_cur + 1, sizeof(uint32_t));
+	rc.cur_match = calloc(rc.num_cur + 1, sizeof(int));
+	rc.want_class = calloc(rc.num_want + 1, sizeof(uint32_t));
+	if (rc.cur_class == NULL || rc.cur_match == NULL ||
+	    rc.want_class == NULL)
+		goto err;
+
+	if (nftnl_reconcile_classify(&rc) < 0 ||
+	    nftnl_reconcile_match(&rc) < 0)
+		goto err;
+
+	ret = nftnl_reconcile_emit(&rc, batch, seq);
+err:
+	xfree(rc.cur);
+	xfree(rc.want);
+	xfree(rc.cur_class);
+	xfree(rc.cur_match);
+	xfree(rc.want_class);
+	return ret;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_reconcile);
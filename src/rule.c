@@ -29,27 +29,6 @@
 #include <libnftnl/set.h>
 #include <libnftnl/expr.h>
 
-struct nftnl_rule {
-	struct list_head head;
-
-	uint32_t	flags;
-	uint32_t	family;
-	const char	*table;
-	const char	*chain;
-	uint64_t	handle;
-	uint64_t	position;
-	struct {
-			void		*data;
-			uint32_t	len;
-	} user;
-	struct {
-			uint32_t	flags;
-			uint32_t	proto;
-	} compat;
-
-	struct list_head expr_list;
-};
-
 struct nftnl_rule *nftnl_rule_alloc(void)
 {
 	struct nftnl_rule *r;
@@ -59,6 +38,7 @@ struct nftnl_rule *nftnl_rule_alloc(void)
 		return NULL;
 
 	INIT_LIST_HEAD(&r->expr_list);
+	INIT_LIST_HEAD(&r->chain_head);
 
 	return r;
 }
@@ -71,10 +51,10 @@ void nftnl_rule_free(struct nftnl_rule *r)
 	list_for_each_entry_safe(e, tmp, &r->expr_list, head)
 		nftnl_expr_free(e);
 
-	if (r->table != NULL)
-		xfree(r->table);
-	if (r->chain != NULL)
-		xfree(r->chain);
+	nftnl_intern_put(r->table);
+	nftnl_intern_put(r->chain);
+	if (r->flags & (1 << NFTNL_RULE_USERDATA))
+		xfree(r->user.data);
 
 	xfree(r);
 }
@@ -93,23 +73,23 @@ void nftnl_rule_unset(struct nftnl_rule *r, uint16_t attr)
 
 	switch (attr) {
 	case NFTNL_RULE_TABLE:
-		if (r->table) {
-			xfree(r->table);
-			r->table = NULL;
-		}
+		nftnl_intern_put(r->table);
+		r->table = NULL;
 		break;
 	case NFTNL_RULE_CHAIN:
-		if (r->chain) {
-			xfree(r->chain);
-			r->chain = NULL;
-		}
+		nftnl_intern_put(r->chain);
+		r->chain = NULL;
 		break;
 	case NFTNL_RULE_HANDLE:
 	case NFTNL_RULE_COMPAT_PROTO:
 	case NFTNL_RULE_COMPAT_FLAGS:
 	case NFTNL_RULE_POSITION:
 	case NFTNL_RULE_FAMILY:
+		break;
 	case NFTNL_RULE_USERDATA:
+		xfree(r->user.data);
+		r->user.data = NULL;
+		r->user.len = 0;
 		break;
 	}
 
@@ -135,16 +115,20 @@ void nftnl_rule_set_data(struct nftnl_rule *r, uint16_t attr,
 
 	switch(attr) {
 	case NFTNL_RULE_TABLE:
-		if (r->table)
-			xfree(r->table);
-
-		r->table = strdup(data);
+		nftnl_intern_put(r->table);
+		r->table = nftnl_intern(data);
+		if (r->table == NULL) {
+			r->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_RULE_CHAIN:
-		if (r->chain)
-			xfree(r->chain);
-
-		r->chain = strdup(data);
+		nftnl_intern_put(r->chain);
+		r->chain = nftnl_intern(data);
+		if (r->chain == NULL) {
+			r->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_RULE_HANDLE:
 		r->handle = *((uint64_t *)data);
@@ -162,7 +146,16 @@ void nftnl_rule_set_data(struct nftnl_rule *r, uint16_t attr,
 		r->position = *((uint64_t *)data);
 		break;
 	case NFTNL_RULE_USERDATA:
-		r->user.data = (void *)data;
+		if (r->flags & (1 << NFTNL_RULE_USERDATA))
+			xfree(r->user.data);
+
+		r->user.data = malloc(data_len);
+		if (r->user.data == NULL) {
+			r->user.len = 0;
+			r->flags &= ~(1 << attr);
+			return;
+		}
+		memcpy(r->user.data, data, data_len);
 		r->user.len = data_len;
 		break;
 	}
@@ -357,7 +350,7 @@ static int nftnl_rule_parse_attr_cb(const struct nlattr *attr, void *data)
 	return MNL_CB_OK;
 }
 
-static int nftnl_rule_parse_expr(struct nlattr *nest, struct nftnl_rule *r)
+int nftnl_rule_parse_expr(struct nlattr *nest, struct nftnl_rule *r)
 {
 	struct nftnl_expr *expr;
 	struct nlattr *attr;
@@ -425,13 +418,21 @@ int nftnl_rule_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_rule *r)
 		return -1;
 
 	if (tb[NFTA_RULE_TABLE]) {
-		xfree(r->table);
-		r->table = strdup(mnl_attr_get_str(tb[NFTA_RULE_TABLE]));
+		nftnl_intern_put(r->table);
+		r->table = nftnl_intern(mnl_attr_get_str(tb[NFTA_RULE_TABLE]));
+		if (r->table == NULL) {
+			r->flags &= ~(1 << NFTNL_RULE_TABLE);
+			return -1;
+		}
 		r->flags |= (1 << NFTNL_RULE_TABLE);
 	}
 	if (tb[NFTA_RULE_CHAIN]) {
-		xfree(r->chain);
-		r->chain = strdup(mnl_attr_get_str(tb[NFTA_RULE_CHAIN]));
+		nftnl_intern_put(r->chain);
+		r->chain = nftnl_intern(mnl_attr_get_str(tb[NFTA_RULE_CHAIN]));
+		if (r->chain == NULL) {
+			r->flags &= ~(1 << NFTNL_RULE_CHAIN);
+			return -1;
+		}
 		r->flags |= (1 << NFTNL_RULE_CHAIN);
 	}
 	if (tb[NFTA_RULE_HANDLE]) {
@@ -711,279 +712,415 @@ int nftnl_rule_parse_file(struct nftnl_rule *r, enum nftnl_parse_type type,
 }
 EXPORT_SYMBOL(nftnl_rule_parse_file, nft_rule_parse_file);
 
-static int nftnl_rule_snprintf_json(char *buf, size_t size, struct nftnl_rule *r,
-					 uint32_t type, uint32_t flags)
+static int nftnl_rule_expr_do_snprintf(char *buf, size_t size, void *e,
+				       uint32_t cmd, uint32_t type,
+				       uint32_t flags)
+{
+	return nftnl_expr_snprintf(buf, size, e, type, flags);
+}
+
+static void nftnl_rule_print_json(struct nftnl_buf *b, struct nftnl_rule *r,
+				  uint32_t type, uint32_t flags)
 {
-	int ret, len = size, offset = 0;
 	struct nftnl_expr *expr;
 
-	ret = snprintf(buf, len, "{\"rule\":{");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_put(b, "{\"rule\":{");
 
-	if (r->flags & (1 << NFTNL_RULE_FAMILY)) {
-		ret = snprintf(buf+offset, len, "\"family\":\"%s\",",
-			       nftnl_family2str(r->family));
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_FAMILY))
+		nftnl_buf_put(b, "\"family\":\"%s\",",
+			      nftnl_family2str(r->family));
 
-	if (r->flags & (1 << NFTNL_RULE_TABLE)) {
-		ret = snprintf(buf+offset, len, "\"table\":\"%s\",",
-			       r->table);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_TABLE))
+		nftnl_buf_put(b, "\"table\":\"%s\",", r->table);
 
-	if (r->flags & (1 << NFTNL_RULE_CHAIN)) {
-		ret = snprintf(buf+offset, len, "\"chain\":\"%s\",",
-			       r->chain);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
-	if (r->flags & (1 << NFTNL_RULE_HANDLE)) {
-		ret = snprintf(buf+offset, len, "\"handle\":%llu,",
-			       (unsigned long long)r->handle);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_CHAIN))
+		nftnl_buf_put(b, "\"chain\":\"%s\",", r->chain);
+	if (r->flags & (1 << NFTNL_RULE_HANDLE))
+		nftnl_buf_put(b, "\"handle\":%llu,",
+			      (unsigned long long)r->handle);
 
 	if (r->flags & (1 << NFTNL_RULE_COMPAT_PROTO) ||
-	    r->flags & (1 << NFTNL_RULE_COMPAT_FLAGS)) {
-		ret = snprintf(buf+offset, len, "\"compat_flags\":%u,"
-					        "\"compat_proto\":%u,",
-			       r->compat.flags, r->compat.proto);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	    r->flags & (1 << NFTNL_RULE_COMPAT_FLAGS))
+		nftnl_buf_put(b, "\"compat_flags\":%u,\"compat_proto\":%u,",
+			      r->compat.flags, r->compat.proto);
 
-	if (r->flags & (1 << NFTNL_RULE_POSITION)) {
-		ret = snprintf(buf+offset, len, "\"position\":%"PRIu64",",
-			       r->position);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_POSITION))
+		nftnl_buf_put(b, "\"position\":%"PRIu64",", r->position);
 
-	ret = snprintf(buf+offset, len, "\"expr\":[");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_put(b, "\"expr\":[");
 
 	list_for_each_entry(expr, &r->expr_list, head) {
-		ret = snprintf(buf+offset, len,
-			       "{\"type\":\"%s\",", expr->ops->name);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-		ret = expr->ops->snprintf(buf+offset, len, type, flags, expr);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+		nftnl_buf_put(b, "{\"type\":\"%s\",", expr->ops->name);
 
 		/*
 		 * Remove comma from the first element if there is type
 		 * key-value pair only. Example: "expr":[{"type":"log"}]
 		 */
-		if (ret == 0) {
-			offset--;
-			len--;
-		}
-
-		ret = snprintf(buf+offset, len, "},");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+		if (nftnl_buf_obj(b, expr, NFTNL_CMD_UNSPEC, type, flags,
+				  nftnl_rule_expr_do_snprintf) == 0)
+			nftnl_buf_unput(b);
 
+		nftnl_buf_put(b, "},");
 	}
-	/* Remove comma from last element */
-	offset--;
-	ret = snprintf(buf+offset, len, "]}}");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	/* Remove comma from last element, its room is available again */
+	if (!list_empty(&r->expr_list))
+		nftnl_buf_unput(b);
 
-	return offset;
+	nftnl_buf_put(b, "]}}");
 }
 
-static int nftnl_rule_snprintf_xml(char *buf, size_t size, struct nftnl_rule *r,
-				 uint32_t type, uint32_t flags)
+/*
+ * Same output as nftnl_rule_print_json() on the rule that
+ * nftnl_rule_nlmsg_parse() would build from @nlh, but the attributes are
+ * printed from the message. Each expression is decoded on its own and
+ * released once printed, its object comes from the expression cache.
+ */
+static int nftnl_rule_nlmsg_snprintf_json(char *buf, size_t size,
+					  const struct nlmsghdr *nlh,
+					  uint32_t type, uint32_t flags)
 {
-	int ret, len = size, offset = 0;
+	struct nlattr *ctb[NFTA_RULE_COMPAT_MAX+1] = {};
+	struct nlattr *tb[NFTA_RULE_MAX+1] = {};
+	struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
+	int ret, len = size, offset = 0, exprs = 0;
 	struct nftnl_expr *expr;
+	struct nlattr *attr;
+	uint64_t val64;
+	uint32_t val;
+
+	if (mnl_attr_parse(nlh, sizeof(*nfg), nftnl_rule_parse_attr_cb, tb) < 0)
+		return -1;
+	if (tb[NFTA_RULE_COMPAT] &&
+	    mnl_attr_parse_nested(tb[NFTA_RULE_COMPAT],
+				  nftnl_rule_parse_compat_cb, ctb) < 0)
+		return -1;
 
-	ret = snprintf(buf, len, "<rule>");
+	ret = snprintf(buf, len, "{\"rule\":{\"family\":\"%s\",",
+		       nftnl_family2str(nfg->nfgen_family));
 	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 
-	if (r->flags & (1 << NFTNL_RULE_FAMILY)) {
-		ret = snprintf(buf+offset, len, "<family>%s</family>",
-			       nftnl_family2str(r->family));
+	if (tb[NFTA_RULE_TABLE]) {
+		ret = snprintf(buf+offset, len, "\"table\":\"%s\",",
+			       mnl_attr_get_str(tb[NFTA_RULE_TABLE]));
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 	}
-
-	if (r->flags & (1 << NFTNL_RULE_TABLE)) {
-		ret = snprintf(buf+offset, len, "<table>%s</table>",
-			       r->table);
+	if (tb[NFTA_RULE_CHAIN]) {
+		ret = snprintf(buf+offset, len, "\"chain\":\"%s\",",
+			       mnl_attr_get_str(tb[NFTA_RULE_CHAIN]));
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 	}
-
-	if (r->flags & (1 << NFTNL_RULE_CHAIN)) {
-		ret = snprintf(buf+offset, len, "<chain>%s</chain>",
-			       r->chain);
+	if (tb[NFTA_RULE_HANDLE]) {
+		ret = snprintf(buf+offset, len, "\"handle\":%llu,",
+			       (unsigned long long)
+			       be64toh(mnl_attr_get_u64(tb[NFTA_RULE_HANDLE])));
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 	}
-	if (r->flags & (1 << NFTNL_RULE_HANDLE)) {
-		ret = snprintf(buf+offset, len, "<handle>%llu</handle>",
-			       (unsigned long long)r->handle);
+	if (ctb[NFTA_RULE_COMPAT_PROTO] || ctb[NFTA_RULE_COMPAT_FLAGS]) {
+		val = ctb[NFTA_RULE_COMPAT_FLAGS] ?
+		      ntohl(mnl_attr_get_u32(ctb[NFTA_RULE_COMPAT_FLAGS])) : 0;
+		ret = snprintf(buf+offset, len, "\"compat_flags\":%u,", val);
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
 
-	if (r->compat.flags != 0 || r->compat.proto != 0) {
-		ret = snprintf(buf+offset, len,
-			       "<compat_flags>%u</compat_flags>"
-			       "<compat_proto>%u</compat_proto>",
-			       r->compat.flags, r->compat.proto);
+		val = ctb[NFTA_RULE_COMPAT_PROTO] ?
+		      ntohl(mnl_attr_get_u32(ctb[NFTA_RULE_COMPAT_PROTO])) : 0;
+		ret = snprintf(buf+offset, len, "\"compat_proto\":%u,", val);
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 	}
-
-	if (r->flags & (1 << NFTNL_RULE_POSITION)) {
-		ret = snprintf(buf+offset, len,
-			       "<position>%"PRIu64"</position>",
-			       r->position);
+	if (tb[NFTA_RULE_POSITION]) {
+		val64 = be64toh(mnl_attr_get_u64(tb[NFTA_RULE_POSITION]));
+		ret = snprintf(buf+offset, len, "\"position\":%"PRIu64",",
+			       val64);
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 	}
 
-	list_for_each_entry(expr, &r->expr_list, head) {
-		ret = snprintf(buf+offset, len,
-				"<expr type=\"%s\">", expr->ops->name);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	ret = snprintf(buf+offset, len, "\"expr\":[");
+	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 
-		ret = nftnl_expr_snprintf(buf+offset, len, expr,
-					     type, flags);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	if (tb[NFTA_RULE_EXPRESSIONS]) {
+		mnl_attr_for_each_nested(attr, tb[NFTA_RULE_EXPRESSIONS]) {
+			if (mnl_attr_get_type(attr) != NFTA_LIST_ELEM)
+				return -1;
 
-		ret = snprintf(buf+offset, len, "</expr>");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+			expr = nftnl_expr_parse(attr);
+			if (expr == NULL)
+				return -1;
+
+			ret = snprintf(buf+offset, len, "{\"type\":\"%s\",",
+				       expr->ops->name);
+			SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 
+			ret = expr->ops->snprintf(buf+offset, len, type, flags,
+						  expr);
+			nftnl_expr_free(expr);
+			/* no comma after the type of expressions without
+			 * attributes, as in nftnl_rule_print_json()
+			 */
+			if (ret == 0) {
+				offset--;
+				if (len > 0)
+					len++;
+			}
+			SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+
+			ret = snprintf(buf+offset, len, "},");
+			SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+			exprs++;
+		}
+	}
+	if (exprs > 0) {
+		offset--;
+		if (len > 0)
+			len++;
 	}
-	ret = snprintf(buf+offset, len, "</rule>");
+	ret = snprintf(buf+offset, len, "]}}");
 	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 
 	return offset;
 }
 
-static int nftnl_rule_snprintf_default(char *buf, size_t size, struct nftnl_rule *r,
-				     uint32_t type, uint32_t flags)
+static void nftnl_rule_print_xml(struct nftnl_buf *b, struct nftnl_rule *r,
+				 uint32_t type, uint32_t flags)
 {
 	struct nftnl_expr *expr;
-	int ret, len = size, offset = 0, i;
 
-	if (r->flags & (1 << NFTNL_RULE_FAMILY)) {
-		ret = snprintf(buf+offset, len, "%s ",
-			       nftnl_family2str(r->family));
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	nftnl_buf_put(b, "<rule>");
 
-	if (r->flags & (1 << NFTNL_RULE_TABLE)) {
-		ret = snprintf(buf+offset, len, "%s ",
-			       r->table);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_FAMILY))
+		nftnl_buf_put(b, "<family>%s</family>",
+			      nftnl_family2str(r->family));
 
-	if (r->flags & (1 << NFTNL_RULE_CHAIN)) {
-		ret = snprintf(buf+offset, len, "%s ",
-			       r->chain);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
-	if (r->flags & (1 << NFTNL_RULE_HANDLE)) {
-		ret = snprintf(buf+offset, len, "%llu ",
-			       (unsigned long long)r->handle);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_TABLE))
+		nftnl_buf_put(b, "<table>%s</table>", r->table);
 
-	if (r->flags & (1 << NFTNL_RULE_POSITION)) {
-		ret = snprintf(buf+offset, len, "%llu ",
-			       (unsigned long long)r->position);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (r->flags & (1 << NFTNL_RULE_CHAIN))
+		nftnl_buf_put(b, "<chain>%s</chain>", r->chain);
+	if (r->flags & (1 << NFTNL_RULE_HANDLE))
+		nftnl_buf_put(b, "<handle>%llu</handle>",
+			      (unsigned long long)r->handle);
 
-	ret = snprintf(buf+offset, len, "\n");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	if (r->compat.flags != 0 || r->compat.proto != 0)
+		nftnl_buf_put(b, "<compat_flags>%u</compat_flags>"
+				 "<compat_proto>%u</compat_proto>",
+			      r->compat.flags, r->compat.proto);
+
+	if (r->flags & (1 << NFTNL_RULE_POSITION))
+		nftnl_buf_put(b, "<position>%"PRIu64"</position>",
+			      r->position);
 
 	list_for_each_entry(expr, &r->expr_list, head) {
-		ret = snprintf(buf+offset, len, "  [ %s ", expr->ops->name);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+		nftnl_buf_put(b, "<expr type=\"%s\">", expr->ops->name);
+		nftnl_buf_obj(b, expr, NFTNL_CMD_UNSPEC, type, flags,
+			      nftnl_rule_expr_do_snprintf);
+		nftnl_buf_put(b, "</expr>");
+	}
+	nftnl_buf_put(b, "</rule>");
+}
 
-		ret = nftnl_expr_snprintf(buf+offset, len, expr,
-					     type, flags);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+static void nftnl_rule_print_default(struct nftnl_buf *b, struct nftnl_rule *r,
+				     uint32_t type, uint32_t flags)
+{
+	struct nftnl_expr *expr;
+	int i;
 
-		ret = snprintf(buf+offset, len, "]\n");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	if (r->flags & (1 << NFTNL_RULE_FAMILY))
+		nftnl_buf_put(b, "%s ", nftnl_family2str(r->family));
+
+	if (r->flags & (1 << NFTNL_RULE_TABLE))
+		nftnl_buf_put(b, "%s ", r->table);
+
+	if (r->flags & (1 << NFTNL_RULE_CHAIN))
+		nftnl_buf_put(b, "%s ", r->chain);
+	if (r->flags & (1 << NFTNL_RULE_HANDLE))
+		nftnl_buf_put(b, "%llu ", (unsigned long long)r->handle);
+
+	if (r->flags & (1 << NFTNL_RULE_POSITION))
+		nftnl_buf_put(b, "%llu ", (unsigned long long)r->position);
+
+	nftnl_buf_put(b, "\n");
+
+	list_for_each_entry(expr, &r->expr_list, head) {
+		nftnl_buf_put(b, "  [ %s ", expr->ops->name);
+		nftnl_buf_obj(b, expr, NFTNL_CMD_UNSPEC, type, flags,
+			      nftnl_rule_expr_do_snprintf);
+		nftnl_buf_put(b, "]\n");
 	}
 
 	if (r->user.len) {
-		ret = snprintf(buf+offset, len, "  userdata = { ");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+		nftnl_buf_put(b, "  userdata = { ");
 
 		for (i = 0; i < r->user.len; i++) {
 			char *c = r->user.data;
 
-			ret = snprintf(buf+offset, len, "%c",
-				       isalnum(c[i]) ? c[i] : 0);
-			SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+			nftnl_buf_put(b, "%c", isalnum(c[i]) ? c[i] : 0);
 		}
 
-		ret = snprintf(buf+offset, len, " }\n");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
+		nftnl_buf_put(b, " }\n");
 	}
-
-	return offset;
 }
 
-static int nftnl_rule_cmd_snprintf(char *buf, size_t size, struct nftnl_rule *r,
-				 uint32_t cmd, uint32_t type, uint32_t flags)
+static int nftnl_rule_cmd_print(struct nftnl_buf *b, struct nftnl_rule *r,
+				uint32_t cmd, uint32_t type, uint32_t flags)
 {
-	int ret, len = size, offset = 0;
 	uint32_t inner_flags = flags;
 
 	inner_flags &= ~NFTNL_OF_EVENT_ANY;
 
-	ret = nftnl_cmd_header_snprintf(buf + offset, len, cmd, type, flags);
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_cmd_header_buf(b, cmd, type, flags);
 
 	switch(type) {
 	case NFTNL_OUTPUT_DEFAULT:
-		ret = nftnl_rule_snprintf_default(buf+offset, len, r, type,
-						inner_flags);
+		nftnl_rule_print_default(b, r, type, inner_flags);
 		break;
 	case NFTNL_OUTPUT_XML:
-		ret = nftnl_rule_snprintf_xml(buf+offset, len, r, type,
-					    inner_flags);
+		nftnl_rule_print_xml(b, r, type, inner_flags);
 		break;
 	case NFTNL_OUTPUT_JSON:
-		ret = nftnl_rule_snprintf_json(buf+offset, len, r, type,
-					     inner_flags);
+		nftnl_rule_print_json(b, r, type, inner_flags);
 		break;
 	default:
 		return -1;
 	}
 
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-	ret = nftnl_cmd_footer_snprintf(buf + offset, len, cmd, type, flags);
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_cmd_footer_buf(b, cmd, type, flags);
 
-	return offset;
+	return nftnl_buf_flush(b);
 }
 
 int nftnl_rule_snprintf(char *buf, size_t size, struct nftnl_rule *r,
 		      uint32_t type, uint32_t flags)
 {
-	return nftnl_rule_cmd_snprintf(buf, size, r, nftnl_flag2cmd(flags), type,
-				     flags);
+	NFTNL_BUF_INIT(b, buf, size);
+
+	return nftnl_rule_cmd_print(&b, r, nftnl_flag2cmd(flags), type, flags);
 }
 EXPORT_SYMBOL(nftnl_rule_snprintf, nft_rule_snprintf);
 
-static inline int nftnl_rule_do_snprintf(char *buf, size_t size, void *r,
-				       uint32_t cmd, uint32_t type,
-				       uint32_t flags)
+int nftnl_rule_nlmsg_snprintf(char *buf, size_t size,
+			      const struct nlmsghdr *nlh, uint32_t type,
+			      uint32_t flags)
 {
-	return nftnl_rule_snprintf(buf, size, r, type, flags);
+	int ret, len = size, offset = 0;
+	uint32_t cmd = nftnl_flag2cmd(flags);
+	struct nftnl_rule *r;
+
+	/* only JSON is printed from the message itself */
+	if (type != NFTNL_OUTPUT_JSON) {
+		r = nftnl_rule_alloc();
+		if (r == NULL)
+			return -1;
+
+		ret = nftnl_rule_nlmsg_parse(nlh, r);
+		if (ret >= 0)
+			ret = nftnl_rule_snprintf(buf, size, r, type, flags);
+
+		nftnl_rule_free(r);
+		return ret;
+	}
+
+	ret = nftnl_cmd_header_snprintf(buf + offset, len, cmd, type, flags);
+	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+
+	ret = nftnl_rule_nlmsg_snprintf_json(buf + offset, len, nlh, type,
+					     flags & ~NFTNL_OF_EVENT_ANY);
+	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+
+	ret = nftnl_cmd_footer_snprintf(buf + offset, len, cmd, type, flags);
+	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+
+	return offset;
 }
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_nlmsg_snprintf);
 
+/* Expressions are written out as they are printed, the rule is printed once */
 int nftnl_rule_fprintf(FILE *fp, struct nftnl_rule *r, uint32_t type,
 		     uint32_t flags)
 {
-	return nftnl_fprintf(fp, r, NFTNL_CMD_UNSPEC, type, flags,
-			   nftnl_rule_do_snprintf);
+	char buf[NFTNL_SNPRINTF_BUFSIZ];
+	NFTNL_BUF_INIT_FILE(b, buf, sizeof(buf), fp);
+
+	return nftnl_rule_cmd_print(&b, r, nftnl_flag2cmd(flags), type, flags);
 }
 EXPORT_SYMBOL(nftnl_rule_fprintf, nft_rule_fprintf);
 
+/*
+ * Attributes that are assigned by the kernel or that only describe where the
+ * rule is placed, they are ignored when comparing and hashing rules.
+ */
+#define NFTNL_RULE_VOLATILE	((1 << NFTNL_RULE_HANDLE) | \
+				 (1 << NFTNL_RULE_POSITION))
+
+uint32_t nftnl_rule_hash(const struct nftnl_rule *r)
+{
+	uint32_t hash = NFTNL_HASH_INIT;
+	struct nftnl_expr *expr;
+
+	if (r->flags & (1 << NFTNL_RULE_FAMILY))
+		hash = nftnl_hash_val(hash, r->family);
+	if (r->flags & (1 << NFTNL_RULE_TABLE))
+		hash = nftnl_hash_str(hash, r->table);
+	if (r->flags & (1 << NFTNL_RULE_CHAIN))
+		hash = nftnl_hash_str(hash, r->chain);
+	if (r->flags & (1 << NFTNL_RULE_COMPAT_PROTO))
+		hash = nftnl_hash_val(hash, r->compat.proto);
+	if (r->flags & (1 << NFTNL_RULE_COMPAT_FLAGS))
+		hash = nftnl_hash_val(hash, r->compat.flags);
+	if (r->flags & (1 << NFTNL_RULE_USERDATA))
+		hash = nftnl_hash_data(hash, r->user.data, r->user.len);
+
+	list_for_each_entry(expr, &r->expr_list, head)
+		hash = nftnl_expr_hash(expr, hash);
+
+	return hash;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_hash);
+
+bool nftnl_rule_cmp_attr(const struct nftnl_rule *r1,
+			 const struct nftnl_rule *r2)
+{
+	if ((r1->flags & ~NFTNL_RULE_VOLATILE) !=
+	    (r2->flags & ~NFTNL_RULE_VOLATILE))
+		return false;
+
+	if (r1->flags & (1 << NFTNL_RULE_FAMILY) && r1->family != r2->family)
+		return false;
+	/* names are interned, equal names are the same string */
+	if (r1->flags & (1 << NFTNL_RULE_TABLE) && r1->table != r2->table)
+		return false;
+	if (r1->flags & (1 << NFTNL_RULE_CHAIN) && r1->chain != r2->chain)
+		return false;
+	if (r1->flags & (1 << NFTNL_RULE_COMPAT_PROTO) &&
+	    r1->compat.proto != r2->compat.proto)
+		return false;
+	if (r1->flags & (1 << NFTNL_RULE_COMPAT_FLAGS) &&
+	    r1->compat.flags != r2->compat.flags)
+		return false;
+	if (r1->flags & (1 << NFTNL_RULE_USERDATA) &&
+	    (r1->user.len != r2->user.len ||
+	     memcmp(r1->user.data, r2->user.data, r1->user.len) != 0))
+		return false;
+
+	return true;
+}
+
+bool nftnl_rule_cmp(const struct nftnl_rule *r1, const struct nftnl_rule *r2)
+{
+	struct nftnl_expr *e1, *e2;
+
+	if (!nftnl_rule_cmp_attr(r1, r2))
+		return false;
+
+	e2 = list_entry(r2->expr_list.next, struct nftnl_expr, head);
+	list_for_each_entry(e1, &r1->expr_list, head) {
+		if (&e2->head == &r2->expr_list || !nftnl_expr_cmp(e1, e2))
+			return false;
+
+		e2 = list_entry(e2->head.next, struct nftnl_expr, head);
+	}
+
+	return &e2->head == &r2->expr_list;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_cmp);
+
 int nftnl_expr_foreach(struct nftnl_rule *r,
                           int (*cb)(struct nftnl_expr *e, void *data),
                           void *data)
@@ -1046,10 +1183,225 @@ void nftnl_expr_iter_destroy(struct nftnl_expr_iter *iter)
 }
 EXPORT_SYMBOL(nftnl_expr_iter_destroy, nft_rule_expr_iter_destroy);
 
-struct nftnl_rule_list {
-	struct list_head list;
+/*
+ * Optional rule list index: rules are hashed by handle, and linked into a
+ * per-chain bucket that keeps the same relative order as the list itself.
+ * Rules are indexed by the handle, family, table and chain they carry when
+ * they are added, so those attributes must not change while listed.
+ */
+#define NFTNL_RULE_INDEX_MIN	64
+
+struct nftnl_rule_chain_bucket {
+	struct hlist_node	hnode;
+	uint32_t		hash;
+	uint32_t		family;
+	const char		*table;
+	const char		*chain;
+	struct list_head	rule_list;
 };
 
+struct nftnl_rule_index {
+	struct hlist_head	*handle_hash;
+	uint32_t		handle_size;
+	uint32_t		handle_count;
+	struct hlist_head	*chain_hash;
+	uint32_t		chain_size;
+	uint32_t		chain_count;
+};
+
+static uint32_t nftnl_rule_handle_slot(uint64_t handle, uint32_t size)
+{
+	return (uint32_t)((handle ^ (handle >> 32)) * 0x9e3779b1U) &
+	       (size - 1);
+}
+
+static uint32_t nftnl_rule_chain_hash(uint32_t family, const char *table,
+				      const char *chain)
+{
+	uint32_t hash = NFTNL_HASH_INIT;
+
+	hash = nftnl_hash_val(hash, family);
+	hash = nftnl_hash_str(hash, table ? table : "");
+	return nftnl_hash_str(hash, chain ? chain : "");
+}
+
+static struct hlist_head *nftnl_rule_hash_alloc(uint32_t size)
+{
+	struct hlist_head *hash;
+	uint32_t i;
+
+	hash = malloc(size * sizeof(struct hlist_head));
+	if (hash == NULL)
+		return NULL;
+
+	for (i = 0; i < size; i++)
+		INIT_HLIST_HEAD(&hash[i]);
+
+	return hash;
+}
+
+static int nftnl_rule_index_grow_handles(struct nftnl_rule_index *idx)
+{
+	uint32_t i, size = idx->handle_size * 2;
+	struct hlist_head *hash;
+	struct hlist_node *pos, *tmp;
+
+	hash = nftnl_rule_hash_alloc(size);
+	if (hash == NULL)
+		return -1;
+
+	/* entries may have been removed behind our back, recount them */
+	idx->handle_count = 0;
+	for (i = 0; i < idx->handle_size; i++) {
+		hlist_for_each_safe(pos, tmp, &idx->handle_hash[i]) {
+			struct nftnl_rule *r;
+
+			r = hlist_entry(pos, struct nftnl_rule, handle_node);
+			__hlist_del(pos);
+			hlist_add_head(pos,
+				       &hash[nftnl_rule_handle_slot(r->handle,
+								    size)]);
+			idx->handle_count++;
+		}
+	}
+	xfree(idx->handle_hash);
+	idx->handle_hash = hash;
+	idx->handle_size = size;
+
+	return 0;
+}
+
+static int nftnl_rule_index_grow_chains(struct nftnl_rule_index *idx)
+{
+	uint32_t i, size = idx->chain_size * 2;
+	struct hlist_head *hash;
+	struct hlist_node *pos, *tmp;
+
+	hash = nftnl_rule_hash_alloc(size);
+	if (hash == NULL)
+		return -1;
+
+	for (i = 0; i < idx->chain_size; i++) {
+		hlist_for_each_safe(pos, tmp, &idx->chain_hash[i]) {
+			struct nftnl_rule_chain_bucket *b;
+
+			b = hlist_entry(pos, struct nftnl_rule_chain_bucket,
+					hnode);
+			__hlist_del(pos);
+			hlist_add_head(pos, &hash[b->hash & (size - 1)]);
+		}
+	}
+	xfree(idx->chain_hash);
+	idx->chain_hash = hash;
+	idx->chain_size = size;
+
+	return 0;
+}
+
+static struct nftnl_rule_chain_bucket *
+nftnl_rule_index_chain(struct nftnl_rule_index *idx, uint32_t family,
+		       const char *table, const char *chain, bool create)
+{
+	struct nftnl_rule_chain_bucket *b;
+	struct hlist_node *pos;
+	uint32_t hash, slot;
+
+	if (table == NULL)
+		table = "";
+	if (chain == NULL)
+		chain = "";
+
+	hash = nftnl_rule_chain_hash(family, table, chain);
+	slot = hash & (idx->chain_size - 1);
+	hlist_for_each_entry(b, pos, &idx->chain_hash[slot], hnode) {
+		if (b->hash == hash && b->family == family &&
+		    strcmp(b->table, table) == 0 &&
+		    strcmp(b->chain, chain) == 0)
+			return b;
+	}
+
+	if (!create)
+		return NULL;
+
+	if (idx->chain_count >= idx->chain_size &&
+	    nftnl_rule_index_grow_chains(idx) < 0)
+		return NULL;
+
+	b = calloc(1, sizeof(struct nftnl_rule_chain_bucket));
+	if (b == NULL)
+		return NULL;
+
+	b->table = strdup(table);
+	b->chain = strdup(chain);
+	if (b->table == NULL || b->chain == NULL) {
+		xfree(b->table);
+		xfree(b->chain);
+		xfree(b);
+		return NULL;
+	}
+	b->hash = hash;
+	b->family = family;
+	INIT_LIST_HEAD(&b->rule_list);
+	slot = hash & (idx->chain_size - 1);
+	hlist_add_head(&b->hnode, &idx->chain_hash[slot]);
+	idx->chain_count++;
+
+	return b;
+}
+
+static int nftnl_rule_index_add(struct nftnl_rule_index *idx,
+				struct nftnl_rule *r, bool tail)
+{
+	struct nftnl_rule_chain_bucket *b;
+	uint32_t slot;
+
+	b = nftnl_rule_index_chain(idx, r->family, r->table, r->chain, true);
+	if (b == NULL)
+		return -1;
+
+	if (r->flags & (1 << NFTNL_RULE_HANDLE)) {
+		if (idx->handle_count >= idx->handle_size &&
+		    nftnl_rule_index_grow_handles(idx) < 0)
+			return -1;
+
+		slot = nftnl_rule_handle_slot(r->handle, idx->handle_size);
+		hlist_add_head(&r->handle_node, &idx->handle_hash[slot]);
+		idx->handle_count++;
+	}
+
+	if (tail)
+		list_add_tail(&r->chain_head, &b->rule_list);
+	else
+		list_add(&r->chain_head, &b->rule_list);
+
+	return 0;
+}
+
+static void nftnl_rule_index_unlink(struct nftnl_rule *r)
+{
+	hlist_del_init(&r->handle_node);
+	list_del_init(&r->chain_head);
+}
+
+static void nftnl_rule_index_free(struct nftnl_rule_index *idx)
+{
+	struct nftnl_rule_chain_bucket *b;
+	struct hlist_node *pos, *tmp;
+	uint32_t i;
+
+	for (i = 0; i < idx->chain_size; i++) {
+		hlist_for_each_entry_safe(b, pos, tmp, &idx->chain_hash[i],
+					  hnode) {
+			xfree(b->table);
+			xfree(b->chain);
+			xfree(b);
+		}
+	}
+	xfree(idx->chain_hash);
+	xfree(idx->handle_hash);
+	xfree(idx);
+}
+
 struct nftnl_rule_list *nftnl_rule_list_alloc(void)
 {
 	struct nftnl_rule_list *list;
@@ -1070,36 +1422,115 @@ void nftnl_rule_list_free(struct nftnl_rule_list *list)
 
 	list_for_each_entry_safe(r, tmp, &list->list, head) {
 		list_del(&r->head);
+		nftnl_rule_index_unlink(r);
 		nftnl_rule_free(r);
 	}
+	if (list->index)
+		nftnl_rule_index_free(list->index);
 	xfree(list);
 }
 EXPORT_SYMBOL(nftnl_rule_list_free, nft_rule_list_free);
 
+int nftnl_rule_list_index(struct nftnl_rule_list *list)
+{
+	struct nftnl_rule_index *idx;
+	struct nftnl_rule *r;
+
+	if (list->index)
+		return 0;
+
+	idx = calloc(1, sizeof(struct nftnl_rule_index));
+	if (idx == NULL)
+		return -1;
+
+	idx->handle_size = idx->chain_size = NFTNL_RULE_INDEX_MIN;
+	idx->handle_hash = nftnl_rule_hash_alloc(idx->handle_size);
+	idx->chain_hash = nftnl_rule_hash_alloc(idx->chain_size);
+	if (idx->handle_hash == NULL || idx->chain_hash == NULL)
+		goto err;
+
+	list_for_each_entry(r, &list->list, head) {
+		if (nftnl_rule_index_add(idx, r, true) < 0)
+			goto err;
+	}
+	list->index = idx;
+
+	return 0;
+err:
+	list_for_each_entry(r, &list->list, head)
+		nftnl_rule_index_unlink(r);
+	nftnl_rule_index_free(idx);
+	errno = ENOMEM;
+	return -1;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_index);
+
 int nftnl_rule_list_is_empty(struct nftnl_rule_list *list)
 {
 	return list_empty(&list->list);
 }
 EXPORT_SYMBOL(nftnl_rule_list_is_empty, nft_rule_list_is_empty);
 
+static void nftnl_rule_list_index_drop(struct nftnl_rule_list *list)
+{
+	struct nftnl_rule *r;
+
+	/* out of memory while indexing: fall back to the unindexed list */
+	list_for_each_entry(r, &list->list, head)
+		nftnl_rule_index_unlink(r);
+	nftnl_rule_index_free(list->index);
+	list->index = NULL;
+}
+
 void nftnl_rule_list_add(struct nftnl_rule *r, struct nftnl_rule_list *list)
 {
 	list_add(&r->head, &list->list);
+	if (list->index && nftnl_rule_index_add(list->index, r, false) < 0)
+		nftnl_rule_list_index_drop(list);
 }
 EXPORT_SYMBOL(nftnl_rule_list_add, nft_rule_list_add);
 
 void nftnl_rule_list_add_tail(struct nftnl_rule *r, struct nftnl_rule_list *list)
 {
 	list_add_tail(&r->head, &list->list);
+	if (list->index && nftnl_rule_index_add(list->index, r, true) < 0)
+		nftnl_rule_list_index_drop(list);
 }
 EXPORT_SYMBOL(nftnl_rule_list_add_tail, nft_rule_list_add_tail);
 
 void nftnl_rule_list_del(struct nftnl_rule *r)
 {
 	list_del(&r->head);
+	nftnl_rule_index_unlink(r);
 }
 EXPORT_SYMBOL(nftnl_rule_list_del, nft_rule_list_del);
 
+struct nftnl_rule *nftnl_rule_list_lookup_handle(struct nftnl_rule_list *list,
+						 uint64_t handle)
+{
+	struct nftnl_rule_index *idx = list->index;
+	struct hlist_node *pos;
+	struct nftnl_rule *r;
+	uint32_t slot;
+
+	if (idx == NULL) {
+		list_for_each_entry(r, &list->list, head) {
+			if (r->flags & (1 << NFTNL_RULE_HANDLE) &&
+			    r->handle == handle)
+				return r;
+		}
+		return NULL;
+	}
+
+	slot = nftnl_rule_handle_slot(handle, idx->handle_size);
+	hlist_for_each_entry(r, pos, &idx->handle_hash[slot], handle_node) {
+		if (r->handle == handle)
+			return r;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_lookup_handle);
+
 int nftnl_rule_list_foreach(struct nftnl_rule_list *rule_list,
 			  int (*cb)(struct nftnl_rule *r, void *data),
 			  void *data)
@@ -1119,6 +1550,7 @@ EXPORT_SYMBOL(nftnl_rule_list_foreach, nft_rule_list_foreach);
 struct nftnl_rule_list_iter {
 	struct nftnl_rule_list	*list;
 	struct nftnl_rule		*cur;
+	struct list_head	*chain;
 };
 
 struct nftnl_rule_list_iter *nftnl_rule_list_iter_create(struct nftnl_rule_list *l)
@@ -1139,6 +1571,33 @@ struct nftnl_rule_list_iter *nftnl_rule_list_iter_create(struct nftnl_rule_list
 }
 EXPORT_SYMBOL(nftnl_rule_list_iter_create, nft_rule_list_iter_create);
 
+struct nftnl_rule_list_iter *
+nftnl_rule_list_iter_create_chain(struct nftnl_rule_list *l, uint32_t family,
+				  const char *table, const char *chain)
+{
+	struct nftnl_rule_chain_bucket *b;
+	struct nftnl_rule_list_iter *iter;
+
+	if (nftnl_rule_list_index(l) < 0)
+		return NULL;
+
+	iter = calloc(1, sizeof(struct nftnl_rule_list_iter));
+	if (iter == NULL)
+		return NULL;
+
+	iter->list = l;
+	b = nftnl_rule_index_chain(l->index, family, table, chain, false);
+	if (b == NULL || list_empty(&b->rule_list))
+		return iter;
+
+	iter->chain = &b->rule_list;
+	iter->cur = list_entry(b->rule_list.next, struct nftnl_rule,
+			       chain_head);
+
+	return iter;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_iter_create_chain);
+
 struct nftnl_rule *nftnl_rule_list_iter_cur(struct nftnl_rule_list_iter *iter)
 {
 	return iter->cur;
@@ -1152,6 +1611,15 @@ struct nftnl_rule *nftnl_rule_list_iter_next(struct nftnl_rule_list_iter *iter)
 	if (r == NULL)
 		return NULL;
 
+	if (iter->chain) {
+		if (r->chain_head.next == iter->chain)
+			iter->cur = NULL;
+		else
+			iter->cur = list_entry(r->chain_head.next,
+					       struct nftnl_rule, chain_head);
+		return r;
+	}
+
 	/* get next rule, if any */
 	iter->cur = list_entry(iter->cur->head.next, struct nftnl_rule, head);
 	if (&iter->cur->head == iter->list->list.next)
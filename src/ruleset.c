@@ -15,13 +15,21 @@
 
 #include "internal.h"
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <libmnl/libmnl.h>
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
 #include <libnftnl/ruleset.h>
 #include <libnftnl/table.h>
 #include <libnftnl/chain.h>
 #include <libnftnl/set.h>
 #include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/snapshot.h>
 
 struct nftnl_ruleset {
 	struct nftnl_table_list	*table_list;
@@ -53,6 +61,7 @@ struct nftnl_parse_ctx {
 	uint32_t format;
 	uint32_t set_id;
 	struct nftnl_set_list *set_list;
+	struct nftnl_ruleset_pool *pool;
 
 	int (*cb)(const struct nftnl_parse_ctx *ctx);
 	uint16_t flags;
@@ -219,7 +228,6 @@ uint32_t nftnl_ruleset_ctx_get_u32(const struct nftnl_parse_ctx *ctx, uint16_t a
 }
 EXPORT_SYMBOL(nftnl_ruleset_ctx_get_u32, nft_ruleset_ctx_get_u32);
 
-#if defined(JSON_PARSING) || defined(XML_PARSING)
 static void nftnl_ruleset_ctx_set(struct nftnl_parse_ctx *ctx, uint16_t attr,
 				void *data)
 {
@@ -255,6 +263,7 @@ static void nftnl_ruleset_ctx_set_u32(struct nftnl_parse_ctx *ctx, uint16_t attr
 	nftnl_ruleset_ctx_set(ctx, attr, &val);
 }
 
+#if defined(JSON_PARSING) || defined(XML_PARSING)
 static int nftnl_ruleset_parse_tables(struct nftnl_parse_ctx *ctx,
 				    struct nftnl_parse_err *err)
 {
@@ -331,19 +340,37 @@ err:
 	return -1;
 }
 
-static int nftnl_ruleset_parse_set(struct nftnl_parse_ctx *ctx,
-				 struct nftnl_set *set, uint32_t type,
-				 struct nftnl_parse_err *err)
+static int nftnl_ruleset_set_register(struct nftnl_parse_ctx *ctx,
+				      struct nftnl_set *set)
 {
 	struct nftnl_set *newset;
 
 	nftnl_set_set_u32(set, NFTNL_SET_ID, ctx->set_id++);
 
-	newset = nftnl_set_clone(set);
+	/* rules only look sets up by name, the elements are not kept */
+	newset = nftnl_set_alloc();
 	if (newset == NULL)
-		goto err;
+		return -1;
+
+	if (nftnl_set_is_set(set, NFTNL_SET_TABLE))
+		nftnl_set_set_str(newset, NFTNL_SET_TABLE,
+				  nftnl_set_get_str(set, NFTNL_SET_TABLE));
+	if (nftnl_set_is_set(set, NFTNL_SET_NAME))
+		nftnl_set_set_str(newset, NFTNL_SET_NAME,
+				  nftnl_set_get_str(set, NFTNL_SET_NAME));
+	nftnl_set_set_u32(newset, NFTNL_SET_ID, ctx->set_id - 1);
 
 	nftnl_set_list_add_tail(newset, ctx->set_list);
+	return 0;
+}
+
+static int nftnl_ruleset_parse_set(struct nftnl_parse_ctx *ctx,
+				 struct nftnl_set *set, uint32_t type,
+				 struct nftnl_parse_err *err)
+{
+	/* threaded decoding has no set list, sets are registered on delivery */
+	if (ctx->set_list != NULL && nftnl_ruleset_set_register(ctx, set) < 0)
+		goto err;
 
 	nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_TYPE, type);
 	nftnl_ruleset_ctx_set(ctx, NFTNL_RULESET_CTX_SET, set);
@@ -468,54 +495,352 @@ err:
 #endif
 
 #ifdef JSON_PARSING
-static int nftnl_ruleset_json_parse_ruleset(struct nftnl_parse_ctx *ctx,
-					  struct nftnl_parse_err *err)
+static int nftnl_ruleset_json_parse_node(struct nftnl_parse_ctx *ctx,
+					 struct nftnl_parse_err *err)
 {
-	json_t *node, *array = ctx->json;
-	int len, i, ret;
+	json_t *node = ctx->json;
+
+	if (nftnl_jansson_node_exist(node, "table"))
+		return nftnl_ruleset_parse_tables(ctx, err);
+	else if (nftnl_jansson_node_exist(node, "chain"))
+		return nftnl_ruleset_parse_chains(ctx, err);
+	else if (nftnl_jansson_node_exist(node, "set"))
+		return nftnl_ruleset_parse_sets(ctx, err);
+	else if (nftnl_jansson_node_exist(node, "rule"))
+		return nftnl_ruleset_parse_rules(ctx, err);
+	else if (nftnl_jansson_node_exist(node, "element"))
+		return nftnl_ruleset_parse_set_elems(ctx, err);
+
+	errno = EINVAL;
+	return -1;
+}
 
-	len = json_array_size(array);
-	for (i = 0; i < len; i++) {
-		node = json_array_get(array, i);
-		if (node == NULL) {
-			errno = EINVAL;
-			return -1;
+/*
+ * Threaded import: the calling thread tokenizes the document and queues
+ * each object as a job in a window of slots. Worker threads claim batches of
+ * jobs in order and decode them without a set list, so lookups are left
+ * unresolved. The calling thread delivers the decoded objects in document
+ * order, registering sets and resolving the set IDs of lookups right before
+ * each callback, as the sequential parser does. When the next job to
+ * deliver was not claimed yet, it decodes it itself instead of waiting.
+ */
+#define NFTNL_RULESET_POOL_SLOTS	256	/* per thread */
+#define NFTNL_RULESET_POOL_BATCH	32	/* jobs claimed at once */
+
+struct nftnl_ruleset_job {
+	json_t			*json;
+	uint32_t		cmd;
+	uint32_t		type;
+	void			*obj;
+	int			ret;
+	int			error;
+	struct nftnl_parse_err	err;
+	bool			done;
+};
+
+struct nftnl_ruleset_pool {
+	pthread_mutex_t		lock;
+	pthread_cond_t		work;	/* a job was queued */
+	pthread_cond_t		done;	/* the next job to deliver is done */
+	struct nftnl_ruleset_job *jobs;
+	uint32_t		mask;
+	uint64_t		queued;
+	uint64_t		claimed;
+	uint64_t		delivered;
+	bool			stop;
+	pthread_t		*threads;
+	unsigned int		nthreads;
+};
+
+static int nftnl_ruleset_job_capture(const struct nftnl_parse_ctx *ctx)
+{
+	struct nftnl_ruleset_job *job = ctx->data;
+
+	job->type = ctx->type;
+	job->obj = ctx->table;		/* any member of the object union */
+	return 0;
+}
+
+static void nftnl_ruleset_job_decode(struct nftnl_ruleset_job *job)
+{
+	struct nftnl_parse_ctx ctx = {
+		.format	= NFTNL_OUTPUT_JSON,
+		.json	= job->json,
+		.data	= job,
+		.cb	= nftnl_ruleset_job_capture,
+	};
+
+	memset(&job->err, 0, sizeof(job->err));
+	job->ret = nftnl_ruleset_json_parse_node(&ctx, &job->err);
+	job->error = errno;
+
+	nftnl_jansson_free_root(job->json);
+	job->json = NULL;
+}
+
+static void nftnl_ruleset_rule_resolve(struct nftnl_parse_ctx *ctx,
+				       struct nftnl_rule *r)
+{
+	struct nftnl_expr *e;
+	uint32_t set_id;
+
+	list_for_each_entry(e, &r->expr_list, head) {
+		if (strcmp(e->ops->name, "lookup") == 0 &&
+		    nftnl_set_lookup_id(e, ctx->set_list, &set_id))
+			nftnl_expr_set_u32(e, NFTNL_EXPR_LOOKUP_SET_ID, set_id);
+	}
+}
+
+static int nftnl_ruleset_job_deliver(struct nftnl_parse_ctx *ctx,
+				     struct nftnl_ruleset_job *job,
+				     struct nftnl_parse_err *err)
+{
+	if (job->ret < 0) {
+		*err = job->err;
+		errno = job->error;
+		return -1;
+	}
+
+	nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_CMD, job->cmd);
+	nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_TYPE, job->type);
+	switch (job->type) {
+	case NFTNL_RULESET_TABLE:
+		nftnl_ruleset_ctx_set(ctx, NFTNL_RULESET_CTX_TABLE, job->obj);
+		break;
+	case NFTNL_RULESET_CHAIN:
+		nftnl_ruleset_ctx_set(ctx, NFTNL_RULESET_CTX_CHAIN, job->obj);
+		break;
+	case NFTNL_RULESET_RULE:
+		nftnl_ruleset_rule_resolve(ctx, job->obj);
+		nftnl_ruleset_ctx_set(ctx, NFTNL_RULESET_CTX_RULE, job->obj);
+		break;
+	case NFTNL_RULESET_SET:
+	case NFTNL_RULESET_SET_ELEMS:
+		nftnl_ruleset_ctx_set(ctx, NFTNL_RULESET_CTX_SET, job->obj);
+		if (nftnl_ruleset_set_register(ctx, job->obj) < 0)
+			goto err;
+		break;
+	}
+
+	if (ctx->cb(ctx) < 0)
+		goto err;
+
+	return 0;
+err:
+	nftnl_ruleset_ctx_free(ctx);
+	return -1;
+}
+
+static void *nftnl_ruleset_pool_worker(void *data)
+{
+	struct nftnl_ruleset_pool *pool = data;
+	struct nftnl_ruleset_job *job;
+	uint64_t seq, first, last;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->stop && pool->claimed == pool->queued)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if (pool->stop)
+			break;
+
+		first = pool->claimed;
+		last = pool->queued;
+		if (last - first > NFTNL_RULESET_POOL_BATCH)
+			last = first + NFTNL_RULESET_POOL_BATCH;
+		pool->claimed = last;
+		pthread_mutex_unlock(&pool->lock);
+
+		for (seq = first; seq < last; seq++) {
+			job = &pool->jobs[seq & pool->mask];
+			if (job->json != NULL)
+				nftnl_ruleset_job_decode(job);
 		}
 
-		ctx->json = node;
-		if (nftnl_jansson_node_exist(node, "table"))
-			ret = nftnl_ruleset_parse_tables(ctx, err);
-		else if (nftnl_jansson_node_exist(node, "chain"))
-			ret = nftnl_ruleset_parse_chains(ctx, err);
-		else if (nftnl_jansson_node_exist(node, "set"))
-			ret = nftnl_ruleset_parse_sets(ctx, err);
-		else if (nftnl_jansson_node_exist(node, "rule"))
-			ret = nftnl_ruleset_parse_rules(ctx, err);
-		else if (nftnl_jansson_node_exist(node, "element"))
-			ret = nftnl_ruleset_parse_set_elems(ctx, err);
-		else
-			return -1;
+		pthread_mutex_lock(&pool->lock);
+		for (seq = first; seq < last; seq++)
+			pool->jobs[seq & pool->mask].done = true;
+		if (pool->delivered >= first && pool->delivered < last)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
 
-		if (ret < 0)
-			return ret;
+	nftnl_expr_cache_thread_exit();
+	return NULL;
+}
+
+static void nftnl_ruleset_pool_free(struct nftnl_ruleset_pool *pool)
+{
+	struct nftnl_parse_ctx ctx;
+	struct nftnl_ruleset_job *job;
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	/* jobs left behind by an error */
+	for (; pool->delivered < pool->queued; pool->delivered++) {
+		job = &pool->jobs[pool->delivered & pool->mask];
+		if (job->json != NULL) {
+			nftnl_jansson_free_root(job->json);
+		} else if (job->ret == 0) {
+			ctx.type = job->type;
+			ctx.table = job->obj;
+			nftnl_ruleset_ctx_free(&ctx);
+		}
 	}
 
-	if (len == 0 && ctx->cmd == NFTNL_CMD_FLUSH) {
-		nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_TYPE,
-					NFTNL_RULESET_RULESET);
-		if (ctx->cb(ctx) < 0)
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	xfree(pool->threads);
+	xfree(pool->jobs);
+	xfree(pool);
+}
+
+static struct nftnl_ruleset_pool *nftnl_ruleset_pool_alloc(unsigned int threads)
+{
+	struct nftnl_ruleset_pool *pool;
+	uint32_t slots = 1;
+
+	pool = calloc(1, sizeof(struct nftnl_ruleset_pool));
+	if (pool == NULL)
+		return NULL;
+
+	while (slots < threads * NFTNL_RULESET_POOL_SLOTS)
+		slots <<= 1;
+	pool->mask = slots - 1;
+
+	pool->jobs = calloc(slots, sizeof(struct nftnl_ruleset_job));
+	pool->threads = calloc(threads, sizeof(pthread_t));
+	if (pool->jobs == NULL || pool->threads == NULL) {
+		xfree(pool->jobs);
+		xfree(pool->threads);
+		xfree(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	/* run with the threads we get */
+	for (; pool->nthreads < threads; pool->nthreads++) {
+		if (pthread_create(&pool->threads[pool->nthreads], NULL,
+				   nftnl_ruleset_pool_worker, pool) != 0)
+			break;
+	}
+	if (pool->nthreads == 0) {
+		nftnl_ruleset_pool_free(pool);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * Deliver the decoded jobs in document order, waiting for those queued
+ * before @upto. Only the calling thread updates the queued and delivered
+ * counters, the workers read them under the lock.
+ */
+static int nftnl_ruleset_pool_deliver(struct nftnl_ruleset_pool *pool,
+				      struct nftnl_parse_ctx *ctx,
+				      struct nftnl_parse_err *err,
+				      uint64_t upto)
+{
+	struct nftnl_ruleset_job *job;
+	bool done;
+	int ret;
+
+	while (pool->delivered < pool->queued) {
+		job = &pool->jobs[pool->delivered & pool->mask];
+
+		pthread_mutex_lock(&pool->lock);
+		if (!job->done && pool->delivered < upto &&
+		    pool->claimed == pool->delivered) {
+			/* no worker took it yet, decode it here */
+			pool->claimed++;
+			pthread_mutex_unlock(&pool->lock);
+			nftnl_ruleset_job_decode(job);
+			pthread_mutex_lock(&pool->lock);
+			job->done = true;
+		}
+		while (!job->done && pool->delivered < upto)
+			pthread_cond_wait(&pool->done, &pool->lock);
+		done = job->done;
+		pthread_mutex_unlock(&pool->lock);
+		if (!done)
+			break;
+
+		ret = nftnl_ruleset_job_deliver(ctx, job, err);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->delivered++;
+		pthread_mutex_unlock(&pool->lock);
+		if (ret < 0)
 			return -1;
 	}
 
 	return 0;
 }
 
-static int nftnl_ruleset_json_parse_cmd(const char *cmd,
-				      struct nftnl_parse_err *err,
-				      struct nftnl_parse_ctx *ctx)
+/*
+ * Queue the object @json of command @cmd, a NULL object stands for an empty
+ * flush. ctx->cmd cannot be used: delivering sets it to the command of each
+ * delivered job.
+ */
+static int nftnl_ruleset_pool_submit(struct nftnl_ruleset_pool *pool,
+				     struct nftnl_parse_ctx *ctx,
+				     struct nftnl_parse_err *err, json_t *json,
+				     uint32_t cmd)
+{
+	struct nftnl_ruleset_job *job;
+	uint64_t upto = 0;
+
+	if (pool->queued - pool->delivered > pool->mask)
+		upto = pool->delivered + 1;	/* the window is full */
+
+	if (nftnl_ruleset_pool_deliver(pool, ctx, err, upto) < 0) {
+		if (json != NULL)
+			nftnl_jansson_free_root(json);
+		return -1;
+	}
+
+	job = &pool->jobs[pool->queued & pool->mask];
+	job->json = json;
+	job->cmd = cmd;
+	job->done = json == NULL;
+	if (json == NULL) {
+		job->type = NFTNL_RULESET_RULESET;
+		job->ret = 0;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->queued++;
+	if (pool->queued - pool->claimed >= NFTNL_RULESET_POOL_BATCH)
+		pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/*
+ * Each object of the command array is built and handed to the callback as
+ * soon as it is closed, then released: only one is held in memory at once.
+ */
+static int nftnl_ruleset_json_parse_cmd(struct nftnl_json_stream *js,
+					const char *cmd,
+					struct nftnl_parse_err *err,
+					struct nftnl_parse_ctx *ctx)
 {
 	uint32_t cmdnum;
-	json_t *nodecmd;
+	int len = 0, ret;
 
 	cmdnum = nftnl_str2cmd(cmd);
 	if (cmdnum == NFTNL_CMD_UNSPEC) {
@@ -526,17 +851,122 @@ static int nftnl_ruleset_json_parse_cmd(const char *cmd,
 
 	nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_CMD, cmdnum);
 
-	nodecmd = json_object_get(ctx->json, cmd);
-	if (nodecmd == NULL)
-		return 0;
+	if (nftnl_json_stream_expect(js, '[') < 0)
+		return -1;
 
-	ctx->json = nodecmd;
-	if (nftnl_ruleset_json_parse_ruleset(ctx, err) != 0)
-		goto err;
+	if (nftnl_json_stream_peek(js) == ']') {
+		nftnl_json_stream_expect(js, ']');
+		ret = 0;
+	} else {
+		do {
+			ctx->json = nftnl_json_stream_value(js);
+			if (ctx->json == NULL)
+				return -1;
+
+			if (ctx->pool != NULL) {
+				ret = nftnl_ruleset_pool_submit(ctx->pool, ctx,
+								err, ctx->json,
+								cmdnum);
+			} else {
+				ret = nftnl_ruleset_json_parse_node(ctx, err);
+				nftnl_jansson_free_root(ctx->json);
+			}
+			ctx->json = NULL;
+			if (ret < 0)
+				return ret;
+			len++;
+		} while ((ret = nftnl_json_stream_next(js, ']')) > 0);
+	}
+	if (ret < 0)
+		return ret;
+
+	if (len == 0 && cmdnum == NFTNL_CMD_FLUSH) {
+		if (ctx->pool != NULL)
+			return nftnl_ruleset_pool_submit(ctx->pool, ctx, err,
+							 NULL, cmdnum);
+
+		nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_TYPE,
+					NFTNL_RULESET_RULESET);
+		if (ctx->cb(ctx) < 0)
+			return -1;
+	}
 
 	return 0;
-err:
-	return -1;
+}
+
+static int nftnl_ruleset_json_parse_cmds(struct nftnl_json_stream *js,
+					 struct nftnl_parse_err *err,
+					 struct nftnl_parse_ctx *ctx)
+{
+	const char *key;
+	int ret;
+
+	if (nftnl_json_stream_expect(js, '[') < 0)
+		return -1;
+
+	if (nftnl_json_stream_peek(js) == ']')
+		return nftnl_json_stream_expect(js, ']');
+
+	do {
+		if (nftnl_json_stream_expect(js, '{') < 0)
+			return -1;
+		do {
+			key = nftnl_json_stream_key(js);
+			if (key == NULL ||
+			    nftnl_ruleset_json_parse_cmd(js, key, err, ctx) < 0)
+				return -1;
+		} while ((ret = nftnl_json_stream_next(js, '}')) > 0);
+		if (ret < 0)
+			return -1;
+	} while ((ret = nftnl_json_stream_next(js, ']')) > 0);
+
+	return ret;
+}
+
+static int nftnl_ruleset_json_parse_root(struct nftnl_json_stream *js,
+					 struct nftnl_parse_err *err,
+					 struct nftnl_parse_ctx *ctx)
+{
+	bool found = false;
+	const char *key;
+	json_t *node;
+	int ret;
+
+	if (nftnl_json_stream_expect(js, '{') < 0)
+		return -1;
+
+	if (nftnl_json_stream_peek(js) != '}') {
+		do {
+			key = nftnl_json_stream_key(js);
+			if (key == NULL)
+				return -1;
+
+			if (strcmp(key, "nftables") == 0) {
+				found = true;
+				if (nftnl_ruleset_json_parse_cmds(js, err,
+								  ctx) < 0)
+					return -1;
+				continue;
+			}
+
+			/* not ours, skipped */
+			node = nftnl_json_stream_value(js);
+			if (node == NULL)
+				return -1;
+			nftnl_jansson_free_root(node);
+		} while ((ret = nftnl_json_stream_next(js, '}')) > 0);
+		if (ret < 0)
+			return -1;
+	} else {
+		nftnl_json_stream_expect(js, '}');
+	}
+
+	if (!found) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return nftnl_json_stream_end(js);
 }
 #endif
 
@@ -544,59 +974,56 @@ static int nftnl_ruleset_json_parse(const void *json,
 				  struct nftnl_parse_err *err,
 				  enum nftnl_parse_input input,
 				  enum nftnl_parse_type type, void *arg,
-				  int (*cb)(const struct nftnl_parse_ctx *ctx))
+				  int (*cb)(const struct nftnl_parse_ctx *ctx),
+				  unsigned int threads)
 {
 #ifdef JSON_PARSING
-	json_t *root, *array, *node;
-	json_error_t error;
-	int i, len;
-	const char *key;
+	struct nftnl_json_stream js;
 	struct nftnl_parse_ctx ctx;
+	int ret;
 
 	ctx.cb = cb;
 	ctx.format = type;
+	ctx.set_id = 0;
+	ctx.pool = NULL;
 
 	ctx.set_list = nftnl_set_list_alloc();
 	if (ctx.set_list == NULL)
 		return -1;
 
+	/* every lookup expression resolves its set by name */
+	if (nftnl_set_list_index(ctx.set_list) < 0) {
+		nftnl_set_list_free(ctx.set_list);
+		return -1;
+	}
+
 	if (arg != NULL)
 		nftnl_ruleset_ctx_set(&ctx, NFTNL_RULESET_CTX_DATA, arg);
 
-	root = nftnl_jansson_create_root(json, &error, err, input);
-	if (root == NULL)
-		goto err1;
-
-	array = json_object_get(root, "nftables");
-	if (array == NULL) {
-		errno = EINVAL;
-		goto err2;
-	}
-
-	len = json_array_size(array);
-	for (i = 0; i < len; i++) {
-		node = json_array_get(array, i);
-		if (node == NULL) {
-			errno = EINVAL;
-			goto err2;
+	if (threads > 1) {
+		ctx.pool = nftnl_ruleset_pool_alloc(threads);
+		if (ctx.pool == NULL) {
+			nftnl_set_list_free(ctx.set_list);
+			return -1;
 		}
-		ctx.json = node;
-		key = json_object_iter_key(json_object_iter(node));
-		if (key == NULL)
-			goto err2;
+	}
 
-		if (nftnl_ruleset_json_parse_cmd(key, err, &ctx) < 0)
-			goto err2;
+	if (nftnl_json_stream_init(&js, json, input, err) < 0) {
+		ret = -1;
+		goto out;
 	}
 
+	ret = nftnl_ruleset_json_parse_root(&js, err, &ctx);
+	if (ret >= 0 && ctx.pool != NULL)
+		ret = nftnl_ruleset_pool_deliver(ctx.pool, &ctx, err,
+						 ctx.pool->queued);
+
+	nftnl_json_stream_fini(&js);
+out:
+	if (ctx.pool != NULL)
+		nftnl_ruleset_pool_free(ctx.pool);
 	nftnl_set_list_free(ctx.set_list);
-	nftnl_jansson_free_root(root);
-	return 0;
-err2:
-	nftnl_jansson_free_root(root);
-err1:
-	nftnl_set_list_free(ctx.set_list);
-	return -1;
+	return ret < 0 ? -1 : 0;
 #else
 	errno = EOPNOTSUPP;
 	return -1;
@@ -604,73 +1031,130 @@ err1:
 }
 
 #ifdef XML_PARSING
-static int nftnl_ruleset_xml_parse_ruleset(struct nftnl_parse_ctx *ctx,
-					 struct nftnl_parse_err *err)
+static int nftnl_ruleset_xml_parse_node(struct nftnl_parse_ctx *ctx,
+					struct nftnl_parse_err *err)
 {
-	const char *node_type;
-	mxml_node_t *node, *array = ctx->xml;
-	int len = 0, ret;
-
-	for (node = mxmlFindElement(array, array, NULL, NULL, NULL,
-				    MXML_DESCEND_FIRST);
-	     node != NULL;
-	     node = mxmlFindElement(node, array, NULL, NULL, NULL,
-				    MXML_NO_DESCEND)) {
-		len++;
-		node_type = node->value.opaque;
-		ctx->xml = node;
-		if (strcmp(node_type, "table") == 0)
-			ret = nftnl_ruleset_parse_tables(ctx, err);
-		else if (strcmp(node_type, "chain") == 0)
-			ret = nftnl_ruleset_parse_chains(ctx, err);
-		else if (strcmp(node_type, "set") == 0)
-			ret = nftnl_ruleset_parse_sets(ctx, err);
-		else if (strcmp(node_type, "rule") == 0)
-			ret = nftnl_ruleset_parse_rules(ctx, err);
-		else if (strcmp(node_type, "element") == 0)
-			ret = nftnl_ruleset_parse_set_elems(ctx, err);
-		else
-			return -1;
-
-		if (ret < 0)
-			return ret;
-	}
+	const char *node_type = ctx->xml->value.opaque;
+
+	if (strcmp(node_type, "table") == 0)
+		return nftnl_ruleset_parse_tables(ctx, err);
+	else if (strcmp(node_type, "chain") == 0)
+		return nftnl_ruleset_parse_chains(ctx, err);
+	else if (strcmp(node_type, "set") == 0)
+		return nftnl_ruleset_parse_sets(ctx, err);
+	else if (strcmp(node_type, "rule") == 0)
+		return nftnl_ruleset_parse_rules(ctx, err);
+	else if (strcmp(node_type, "element") == 0)
+		return nftnl_ruleset_parse_set_elems(ctx, err);
+
+	errno = EINVAL;
+	return -1;
+}
 
-	if (len == 0 && ctx->cmd == NFTNL_CMD_FLUSH) {
-		nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_TYPE,
-					NFTNL_RULESET_RULESET);
-		if (ctx->cb(ctx) < 0)
-			return -1;
-	}
+enum {
+	NFTNL_XML_DEPTH_ROOT	= 1,
+	NFTNL_XML_DEPTH_CMD,
+	NFTNL_XML_DEPTH_OBJ,
+};
 
-	return 0;
-}
+struct nftnl_ruleset_xml_stream {
+	struct nftnl_parse_ctx	*ctx;
+	struct nftnl_parse_err	*err;
+	int			depth;
+	int			len;
+	bool			root;
+	int			ret;
+};
 
-static int nftnl_ruleset_xml_parse_cmd(const char *cmd, struct nftnl_parse_err *err,
-				     struct nftnl_parse_ctx *ctx)
+static void nftnl_ruleset_xml_stream_open(struct nftnl_ruleset_xml_stream *xs,
+					  mxml_node_t *node)
 {
+	const char *name = node->value.opaque;
 	uint32_t cmdnum;
-	mxml_node_t *nodecmd;
 
-	cmdnum = nftnl_str2cmd(cmd);
-	if (cmdnum == NFTNL_CMD_UNSPEC) {
-		err->error = NFTNL_PARSE_EMISSINGNODE;
-		err->node_name = strdup(cmd);
-		return -1;
+	switch (++xs->depth) {
+	case NFTNL_XML_DEPTH_ROOT:
+		if (strcmp(name, "nftables") != 0) {
+			xs->err->error = NFTNL_PARSE_EMISSINGNODE;
+			xs->err->node_name = "nftables";
+			errno = EINVAL;
+			xs->ret = -1;
+		}
+		xs->root = true;
+		break;
+	case NFTNL_XML_DEPTH_CMD:
+		cmdnum = nftnl_str2cmd(name);
+		if (cmdnum == NFTNL_CMD_UNSPEC) {
+			xs->err->error = NFTNL_PARSE_EMISSINGNODE;
+			xs->err->node_name = strdup(name);
+			xs->ret = -1;
+			break;
+		}
+		nftnl_ruleset_ctx_set_u32(xs->ctx, NFTNL_RULESET_CTX_CMD,
+					  cmdnum);
+		xs->len = 0;
+		break;
+	case NFTNL_XML_DEPTH_OBJ:
+		xs->len++;
+		break;
+	default:
+		/* keep the object subtree until the object is closed */
+		mxmlRetain(node);
+		break;
 	}
+}
 
-	nodecmd = mxmlFindElement(ctx->xml, ctx->xml, cmd, NULL, NULL,
-				  MXML_DESCEND_FIRST);
+static void nftnl_ruleset_xml_stream_close(struct nftnl_ruleset_xml_stream *xs,
+					   mxml_node_t *node)
+{
+	struct nftnl_parse_ctx *ctx = xs->ctx;
+
+	switch (xs->depth--) {
+	case NFTNL_XML_DEPTH_CMD:
+		if (xs->len == 0 && ctx->cmd == NFTNL_CMD_FLUSH) {
+			nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_TYPE,
+						  NFTNL_RULESET_RULESET);
+			if (ctx->cb(ctx) < 0)
+				xs->ret = -1;
+		}
+		break;
+	case NFTNL_XML_DEPTH_OBJ:
+		/* mxml releases the object and its subtree once we return */
+		ctx->xml = node;
+		xs->ret = nftnl_ruleset_xml_parse_node(ctx, xs->err);
+		ctx->xml = NULL;
+		break;
+	}
+}
 
-	ctx->xml = nodecmd;
-	nftnl_ruleset_ctx_set_u32(ctx, NFTNL_RULESET_CTX_CMD, cmdnum);
+/*
+ * SAX callback: nodes below an object are retained while it is open, the
+ * whole object is parsed and delivered when its close tag is seen, then
+ * mxml drops it. Only one object is held in memory at once.
+ */
+static void nftnl_ruleset_xml_stream_cb(mxml_node_t *node,
+					mxml_sax_event_t event, void *data)
+{
+	struct nftnl_ruleset_xml_stream *xs = data;
 
-	if (nftnl_ruleset_xml_parse_ruleset(ctx, err) != 0)
-		goto err;
+	/* mxml cannot be stopped, skip the rest of the document */
+	if (xs->ret < 0)
+		return;
 
-	return 0;
-err:
-	return -1;
+	switch (event) {
+	case MXML_SAX_ELEMENT_OPEN:
+		nftnl_ruleset_xml_stream_open(xs, node);
+		break;
+	case MXML_SAX_ELEMENT_CLOSE:
+		nftnl_ruleset_xml_stream_close(xs, node);
+		break;
+	case MXML_SAX_DATA:
+		if (xs->depth >= NFTNL_XML_DEPTH_OBJ)
+			mxmlRetain(node);
+		break;
+	default:
+		break;
+	}
 }
 #endif
 
@@ -680,40 +1164,46 @@ static int nftnl_ruleset_xml_parse(const void *xml, struct nftnl_parse_err *err,
 				 int (*cb)(const struct nftnl_parse_ctx *ctx))
 {
 #ifdef XML_PARSING
-	mxml_node_t *tree, *nodecmd = NULL;
-	char *cmd;
+	struct nftnl_ruleset_xml_stream xs = {
+		.err	= err,
+	};
 	struct nftnl_parse_ctx ctx;
 
 	ctx.cb = cb;
 	ctx.format = type;
+	ctx.set_id = 0;
+	ctx.xml = NULL;
 
 	ctx.set_list = nftnl_set_list_alloc();
 	if (ctx.set_list == NULL)
 		return -1;
 
+	/* every lookup expression resolves its set by name */
+	if (nftnl_set_list_index(ctx.set_list) < 0) {
+		nftnl_set_list_free(ctx.set_list);
+		return -1;
+	}
+
 	if (arg != NULL)
 		nftnl_ruleset_ctx_set(&ctx, NFTNL_RULESET_CTX_DATA, arg);
 
-	tree = nftnl_mxml_build_tree(xml, "nftables", err, input);
-	if (tree == NULL)
-		goto err1;
-
-	ctx.xml = tree;
+	xs.ctx = &ctx;
+	if (nftnl_mxml_sax_load(xml, input, nftnl_ruleset_xml_stream_cb, &xs,
+				err) < 0)
+		goto err;
+	if (xs.ret < 0)
+		goto err;
 
-	nodecmd = mxmlWalkNext(tree, tree, MXML_DESCEND_FIRST);
-	while (nodecmd != NULL) {
-		cmd = nodecmd->value.opaque;
-		if (nftnl_ruleset_xml_parse_cmd(cmd, err, &ctx) < 0)
-			goto err2;
-		nodecmd = mxmlWalkNext(tree, tree, MXML_NO_DESCEND);
+	if (!xs.root) {
+		err->error = NFTNL_PARSE_EMISSINGNODE;
+		err->node_name = "nftables";
+		errno = EINVAL;
+		goto err;
 	}
 
 	nftnl_set_list_free(ctx.set_list);
-	mxmlDelete(tree);
 	return 0;
-err2:
-	mxmlDelete(tree);
-err1:
+err:
 	nftnl_set_list_free(ctx.set_list);
 	return -1;
 #else
@@ -722,10 +1212,108 @@ err1:
 #endif
 }
 
+static void *nftnl_ruleset_snapshot_get(const struct nftnl_snapshot *snap,
+					enum nftnl_ruleset_type type,
+					uint32_t index)
+{
+	switch (type) {
+	case NFTNL_RULESET_TABLE:
+		return nftnl_snapshot_get_table(snap, index);
+	case NFTNL_RULESET_CHAIN:
+		return nftnl_snapshot_get_chain(snap, index);
+	case NFTNL_RULESET_SET:
+		return nftnl_snapshot_get_set(snap, index);
+	case NFTNL_RULESET_RULE:
+		return nftnl_snapshot_get_rule(snap, index);
+	default:
+		return NULL;
+	}
+}
+
+/* objects are delivered in the order nftnl_ruleset_fprintf() writes them */
+static int nftnl_ruleset_snapshot_parse(const void *data,
+				struct nftnl_parse_err *err,
+				enum nftnl_parse_input input, void *arg,
+				int (*cb)(const struct nftnl_parse_ctx *ctx))
+{
+	static const struct {
+		enum nftnl_ruleset_type	type;
+		uint16_t		attr;
+	} objs[] = {
+		{ NFTNL_RULESET_TABLE,	NFTNL_RULESET_CTX_TABLE },
+		{ NFTNL_RULESET_CHAIN,	NFTNL_RULESET_CTX_CHAIN },
+		{ NFTNL_RULESET_SET,	NFTNL_RULESET_CTX_SET },
+		{ NFTNL_RULESET_RULE,	NFTNL_RULESET_CTX_RULE },
+	};
+	FILE *fp = (FILE *)data;
+	struct nftnl_parse_ctx ctx;
+	struct nftnl_snapshot *snap;
+	uint32_t i, j, count;
+	off_t offset;
+	void *obj;
+	int ret = -1;
+
+	/* the snapshot is mapped, it has to be a file */
+	if (input != NFTNL_PARSE_FILE) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	/*
+	 * The snapshot starts at the position of the stream, not at the file
+	 * offset, which is past any data buffered by the stream. Pending
+	 * output has to reach the file before it is mapped.
+	 */
+	offset = ftello(fp);
+	if (offset < 0 || fflush(fp) != 0) {
+		err->error = NFTNL_PARSE_EBADINPUT;
+		return -1;
+	}
+
+	snap = nftnl_snapshot_open_at(fileno(fp), offset);
+	if (snap == NULL) {
+		err->error = NFTNL_PARSE_EBADINPUT;
+		return -1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cb = cb;
+	ctx.format = NFTNL_OUTPUT_SNAPSHOT;
+	if (arg != NULL)
+		nftnl_ruleset_ctx_set(&ctx, NFTNL_RULESET_CTX_DATA, arg);
+	nftnl_ruleset_ctx_set_u32(&ctx, NFTNL_RULESET_CTX_CMD, NFTNL_CMD_ADD);
+
+	for (i = 0; i < sizeof(objs) / sizeof(objs[0]); i++) {
+		count = nftnl_snapshot_count(snap, objs[i].type);
+		for (j = 0; j < count; j++) {
+			obj = nftnl_ruleset_snapshot_get(snap, objs[i].type, j);
+			if (obj == NULL) {
+				err->error = NFTNL_PARSE_EBADINPUT;
+				goto out;
+			}
+
+			nftnl_ruleset_ctx_set_u32(&ctx, NFTNL_RULESET_CTX_TYPE,
+						  objs[i].type);
+			nftnl_ruleset_ctx_set(&ctx, objs[i].attr, obj);
+			if (cb(&ctx) < 0) {
+				nftnl_ruleset_ctx_free(&ctx);
+				goto out;
+			}
+		}
+	}
+	/* what follows the snapshot is left to be read from the stream */
+	if (fseeko(fp, offset + nftnl_snapshot_size(snap), SEEK_SET) == 0)
+		ret = 0;
+out:
+	nftnl_snapshot_close(snap);
+	return ret;
+}
+
 static int
 nftnl_ruleset_do_parse(enum nftnl_parse_type type, const void *data,
 		     struct nftnl_parse_err *err, enum nftnl_parse_input input,
-		     void *arg, int (*cb)(const struct nftnl_parse_ctx *ctx))
+		     void *arg, int (*cb)(const struct nftnl_parse_ctx *ctx),
+		     unsigned int threads)
 {
 	int ret;
 
@@ -734,7 +1322,11 @@ nftnl_ruleset_do_parse(enum nftnl_parse_type type, const void *data,
 		ret = nftnl_ruleset_xml_parse(data, err, input, type, arg, cb);
 		break;
 	case NFTNL_PARSE_JSON:
-		ret = nftnl_ruleset_json_parse(data, err, input, type, arg, cb);
+		ret = nftnl_ruleset_json_parse(data, err, input, type, arg, cb,
+					       threads);
+		break;
+	case NFTNL_PARSE_SNAPSHOT:
+		ret = nftnl_ruleset_snapshot_parse(data, err, input, arg, cb);
 		break;
 	default:
 		ret = -1;
@@ -749,16 +1341,34 @@ int nftnl_ruleset_parse_file_cb(enum nftnl_parse_type type, FILE *fp,
 			      struct nftnl_parse_err *err, void *data,
 			      int (*cb)(const struct nftnl_parse_ctx *ctx))
 {
-	return nftnl_ruleset_do_parse(type, fp, err, NFTNL_PARSE_FILE, data, cb);
+	return nftnl_ruleset_do_parse(type, fp, err, NFTNL_PARSE_FILE, data, cb,
+				      1);
 }
 EXPORT_SYMBOL(nftnl_ruleset_parse_file_cb, nft_ruleset_parse_file_cb);
 
+int nftnl_ruleset_parse_file_cb_threads(enum nftnl_parse_type type, FILE *fp,
+				struct nftnl_parse_err *err, void *data,
+				int (*cb)(const struct nftnl_parse_ctx *ctx),
+				unsigned int threads)
+{
+	long cpus;
+
+	if (threads == 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+
+	return nftnl_ruleset_do_parse(type, fp, err, NFTNL_PARSE_FILE, data, cb,
+				      threads);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_ruleset_parse_file_cb_threads);
+
 int nftnl_ruleset_parse_buffer_cb(enum nftnl_parse_type type, const char *buffer,
 				struct nftnl_parse_err *err, void *data,
 				int (*cb)(const struct nftnl_parse_ctx *ctx))
 {
 	return nftnl_ruleset_do_parse(type, buffer, err, NFTNL_PARSE_BUFFER, data,
-				    cb);
+				    cb, 1);
 }
 EXPORT_SYMBOL(nftnl_ruleset_parse_buffer_cb, nft_ruleset_parse_buffer_cb);
 
@@ -1314,7 +1924,295 @@ static int nftnl_ruleset_cmd_fprintf(FILE *fp, const struct nftnl_ruleset *rs,
 int nftnl_ruleset_fprintf(FILE *fp, const struct nftnl_ruleset *rs, uint32_t type,
 			uint32_t flags)
 {
+	if (type == NFTNL_OUTPUT_SNAPSHOT)
+		return nftnl_snapshot_fprintf(fp,
+				nftnl_ruleset_get(rs, NFTNL_RULESET_TABLELIST),
+				nftnl_ruleset_get(rs, NFTNL_RULESET_CHAINLIST),
+				nftnl_ruleset_get(rs, NFTNL_RULESET_SETLIST),
+				nftnl_ruleset_get(rs, NFTNL_RULESET_RULELIST));
+
 	return nftnl_ruleset_cmd_fprintf(fp, rs, nftnl_flag2cmd(flags), type,
 				       flags);
 }
 EXPORT_SYMBOL(nftnl_ruleset_fprintf, nft_ruleset_fprintf);
+
+/*
+ * Streaming export of netlink dumps: every message is printed as soon as it
+ * is received, so that the memory in use does not depend on the size of the
+ * ruleset. Tables, chains and set headers are few, they go through their
+ * objects. Rules and set elements are printed straight from the messages.
+ */
+struct nftnl_ruleset_export {
+	FILE			*fp;
+	uint32_t		type;
+	uint32_t		flags;
+	uint32_t		objs;
+	/* set whose elements are being printed */
+	struct nftnl_set	*set;
+	uint32_t		elems;
+	/* rendering buffer, it grows up to the largest message */
+	char			*buf;
+	size_t			bufsiz;
+};
+
+struct nftnl_ruleset_export *nftnl_ruleset_export_alloc(FILE *fp,
+							uint32_t type,
+							uint32_t flags)
+{
+	struct nftnl_ruleset_export *exp;
+
+	if (type != NFTNL_OUTPUT_JSON) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	exp = calloc(1, sizeof(struct nftnl_ruleset_export));
+	if (exp == NULL)
+		return NULL;
+
+	exp->bufsiz = NFTNL_SNPRINTF_BUFSIZ;
+	exp->buf = malloc(exp->bufsiz);
+	if (exp->buf == NULL) {
+		xfree(exp);
+		return NULL;
+	}
+
+	exp->fp = fp;
+	exp->type = type;
+	exp->flags = flags;
+
+	return exp;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_ruleset_export_alloc);
+
+void nftnl_ruleset_export_free(struct nftnl_ruleset_export *exp)
+{
+	if (exp->set != NULL)
+		nftnl_set_free(exp->set);
+
+	xfree(exp->buf);
+	xfree(exp);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_ruleset_export_free);
+
+static int nftnl_ruleset_export_rule_cb(char *buf, size_t size, void *nlh,
+					uint32_t cmd, uint32_t type,
+					uint32_t flags)
+{
+	return nftnl_rule_nlmsg_snprintf(buf, size, nlh, type, flags);
+}
+
+static int nftnl_ruleset_export_elems_cb(char *buf, size_t size, void *nlh,
+					 uint32_t cmd, uint32_t type,
+					 uint32_t flags)
+{
+	return nftnl_set_elems_nlmsg_snprintf(buf, size, nlh, type, flags);
+}
+
+static int nftnl_ruleset_export_set_cb(char *buf, size_t size, void *s,
+				       uint32_t cmd, uint32_t type,
+				       uint32_t flags)
+{
+	return nftnl_set_snprintf_json_head(buf, size, s);
+}
+
+static uint32_t
+nftnl_ruleset_export_inner_flags(const struct nftnl_ruleset_export *exp)
+{
+	/* dont pass events flags to child calls of _snprintf() */
+	return exp->flags & ~NFTNL_OF_EVENT_ANY;
+}
+
+/* Print @obj into the buffer of @exp, enlarging it as required. */
+static int
+nftnl_ruleset_export_render(struct nftnl_ruleset_export *exp, void *obj,
+			    int (*snprintf_cb)(char *buf, size_t bufsiz,
+					       void *obj, uint32_t cmd,
+					       uint32_t type, uint32_t flags))
+{
+	uint32_t flags = nftnl_ruleset_export_inner_flags(exp);
+	char *buf;
+	int ret;
+
+	ret = snprintf_cb(exp->buf, exp->bufsiz, obj, NFTNL_CMD_UNSPEC,
+			  exp->type, flags);
+	if (ret < 0 || (size_t)ret < exp->bufsiz)
+		return ret;
+
+	buf = realloc(exp->buf, ret + 1);
+	if (buf == NULL)
+		return -1;
+
+	exp->buf = buf;
+	exp->bufsiz = ret + 1;
+
+	return snprintf_cb(exp->buf, exp->bufsiz, obj, NFTNL_CMD_UNSPEC,
+			   exp->type, flags);
+}
+
+/* Print what goes before the next object of the ruleset. */
+static int nftnl_ruleset_export_sep(struct nftnl_ruleset_export *exp)
+{
+	int ret;
+
+	if (exp->objs++ > 0)
+		return fprintf(exp->fp, "%s",
+			       nftnl_ruleset_o_separator(exp, exp->type));
+
+	ret = fprintf(exp->fp, "%s", nftnl_ruleset_o_opentag(exp->type));
+	if (ret < 0)
+		return -1;
+
+	return nftnl_cmd_header_fprintf(exp->fp, nftnl_flag2cmd(exp->flags),
+					exp->type, exp->flags);
+}
+
+static int nftnl_ruleset_export_set_close(struct nftnl_ruleset_export *exp)
+{
+	int ret;
+
+	if (exp->set == NULL)
+		return 0;
+
+	if (exp->elems > 0)
+		ret = fprintf(exp->fp, "]}}");
+	else
+		ret = nftnl_set_fprintf(exp->fp, exp->set, exp->type,
+					nftnl_ruleset_export_inner_flags(exp));
+
+	nftnl_set_free(exp->set);
+	exp->set = NULL;
+
+	return ret < 0 ? -1 : 0;
+}
+
+static int nftnl_ruleset_export_elems(struct nftnl_ruleset_export *exp,
+				      const struct nlmsghdr *nlh)
+{
+	int ret;
+
+	if (exp->set == NULL || !nftnl_set_elems_nlmsg_match(nlh, exp->set)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = nftnl_ruleset_export_render(exp, (void *)nlh,
+					  nftnl_ruleset_export_elems_cb);
+	if (ret <= 0)
+		return ret;
+
+	/* the set goes out with its first element, so that an empty set
+	 * is printed as nftnl_set_snprintf() does
+	 */
+	if (exp->elems++ == 0) {
+		ret = nftnl_fprintf(exp->fp, exp->set, NFTNL_CMD_UNSPEC,
+				    exp->type,
+				    nftnl_ruleset_export_inner_flags(exp),
+				    nftnl_ruleset_export_set_cb);
+		if (ret < 0)
+			return -1;
+
+		ret = fprintf(exp->fp, ",\"set_elem\":[");
+	} else {
+		ret = fprintf(exp->fp, ",");
+	}
+	if (ret < 0 || fputs(exp->buf, exp->fp) == EOF)
+		return -1;
+
+	return 0;
+}
+
+int nftnl_ruleset_export_nlmsg(struct nftnl_ruleset_export *exp,
+			       const struct nlmsghdr *nlh)
+{
+	uint32_t flags = nftnl_ruleset_export_inner_flags(exp);
+	uint16_t type = NFNL_MSG_TYPE(nlh->nlmsg_type);
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	int ret;
+
+	if (type == NFT_MSG_NEWSETELEM)
+		return nftnl_ruleset_export_elems(exp, nlh);
+
+	if (nftnl_ruleset_export_set_close(exp) < 0)
+		return -1;
+
+	switch (type) {
+	case NFT_MSG_NEWTABLE:
+		t = nftnl_table_alloc();
+		if (t == NULL)
+			return -1;
+
+		ret = nftnl_table_nlmsg_parse(nlh, t);
+		if (ret >= 0)
+			ret = nftnl_ruleset_export_sep(exp);
+		if (ret >= 0)
+			ret = nftnl_table_fprintf(exp->fp, t, exp->type, flags);
+
+		nftnl_table_free(t);
+		break;
+	case NFT_MSG_NEWCHAIN:
+		c = nftnl_chain_alloc();
+		if (c == NULL)
+			return -1;
+
+		ret = nftnl_chain_nlmsg_parse(nlh, c);
+		if (ret >= 0)
+			ret = nftnl_ruleset_export_sep(exp);
+		if (ret >= 0)
+			ret = nftnl_chain_fprintf(exp->fp, c, exp->type, flags);
+
+		nftnl_chain_free(c);
+		break;
+	case NFT_MSG_NEWSET:
+		exp->set = nftnl_set_alloc();
+		if (exp->set == NULL)
+			return -1;
+
+		exp->elems = 0;
+		ret = nftnl_set_nlmsg_parse(nlh, exp->set);
+		if (ret >= 0)
+			ret = nftnl_ruleset_export_sep(exp);
+		break;
+	case NFT_MSG_NEWRULE:
+		ret = nftnl_ruleset_export_render(exp, (void *)nlh,
+						  nftnl_ruleset_export_rule_cb);
+		if (ret >= 0)
+			ret = nftnl_ruleset_export_sep(exp);
+		if (ret >= 0 && fputs(exp->buf, exp->fp) == EOF)
+			ret = -1;
+		break;
+	default:
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	return ret < 0 ? -1 : 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_ruleset_export_nlmsg);
+
+int nftnl_ruleset_export_end(struct nftnl_ruleset_export *exp)
+{
+	int ret;
+
+	if (nftnl_ruleset_export_set_close(exp) < 0)
+		return -1;
+
+	if (exp->objs == 0) {
+		ret = nftnl_ruleset_export_sep(exp);
+		if (ret < 0)
+			return -1;
+	}
+
+	ret = nftnl_cmd_footer_fprintf(exp->fp, nftnl_flag2cmd(exp->flags),
+				       exp->type, exp->flags);
+	if (ret < 0)
+		return -1;
+
+	ret = fprintf(exp->fp, "%s", nftnl_ruleset_o_closetag(exp->type));
+	if (ret < 0)
+		return -1;
+
+	return fflush(exp->fp) == EOF ? -1 : 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_ruleset_export_end);
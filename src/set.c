@@ -44,10 +44,8 @@ void nftnl_set_free(struct nftnl_set *s)
 {
 	struct nftnl_set_elem *elem, *tmp;
 
-	if (s->table != NULL)
-		xfree(s->table);
-	if (s->name != NULL)
-		xfree(s->name);
+	nftnl_intern_put(s->table);
+	nftnl_intern_put(s->name);
 
 	list_for_each_entry_safe(elem, tmp, &s->element_list, head) {
 		list_del(&elem->head);
@@ -67,18 +65,16 @@ void nftnl_set_unset(struct nftnl_set *s, uint16_t attr)
 {
 	switch (attr) {
 	case NFTNL_SET_TABLE:
-		if (s->flags & (1 << NFTNL_SET_TABLE))
-			if (s->table) {
-				xfree(s->table);
-				s->table = NULL;
-			}
+		if (s->flags & (1 << NFTNL_SET_TABLE)) {
+			nftnl_intern_put(s->table);
+			s->table = NULL;
+		}
 		break;
 	case NFTNL_SET_NAME:
-		if (s->flags & (1 << NFTNL_SET_NAME))
-			if (s->name) {
-				xfree(s->name);
-				s->name = NULL;
-			}
+		if (s->flags & (1 << NFTNL_SET_NAME)) {
+			nftnl_intern_put(s->name);
+			s->name = NULL;
+		}
 		break;
 	case NFTNL_SET_FLAGS:
 	case NFTNL_SET_KEY_TYPE:
@@ -123,16 +119,20 @@ void nftnl_set_set_data(struct nftnl_set *s, uint16_t attr, const void *data,
 
 	switch(attr) {
 	case NFTNL_SET_TABLE:
-		if (s->table)
-			xfree(s->table);
-
-		s->table = strdup(data);
+		nftnl_intern_put(s->table);
+		s->table = nftnl_intern(data);
+		if (s->table == NULL) {
+			s->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_SET_NAME:
-		if (s->name)
-			xfree(s->name);
-
-		s->name = strdup(data);
+		nftnl_intern_put(s->name);
+		s->name = nftnl_intern(data);
+		if (s->name == NULL) {
+			s->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_SET_FLAGS:
 		s->set_flags = *((uint32_t *)data);
@@ -292,9 +292,9 @@ struct nftnl_set *nftnl_set_clone(const struct nftnl_set *set)
 	memcpy(newset, set, sizeof(*set));
 
 	if (set->flags & (1 << NFTNL_SET_TABLE))
-		newset->table = strdup(set->table);
+		newset->table = nftnl_intern_get(set->table);
 	if (set->flags & (1 << NFTNL_SET_NAME))
-		newset->name = strdup(set->name);
+		newset->name = nftnl_intern_get(set->name);
 
 	INIT_LIST_HEAD(&newset->element_list);
 	list_for_each_entry(elem, &set->element_list, head) {
@@ -435,13 +435,21 @@ int nftnl_set_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_set *s)
 		return -1;
 
 	if (tb[NFTA_SET_TABLE]) {
-		xfree(s->table);
-		s->table = strdup(mnl_attr_get_str(tb[NFTA_SET_TABLE]));
+		nftnl_intern_put(s->table);
+		s->table = nftnl_intern(mnl_attr_get_str(tb[NFTA_SET_TABLE]));
+		if (s->table == NULL) {
+			s->flags &= ~(1 << NFTNL_SET_TABLE);
+			return -1;
+		}
 		s->flags |= (1 << NFTNL_SET_TABLE);
 	}
 	if (tb[NFTA_SET_NAME]) {
-		xfree(s->name);
-		s->name = strdup(mnl_attr_get_str(tb[NFTA_SET_NAME]));
+		nftnl_intern_put(s->name);
+		s->name = nftnl_intern(mnl_attr_get_str(tb[NFTA_SET_NAME]));
+		if (s->name == NULL) {
+			s->flags &= ~(1 << NFTNL_SET_NAME);
+			return -1;
+		}
 		s->flags |= (1 << NFTNL_SET_NAME);
 	}
 	if (tb[NFTA_SET_FLAGS]) {
@@ -771,11 +779,10 @@ int nftnl_set_parse_file(struct nftnl_set *s, enum nftnl_parse_type type,
 }
 EXPORT_SYMBOL(nftnl_set_parse_file, nft_set_parse_file);
 
-static int nftnl_set_snprintf_json(char *buf, size_t size, struct nftnl_set *s,
-				  uint32_t type, uint32_t flags)
+int nftnl_set_snprintf_json_head(char *buf, size_t size,
+				 const struct nftnl_set *s)
 {
 	int len = size, offset = 0, ret;
-	struct nftnl_set_elem *elem;
 
 	ret = snprintf(buf, len, "{\"set\":{");
 	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
@@ -832,224 +839,172 @@ static int nftnl_set_snprintf_json(char *buf, size_t size, struct nftnl_set *s,
 		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
 	}
 
+	return offset;
+}
+
+static int nftnl_set_json_head_snprintf(char *buf, size_t size, void *s,
+					uint32_t cmd, uint32_t type,
+					uint32_t flags)
+{
+	return nftnl_set_snprintf_json_head(buf, size, s);
+}
+
+static int nftnl_set_elem_do_snprintf(char *buf, size_t size, void *e,
+				      uint32_t cmd, uint32_t type,
+				      uint32_t flags)
+{
+	return nftnl_set_elem_snprintf(buf, size, e, type, flags);
+}
+
+static void nftnl_set_print_json(struct nftnl_buf *b, struct nftnl_set *s,
+				 uint32_t type, uint32_t flags)
+{
+	struct nftnl_set_elem *elem;
+
+	nftnl_buf_obj(b, s, NFTNL_CMD_UNSPEC, type, flags,
+		      nftnl_set_json_head_snprintf);
+
 	/* Empty set? Skip printinf of elements */
-	if (list_empty(&s->element_list)){
-		ret = snprintf(buf + offset, len, "}}");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-		return offset;
+	if (list_empty(&s->element_list)) {
+		nftnl_buf_put(b, "}}");
+		return;
 	}
 
-	ret = snprintf(buf + offset, len, ",\"set_elem\":[");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_put(b, ",\"set_elem\":[");
 
 	list_for_each_entry(elem, &s->element_list, head) {
-		ret = snprintf(buf + offset, len, "{");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-		ret = nftnl_set_elem_snprintf(buf + offset, len, elem, type,
-					    flags);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-		ret = snprintf(buf + offset, len, "},");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+		nftnl_buf_put(b, "{");
+		nftnl_buf_obj(b, elem, NFTNL_CMD_UNSPEC, type, flags,
+			      nftnl_set_elem_do_snprintf);
+		nftnl_buf_put(b, "},");
 	}
 	/* Overwrite trailing ", " from last set element */
-	offset --;
-
-	ret = snprintf(buf + offset, len, "]}}");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_unput(b);
 
-	return offset;
+	nftnl_buf_put(b, "]}}");
 }
 
-static int nftnl_set_snprintf_default(char *buf, size_t size, struct nftnl_set *s,
+static void nftnl_set_print_default(struct nftnl_buf *b, struct nftnl_set *s,
 				    uint32_t type, uint32_t flags)
 {
-	int ret;
-	int len = size, offset = 0;
 	struct nftnl_set_elem *elem;
 
-	ret = snprintf(buf, len, "%s %s %x",
-			s->name, s->table, s->set_flags);
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_put(b, "%s %s %x", s->name, s->table, s->set_flags);
 
-	if (s->flags & (1 << NFTNL_SET_TIMEOUT)) {
-		ret = snprintf(buf + offset, len, " timeout %"PRIu64"ms",
-			       s->timeout);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_TIMEOUT))
+		nftnl_buf_put(b, " timeout %"PRIu64"ms", s->timeout);
 
-	if (s->flags & (1 << NFTNL_SET_GC_INTERVAL)) {
-		ret = snprintf(buf + offset, len, " gc_interval %ums",
-			       s->gc_interval);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_GC_INTERVAL))
+		nftnl_buf_put(b, " gc_interval %ums", s->gc_interval);
 
-	if (s->flags & (1 << NFTNL_SET_POLICY)) {
-		ret = snprintf(buf + offset, len, " policy %u", s->policy);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_POLICY))
+		nftnl_buf_put(b, " policy %u", s->policy);
 
-	if (s->flags & (1 << NFTNL_SET_DESC_SIZE)) {
-		ret = snprintf(buf + offset, len, " size %u", s->desc.size);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_DESC_SIZE))
+		nftnl_buf_put(b, " size %u", s->desc.size);
 
 	/* Empty set? Skip printinf of elements */
 	if (list_empty(&s->element_list))
-		return offset;
+		return;
 
-	ret = snprintf(buf+offset, len, "\n");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_put(b, "\n");
 
 	list_for_each_entry(elem, &s->element_list, head) {
-		ret = snprintf(buf+offset, len, "\t");
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-		ret = nftnl_set_elem_snprintf(buf+offset, len, elem, type, flags);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+		nftnl_buf_put(b, "\t");
+		nftnl_buf_obj(b, elem, NFTNL_CMD_UNSPEC, type, flags,
+			      nftnl_set_elem_do_snprintf);
 	}
-
-	return offset;
 }
 
-static int nftnl_set_snprintf_xml(char *buf, size_t size, struct nftnl_set *s,
+static void nftnl_set_print_xml(struct nftnl_buf *b, struct nftnl_set *s,
 				uint32_t flags)
 {
-	int ret;
-	int len = size, offset = 0;
 	struct nftnl_set_elem *elem;
 
-	ret = snprintf(buf, len, "<set>");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_buf_put(b, "<set>");
 
-	if (s->flags & (1 << NFTNL_SET_FAMILY)) {
-		ret = snprintf(buf + offset, len, "<family>%s</family>",
-			       nftnl_family2str(s->family));
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_FAMILY))
+		nftnl_buf_put(b, "<family>%s</family>",
+			      nftnl_family2str(s->family));
 
-	if (s->flags & (1 << NFTNL_SET_TABLE)) {
-		ret = snprintf(buf + offset, len, "<table>%s</table>",
-			       s->table);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_TABLE))
+		nftnl_buf_put(b, "<table>%s</table>", s->table);
 
-	if (s->flags & (1 << NFTNL_SET_NAME)) {
-		ret = snprintf(buf + offset, len, "<name>%s</name>",
-			       s->name);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_NAME))
+		nftnl_buf_put(b, "<name>%s</name>", s->name);
 
-	if (s->flags & (1 << NFTNL_SET_FLAGS)) {
-		ret = snprintf(buf + offset, len, "<flags>%u</flags>",
-			       s->set_flags);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
-	if (s->flags & (1 << NFTNL_SET_KEY_TYPE)) {
-		ret = snprintf(buf + offset, len, "<key_type>%u</key_type>",
-			       s->key_type);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
-	if (s->flags & (1 << NFTNL_SET_KEY_LEN)) {
-		ret = snprintf(buf + offset, len, "<key_len>%u</key_len>",
-			       s->key_len);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_FLAGS))
+		nftnl_buf_put(b, "<flags>%u</flags>", s->set_flags);
+	if (s->flags & (1 << NFTNL_SET_KEY_TYPE))
+		nftnl_buf_put(b, "<key_type>%u</key_type>", s->key_type);
+	if (s->flags & (1 << NFTNL_SET_KEY_LEN))
+		nftnl_buf_put(b, "<key_len>%u</key_len>", s->key_len);
 
-	if (s->flags & (1 << NFTNL_SET_DATA_TYPE)) {
-		ret = snprintf(buf + offset, len, "<data_type>%u</data_type>",
-			       s->data_type);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
-	if (s->flags & (1 << NFTNL_SET_DATA_LEN)) {
-		ret = snprintf(buf + offset, len, "<data_len>%u</data_len>",
-			       s->data_len);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_DATA_TYPE))
+		nftnl_buf_put(b, "<data_type>%u</data_type>", s->data_type);
+	if (s->flags & (1 << NFTNL_SET_DATA_LEN))
+		nftnl_buf_put(b, "<data_len>%u</data_len>", s->data_len);
 
-	if (s->flags & (1 << NFTNL_SET_POLICY)) {
-		ret = snprintf(buf + offset, len, "<policy>%u</policy>",
-			       s->policy);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_POLICY))
+		nftnl_buf_put(b, "<policy>%u</policy>", s->policy);
 
-	if (s->flags & (1 << NFTNL_SET_DESC_SIZE)) {
-		ret = snprintf(buf + offset, len, "<desc_size>%u</desc_size>",
-			       s->desc.size);
-		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-	}
+	if (s->flags & (1 << NFTNL_SET_DESC_SIZE))
+		nftnl_buf_put(b, "<desc_size>%u</desc_size>", s->desc.size);
 
-	if (!list_empty(&s->element_list)) {
-		list_for_each_entry(elem, &s->element_list, head) {
-			ret = nftnl_set_elem_snprintf(buf + offset, len, elem,
-						    NFTNL_OUTPUT_XML, flags);
-			SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-		}
+	list_for_each_entry(elem, &s->element_list, head) {
+		nftnl_buf_obj(b, elem, NFTNL_CMD_UNSPEC, NFTNL_OUTPUT_XML,
+			      flags, nftnl_set_elem_do_snprintf);
 	}
 
-	ret = snprintf(buf + offset, len, "</set>");
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-	return offset;
+	nftnl_buf_put(b, "</set>");
 }
 
-static int nftnl_set_cmd_snprintf(char *buf, size_t size, struct nftnl_set *s,
-				uint32_t cmd, uint32_t type, uint32_t flags)
+static int nftnl_set_cmd_print(struct nftnl_buf *b, struct nftnl_set *s,
+			       uint32_t cmd, uint32_t type, uint32_t flags)
 {
-	int ret, len = size, offset = 0;
 	uint32_t inner_flags = flags;
 
 	/* prevent set_elems to print as events */
 	inner_flags &= ~NFTNL_OF_EVENT_ANY;
 
-	ret = nftnl_cmd_header_snprintf(buf + offset, len, cmd, type, flags);
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_cmd_header_buf(b, cmd, type, flags);
 
 	switch(type) {
 	case NFTNL_OUTPUT_DEFAULT:
-		ret = nftnl_set_snprintf_default(buf+offset, len, s, type,
-					       inner_flags);
+		nftnl_set_print_default(b, s, type, inner_flags);
 		break;
 	case NFTNL_OUTPUT_XML:
-		ret = nftnl_set_snprintf_xml(buf+offset, len, s, inner_flags);
+		nftnl_set_print_xml(b, s, inner_flags);
 		break;
 	case NFTNL_OUTPUT_JSON:
-		ret = nftnl_set_snprintf_json(buf+offset, len, s, type,
-					    inner_flags);
+		nftnl_set_print_json(b, s, type, inner_flags);
 		break;
 	default:
 		return -1;
 	}
 
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	nftnl_cmd_footer_buf(b, cmd, type, flags);
 
-	ret = nftnl_cmd_footer_snprintf(buf + offset, len, cmd, type, flags);
-	SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
-
-	return offset;
+	return nftnl_buf_flush(b);
 }
 
 int nftnl_set_snprintf(char *buf, size_t size, struct nftnl_set *s,
 		     uint32_t type, uint32_t flags)
 {
-	return nftnl_set_cmd_snprintf(buf, size, s, nftnl_flag2cmd(flags), type,
-				    flags);
-}
-EXPORT_SYMBOL(nftnl_set_snprintf, nft_set_snprintf);
+	NFTNL_BUF_INIT(b, buf, size);
 
-static inline int nftnl_set_do_snprintf(char *buf, size_t size, void *s,
-				      uint32_t cmd, uint32_t type,
-				      uint32_t flags)
-{
-	return nftnl_set_snprintf(buf, size, s, type, flags);
+	return nftnl_set_cmd_print(&b, s, nftnl_flag2cmd(flags), type, flags);
 }
+EXPORT_SYMBOL(nftnl_set_snprintf, nft_set_snprintf);
 
+/* Elements are written out as they are printed, the set is printed once */
 int nftnl_set_fprintf(FILE *fp, struct nftnl_set *s, uint32_t type,
 		    uint32_t flags)
 {
-	return nftnl_fprintf(fp, s, NFTNL_CMD_UNSPEC, type, flags,
-			   nftnl_set_do_snprintf);
+	char buf[NFTNL_SNPRINTF_BUFSIZ];
+	NFTNL_BUF_INIT_FILE(b, buf, sizeof(buf), fp);
+
+	return nftnl_set_cmd_print(&b, s, nftnl_flag2cmd(flags), type, flags);
 }
 EXPORT_SYMBOL(nftnl_set_fprintf, nft_set_fprintf);
 
@@ -1061,8 +1016,104 @@ EXPORT_SYMBOL(nftnl_set_elem_add, nft_set_elem_add);
 
 struct nftnl_set_list {
 	struct list_head list;
+
+	/* optional name index, see nftnl_set_list_index() */
+	struct nftnl_set	**index;
+	uint32_t		index_size;
+	uint32_t		index_used;
 };
 
+static struct nftnl_set **nftnl_set_list_index_slot(struct nftnl_set_list *list,
+						   const char *name)
+{
+	uint32_t mask = list->index_size - 1, h;
+
+	h = nftnl_hash_str(NFTNL_HASH_INIT, name) & mask;
+	while (list->index[h] != NULL &&
+	       strcmp(list->index[h]->name, name) != 0)
+		h = (h + 1) & mask;
+
+	return &list->index[h];
+}
+
+static void nftnl_set_list_index_drop(struct nftnl_set_list *list)
+{
+	xfree(list->index);
+	list->index = NULL;
+	list->index_size = 0;
+	list->index_used = 0;
+}
+
+static int nftnl_set_list_index_grow(struct nftnl_set_list *list)
+{
+	struct nftnl_set **old = list->index;
+	uint32_t i, old_size = list->index_size;
+
+	list->index_size = old_size ? old_size * 2 : 64;
+	list->index = calloc(list->index_size, sizeof(struct nftnl_set *));
+	if (list->index == NULL) {
+		list->index = old;
+		list->index_size = old_size;
+		return -1;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i] != NULL)
+			*nftnl_set_list_index_slot(list, old[i]->name) = old[i];
+	}
+	xfree(old);
+
+	return 0;
+}
+
+/*
+ * nftnl_set_lookup() returns the first set with a matching name in list
+ * order, so a set added at the head replaces an indexed one and a set added
+ * at the tail does not.
+ */
+static void nftnl_set_list_index_add(struct nftnl_set_list *list,
+				     struct nftnl_set *s, bool head)
+{
+	struct nftnl_set **slot;
+
+	if (list->index == NULL || !(s->flags & (1 << NFTNL_SET_NAME)))
+		return;
+
+	if ((list->index_used + 1) * 4 > list->index_size * 3 &&
+	    nftnl_set_list_index_grow(list) < 0) {
+		/* out of memory, lookups fall back to walking the list */
+		nftnl_set_list_index_drop(list);
+		return;
+	}
+
+	slot = nftnl_set_list_index_slot(list, s->name);
+	if (*slot == NULL)
+		list->index_used++;
+	else if (!head)
+		return;
+
+	*slot = s;
+}
+
+int nftnl_set_list_index(struct nftnl_set_list *list)
+{
+	struct nftnl_set *s;
+
+	if (list->index != NULL)
+		return 0;
+
+	if (nftnl_set_list_index_grow(list) < 0)
+		return -1;
+
+	list_for_each_entry(s, &list->list, head) {
+		nftnl_set_list_index_add(list, s, false);
+		if (list->index == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
 struct nftnl_set_list *nftnl_set_list_alloc(void)
 {
 	struct nftnl_set_list *list;
@@ -1085,6 +1136,7 @@ void nftnl_set_list_free(struct nftnl_set_list *list)
 		list_del(&s->head);
 		nftnl_set_free(s);
 	}
+	xfree(list->index);
 	xfree(list);
 }
 EXPORT_SYMBOL(nftnl_set_list_free, nft_set_list_free);
@@ -1098,12 +1150,14 @@ EXPORT_SYMBOL(nftnl_set_list_is_empty, nft_set_list_is_empty);
 void nftnl_set_list_add(struct nftnl_set *s, struct nftnl_set_list *list)
 {
 	list_add(&s->head, &list->list);
+	nftnl_set_list_index_add(list, s, true);
 }
 EXPORT_SYMBOL(nftnl_set_list_add, nft_set_list_add);
 
 void nftnl_set_list_add_tail(struct nftnl_set *s, struct nftnl_set_list *list)
 {
 	list_add_tail(&s->head, &list->list);
+	nftnl_set_list_index_add(list, s, false);
 }
 EXPORT_SYMBOL(nftnl_set_list_add_tail, nft_set_list_add_tail);
 
@@ -1186,6 +1240,9 @@ static struct nftnl_set *nftnl_set_lookup(const char *this_set_name,
 	struct nftnl_set *s;
 	const char *set_name;
 
+	if (set_list->index != NULL)
+		return *nftnl_set_list_index_slot(set_list, this_set_name);
+
 	iter = nftnl_set_list_iter_create(set_list);
 	if (iter == NULL)
 		return NULL;
@@ -0,0 +1,479 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libnftnl/set.h>
+
+/*
+ * Model of the kernel set backends. Memory is what the kernel allocates for
+ * the table and its elements, slab rounding included. The lookup cost adds
+ * the hashing and key comparisons to the latency of each memory access,
+ * which depends on the cache level the whole structure fits in: lookups are
+ * assumed to be spread over the set, so only its hot top levels, if any,
+ * stay in the first level cache.
+ */
+#define NFTNL_SET_COST_MAXKEYS	(1U << 24)	/* beyond, no hash backend */
+#define NFTNL_SET_COST_BRANCH	5.0	/* mispredicted tree walk step */
+
+static const struct {
+	uint64_t	size;
+	double		ns;
+} nftnl_set_cost_cache[] = {
+	{ 32 << 10,	1.0 },
+	{ 1 << 20,	4.0 },
+	{ 32 << 20,	15.0 },
+	{ UINT64_MAX,	80.0 },
+};
+
+/* kernel lookup class, nft_set_estimate */
+enum {
+	NFTNL_SET_CLASS_O_1,
+	NFTNL_SET_CLASS_O_LOG_N,
+};
+
+struct nftnl_set_cost_key {
+	const uint8_t			*key;
+	uint32_t			len;
+	bool				end;
+	const struct nftnl_set_elem	*elem;
+};
+
+/* maximal run of consecutive keys mapping to the same data */
+struct nftnl_set_cost_run {
+	uint8_t				start[NFT_DATA_VALUE_MAXLEN];
+	uint8_t				end[NFT_DATA_VALUE_MAXLEN];
+	bool				to_max;	/* end is past the last key */
+	const struct nftnl_set_elem	*elem;
+};
+
+struct nftnl_set_cost_stats {
+	uint64_t			keys;
+	uint32_t			ranges;
+	uint32_t			elements;	/* with intervals */
+	struct nftnl_set_cost_run	last;
+	bool				has_last;
+};
+
+static double nftnl_set_cost_access(uint64_t footprint)
+{
+	uint32_t i;
+
+	for (i = 0; footprint > nftnl_set_cost_cache[i].size; i++)
+		;
+	return nftnl_set_cost_cache[i].ns;
+}
+
+/* memcmp() of the key, a word at a time */
+static double nftnl_set_cost_cmp(uint32_t key_len)
+{
+	return 0.5 + key_len / 16.0;
+}
+
+static uint64_t nftnl_set_cost_kmalloc(uint64_t size)
+{
+	static const uint32_t caches[] = { 8, 16, 32, 64, 96, 128, 192, 256 };
+	uint64_t alloc = 512;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
+		if (size <= caches[i])
+			return caches[i];
+	}
+	while (alloc < size)
+		alloc <<= 1;
+	return alloc;
+}
+
+/* struct nft_set_ext with the extensions the set flags call for */
+static uint32_t nftnl_set_cost_ext(const struct nftnl_set *s, bool interval)
+{
+	uint32_t len = 8;
+
+	len += (s->key_len + 3) & ~3U;
+	if (s->set_flags & NFT_SET_MAP) {
+		if (s->data_type == NFT_DATA_VERDICT)
+			len += 16;
+		else
+			len += (s->data_len + 3) & ~3U;
+	}
+	if (interval)
+		len += 4;
+	if (s->set_flags & NFT_SET_TIMEOUT)
+		len += 16;
+
+	return (len + 7) & ~7U;
+}
+
+static uint32_t nftnl_set_cost_ilog2(uint64_t n)
+{
+	uint32_t log = 0;
+
+	while (n >>= 1)
+		log++;
+	return log;
+}
+
+static int nftnl_set_cost_key_cmp(const void *a, const void *b)
+{
+	const struct nftnl_set_cost_key *k1 = a, *k2 = b;
+	int ret;
+
+	ret = memcmp(k1->key, k2->key, k1->len);
+	if (ret != 0)
+		return ret;
+
+	/* an interval end sorts before a start of the same key */
+	return (int)k2->end - (int)k1->end;
+}
+
+static bool nftnl_set_cost_data_equal(const struct nftnl_set *s,
+				      const struct nftnl_set_elem *e1,
+				      const struct nftnl_set_elem *e2)
+{
+	if (!(s->set_flags & NFT_SET_MAP))
+		return true;
+
+	if (s->data_type != NFT_DATA_VERDICT)
+		return memcmp(e1->data.val, e2->data.val, s->data_len) == 0;
+
+	if (e1->data.verdict != e2->data.verdict)
+		return false;
+	/* chain names are interned, NULL only matches NULL */
+	return e1->data.chain == e2->data.chain;
+}
+
+/* number of keys in [start, end), saturated */
+static uint64_t nftnl_set_cost_span(const struct nftnl_set_cost_run *run,
+				    uint32_t len)
+{
+	uint8_t diff[NFT_DATA_VALUE_MAXLEN];
+	uint64_t span = 0;
+	int borrow = 0, i;
+
+	for (i = len - 1; i >= 0; i--) {
+		int d = (run->to_max ? 0 : run->end[i]) - run->start[i] -
+			borrow;
+
+		borrow = d < 0;
+		diff[i] = d & 0xff;
+	}
+	/* with to_max, the difference wrapped around 2^(8 * len) */
+	for (i = 0; i < (int)len; i++) {
+		if (i < (int)len - 8 && diff[i] != 0)
+			return UINT64_MAX;
+		if (i >= (int)len - 8)
+			span = span << 8 | diff[i];
+	}
+	if (run->to_max && span == 0)
+		return len >= 8 ? UINT64_MAX : 1ULL << (8 * len);
+
+	return span;
+}
+
+static void nftnl_set_cost_emit(struct nftnl_set_cost_stats *st,
+				const struct nftnl_set_cost_run *run,
+				uint32_t len)
+{
+	uint64_t span = nftnl_set_cost_span(run, len);
+
+	/* the end of the previous range is implied by this start */
+	if (st->has_last && !st->last.to_max &&
+	    memcmp(st->last.end, run->start, len) != 0)
+		st->elements++;
+
+	st->keys = st->keys + span < st->keys ? UINT64_MAX : st->keys + span;
+	st->ranges++;
+	st->elements++;
+	st->last = *run;
+	st->has_last = true;
+}
+
+static void nftnl_set_cost_add(const struct nftnl_set *s,
+			       struct nftnl_set_cost_stats *st,
+			       struct nftnl_set_cost_run *cur, bool *has_cur,
+			       const struct nftnl_set_cost_run *run)
+{
+	uint32_t len = s->key_len;
+
+	if (*has_cur && !cur->to_max &&
+	    memcmp(cur->end, run->start, len) == 0 &&
+	    nftnl_set_cost_data_equal(s, cur->elem, run->elem)) {
+		memcpy(cur->end, run->end, len);
+		cur->to_max = run->to_max;
+		return;
+	}
+	if (*has_cur)
+		nftnl_set_cost_emit(st, cur, len);
+	*cur = *run;
+	*has_cur = true;
+}
+
+static int nftnl_set_cost_stats(const struct nftnl_set *s,
+				struct nftnl_set_cost_stats *st)
+{
+	struct nftnl_set_cost_run cur, run;
+	struct nftnl_set_cost_key *keys;
+	struct nftnl_set_elem *elem;
+	bool interval = s->set_flags & NFT_SET_INTERVAL, has_cur = false;
+	uint32_t n = 0, i;
+
+	memset(st, 0, sizeof(*st));
+	list_for_each_entry(elem, &s->element_list, head)
+		n++;
+	if (n == 0)
+		return 0;
+
+	keys = calloc(n, sizeof(*keys));
+	if (keys == NULL)
+		return -1;
+
+	n = 0;
+	list_for_each_entry(elem, &s->element_list, head) {
+		keys[n].key = (const uint8_t *)elem->key.val;
+		keys[n].len = s->key_len;
+		keys[n].end = interval && (elem->set_elem_flags &
+					   NFT_SET_ELEM_INTERVAL_END);
+		keys[n++].elem = elem;
+	}
+	qsort(keys, n, sizeof(*keys), nftnl_set_cost_key_cmp);
+
+	/*
+	 * A start matches up to the next element, as in the kernel the
+	 * closest element not greater than the key decides.
+	 */
+	memset(&run, 0, sizeof(run));
+	for (i = 0; i < n; i++) {
+		if (keys[i].end)
+			continue;
+		if (!interval && i > 0 &&
+		    memcmp(keys[i].key, keys[i - 1].key, s->key_len) == 0)
+			continue;
+
+		memcpy(run.start, keys[i].key, s->key_len);
+		run.elem = keys[i].elem;
+		if (!interval) {
+			memcpy(run.end, keys[i].key, s->key_len);
+			run.to_max = !nftnl_value_inc(run.end, s->key_len);
+		} else if (i + 1 < n) {
+			memcpy(run.end, keys[i + 1].key, s->key_len);
+			run.to_max = false;
+		} else {
+			run.to_max = true;
+		}
+		nftnl_set_cost_add(s, st, &cur, &has_cur, &run);
+	}
+	if (has_cur)
+		nftnl_set_cost_emit(st, &cur, s->key_len);
+	if (st->has_last && !st->last.to_max)
+		st->elements++;
+
+	xfree(keys);
+	return 0;
+}
+
+static void nftnl_set_cost_hash(const struct nftnl_set *s,
+				const struct nftnl_set_cost_stats *st,
+				struct nftnl_set_backend_cost *c)
+{
+	uint64_t buckets = 4, elem;
+	double alpha;
+
+	if (st->keys > NFTNL_SET_COST_MAXKEYS)
+		return;
+
+	/* rhashtable grows at 75% load, a hit walks half of a chain */
+	while (buckets * 3 < st->keys * 4)
+		buckets <<= 1;
+	alpha = (double)st->keys / buckets;
+	elem = nftnl_set_cost_kmalloc(8 + nftnl_set_cost_ext(s, false));
+
+	c->usable = true;
+	c->interval = false;
+	c->elements = st->keys;
+	c->memory = 64 + buckets * 8 + st->keys * elem;
+	c->lookup = 3.0 + s->key_len / 8.0 +
+		    nftnl_set_cost_access(buckets * 8) +
+		    (1.0 + alpha / 2) *
+		    (nftnl_set_cost_access(st->keys * elem) +
+		     nftnl_set_cost_cmp(s->key_len));
+}
+
+static void nftnl_set_cost_rbtree(const struct nftnl_set *s,
+				  const struct nftnl_set_cost_stats *st,
+				  struct nftnl_set_backend_cost *c)
+{
+	uint64_t elements, node, total;
+	uint32_t levels, i;
+	bool interval;
+
+	if (s->set_flags & (NFT_SET_TIMEOUT | NFT_SET_EVAL))
+		return;
+
+	/* the plain keys if they do not take more elements than ranges */
+	interval = !(st->keys <= st->elements &&
+		     st->keys <= NFTNL_SET_COST_MAXKEYS);
+	elements = interval ? st->elements : st->keys;
+	node = nftnl_set_cost_kmalloc(24 + nftnl_set_cost_ext(s, interval));
+	total = elements * node;
+	levels = elements ? nftnl_set_cost_ilog2(elements) + 1 : 0;
+
+	c->usable = true;
+	c->interval = interval;
+	c->elements = elements;
+	c->memory = 8 + total;
+	/*
+	 * seqcount read section and the walk down to a leaf, where the
+	 * direction taken at each level is a coin toss for the predictor
+	 */
+	c->lookup = 2.0;
+	for (i = 0; i < levels; i++) {
+		uint64_t level = i < 40 ? node << (i + 1) : total;
+
+		c->lookup += nftnl_set_cost_access(level < total ?
+						   level : total) +
+			     nftnl_set_cost_cmp(s->key_len) +
+			     NFTNL_SET_COST_BRANCH;
+	}
+}
+
+static void nftnl_set_cost_bitmap(const struct nftnl_set *s,
+				  const struct nftnl_set_cost_stats *st,
+				  struct nftnl_set_backend_cost *c)
+{
+	uint64_t bitmap, elem;
+	bool interval;
+
+	if (s->key_len > 2 ||
+	    s->set_flags & (NFT_SET_MAP | NFT_SET_TIMEOUT | NFT_SET_EVAL))
+		return;
+
+	/* two bits per key, for the current and next generation */
+	bitmap = (1ULL << (s->key_len * 8)) * 2 / 8;
+	interval = st->elements < st->keys;
+	elem = nftnl_set_cost_kmalloc(16 + nftnl_set_cost_ext(s, interval));
+
+	c->usable = true;
+	c->interval = interval;
+	c->elements = interval ? st->elements : st->keys;
+	c->memory = 8 + bitmap + c->elements * elem;
+	c->lookup = 1.0 + nftnl_set_cost_access(bitmap);
+}
+
+static uint32_t nftnl_set_cost_class(uint32_t backend)
+{
+	return backend == NFTNL_SET_BACKEND_RBTREE ? NFTNL_SET_CLASS_O_LOG_N :
+						     NFTNL_SET_CLASS_O_1;
+}
+
+/* the backend nft_select_set_ops() instantiates given the policy */
+static uint32_t nftnl_set_cost_select(const struct nftnl_set_advice *adv,
+				      bool interval, uint32_t policy)
+{
+	const struct nftnl_set_backend_cost *c, *best = NULL;
+	uint32_t i, sel = NFTNL_SET_BACKEND_MAX + 1;
+
+	for (i = 0; i <= NFTNL_SET_BACKEND_MAX; i++) {
+		c = &adv->cost[i];
+		if (!c->usable || (interval && i == NFTNL_SET_BACKEND_HASH))
+			continue;
+		if (best == NULL)
+			goto pick;
+
+		if (policy == NFT_SET_POL_PERFORMANCE) {
+			if (nftnl_set_cost_class(i) <
+			    nftnl_set_cost_class(sel))
+				goto pick;
+			if (nftnl_set_cost_class(i) ==
+			    nftnl_set_cost_class(sel) &&
+			    c->memory < best->memory)
+				goto pick;
+		} else {
+			if (c->memory < best->memory)
+				goto pick;
+			if (c->memory == best->memory &&
+			    nftnl_set_cost_class(i) <
+			    nftnl_set_cost_class(sel))
+				goto pick;
+		}
+		continue;
+pick:
+		best = c;
+		sel = i;
+	}
+	return sel;
+}
+
+int nftnl_set_advise(const struct nftnl_set *s, struct nftnl_set_advice *adv)
+{
+	const struct nftnl_set_backend_cost *c, *fast = NULL, *best;
+	struct nftnl_set_cost_stats st;
+	uint32_t i;
+
+	memset(adv, 0, sizeof(*adv));
+	if (s->key_len == 0 || s->key_len > NFT_DATA_VALUE_MAXLEN ||
+	    s->data_len > NFT_DATA_VALUE_MAXLEN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (nftnl_set_cost_stats(s, &st) < 0)
+		return -1;
+
+	nftnl_set_cost_hash(s, &st, &adv->cost[NFTNL_SET_BACKEND_HASH]);
+	nftnl_set_cost_rbtree(s, &st, &adv->cost[NFTNL_SET_BACKEND_RBTREE]);
+	nftnl_set_cost_bitmap(s, &st, &adv->cost[NFTNL_SET_BACKEND_BITMAP]);
+	adv->keys = st.keys;
+	adv->ranges = st.ranges;
+
+	for (i = 0; i <= NFTNL_SET_BACKEND_MAX; i++) {
+		c = &adv->cost[i];
+		if (c->usable && (fast == NULL || c->lookup < fast->lookup)) {
+			fast = c;
+			adv->backend = i;
+		}
+	}
+	if (fast == NULL) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	/*
+	 * Trade a little lookup speed for half the memory, and up to two
+	 * and a half times the lookup cost for a 32nd of it.
+	 */
+	best = fast;
+	for (i = 0; i <= NFTNL_SET_BACKEND_MAX; i++) {
+		c = &adv->cost[i];
+		if (!c->usable || c->memory >= best->memory)
+			continue;
+		if ((c->lookup <= fast->lookup * 1.25 &&
+		     c->memory * 2 <= fast->memory) ||
+		    (c->lookup <= fast->lookup * 2.5 &&
+		     c->memory * 32 <= fast->memory)) {
+			best = c;
+			adv->backend = i;
+		}
+	}
+
+	adv->interval = best->interval;
+	adv->size = best->elements;
+	adv->policy = NFT_SET_POL_PERFORMANCE;
+	if (nftnl_set_cost_select(adv, adv->interval,
+				  NFT_SET_POL_PERFORMANCE) != adv->backend &&
+	    nftnl_set_cost_select(adv, adv->interval,
+				  NFT_SET_POL_MEMORY) == adv->backend)
+		adv->policy = NFT_SET_POL_MEMORY;
+	adv->selected = nftnl_set_cost_select(adv, adv->interval, adv->policy);
+
+	return 0;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_set_advise);
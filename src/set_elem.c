@@ -41,12 +41,8 @@ EXPORT_SYMBOL(nftnl_set_elem_alloc, nft_set_elem_alloc);
 
 void nftnl_set_elem_free(struct nftnl_set_elem *s)
 {
-	if (s->flags & (1 << NFTNL_SET_ELEM_CHAIN)) {
-		if (s->data.chain) {
-			xfree(s->data.chain);
-			s->data.chain = NULL;
-		}
-	}
+	if (s->flags & (1 << NFTNL_SET_ELEM_CHAIN))
+		nftnl_intern_put(s->data.chain);
 
 	if (s->flags & (1 << NFTNL_SET_ELEM_EXPR))
 		nftnl_expr_free(s->expr);
@@ -66,10 +62,8 @@ void nftnl_set_elem_unset(struct nftnl_set_elem *s, uint16_t attr)
 	switch (attr) {
 	case NFTNL_SET_ELEM_CHAIN:
 		if (s->flags & (1 << NFTNL_SET_ELEM_CHAIN)) {
-			if (s->data.chain) {
-				xfree(s->data.chain);
-				s->data.chain = NULL;
-			}
+			nftnl_intern_put(s->data.chain);
+			s->data.chain = NULL;
 		}
 		break;
 	case NFTNL_SET_ELEM_FLAGS:
@@ -109,10 +103,12 @@ void nftnl_set_elem_set(struct nftnl_set_elem *s, uint16_t attr,
 		s->data.verdict = *((uint32_t *)data);
 		break;
 	case NFTNL_SET_ELEM_CHAIN:	/* NFTA_SET_ELEM_DATA */
-		if (s->data.chain)
-			xfree(s->data.chain);
-
-		s->data.chain = strdup(data);
+		nftnl_intern_put(s->data.chain);
+		s->data.chain = nftnl_intern(data);
+		if (s->data.chain == NULL) {
+			s->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_SET_ELEM_DATA:	/* NFTA_SET_ELEM_DATA */
 		memcpy(s->data.val, data, data_len);
@@ -217,7 +213,7 @@ struct nftnl_set_elem *nftnl_set_elem_clone(struct nftnl_set_elem *elem)
 	memcpy(newelem, elem, sizeof(*elem));
 
 	if (elem->flags & (1 << NFTNL_SET_ELEM_CHAIN))
-		newelem->data.chain = strdup(elem->data.chain);
+		newelem->data.chain = nftnl_intern_get(elem->data.chain);
 
 	return newelem;
 }
@@ -271,11 +267,11 @@ static void nftnl_set_elem_nlmsg_build_def(struct nlmsghdr *nlh,
 }
 
 static struct nlattr *nftnl_set_elem_build(struct nlmsghdr *nlh,
-					      struct nftnl_set_elem *elem, int i)
+					      struct nftnl_set_elem *elem)
 {
 	struct nlattr *nest2;
 
-	nest2 = mnl_attr_nest_start(nlh, i);
+	nest2 = mnl_attr_nest_start(nlh, NFTA_LIST_ELEM);
 	nftnl_set_elem_nlmsg_build_payload(nlh, elem);
 	mnl_attr_nest_end(nlh, nest2);
 
@@ -286,13 +282,12 @@ void nftnl_set_elems_nlmsg_build_payload(struct nlmsghdr *nlh, struct nftnl_set
 {
 	struct nftnl_set_elem *elem;
 	struct nlattr *nest1;
-	int i = 0;
 
 	nftnl_set_elem_nlmsg_build_def(nlh, s);
 
 	nest1 = mnl_attr_nest_start(nlh, NFTA_SET_ELEM_LIST_ELEMENTS);
 	list_for_each_entry(elem, &s->element_list, head)
-		nftnl_set_elem_build(nlh, elem, ++i);
+		nftnl_set_elem_build(nlh, elem);
 
 	mnl_attr_nest_end(nlh, nest1);
 }
@@ -332,21 +327,15 @@ static int nftnl_set_elem_parse_attr_cb(const struct nlattr *attr, void *data)
 	return MNL_CB_OK;
 }
 
-static int nftnl_set_elems_parse2(struct nftnl_set *s, const struct nlattr *nest)
+static int nftnl_set_elem_parse_nest(struct nftnl_set_elem *e,
+				     const struct nlattr *nest)
 {
 	struct nlattr *tb[NFTA_SET_ELEM_MAX+1] = {};
-	struct nftnl_set_elem *e;
 	int ret = 0, type;
 
-	e = nftnl_set_elem_alloc();
-	if (e == NULL)
+	if (mnl_attr_parse_nested(nest, nftnl_set_elem_parse_attr_cb, tb) < 0)
 		return -1;
 
-	if (mnl_attr_parse_nested(nest, nftnl_set_elem_parse_attr_cb, tb) < 0) {
-		nftnl_set_elem_free(e);
-		return -1;
-	}
-
 	if (tb[NFTA_SET_ELEM_FLAGS]) {
 		e->set_elem_flags =
 			ntohl(mnl_attr_get_u32(tb[NFTA_SET_ELEM_FLAGS]));
@@ -366,6 +355,8 @@ static int nftnl_set_elems_parse2(struct nftnl_set *s, const struct nlattr *nest
         }
         if (tb[NFTA_SET_ELEM_DATA]) {
 		ret = nftnl_parse_data(&e->data, tb[NFTA_SET_ELEM_DATA], &type);
+		if (ret < 0)
+			return ret;
 		switch(type) {
 		case DATA_VERDICT:
 			e->flags |= (1 << NFTNL_SET_ELEM_VERDICT);
@@ -382,7 +373,7 @@ static int nftnl_set_elems_parse2(struct nftnl_set *s, const struct nlattr *nest
 	if (tb[NFTA_SET_ELEM_EXPR]) {
 		e->expr = nftnl_expr_parse(tb[NFTA_SET_ELEM_EXPR]);
 		if (e->expr == NULL)
-			goto err;
+			return -1;
 		e->flags |= (1 << NFTNL_SET_ELEM_EXPR);
 	}
 	if (tb[NFTA_SET_ELEM_USERDATA]) {
@@ -395,13 +386,25 @@ static int nftnl_set_elems_parse2(struct nftnl_set *s, const struct nlattr *nest
 		e->user.len  = mnl_attr_get_payload_len(tb[NFTA_SET_ELEM_USERDATA]);
 		e->user.data = malloc(e->user.len);
 		if (e->user.data == NULL)
-			goto err;
+			return -1;
 		memcpy(e->user.data, udata, e->user.len);
 		e->flags |= (1 << NFTNL_RULE_USERDATA);
 	}
 
+	return ret;
+}
+
+static int nftnl_set_elems_parse2(struct nftnl_set *s, const struct nlattr *nest)
+{
+	struct nftnl_set_elem *e;
+	int ret;
+
+	e = nftnl_set_elem_alloc();
+	if (e == NULL)
+		return -1;
+
+	ret = nftnl_set_elem_parse_nest(e, nest);
 	if (ret < 0) {
-err:
 		nftnl_set_elem_free(e);
 		return -1;
 	}
@@ -455,6 +458,7 @@ int nftnl_set_elems_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_set *s)
 {
 	struct nlattr *tb[NFTA_SET_ELEM_LIST_MAX+1] = {};
 	struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
+	const char *str;
 	int ret = 0;
 
 	if (mnl_attr_parse(nlh, sizeof(*nfg),
@@ -462,15 +466,23 @@ int nftnl_set_elems_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_set *s)
 		return -1;
 
 	if (tb[NFTA_SET_ELEM_LIST_TABLE]) {
-		xfree(s->table);
-		s->table =
-			strdup(mnl_attr_get_str(tb[NFTA_SET_ELEM_LIST_TABLE]));
+		str = mnl_attr_get_str(tb[NFTA_SET_ELEM_LIST_TABLE]);
+		nftnl_intern_put(s->table);
+		s->table = nftnl_intern(str);
+		if (s->table == NULL) {
+			s->flags &= ~(1 << NFTNL_SET_TABLE);
+			return -1;
+		}
 		s->flags |= (1 << NFTNL_SET_TABLE);
 	}
 	if (tb[NFTA_SET_ELEM_LIST_SET]) {
-		xfree(s->name);
-		s->name =
-			strdup(mnl_attr_get_str(tb[NFTA_SET_ELEM_LIST_SET]));
+		str = mnl_attr_get_str(tb[NFTA_SET_ELEM_LIST_SET]);
+		nftnl_intern_put(s->name);
+		s->name = nftnl_intern(str);
+		if (s->name == NULL) {
+			s->flags &= ~(1 << NFTNL_SET_NAME);
+			return -1;
+		}
 		s->flags |= (1 << NFTNL_SET_NAME);
 	}
 	if (tb[NFTA_SET_ELEM_LIST_SET_ID]) {
@@ -487,6 +499,90 @@ int nftnl_set_elems_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_set *s)
 }
 EXPORT_SYMBOL(nftnl_set_elems_nlmsg_parse, nft_set_elems_nlmsg_parse);
 
+bool nftnl_set_elems_nlmsg_match(const struct nlmsghdr *nlh,
+				 const struct nftnl_set *s)
+{
+	struct nlattr *tb[NFTA_SET_ELEM_LIST_MAX+1] = {};
+	struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
+
+	if (mnl_attr_parse(nlh, sizeof(*nfg),
+			   nftnl_set_elem_list_parse_attr_cb, tb) < 0)
+		return false;
+
+	if (!tb[NFTA_SET_ELEM_LIST_TABLE] || !tb[NFTA_SET_ELEM_LIST_SET] ||
+	    !(s->flags & (1 << NFTNL_SET_TABLE)) ||
+	    !(s->flags & (1 << NFTNL_SET_NAME)))
+		return false;
+
+	return nfg->nfgen_family == s->family &&
+	       strcmp(mnl_attr_get_str(tb[NFTA_SET_ELEM_LIST_TABLE]),
+		      s->table) == 0 &&
+	       strcmp(mnl_attr_get_str(tb[NFTA_SET_ELEM_LIST_SET]),
+		      s->name) == 0;
+}
+
+static void nftnl_set_elem_release(struct nftnl_set_elem *e)
+{
+	if (e->flags & (1 << NFTNL_SET_ELEM_CHAIN))
+		nftnl_intern_put(e->data.chain);
+	if (e->flags & (1 << NFTNL_SET_ELEM_EXPR))
+		nftnl_expr_free(e->expr);
+	xfree(e->user.data);
+}
+
+/*
+ * Print the elements of @nlh as the members of a JSON "set_elem" array,
+ * without the brackets, as nftnl_set_snprintf() would once
+ * nftnl_set_elems_nlmsg_parse() has added them to a set. The elements are
+ * decoded one at a time on the stack and never linked to a set.
+ */
+int nftnl_set_elems_nlmsg_snprintf(char *buf, size_t size,
+				   const struct nlmsghdr *nlh, uint32_t type,
+				   uint32_t flags)
+{
+	struct nlattr *tb[NFTA_SET_ELEM_LIST_MAX+1] = {};
+	struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
+	int ret, len = size, offset = 0;
+	struct nftnl_set_elem e;
+	struct nlattr *attr;
+
+	if (type != NFTNL_OUTPUT_JSON) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (mnl_attr_parse(nlh, sizeof(*nfg),
+			   nftnl_set_elem_list_parse_attr_cb, tb) < 0)
+		return -1;
+
+	if (!tb[NFTA_SET_ELEM_LIST_ELEMENTS])
+		return 0;
+
+	mnl_attr_for_each_nested(attr, tb[NFTA_SET_ELEM_LIST_ELEMENTS]) {
+		if (mnl_attr_get_type(attr) != NFTA_LIST_ELEM)
+			return -1;
+
+		memset(&e, 0, sizeof(e));
+		if (nftnl_set_elem_parse_nest(&e, attr) < 0) {
+			nftnl_set_elem_release(&e);
+			return -1;
+		}
+
+		ret = snprintf(buf + offset, len, offset ? ",{" : "{");
+		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+
+		ret = nftnl_set_elem_snprintf(buf + offset, len, &e, type,
+					      flags);
+		nftnl_set_elem_release(&e);
+		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+
+		ret = snprintf(buf + offset, len, "}");
+		SNPRINTF_BUFFER_SIZE(ret, size, len, offset);
+	}
+
+	return offset;
+}
+
 #ifdef XML_PARSING
 int nftnl_mxml_set_elem_parse(mxml_node_t *tree, struct nftnl_set_elem *e,
 			    struct nftnl_parse_err *err)
@@ -879,14 +975,14 @@ int nftnl_set_elems_nlmsg_build_payload_iter(struct nlmsghdr *nlh,
 {
 	struct nftnl_set_elem *elem;
 	struct nlattr *nest1, *nest2;
-	int i = 0, ret = 0;
+	int ret = 0;
 
 	nftnl_set_elem_nlmsg_build_def(nlh, iter->set);
 
 	nest1 = mnl_attr_nest_start(nlh, NFTA_SET_ELEM_LIST_ELEMENTS);
 	elem = nftnl_set_elems_iter_next(iter);
 	while (elem != NULL) {
-		nest2 = nftnl_set_elem_build(nlh, elem, ++i);
+		nest2 = nftnl_set_elem_build(nlh, elem);
 		if (nftnl_attr_nest_overflow(nlh, nest1, nest2)) {
 			/* Go back to previous not to miss this element */
 			iter->cur = list_entry(iter->cur->head.prev,
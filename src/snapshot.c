@@ -0,0 +1,1124 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/set.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/snapshot.h>
+
+/*
+ * A snapshot is a header followed by its sections, every one of them starts
+ * on an 8 byte boundary. Integers are in host byte order, the header records
+ * it so that a snapshot from another architecture is refused. Strings are
+ * referred to by their offset in the string section, offset 0 is the empty
+ * string. Set keys and data live in one array per set, an element takes a
+ * slot of key_stride (data_stride) bytes there. Rule expressions are kept as
+ * their NFTA_RULE_EXPRESSIONS attribute in the blob section, along with user
+ * data. Records and strings are bounds checked when they are read, and rules
+ * carry a checksum of their expressions. The checksum is a plain FNV hash
+ * that catches a truncated or accidentally damaged file. Anyone who can
+ * write the file can recompute it, so it does not make a crafted snapshot
+ * safe to load: snapshots have to come from a trusted source.
+ */
+#define NFTNL_SNAPSHOT_MAGIC		"NFTNLSNP"
+#define NFTNL_SNAPSHOT_VERSION		1
+#define NFTNL_SNAPSHOT_BYTEORDER	0x01020304
+#define NFTNL_SNAPSHOT_ALIGN(len)	(((len) + 7) & ~(uint64_t)7)
+#define NFTNL_SNAPSHOT_SCRATCH		(1 << 17)
+
+enum {
+	NFTNL_SNAPSHOT_STR	= 0,
+	NFTNL_SNAPSHOT_TABLE,
+	NFTNL_SNAPSHOT_CHAIN,
+	NFTNL_SNAPSHOT_SET,
+	NFTNL_SNAPSHOT_ELEM,
+	NFTNL_SNAPSHOT_RULE,
+	NFTNL_SNAPSHOT_ARRAY,
+	NFTNL_SNAPSHOT_BLOB,
+	__NFTNL_SNAPSHOT_MAX
+};
+
+struct nftnl_snapshot_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byteorder;
+	uint64_t	size;
+	struct {
+		uint64_t	offset;
+		uint64_t	len;
+		uint64_t	count;
+	} sec[__NFTNL_SNAPSHOT_MAX];
+};
+
+/* attrs is the mask of attributes that are set, as in the objects */
+struct nftnl_snapshot_table {
+	uint32_t	attrs;
+	uint32_t	name;
+	uint32_t	family;
+	uint32_t	table_flags;
+	uint32_t	use;
+	uint32_t	pad;
+};
+
+struct nftnl_snapshot_chain {
+	uint32_t	attrs;
+	uint32_t	name;
+	uint32_t	table;
+	uint32_t	type;
+	uint32_t	dev;
+	uint32_t	family;
+	uint32_t	hooknum;
+	int32_t		prio;
+	uint32_t	policy;
+	uint32_t	use;
+	uint64_t	handle;
+	uint64_t	bytes;
+	uint64_t	packets;
+};
+
+struct nftnl_snapshot_set {
+	uint32_t	attrs;
+	uint32_t	table;
+	uint32_t	name;
+	uint32_t	family;
+	uint32_t	set_flags;
+	uint32_t	key_type;
+	uint32_t	key_len;
+	uint32_t	data_type;
+	uint32_t	data_len;
+	uint32_t	id;
+	uint32_t	policy;
+	uint32_t	desc_size;
+	uint32_t	gc_interval;
+	uint32_t	key_stride;
+	uint32_t	data_stride;
+	uint32_t	pad;
+	uint64_t	timeout;
+	uint64_t	elem_first;
+	uint64_t	elem_count;
+	uint64_t	key_off;
+	uint64_t	data_off;
+};
+
+struct nftnl_snapshot_elem {
+	uint32_t	attrs;
+	uint32_t	elem_flags;
+	uint32_t	key_len;
+	uint32_t	data_len;
+	int32_t		verdict;
+	uint32_t	chain;
+	uint64_t	timeout;
+	uint64_t	expiration;
+	uint64_t	udata_off;
+	uint32_t	udata_len;
+	uint32_t	pad;
+};
+
+struct nftnl_snapshot_rule {
+	uint32_t	attrs;
+	uint32_t	family;
+	uint32_t	table;
+	uint32_t	chain;
+	uint32_t	compat_proto;
+	uint32_t	compat_flags;
+	uint64_t	handle;
+	uint64_t	position;
+	uint64_t	udata_off;
+	uint64_t	expr_off;
+	uint32_t	udata_len;
+	uint32_t	expr_len;
+	uint32_t	expr_hash;
+	uint32_t	pad;
+};
+
+/* size of the records, sections of bytes count them one by one */
+static const uint32_t nftnl_snapshot_recsize[__NFTNL_SNAPSHOT_MAX] = {
+	[NFTNL_SNAPSHOT_STR]	= 1,
+	[NFTNL_SNAPSHOT_TABLE]	= sizeof(struct nftnl_snapshot_table),
+	[NFTNL_SNAPSHOT_CHAIN]	= sizeof(struct nftnl_snapshot_chain),
+	[NFTNL_SNAPSHOT_SET]	= sizeof(struct nftnl_snapshot_set),
+	[NFTNL_SNAPSHOT_ELEM]	= sizeof(struct nftnl_snapshot_elem),
+	[NFTNL_SNAPSHOT_RULE]	= sizeof(struct nftnl_snapshot_rule),
+	[NFTNL_SNAPSHOT_ARRAY]	= 1,
+	[NFTNL_SNAPSHOT_BLOB]	= 1,
+};
+
+#define nftnl_snapshot_has(rec, attr)	((rec)->attrs & (1 << (attr)))
+
+struct nftnl_snapshot_sec {
+	char		*data;
+	uint64_t	len;
+	uint64_t	size;
+	uint64_t	count;
+};
+
+struct nftnl_snapshot_writer {
+	struct nftnl_snapshot_sec	sec[__NFTNL_SNAPSHOT_MAX];
+	uint32_t			*strs;		/* string offset + 1 */
+	uint32_t			strs_size;
+	uint32_t			strs_count;
+	char				*scratch;
+};
+
+/*
+ * Append @len zeroed bytes to section @sec at an @align boundary. The
+ * pointer is only good until the next reservation in the same section.
+ */
+static void *nftnl_snapshot_reserve(struct nftnl_snapshot_writer *w, int sec,
+				    uint64_t len, uint64_t align,
+				    uint64_t *offset)
+{
+	struct nftnl_snapshot_sec *s = &w->sec[sec];
+	uint64_t off = (s->len + align - 1) & ~(align - 1);
+	uint64_t size = s->size ? s->size : 4096;
+	char *data;
+
+	if (off + len > s->size || s->data == NULL) {
+		while (size < off + len)
+			size *= 2;
+
+		data = realloc(s->data, size);
+		if (data == NULL)
+			return NULL;
+
+		s->data = data;
+		s->size = size;
+	}
+	memset(s->data + s->len, 0, off + len - s->len);
+	s->len = off + len;
+	s->count = s->len / nftnl_snapshot_recsize[sec];
+
+	if (offset != NULL)
+		*offset = off;
+
+	return s->data + off;
+}
+
+static void *nftnl_snapshot_record(struct nftnl_snapshot_writer *w, int sec)
+{
+	return nftnl_snapshot_reserve(w, sec, nftnl_snapshot_recsize[sec], 8,
+				      NULL);
+}
+
+static int nftnl_snapshot_put_data(struct nftnl_snapshot_writer *w, int sec,
+				   const void *data, uint32_t len,
+				   uint64_t *offset)
+{
+	void *p;
+
+	p = nftnl_snapshot_reserve(w, sec, len, 8, offset);
+	if (p == NULL)
+		return -1;
+
+	memcpy(p, data, len);
+	return 0;
+}
+
+static int nftnl_snapshot_strs_grow(struct nftnl_snapshot_writer *w)
+{
+	uint32_t size = w->strs_size ? w->strs_size * 2 : 1024;
+	uint32_t *strs, i, j;
+	const char *str;
+
+	strs = calloc(size, sizeof(uint32_t));
+	if (strs == NULL)
+		return -1;
+
+	for (i = 0; i < w->strs_size; i++) {
+		if (w->strs[i] == 0)
+			continue;
+
+		str = w->sec[NFTNL_SNAPSHOT_STR].data + w->strs[i] - 1;
+		j = nftnl_hash_str(0, str) & (size - 1);
+		while (strs[j] != 0)
+			j = (j + 1) & (size - 1);
+		strs[j] = w->strs[i];
+	}
+
+	xfree(w->strs);
+	w->strs = strs;
+	w->strs_size = size;
+	return 0;
+}
+
+/* strings are stored once, whatever the number of objects using them */
+static int nftnl_snapshot_put_str(struct nftnl_snapshot_writer *w,
+				  const char *str, uint32_t *offset)
+{
+	struct nftnl_snapshot_sec *s = &w->sec[NFTNL_SNAPSHOT_STR];
+	uint64_t off;
+	size_t len;
+	uint32_t i;
+
+	if (str == NULL || str[0] == '\0') {
+		*offset = 0;
+		return 0;
+	}
+
+	if (w->strs_count * 2 >= w->strs_size &&
+	    nftnl_snapshot_strs_grow(w) < 0)
+		return -1;
+
+	i = nftnl_hash_str(0, str) & (w->strs_size - 1);
+	while (w->strs[i] != 0) {
+		if (strcmp(s->data + w->strs[i] - 1, str) == 0) {
+			*offset = w->strs[i] - 1;
+			return 0;
+		}
+		i = (i + 1) & (w->strs_size - 1);
+	}
+
+	len = strlen(str) + 1;
+	if (s->len + len >= UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+	if (nftnl_snapshot_reserve(w, NFTNL_SNAPSHOT_STR, len, 1, &off) == NULL)
+		return -1;
+
+	memcpy(s->data + off, str, len);
+	w->strs[i] = off + 1;
+	w->strs_count++;
+	*offset = off;
+	return 0;
+}
+
+static int nftnl_snapshot_put_table(struct nftnl_table *t, void *data)
+{
+	struct nftnl_snapshot_writer *w = data;
+	struct nftnl_snapshot_table *rec;
+	uint32_t name, attrs = 0;
+	uint16_t attr;
+
+	for (attr = 0; attr <= NFTNL_TABLE_MAX; attr++) {
+		if (nftnl_table_is_set(t, attr))
+			attrs |= (1 << attr);
+	}
+
+	if (nftnl_snapshot_put_str(w, nftnl_table_get_str(t, NFTNL_TABLE_NAME),
+				   &name) < 0)
+		return -1;
+
+	rec = nftnl_snapshot_record(w, NFTNL_SNAPSHOT_TABLE);
+	if (rec == NULL)
+		return -1;
+
+	rec->attrs = attrs;
+	rec->name = name;
+	rec->family = nftnl_table_get_u32(t, NFTNL_TABLE_FAMILY);
+	rec->table_flags = nftnl_table_get_u32(t, NFTNL_TABLE_FLAGS);
+	rec->use = nftnl_table_get_u32(t, NFTNL_TABLE_USE);
+	return 0;
+}
+
+static int nftnl_snapshot_put_chain(struct nftnl_chain *c, void *data)
+{
+	struct nftnl_snapshot_writer *w = data;
+	struct nftnl_snapshot_chain *rec;
+	uint32_t name, table, type, dev, attrs = 0;
+	uint16_t attr;
+
+	for (attr = 0; attr <= NFTNL_CHAIN_MAX; attr++) {
+		if (nftnl_chain_is_set(c, attr))
+			attrs |= (1 << attr);
+	}
+
+	if (nftnl_snapshot_put_str(w, nftnl_chain_get_str(c, NFTNL_CHAIN_NAME),
+				   &name) < 0 ||
+	    nftnl_snapshot_put_str(w, nftnl_chain_get_str(c, NFTNL_CHAIN_TABLE),
+				   &table) < 0 ||
+	    nftnl_snapshot_put_str(w, nftnl_chain_get_str(c, NFTNL_CHAIN_TYPE),
+				   &type) < 0 ||
+	    nftnl_snapshot_put_str(w, nftnl_chain_get_str(c, NFTNL_CHAIN_DEV),
+				   &dev) < 0)
+		return -1;
+
+	rec = nftnl_snapshot_record(w, NFTNL_SNAPSHOT_CHAIN);
+	if (rec == NULL)
+		return -1;
+
+	rec->attrs = attrs;
+	rec->name = name;
+	rec->table = table;
+	rec->type = type;
+	rec->dev = dev;
+	rec->family = nftnl_chain_get_u32(c, NFTNL_CHAIN_FAMILY);
+	rec->hooknum = nftnl_chain_get_u32(c, NFTNL_CHAIN_HOOKNUM);
+	rec->prio = nftnl_chain_get_s32(c, NFTNL_CHAIN_PRIO);
+	rec->policy = nftnl_chain_get_u32(c, NFTNL_CHAIN_POLICY);
+	rec->use = nftnl_chain_get_u32(c, NFTNL_CHAIN_USE);
+	rec->handle = nftnl_chain_get_u64(c, NFTNL_CHAIN_HANDLE);
+	rec->bytes = nftnl_chain_get_u64(c, NFTNL_CHAIN_BYTES);
+	rec->packets = nftnl_chain_get_u64(c, NFTNL_CHAIN_PACKETS);
+	return 0;
+}
+
+static int nftnl_snapshot_put_elem(struct nftnl_snapshot_writer *w,
+				   const struct nftnl_set_elem *e)
+{
+	struct nftnl_snapshot_elem *rec;
+	uint64_t udata_off = 0;
+	uint32_t chain = 0;
+
+	/* expressions attached to elements are not supported */
+	if (e->flags & (1 << NFTNL_SET_ELEM_EXPR)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (e->flags & (1 << NFTNL_SET_ELEM_CHAIN) &&
+	    nftnl_snapshot_put_str(w, e->data.chain, &chain) < 0)
+		return -1;
+	if (e->flags & (1 << NFTNL_SET_ELEM_USERDATA) &&
+	    nftnl_snapshot_put_data(w, NFTNL_SNAPSHOT_BLOB, e->user.data,
+				    e->user.len, &udata_off) < 0)
+		return -1;
+
+	rec = nftnl_snapshot_record(w, NFTNL_SNAPSHOT_ELEM);
+	if (rec == NULL)
+		return -1;
+
+	rec->attrs = e->flags;
+	rec->elem_flags = e->set_elem_flags;
+	if (e->flags & (1 << NFTNL_SET_ELEM_KEY))
+		rec->key_len = e->key.len;
+	if (e->flags & (1 << NFTNL_SET_ELEM_DATA))
+		rec->data_len = e->data.len;
+	if (e->flags & (1 << NFTNL_SET_ELEM_VERDICT))
+		rec->verdict = e->data.verdict;
+	rec->chain = chain;
+	rec->timeout = e->timeout;
+	rec->expiration = e->expiration;
+	if (e->flags & (1 << NFTNL_SET_ELEM_USERDATA)) {
+		rec->udata_off = udata_off;
+		rec->udata_len = e->user.len;
+	}
+	return 0;
+}
+
+static int nftnl_snapshot_put_set(struct nftnl_set *s, void *data)
+{
+	struct nftnl_snapshot_writer *w = data;
+	struct nftnl_snapshot_sec *array = &w->sec[NFTNL_SNAPSHOT_ARRAY];
+	uint32_t table, name, key_stride = 0, data_stride = 0;
+	uint64_t elem_first, elem_count = 0, key_off, data_off, i = 0;
+	struct nftnl_snapshot_set *rec;
+	struct nftnl_set_elem *e;
+
+	list_for_each_entry(e, &s->element_list, head) {
+		if (e->flags & (1 << NFTNL_SET_ELEM_KEY) &&
+		    e->key.len > key_stride)
+			key_stride = e->key.len;
+		if (e->flags & (1 << NFTNL_SET_ELEM_DATA) &&
+		    e->data.len > data_stride)
+			data_stride = e->data.len;
+		elem_count++;
+	}
+
+	if (nftnl_snapshot_put_str(w, s->table, &table) < 0 ||
+	    nftnl_snapshot_put_str(w, s->name, &name) < 0)
+		return -1;
+
+	if (nftnl_snapshot_reserve(w, NFTNL_SNAPSHOT_ARRAY,
+				   elem_count * key_stride, 8,
+				   &key_off) == NULL ||
+	    nftnl_snapshot_reserve(w, NFTNL_SNAPSHOT_ARRAY,
+				   elem_count * data_stride, 8,
+				   &data_off) == NULL)
+		return -1;
+
+	elem_first = w->sec[NFTNL_SNAPSHOT_ELEM].count;
+	list_for_each_entry(e, &s->element_list, head) {
+		if (nftnl_snapshot_put_elem(w, e) < 0)
+			return -1;
+
+		if (e->flags & (1 << NFTNL_SET_ELEM_KEY))
+			memcpy(array->data + key_off + i * key_stride,
+			       e->key.val, e->key.len);
+		if (e->flags & (1 << NFTNL_SET_ELEM_DATA))
+			memcpy(array->data + data_off + i * data_stride,
+			       e->data.val, e->data.len);
+		i++;
+	}
+
+	rec = nftnl_snapshot_record(w, NFTNL_SNAPSHOT_SET);
+	if (rec == NULL)
+		return -1;
+
+	rec->attrs = s->flags;
+	rec->table = table;
+	rec->name = name;
+	rec->family = s->family;
+	rec->set_flags = s->set_flags;
+	rec->key_type = s->key_type;
+	rec->key_len = s->key_len;
+	rec->data_type = s->data_type;
+	rec->data_len = s->data_len;
+	rec->id = s->id;
+	rec->policy = s->policy;
+	rec->desc_size = s->desc.size;
+	rec->gc_interval = s->gc_interval;
+	rec->key_stride = key_stride;
+	rec->data_stride = data_stride;
+	rec->timeout = s->timeout;
+	rec->elem_first = elem_first;
+	rec->elem_count = elem_count;
+	rec->key_off = key_off;
+	rec->data_off = data_off;
+	return 0;
+}
+
+/* expressions are stored in their netlink encoding, see rule.c */
+static int nftnl_snapshot_put_exprs(struct nftnl_snapshot_writer *w,
+				    struct nftnl_rule *r, uint64_t *offset,
+				    uint32_t *len, uint32_t *hash)
+{
+	struct nlattr *nest, *nest2;
+	struct nftnl_expr *expr;
+	struct nlmsghdr *nlh;
+
+	if (w->scratch == NULL) {
+		w->scratch = malloc(NFTNL_SNAPSHOT_SCRATCH);
+		if (w->scratch == NULL)
+			return -1;
+	}
+
+	nlh = mnl_nlmsg_put_header(w->scratch);
+	nest = mnl_attr_nest_start(nlh, NFTA_RULE_EXPRESSIONS);
+	list_for_each_entry(expr, &r->expr_list, head) {
+		nest2 = mnl_attr_nest_start(nlh, NFTA_LIST_ELEM);
+		nftnl_expr_build_payload(nlh, expr);
+		mnl_attr_nest_end(nlh, nest2);
+
+		/* the attribute length has 16 bits */
+		if ((char *)mnl_nlmsg_get_payload_tail(nlh) - (char *)nest >
+		    UINT16_MAX) {
+			errno = EFBIG;
+			return -1;
+		}
+	}
+	mnl_attr_nest_end(nlh, nest);
+
+	*len = nest->nla_len;
+	/* a checksum against accidental damage, see the top of this file */
+	*hash = nftnl_hash_data(0, nest, *len);
+	return nftnl_snapshot_put_data(w, NFTNL_SNAPSHOT_BLOB, nest, *len,
+				       offset);
+}
+
+static int nftnl_snapshot_put_rule(struct nftnl_rule *r, void *data)
+{
+	struct nftnl_snapshot_writer *w = data;
+	struct nftnl_snapshot_rule *rec;
+	uint64_t udata_off = 0, expr_off = 0;
+	uint32_t table, chain, expr_len = 0, expr_hash = 0;
+
+	if (nftnl_snapshot_put_str(w, r->table, &table) < 0 ||
+	    nftnl_snapshot_put_str(w, r->chain, &chain) < 0)
+		return -1;
+	if (r->flags & (1 << NFTNL_RULE_USERDATA) &&
+	    nftnl_snapshot_put_data(w, NFTNL_SNAPSHOT_BLOB, r->user.data,
+				    r->user.len, &udata_off) < 0)
+		return -1;
+	if (!list_empty(&r->expr_list) &&
+	    nftnl_snapshot_put_exprs(w, r, &expr_off, &expr_len,
+				     &expr_hash) < 0)
+		return -1;
+
+	rec = nftnl_snapshot_record(w, NFTNL_SNAPSHOT_RULE);
+	if (rec == NULL)
+		return -1;
+
+	rec->attrs = r->flags;
+	rec->family = r->family;
+	rec->table = table;
+	rec->chain = chain;
+	rec->compat_proto = r->compat.proto;
+	rec->compat_flags = r->compat.flags;
+	rec->handle = r->handle;
+	rec->position = r->position;
+	if (r->flags & (1 << NFTNL_RULE_USERDATA)) {
+		rec->udata_off = udata_off;
+		rec->udata_len = r->user.len;
+	}
+	rec->expr_off = expr_off;
+	rec->expr_len = expr_len;
+	rec->expr_hash = expr_hash;
+	return 0;
+}
+
+static int nftnl_snapshot_write(FILE *fp, struct nftnl_snapshot_writer *w)
+{
+	static const char pad[8];
+	struct nftnl_snapshot_hdr hdr;
+	uint64_t offset;
+	size_t n;
+	int i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, NFTNL_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = NFTNL_SNAPSHOT_VERSION;
+	hdr.byteorder = NFTNL_SNAPSHOT_BYTEORDER;
+
+	offset = NFTNL_SNAPSHOT_ALIGN(sizeof(hdr));
+	for (i = 0; i < __NFTNL_SNAPSHOT_MAX; i++) {
+		hdr.sec[i].offset = offset;
+		hdr.sec[i].len = w->sec[i].len;
+		hdr.sec[i].count = w->sec[i].count;
+		offset = NFTNL_SNAPSHOT_ALIGN(offset + w->sec[i].len);
+	}
+	hdr.size = offset;
+
+	n = NFTNL_SNAPSHOT_ALIGN(sizeof(hdr)) - sizeof(hdr);
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    (n != 0 && fwrite(pad, n, 1, fp) != 1))
+		return -1;
+
+	for (i = 0; i < __NFTNL_SNAPSHOT_MAX; i++) {
+		if (w->sec[i].len == 0)
+			continue;
+
+		if (fwrite(w->sec[i].data, w->sec[i].len, 1, fp) != 1)
+			return -1;
+		n = NFTNL_SNAPSHOT_ALIGN(w->sec[i].len) - w->sec[i].len;
+		if (n != 0 && fwrite(pad, n, 1, fp) != 1)
+			return -1;
+	}
+
+	/* the length is an int, as for the other output types */
+	return offset > INT_MAX ? INT_MAX : offset;
+}
+
+int nftnl_snapshot_fprintf(FILE *fp, struct nftnl_table_list *tl,
+			   struct nftnl_chain_list *cl,
+			   struct nftnl_set_list *sl,
+			   struct nftnl_rule_list *rl)
+{
+	struct nftnl_snapshot_writer w;
+	int ret = -1, i;
+
+	memset(&w, 0, sizeof(w));
+
+	/* offset 0 is the empty string */
+	if (nftnl_snapshot_reserve(&w, NFTNL_SNAPSHOT_STR, 1, 1, NULL) == NULL)
+		goto out;
+
+	if (tl != NULL &&
+	    nftnl_table_list_foreach(tl, nftnl_snapshot_put_table, &w) < 0)
+		goto out;
+	if (cl != NULL &&
+	    nftnl_chain_list_foreach(cl, nftnl_snapshot_put_chain, &w) < 0)
+		goto out;
+	if (sl != NULL &&
+	    nftnl_set_list_foreach(sl, nftnl_snapshot_put_set, &w) < 0)
+		goto out;
+	if (rl != NULL &&
+	    nftnl_rule_list_foreach(rl, nftnl_snapshot_put_rule, &w) < 0)
+		goto out;
+
+	ret = nftnl_snapshot_write(fp, &w);
+out:
+	for (i = 0; i < __NFTNL_SNAPSHOT_MAX; i++)
+		xfree(w.sec[i].data);
+	xfree(w.strs);
+	xfree(w.scratch);
+	return ret;
+}
+
+struct nftnl_snapshot {
+	void		*map;
+	size_t		map_len;
+	const char	*data;
+	size_t		size;
+	const char	*sec[__NFTNL_SNAPSHOT_MAX];
+	uint64_t	len[__NFTNL_SNAPSHOT_MAX];
+	uint64_t	count[__NFTNL_SNAPSHOT_MAX];
+};
+
+static int nftnl_snapshot_check(struct nftnl_snapshot *snap)
+{
+	const struct nftnl_snapshot_hdr *hdr = (const void *)snap->data;
+	uint64_t offset, len, count;
+	int i;
+
+	if (memcmp(hdr->magic, NFTNL_SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != NFTNL_SNAPSHOT_VERSION ||
+	    hdr->byteorder != NFTNL_SNAPSHOT_BYTEORDER ||
+	    hdr->size < sizeof(*hdr) || hdr->size > snap->size)
+		return -1;
+
+	/* whatever follows the snapshot in the file is not part of it */
+	snap->size = hdr->size;
+
+	for (i = 0; i < __NFTNL_SNAPSHOT_MAX; i++) {
+		offset = hdr->sec[i].offset;
+		len = hdr->sec[i].len;
+		count = hdr->sec[i].count;
+
+		if (offset % 8 || offset < sizeof(*hdr) ||
+		    offset > snap->size || len > snap->size - offset)
+			return -1;
+		if (len % nftnl_snapshot_recsize[i] ||
+		    len / nftnl_snapshot_recsize[i] != count ||
+		    count > UINT32_MAX)
+			return -1;
+
+		snap->sec[i] = snap->data + offset;
+		snap->len[i] = len;
+		snap->count[i] = count;
+	}
+
+	/* every string offset within the section finds its terminator */
+	len = snap->len[NFTNL_SNAPSHOT_STR];
+	if (len == 0 || snap->sec[NFTNL_SNAPSHOT_STR][0] != '\0' ||
+	    snap->sec[NFTNL_SNAPSHOT_STR][len - 1] != '\0')
+		return -1;
+
+	return 0;
+}
+
+struct nftnl_snapshot *nftnl_snapshot_open_at(int fd, off_t offset)
+{
+	struct nftnl_snapshot *snap;
+	struct stat st;
+	off_t start;
+
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	/* records are read in place, they keep their alignment in the file */
+	if (offset < 0 || offset % 8 || offset > st.st_size ||
+	    st.st_size - offset < (off_t)sizeof(struct nftnl_snapshot_hdr)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	snap = calloc(1, sizeof(struct nftnl_snapshot));
+	if (snap == NULL)
+		return NULL;
+
+	/* mmap() only takes offsets that are a multiple of the page size */
+	start = offset - offset % sysconf(_SC_PAGESIZE);
+	snap->map_len = st.st_size - start;
+	snap->map = mmap(NULL, snap->map_len, PROT_READ, MAP_PRIVATE, fd,
+			 start);
+	if (snap->map == MAP_FAILED) {
+		xfree(snap);
+		return NULL;
+	}
+
+	snap->data = (const char *)snap->map + (offset - start);
+	snap->size = st.st_size - offset;
+
+	if (nftnl_snapshot_check(snap) < 0) {
+		nftnl_snapshot_close(snap);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return snap;
+}
+
+struct nftnl_snapshot *nftnl_snapshot_open(int fd)
+{
+	return nftnl_snapshot_open_at(fd, 0);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_open);
+
+size_t nftnl_snapshot_size(const struct nftnl_snapshot *snap)
+{
+	return snap->size;
+}
+
+void nftnl_snapshot_close(struct nftnl_snapshot *snap)
+{
+	munmap(snap->map, snap->map_len);
+	xfree(snap);
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_close);
+
+uint32_t nftnl_snapshot_count(const struct nftnl_snapshot *snap,
+			      enum nftnl_ruleset_type type)
+{
+	switch (type) {
+	case NFTNL_RULESET_TABLE:
+		return snap->count[NFTNL_SNAPSHOT_TABLE];
+	case NFTNL_RULESET_CHAIN:
+		return snap->count[NFTNL_SNAPSHOT_CHAIN];
+	case NFTNL_RULESET_SET:
+		return snap->count[NFTNL_SNAPSHOT_SET];
+	case NFTNL_RULESET_SET_ELEMS:
+		return snap->count[NFTNL_SNAPSHOT_ELEM];
+	case NFTNL_RULESET_RULE:
+		return snap->count[NFTNL_SNAPSHOT_RULE];
+	default:
+		return 0;
+	}
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_count);
+
+static const void *nftnl_snapshot_record_get(const struct nftnl_snapshot *snap,
+					     int sec, uint32_t index)
+{
+	if (index >= snap->count[sec]) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	return snap->sec[sec] + (uint64_t)index * nftnl_snapshot_recsize[sec];
+}
+
+static const char *nftnl_snapshot_get_str(const struct nftnl_snapshot *snap,
+					  uint32_t offset)
+{
+	if (offset >= snap->len[NFTNL_SNAPSHOT_STR]) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return snap->sec[NFTNL_SNAPSHOT_STR] + offset;
+}
+
+static const char *nftnl_snapshot_get_data(const struct nftnl_snapshot *snap,
+					   int sec, uint64_t offset,
+					   uint64_t len)
+{
+	if (offset > snap->len[sec] || len > snap->len[sec] - offset) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return snap->sec[sec] + offset;
+}
+
+struct nftnl_table *nftnl_snapshot_get_table(const struct nftnl_snapshot *snap,
+					     uint32_t index)
+{
+	const struct nftnl_snapshot_table *rec;
+	struct nftnl_table *t;
+	const char *name;
+
+	rec = nftnl_snapshot_record_get(snap, NFTNL_SNAPSHOT_TABLE, index);
+	if (rec == NULL)
+		return NULL;
+
+	name = nftnl_snapshot_get_str(snap, rec->name);
+	if (name == NULL)
+		return NULL;
+
+	t = nftnl_table_alloc();
+	if (t == NULL)
+		return NULL;
+
+	if (nftnl_snapshot_has(rec, NFTNL_TABLE_NAME))
+		nftnl_table_set_str(t, NFTNL_TABLE_NAME, name);
+	if (nftnl_snapshot_has(rec, NFTNL_TABLE_FAMILY))
+		nftnl_table_set_u32(t, NFTNL_TABLE_FAMILY, rec->family);
+	if (nftnl_snapshot_has(rec, NFTNL_TABLE_FLAGS))
+		nftnl_table_set_u32(t, NFTNL_TABLE_FLAGS, rec->table_flags);
+	if (nftnl_snapshot_has(rec, NFTNL_TABLE_USE))
+		nftnl_table_set_u32(t, NFTNL_TABLE_USE, rec->use);
+
+	return t;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_get_table);
+
+struct nftnl_chain *nftnl_snapshot_get_chain(const struct nftnl_snapshot *snap,
+					     uint32_t index)
+{
+	const struct nftnl_snapshot_chain *rec;
+	const char *name, *table, *type, *dev;
+	struct nftnl_chain *c;
+
+	rec = nftnl_snapshot_record_get(snap, NFTNL_SNAPSHOT_CHAIN, index);
+	if (rec == NULL)
+		return NULL;
+
+	name = nftnl_snapshot_get_str(snap, rec->name);
+	table = nftnl_snapshot_get_str(snap, rec->table);
+	type = nftnl_snapshot_get_str(snap, rec->type);
+	dev = nftnl_snapshot_get_str(snap, rec->dev);
+	if (name == NULL || table == NULL || type == NULL || dev == NULL)
+		return NULL;
+
+	c = nftnl_chain_alloc();
+	if (c == NULL)
+		return NULL;
+
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_NAME))
+		nftnl_chain_set_str(c, NFTNL_CHAIN_NAME, name);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_TABLE))
+		nftnl_chain_set_str(c, NFTNL_CHAIN_TABLE, table);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_TYPE))
+		nftnl_chain_set_str(c, NFTNL_CHAIN_TYPE, type);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_DEV))
+		nftnl_chain_set_str(c, NFTNL_CHAIN_DEV, dev);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_FAMILY))
+		nftnl_chain_set_u32(c, NFTNL_CHAIN_FAMILY, rec->family);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_HOOKNUM))
+		nftnl_chain_set_u32(c, NFTNL_CHAIN_HOOKNUM, rec->hooknum);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_PRIO))
+		nftnl_chain_set_s32(c, NFTNL_CHAIN_PRIO, rec->prio);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_POLICY))
+		nftnl_chain_set_u32(c, NFTNL_CHAIN_POLICY, rec->policy);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_USE))
+		nftnl_chain_set_u32(c, NFTNL_CHAIN_USE, rec->use);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_HANDLE))
+		nftnl_chain_set_u64(c, NFTNL_CHAIN_HANDLE, rec->handle);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_BYTES))
+		nftnl_chain_set_u64(c, NFTNL_CHAIN_BYTES, rec->bytes);
+	if (nftnl_snapshot_has(rec, NFTNL_CHAIN_PACKETS))
+		nftnl_chain_set_u64(c, NFTNL_CHAIN_PACKETS, rec->packets);
+
+	return c;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_get_chain);
+
+static struct nftnl_set_elem *
+nftnl_snapshot_get_elem(const struct nftnl_snapshot *snap,
+			const struct nftnl_snapshot_elem *rec,
+			const struct nftnl_snapshot_set *srec,
+			const char *key, const char *data)
+{
+	const char *chain = NULL, *udata = NULL;
+	struct nftnl_set_elem *e;
+
+	if (rec->key_len > srec->key_stride ||
+	    rec->data_len > srec->data_stride ||
+	    nftnl_snapshot_has(rec, NFTNL_SET_ELEM_EXPR)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (nftnl_snapshot_has(rec, NFTNL_SET_ELEM_CHAIN)) {
+		chain = nftnl_snapshot_get_str(snap, rec->chain);
+		if (chain == NULL)
+			return NULL;
+	}
+	if (nftnl_snapshot_has(rec, NFTNL_SET_ELEM_USERDATA)) {
+		udata = nftnl_snapshot_get_data(snap, NFTNL_SNAPSHOT_BLOB,
+						rec->udata_off, rec->udata_len);
+		if (udata == NULL)
+			return NULL;
+	}
+
+	e = nftnl_set_elem_alloc();
+	if (e == NULL)
+		return NULL;
+
+	e->flags = rec->attrs & ((1 << (NFTNL_SET_ELEM_EXPR + 1)) - 1);
+	e->set_elem_flags = rec->elem_flags;
+	e->timeout = rec->timeout;
+	e->expiration = rec->expiration;
+	if (nftnl_snapshot_has(rec, NFTNL_SET_ELEM_KEY)) {
+		memcpy(e->key.val, key, rec->key_len);
+		e->key.len = rec->key_len;
+	}
+	if (nftnl_snapshot_has(rec, NFTNL_SET_ELEM_DATA)) {
+		memcpy(e->data.val, data, rec->data_len);
+		e->data.len = rec->data_len;
+	}
+	if (nftnl_snapshot_has(rec, NFTNL_SET_ELEM_VERDICT))
+		e->data.verdict = rec->verdict;
+	if (chain != NULL) {
+		e->data.chain = nftnl_intern(chain);
+		if (e->data.chain == NULL)
+			goto err;
+	}
+	/* as nftnl_set_elems_parse2() does, the element owns its copy */
+	if (udata != NULL) {
+		e->user.data = malloc(rec->udata_len);
+		if (e->user.data == NULL)
+			goto err;
+		memcpy(e->user.data, udata, rec->udata_len);
+		e->user.len = rec->udata_len;
+	}
+
+	return e;
+err:
+	nftnl_set_elem_free(e);
+	return NULL;
+}
+
+struct nftnl_set *nftnl_snapshot_get_set(const struct nftnl_snapshot *snap,
+					 uint32_t index)
+{
+	const struct nftnl_snapshot_elem *elems;
+	const struct nftnl_snapshot_set *rec;
+	const char *table, *name, *keys, *data;
+	struct nftnl_set_elem *e;
+	struct nftnl_set *s;
+	uint64_t i;
+
+	rec = nftnl_snapshot_record_get(snap, NFTNL_SNAPSHOT_SET, index);
+	if (rec == NULL)
+		return NULL;
+
+	table = nftnl_snapshot_get_str(snap, rec->table);
+	name = nftnl_snapshot_get_str(snap, rec->name);
+	if (table == NULL || name == NULL)
+		return NULL;
+
+	if (rec->elem_first > snap->count[NFTNL_SNAPSHOT_ELEM] ||
+	    rec->elem_count > snap->count[NFTNL_SNAPSHOT_ELEM] -
+			      rec->elem_first ||
+	    rec->key_stride > NFT_DATA_VALUE_MAXLEN ||
+	    rec->data_stride > NFT_DATA_VALUE_MAXLEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+	elems = (const struct nftnl_snapshot_elem *)
+		snap->sec[NFTNL_SNAPSHOT_ELEM] + rec->elem_first;
+
+	keys = nftnl_snapshot_get_data(snap, NFTNL_SNAPSHOT_ARRAY, rec->key_off,
+				       rec->elem_count * rec->key_stride);
+	data = nftnl_snapshot_get_data(snap, NFTNL_SNAPSHOT_ARRAY,
+				       rec->data_off,
+				       rec->elem_count * rec->data_stride);
+	if (keys == NULL || data == NULL)
+		return NULL;
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		return NULL;
+
+	if (nftnl_snapshot_has(rec, NFTNL_SET_TABLE))
+		nftnl_set_set_str(s, NFTNL_SET_TABLE, table);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_NAME))
+		nftnl_set_set_str(s, NFTNL_SET_NAME, name);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_FAMILY))
+		nftnl_set_set_u32(s, NFTNL_SET_FAMILY, rec->family);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_FLAGS))
+		nftnl_set_set_u32(s, NFTNL_SET_FLAGS, rec->set_flags);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_KEY_TYPE))
+		nftnl_set_set_u32(s, NFTNL_SET_KEY_TYPE, rec->key_type);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_KEY_LEN))
+		nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, rec->key_len);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_DATA_TYPE))
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, rec->data_type);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_DATA_LEN))
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_LEN, rec->data_len);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_ID))
+		nftnl_set_set_u32(s, NFTNL_SET_ID, rec->id);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_POLICY))
+		nftnl_set_set_u32(s, NFTNL_SET_POLICY, rec->policy);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_DESC_SIZE))
+		nftnl_set_set_u32(s, NFTNL_SET_DESC_SIZE, rec->desc_size);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_TIMEOUT))
+		nftnl_set_set_u64(s, NFTNL_SET_TIMEOUT, rec->timeout);
+	if (nftnl_snapshot_has(rec, NFTNL_SET_GC_INTERVAL))
+		nftnl_set_set_u32(s, NFTNL_SET_GC_INTERVAL, rec->gc_interval);
+
+	for (i = 0; i < rec->elem_count; i++) {
+		e = nftnl_snapshot_get_elem(snap, &elems[i], rec,
+					    keys + i * rec->key_stride,
+					    data + i * rec->data_stride);
+		if (e == NULL) {
+			nftnl_set_free(s);
+			return NULL;
+		}
+		list_add_tail(&e->head, &s->element_list);
+	}
+
+	return s;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_get_set);
+
+struct nftnl_rule *nftnl_snapshot_get_rule(const struct nftnl_snapshot *snap,
+					   uint32_t index)
+{
+	const struct nftnl_snapshot_rule *rec;
+	const char *table, *chain, *udata = NULL;
+	const struct nlattr *nest = NULL;
+	struct nftnl_rule *r;
+
+	rec = nftnl_snapshot_record_get(snap, NFTNL_SNAPSHOT_RULE, index);
+	if (rec == NULL)
+		return NULL;
+
+	table = nftnl_snapshot_get_str(snap, rec->table);
+	chain = nftnl_snapshot_get_str(snap, rec->chain);
+	if (table == NULL || chain == NULL)
+		return NULL;
+
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_USERDATA)) {
+		udata = nftnl_snapshot_get_data(snap, NFTNL_SNAPSHOT_BLOB,
+						rec->udata_off, rec->udata_len);
+		if (udata == NULL)
+			return NULL;
+	}
+	if (rec->expr_len > 0) {
+		nest = (const struct nlattr *)
+			nftnl_snapshot_get_data(snap, NFTNL_SNAPSHOT_BLOB,
+						rec->expr_off, rec->expr_len);
+		if (nest == NULL)
+			return NULL;
+
+		if (rec->expr_off % MNL_ALIGNTO ||
+		    rec->expr_len < sizeof(struct nlattr) ||
+		    nest->nla_len != rec->expr_len ||
+		    mnl_attr_get_type(nest) != NFTA_RULE_EXPRESSIONS ||
+		    nftnl_hash_data(0, nest, rec->expr_len) != rec->expr_hash) {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		return NULL;
+
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_FAMILY))
+		nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, rec->family);
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_TABLE))
+		nftnl_rule_set_str(r, NFTNL_RULE_TABLE, table);
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_CHAIN))
+		nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, chain);
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_HANDLE))
+		nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, rec->handle);
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_POSITION))
+		nftnl_rule_set_u64(r, NFTNL_RULE_POSITION, rec->position);
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_COMPAT_PROTO))
+		nftnl_rule_set_u32(r, NFTNL_RULE_COMPAT_PROTO,
+				   rec->compat_proto);
+	if (nftnl_snapshot_has(rec, NFTNL_RULE_COMPAT_FLAGS))
+		nftnl_rule_set_u32(r, NFTNL_RULE_COMPAT_FLAGS,
+				   rec->compat_flags);
+	if (nest != NULL &&
+	    nftnl_rule_parse_expr((struct nlattr *)nest, r) < 0) {
+		errno = EINVAL;
+		goto err;
+	}
+	/* as nftnl_rule_nlmsg_parse() does, the rule owns its copy */
+	if (udata != NULL) {
+		r->user.data = malloc(rec->udata_len);
+		if (r->user.data == NULL)
+			goto err;
+		memcpy(r->user.data, udata, rec->udata_len);
+		r->user.len = rec->udata_len;
+		r->flags |= (1 << NFTNL_RULE_USERDATA);
+	}
+
+	return r;
+err:
+	nftnl_rule_free(r);
+	return NULL;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_snapshot_get_rule);
@@ -45,7 +45,7 @@ EXPORT_SYMBOL(nftnl_table_alloc, nft_table_alloc);
 void nftnl_table_free(struct nftnl_table *t)
 {
 	if (t->flags & (1 << NFTNL_TABLE_NAME))
-		xfree(t->name);
+		nftnl_intern_put(t->name);
 
 	xfree(t);
 }
@@ -64,10 +64,8 @@ void nftnl_table_unset(struct nftnl_table *t, uint16_t attr)
 
 	switch (attr) {
 	case NFTNL_TABLE_NAME:
-		if (t->name) {
-			xfree(t->name);
-			t->name = NULL;
-		}
+		nftnl_intern_put(t->name);
+		t->name = NULL;
 		break;
 	case NFTNL_TABLE_FLAGS:
 	case NFTNL_TABLE_FAMILY:
@@ -94,10 +92,12 @@ void nftnl_table_set_data(struct nftnl_table *t, uint16_t attr,
 
 	switch (attr) {
 	case NFTNL_TABLE_NAME:
-		if (t->name)
-			xfree(t->name);
-
-		t->name = strdup(data);
+		nftnl_intern_put(t->name);
+		t->name = nftnl_intern(data);
+		if (t->name == NULL) {
+			t->flags &= ~(1 << attr);
+			return;
+		}
 		break;
 	case NFTNL_TABLE_FLAGS:
 		t->table_flags = *((uint32_t *)data);
@@ -229,8 +229,12 @@ int nftnl_table_nlmsg_parse(const struct nlmsghdr *nlh, struct nftnl_table *t)
 		return -1;
 
 	if (tb[NFTA_TABLE_NAME]) {
-		xfree(t->name);
-		t->name = strdup(mnl_attr_get_str(tb[NFTA_TABLE_NAME]));
+		nftnl_intern_put(t->name);
+		t->name = nftnl_intern(mnl_attr_get_str(tb[NFTA_TABLE_NAME]));
+		if (t->name == NULL) {
+			t->flags &= ~(1 << NFTNL_TABLE_NAME);
+			return -1;
+		}
 		t->flags |= (1 << NFTNL_TABLE_NAME);
 	}
 	if (tb[NFTA_TABLE_FLAGS]) {
@@ -220,38 +220,37 @@ uint32_t nftnl_str2cmd(const char *cmd)
 	return NFTNL_CMD_UNSPEC;
 }
 
-int nftnl_fprintf(FILE *fp, void *obj, uint32_t cmd, uint32_t type, uint32_t flags,
-		int (*snprintf_cb)(char *buf, size_t bufsiz, void *obj,
-				   uint32_t cmd, uint32_t type, uint32_t flags))
+/* 32-bits FNV-1a, used to fingerprint objects by their content. */
+uint32_t nftnl_hash_data(uint32_t hash, const void *data, size_t len)
 {
-	char _buf[NFTNL_SNPRINTF_BUFSIZ];
-	char *buf = _buf;
-	size_t bufsiz = sizeof(_buf);
-	int ret;
+	const uint8_t *p = data;
+	size_t i;
 
-	ret = snprintf_cb(buf, bufsiz, obj, cmd, type, flags);
-	if (ret <= 0)
-		goto out;
-
-	if (ret >= NFTNL_SNPRINTF_BUFSIZ) {
-		bufsiz = ret + 1;
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
 
-		buf = malloc(bufsiz);
-		if (buf == NULL)
-			return -1;
+uint32_t nftnl_hash_str(uint32_t hash, const char *str)
+{
+	if (str == NULL)
+		return hash;
 
-		ret = snprintf_cb(buf, bufsiz, obj, cmd, type, flags);
-		if (ret <= 0)
-			goto out;
-	}
+	return nftnl_hash_data(hash, str, strlen(str) + 1);
+}
 
-	ret = fprintf(fp, "%s", buf);
+int nftnl_fprintf(FILE *fp, void *obj, uint32_t cmd, uint32_t type, uint32_t flags,
+		int (*snprintf_cb)(char *buf, size_t bufsiz, void *obj,
+				   uint32_t cmd, uint32_t type, uint32_t flags))
+{
+	char buf[NFTNL_SNPRINTF_BUFSIZ];
+	NFTNL_BUF_INIT_FILE(b, buf, sizeof(buf), fp);
 
-out:
-	if (buf != _buf)
-		xfree(buf);
+	nftnl_buf_obj(&b, obj, cmd, type, flags, snprintf_cb);
 
-	return ret;
+	return nftnl_buf_flush(&b);
 }
 
 void __nftnl_assert_fail(uint16_t attr, const char *filename, int line)
@@ -0,0 +1,583 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+
+/*
+ * Translation of xtables compat extensions to native expressions. The
+ * layouts below mirror the info blobs of the kernel extensions, only the
+ * fields that are interpreted are spelled out.
+ */
+
+/* From include/uapi/linux/netfilter/xt_tcpudp.h */
+struct xt_tcp {
+	uint16_t	spts[2];
+	uint16_t	dpts[2];
+	uint8_t		option;
+	uint8_t		flg_mask;
+	uint8_t		flg_cmp;
+	uint8_t		invflags;
+};
+
+#define XT_TCP_INV_SRCPT	0x01
+#define XT_TCP_INV_DSTPT	0x02
+#define XT_TCP_INV_FLAGS	0x04
+#define XT_TCP_INV_MASK		0x0f
+
+struct xt_udp {
+	uint16_t	spts[2];
+	uint16_t	dpts[2];
+	uint8_t		invflags;
+};
+
+#define XT_UDP_INV_SRCPT	0x01
+#define XT_UDP_INV_DSTPT	0x02
+#define XT_UDP_INV_MASK		0x03
+
+/* From include/uapi/linux/netfilter/xt_state.h */
+struct xt_state_info {
+	uint32_t	statemask;
+};
+
+/* From include/uapi/linux/netfilter/xt_conntrack.h */
+struct xt_conntrack_mtinfo1 {
+	uint8_t		addr[8][16];
+	uint32_t	expires_min, expires_max;
+	uint16_t	l4proto;
+	uint16_t	ports[4];
+	uint16_t	match_flags, invert_flags;
+	uint8_t		state_mask, status_mask;
+};
+
+struct xt_conntrack_mtinfo2 {
+	uint8_t		addr[8][16];
+	uint32_t	expires_min, expires_max;
+	uint16_t	l4proto;
+	uint16_t	ports[4];
+	uint16_t	match_flags, invert_flags;
+	uint16_t	state_mask, status_mask;
+};
+
+#define XT_CONNTRACK_STATE	(1 << 0)
+
+/* states beyond untracked (SNAT, DNAT) have no ct state counterpart */
+#define XT_CONNTRACK_STATE_MASK	0x7f
+
+/* From include/uapi/linux/netfilter/xt_mark.h */
+struct xt_mark_mtinfo1 {
+	uint32_t	mark, mask;
+	uint8_t		invert;
+};
+
+struct xt_mark_tginfo2 {
+	uint32_t	mark, mask;
+};
+
+/* From include/uapi/linux/netfilter/xt_limit.h */
+struct xt_rateinfo {
+	uint32_t	avg;
+	uint32_t	burst;
+};
+
+#define XT_LIMIT_SCALE		10000
+
+/* From include/uapi/linux/netfilter/xt_comment.h */
+#define XT_MAX_COMMENT_LEN	256
+
+#define array_size(x)		(sizeof(x) / sizeof((x)[0]))
+
+/*
+ * Expression builders, they append to @exprs and return -1 on allocation
+ * failure. The translated expressions use NFT_REG_1 only; xtables
+ * extensions do not touch registers, so no frontend keeps data there across
+ * them.
+ */
+static struct nftnl_expr *nftnl_xt_expr(struct list_head *exprs,
+					const char *name)
+{
+	struct nftnl_expr *e;
+
+	e = nftnl_expr_alloc(name);
+	if (e != NULL)
+		list_add_tail(&e->head, exprs);
+
+	return e;
+}
+
+static int nftnl_xt_payload(struct list_head *exprs, uint32_t base,
+			    uint32_t offset, uint32_t len)
+{
+	struct nftnl_expr *e = nftnl_xt_expr(exprs, "payload");
+
+	if (e == NULL)
+		return -1;
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_BASE, base);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET, offset);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_LEN, len);
+	return 0;
+}
+
+static int nftnl_xt_meta(struct list_head *exprs, uint32_t key, uint16_t reg)
+{
+	struct nftnl_expr *e = nftnl_xt_expr(exprs, "meta");
+
+	if (e == NULL)
+		return -1;
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_META_KEY, key);
+	nftnl_expr_set_u32(e, reg, NFT_REG_1);
+	return 0;
+}
+
+static int nftnl_xt_ct(struct list_head *exprs, uint32_t key)
+{
+	struct nftnl_expr *e = nftnl_xt_expr(exprs, "ct");
+
+	if (e == NULL)
+		return -1;
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CT_KEY, key);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CT_DREG, NFT_REG_1);
+	return 0;
+}
+
+static int nftnl_xt_bitwise(struct list_head *exprs, const void *mask,
+			    const void *xor, uint32_t len)
+{
+	struct nftnl_expr *e = nftnl_xt_expr(exprs, "bitwise");
+
+	if (e == NULL)
+		return -1;
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_LEN, len);
+	nftnl_expr_set(e, NFTNL_EXPR_BITWISE_MASK, mask, len);
+	nftnl_expr_set(e, NFTNL_EXPR_BITWISE_XOR, xor, len);
+	return 0;
+}
+
+static int nftnl_xt_cmp(struct list_head *exprs, uint32_t op,
+			const void *data, uint32_t len)
+{
+	struct nftnl_expr *e = nftnl_xt_expr(exprs, "cmp");
+
+	if (e == NULL)
+		return -1;
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, op);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, data, len);
+	return 0;
+}
+
+/* load, optionally mask, and compare a 32-bit host byte order key */
+static int nftnl_xt_masked_u32(struct list_head *exprs, uint32_t mask,
+			       uint32_t op, uint32_t value)
+{
+	static const uint32_t zero;
+
+	if (mask != UINT32_MAX &&
+	    nftnl_xt_bitwise(exprs, &mask, &zero, sizeof(mask)) < 0)
+		return -1;
+
+	return nftnl_xt_cmp(exprs, op, &value, sizeof(value));
+}
+
+static int nftnl_xt_l4proto(struct list_head *exprs, uint8_t proto)
+{
+	if (nftnl_xt_meta(exprs, NFT_META_L4PROTO,
+			  NFTNL_EXPR_META_DREG) < 0)
+		return -1;
+
+	return nftnl_xt_cmp(exprs, NFT_CMP_EQ, &proto, sizeof(proto));
+}
+
+/*
+ * Port ranges are host byte order in the blob. cmp orders its data with
+ * memcmp(), so network byte order bounds give the right range check.
+ */
+static int nftnl_xt_ports(struct list_head *exprs, uint32_t offset,
+			  const uint16_t *pts, bool inv)
+{
+	uint16_t lo = htons(pts[0]), hi = htons(pts[1]);
+
+	if (pts[0] == 0 && pts[1] == UINT16_MAX && !inv)
+		return 0;
+	/* no range expression, an inverted range cannot be expressed */
+	if (pts[0] > pts[1] || (pts[0] != pts[1] && inv)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (nftnl_xt_payload(exprs, NFT_PAYLOAD_TRANSPORT_HEADER, offset,
+			     sizeof(uint16_t)) < 0)
+		return -1;
+
+	if (pts[0] == pts[1])
+		return nftnl_xt_cmp(exprs, inv ? NFT_CMP_NEQ : NFT_CMP_EQ,
+				    &lo, sizeof(lo));
+
+	if (nftnl_xt_cmp(exprs, NFT_CMP_GTE, &lo, sizeof(lo)) < 0)
+		return -1;
+
+	return nftnl_xt_cmp(exprs, NFT_CMP_LTE, &hi, sizeof(hi));
+}
+
+static int nftnl_xt_tcp(struct nftnl_rule *r, const void *data,
+			struct list_head *exprs)
+{
+	const struct xt_tcp *info = data;
+	static const uint8_t zero;
+	uint32_t op;
+
+	if (info->option != 0 || info->invflags & ~XT_TCP_INV_MASK) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (nftnl_xt_l4proto(exprs, IPPROTO_TCP) < 0 ||
+	    nftnl_xt_ports(exprs, 0, info->spts,
+			   info->invflags & XT_TCP_INV_SRCPT) < 0 ||
+	    nftnl_xt_ports(exprs, 2, info->dpts,
+			   info->invflags & XT_TCP_INV_DSTPT) < 0)
+		return -1;
+
+	if (info->flg_mask == 0)
+		return 0;
+
+	op = info->invflags & XT_TCP_INV_FLAGS ? NFT_CMP_NEQ : NFT_CMP_EQ;
+	if (nftnl_xt_payload(exprs, NFT_PAYLOAD_TRANSPORT_HEADER, 13,
+			     sizeof(uint8_t)) < 0 ||
+	    nftnl_xt_bitwise(exprs, &info->flg_mask, &zero,
+			     sizeof(uint8_t)) < 0)
+		return -1;
+
+	return nftnl_xt_cmp(exprs, op, &info->flg_cmp, sizeof(uint8_t));
+}
+
+static int nftnl_xt_udp(struct nftnl_rule *r, const void *data,
+			struct list_head *exprs)
+{
+	const struct xt_udp *info = data;
+
+	if (info->invflags & ~XT_UDP_INV_MASK) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (nftnl_xt_l4proto(exprs, IPPROTO_UDP) < 0 ||
+	    nftnl_xt_ports(exprs, 0, info->spts,
+			   info->invflags & XT_UDP_INV_SRCPT) < 0)
+		return -1;
+
+	return nftnl_xt_ports(exprs, 2, info->dpts,
+			      info->invflags & XT_UDP_INV_DSTPT);
+}
+
+/* xtables and ct state share the same state bit layout */
+static int nftnl_xt_ct_state(struct list_head *exprs, uint32_t mask, bool inv)
+{
+	if (mask & ~XT_CONNTRACK_STATE_MASK) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (nftnl_xt_ct(exprs, NFT_CT_STATE) < 0)
+		return -1;
+
+	return nftnl_xt_masked_u32(exprs, mask,
+				   inv ? NFT_CMP_EQ : NFT_CMP_NEQ, 0);
+}
+
+static int nftnl_xt_state(struct nftnl_rule *r, const void *data,
+			  struct list_head *exprs)
+{
+	const struct xt_state_info *info = data;
+
+	return nftnl_xt_ct_state(exprs, info->statemask, false);
+}
+
+static int nftnl_xt_conntrack(struct list_head *exprs, uint16_t flags,
+			      uint16_t invert, uint16_t state)
+{
+	if (flags != XT_CONNTRACK_STATE || invert & ~XT_CONNTRACK_STATE) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	return nftnl_xt_ct_state(exprs, state, invert);
+}
+
+static int nftnl_xt_conntrack1(struct nftnl_rule *r, const void *data,
+			       struct list_head *exprs)
+{
+	const struct xt_conntrack_mtinfo1 *info = data;
+
+	return nftnl_xt_conntrack(exprs, info->match_flags,
+				  info->invert_flags, info->state_mask);
+}
+
+/* revision 3 only appends fields to the revision 2 layout */
+static int nftnl_xt_conntrack2(struct nftnl_rule *r, const void *data,
+			       struct list_head *exprs)
+{
+	const struct xt_conntrack_mtinfo2 *info = data;
+
+	return nftnl_xt_conntrack(exprs, info->match_flags,
+				  info->invert_flags, info->state_mask);
+}
+
+static int nftnl_xt_mark(struct nftnl_rule *r, const void *data,
+			 struct list_head *exprs)
+{
+	const struct xt_mark_mtinfo1 *info = data;
+
+	if (nftnl_xt_meta(exprs, NFT_META_MARK, NFTNL_EXPR_META_DREG) < 0)
+		return -1;
+
+	return nftnl_xt_masked_u32(exprs, info->mask,
+				   info->invert ? NFT_CMP_NEQ : NFT_CMP_EQ,
+				   info->mark);
+}
+
+/* MARK sets mark = (mark & ~mask) ^ value */
+static int nftnl_xt_mark_target(struct nftnl_rule *r, const void *data,
+				struct list_head *exprs)
+{
+	const struct xt_mark_tginfo2 *info = data;
+	uint32_t mask = ~info->mask;
+	struct nftnl_expr *e;
+
+	if (info->mask == UINT32_MAX) {
+		e = nftnl_xt_expr(exprs, "immediate");
+		if (e == NULL)
+			return -1;
+
+		nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_DREG, NFT_REG_1);
+		nftnl_expr_set(e, NFTNL_EXPR_IMM_DATA, &info->mark,
+			       sizeof(info->mark));
+	} else if (nftnl_xt_meta(exprs, NFT_META_MARK,
+				 NFTNL_EXPR_META_DREG) < 0 ||
+		   nftnl_xt_bitwise(exprs, &mask, &info->mark,
+				    sizeof(mask)) < 0) {
+		return -1;
+	}
+
+	return nftnl_xt_meta(exprs, NFT_META_MARK, NFTNL_EXPR_META_SREG);
+}
+
+/*
+ * The blob stores XT_LIMIT_SCALE * unit / rate, rounded down. Pick the
+ * smallest unit that gives that value back exactly.
+ */
+static int nftnl_xt_limit(struct nftnl_rule *r, const void *data,
+			  struct list_head *exprs)
+{
+	static const uint64_t units[] = { 1, 60, 60 * 60, 60 * 60 * 24 };
+	const struct xt_rateinfo *info = data;
+	struct nftnl_expr *e;
+	uint64_t rate = 0;
+	unsigned int i;
+
+	for (i = 0; i < array_size(units) && info->avg != 0; i++) {
+		rate = XT_LIMIT_SCALE * units[i] / info->avg;
+		if (rate != 0 && XT_LIMIT_SCALE * units[i] / rate == info->avg)
+			break;
+	}
+	if (i == array_size(units) || info->avg == 0) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	e = nftnl_xt_expr(exprs, "limit");
+	if (e == NULL)
+		return -1;
+
+	nftnl_expr_set_u64(e, NFTNL_EXPR_LIMIT_RATE, rate);
+	nftnl_expr_set_u64(e, NFTNL_EXPR_LIMIT_UNIT, units[i]);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_LIMIT_BURST, info->burst);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_LIMIT_TYPE, NFT_LIMIT_PKTS);
+	return 0;
+}
+
+/*
+ * Comments become the rule userdata, as nft stores them. The rule keeps its
+ * own copy of the comment.
+ */
+static int nftnl_xt_comment(struct nftnl_rule *r, const void *data,
+			    struct list_head *exprs)
+{
+	uint32_t len = strnlen(data, XT_MAX_COMMENT_LEN - 1) + 1;
+	char comment[XT_MAX_COMMENT_LEN];
+
+	if (r->flags & (1 << NFTNL_RULE_USERDATA)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	memcpy(comment, data, len - 1);
+	comment[len - 1] = '\0';
+	nftnl_rule_set_data(r, NFTNL_RULE_USERDATA, comment, len);
+	if (!(r->flags & (1 << NFTNL_RULE_USERDATA)))
+		return -1;
+
+	return 0;
+}
+
+struct nftnl_xt_xlat {
+	const char	*name;
+	bool		target;
+	uint32_t	rev;
+	uint32_t	len;
+	int		(*xlat)(struct nftnl_rule *r, const void *data,
+				struct list_head *exprs);
+};
+
+static const struct nftnl_xt_xlat nftnl_xt_xlat[] = {
+	{ "tcp", false, 0, sizeof(struct xt_tcp), nftnl_xt_tcp },
+	{ "udp", false, 0, sizeof(struct xt_udp), nftnl_xt_udp },
+	{ "state", false, 0, sizeof(struct xt_state_info), nftnl_xt_state },
+	{ "conntrack", false, 1, sizeof(struct xt_conntrack_mtinfo1),
+	  nftnl_xt_conntrack1 },
+	{ "conntrack", false, 2, sizeof(struct xt_conntrack_mtinfo2),
+	  nftnl_xt_conntrack2 },
+	{ "conntrack", false, 3, sizeof(struct xt_conntrack_mtinfo2),
+	  nftnl_xt_conntrack2 },
+	{ "mark", false, 1, sizeof(struct xt_mark_mtinfo1), nftnl_xt_mark },
+	{ "limit", false, 0, sizeof(struct xt_rateinfo), nftnl_xt_limit },
+	{ "comment", false, 0, XT_MAX_COMMENT_LEN, nftnl_xt_comment },
+	{ "MARK", true, 2, sizeof(struct xt_mark_tginfo2),
+	  nftnl_xt_mark_target },
+};
+
+static const struct nftnl_xt_xlat *nftnl_xt_xlat_lookup(struct nftnl_expr *e)
+{
+	uint16_t name, rev;
+	bool target;
+	unsigned int i;
+
+	if (nftnl_expr_is(e, "match")) {
+		target = false;
+		name = NFTNL_EXPR_MT_NAME;
+		rev = NFTNL_EXPR_MT_REV;
+	} else if (nftnl_expr_is(e, "target")) {
+		target = true;
+		name = NFTNL_EXPR_TG_NAME;
+		rev = NFTNL_EXPR_TG_REV;
+	} else {
+		return NULL;
+	}
+
+	for (i = 0; i < array_size(nftnl_xt_xlat); i++) {
+		if (nftnl_xt_xlat[i].target == target &&
+		    nftnl_xt_xlat[i].rev == nftnl_expr_get_u32(e, rev) &&
+		    strcmp(nftnl_xt_xlat[i].name,
+			   nftnl_expr_get_str(e, name)) == 0)
+			return &nftnl_xt_xlat[i];
+	}
+	return NULL;
+}
+
+/* Replace @e by its native translation, all or nothing. */
+static int nftnl_xt_translate(struct nftnl_rule *r, struct nftnl_expr *e)
+{
+	const struct nftnl_xt_xlat *xlat = nftnl_xt_xlat_lookup(e);
+	uint16_t info = nftnl_expr_is(e, "match") ?
+			NFTNL_EXPR_MT_INFO : NFTNL_EXPR_TG_INFO;
+	struct nftnl_expr *n, *tmp;
+	const void *data;
+	LIST_HEAD(exprs);
+	uint32_t len;
+
+	if (xlat == NULL) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	data = nftnl_expr_get(e, info, &len);
+	if (data == NULL || len < xlat->len) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (xlat->xlat(r, data, &exprs) < 0) {
+		list_for_each_entry_safe(n, tmp, &exprs, head) {
+			list_del(&n->head);
+			nftnl_expr_free(n);
+		}
+		return -1;
+	}
+
+	list_for_each_entry_safe(n, tmp, &exprs, head) {
+		list_del(&n->head);
+		list_add_tail(&n->head, &e->head);
+	}
+	list_del(&e->head);
+	nftnl_expr_free(e);
+	return 0;
+}
+
+int nftnl_rule_xt_translate(struct nftnl_rule *r,
+			    void (*cb)(const struct nftnl_rule *r,
+				       const struct nftnl_expr *e, int err,
+				       void *data),
+			    void *data)
+{
+	struct nftnl_expr *e, *tmp;
+	int left = 0;
+
+	list_for_each_entry_safe(e, tmp, &r->expr_list, head) {
+		if (!nftnl_expr_is(e, "match") &&
+		    !nftnl_expr_is(e, "target"))
+			continue;
+
+		if (nftnl_xt_translate(r, e) == 0)
+			continue;
+		if (errno == ENOMEM)
+			return -1;
+
+		left++;
+		if (cb != NULL)
+			cb(r, e, errno, data);
+	}
+	return left;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_xt_translate);
+
+int nftnl_rule_list_xt_translate(struct nftnl_rule_list *list,
+				 void (*cb)(const struct nftnl_rule *r,
+					    const struct nftnl_expr *e,
+					    int err, void *data),
+				 void *data)
+{
+	struct nftnl_rule *r;
+	int ret, left = 0;
+
+	list_for_each_entry(r, &list->list, head) {
+		ret = nftnl_rule_xt_translate(r, cb, data);
+		if (ret < 0)
+			return -1;
+
+		left += ret;
+	}
+	return left;
+}
+EXPORT_SYMBOL_NOALIAS(nftnl_rule_list_xt_translate);
@@ -0,0 +1,222 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/set.h>
+
+#include "test-rule.h"
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+static void add_saddr(struct nftnl_rule *r, uint32_t op, const char *addr,
+		      uint32_t mask)
+{
+	struct in_addr in;
+
+	inet_pton(AF_INET, addr, &in);
+	add_payload(r, NFT_PAYLOAD_NETWORK_HEADER, 12, sizeof(in));
+	if (mask != 0xffffffff)
+		add_mask(r, mask);
+	add_cmp(r, op, &in, sizeof(in));
+}
+
+static struct nftnl_set *port_set(const char *name, const uint16_t *ports,
+				  int num)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nftnl_set_elem *elem;
+	uint16_t port;
+	int i;
+
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, name);
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, NFPROTO_IPV4);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS,
+			  NFT_SET_ANONYMOUS | NFT_SET_CONSTANT);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, sizeof(port));
+	for (i = 0; i < num; i++) {
+		port = htons(ports[i]);
+		elem = nftnl_set_elem_alloc();
+		nftnl_set_elem_set(elem, NFTNL_SET_ELEM_KEY, &port,
+				   sizeof(port));
+		nftnl_set_elem_add(s, elem);
+	}
+	return s;
+}
+
+struct report {
+	uint64_t	handle;
+	uint64_t	by;
+	int		type;
+};
+
+static struct report reports[16];
+static int num_reports;
+
+static void report(const struct nftnl_rule *r, const struct nftnl_rule *by,
+		   enum nftnl_rule_redundancy type, void *data)
+{
+	if (num_reports == 16)
+		return;
+
+	reports[num_reports].handle = nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE);
+	reports[num_reports].by =
+		by ? nftnl_rule_get_u64(by, NFTNL_RULE_HANDLE) : 0;
+	reports[num_reports++].type = type;
+}
+
+static void test_redundant(void)
+{
+	static const struct report expected[] = {
+		{ 2, 1, NFTNL_RULE_SHADOWED },
+		{ 6, 5, NFTNL_RULE_SHADOWED },
+		{ 9, 8, NFTNL_RULE_SHADOWED },
+		{ 10, 0, NFTNL_RULE_SHADOWED },
+		{ 15, 14, NFTNL_RULE_SHADOWED },
+		{ 17, 16, NFTNL_RULE_DUPLICATE },
+		{ 20, 11, NFTNL_RULE_SHADOWED },
+	};
+	static const uint16_t ports[] = { 2222, 8080 };
+	struct nftnl_rule_list *list = nftnl_rule_list_alloc();
+	struct nftnl_set_list *sets = nftnl_set_list_alloc();
+	struct nftnl_rule *r;
+	int i;
+
+	nftnl_set_list_add(port_set("__set0", ports, 2), sets);
+
+	/* ip saddr 10.0.0.0/8 accept */
+	r = rule_add(list, "input", 1);
+	add_saddr(r, NFT_CMP_EQ, "10.0.0.0", 0xff000000);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* ip saddr 10.1.2.0/24 tcp dport 22 drop */
+	r = rule_add(list, "input", 2);
+	add_saddr(r, NFT_CMP_EQ, "10.1.2.0", 0xffffff00);
+	add_tcp(r);
+	add_dport(r, NFT_CMP_EQ, 22);
+	add_verdict(r, NF_DROP, NULL);
+	/* tcp dport 22 counter, twice, both run */
+	for (i = 3; i <= 4; i++) {
+		r = rule_add(list, "input", i);
+		add_tcp(r);
+		add_dport(r, NFT_CMP_EQ, 22);
+		add_expr(r, "counter");
+	}
+	/* th dport 1-1024 accept, then tcp dport 80 accept */
+	r = rule_add(list, "input", 5);
+	add_dport(r, NFT_CMP_GTE, 1);
+	add_dport(r, NFT_CMP_LTE, 1024);
+	add_verdict(r, NF_ACCEPT, NULL);
+	r = rule_add(list, "input", 6);
+	add_tcp(r);
+	add_dport(r, NFT_CMP_EQ, 80);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* tcp dport 2000 accept */
+	r = rule_add(list, "input", 7);
+	add_tcp(r);
+	add_dport(r, NFT_CMP_EQ, 2000);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* th dport { 2222, 8080 } accept, then th dport 8080 drop */
+	r = rule_add(list, "input", 8);
+	add_payload(r, NFT_PAYLOAD_TRANSPORT_HEADER, 2, sizeof(uint16_t));
+	add_lookup(r, "__set0", false);
+	add_verdict(r, NF_ACCEPT, NULL);
+	r = rule_add(list, "input", 9);
+	add_dport(r, NFT_CMP_EQ, 8080);
+	add_verdict(r, NF_DROP, NULL);
+	/* th dport 3000 th dport 3001 accept, never matches */
+	r = rule_add(list, "input", 10);
+	add_dport(r, NFT_CMP_EQ, 3000);
+	add_dport(r, NFT_CMP_EQ, 3001);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* ip saddr 10.0.0.0/8 accept, in another chain */
+	r = rule_add(list, "forward", 11);
+	add_saddr(r, NFT_CMP_EQ, "10.0.0.0", 0xff000000);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* ip saddr 192.168.0.0/16 limit accept, then ip saddr 192.168.1.1 */
+	r = rule_add(list, "input", 12);
+	add_saddr(r, NFT_CMP_EQ, "192.168.0.0", 0xffff0000);
+	add_expr(r, "limit");
+	add_verdict(r, NF_ACCEPT, NULL);
+	r = rule_add(list, "input", 13);
+	add_saddr(r, NFT_CMP_EQ, "192.168.1.1", 0xffffffff);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* ip saddr != 10.0.0.0/8 drop, then ip saddr 11.0.0.1 drop */
+	r = rule_add(list, "input", 14);
+	add_saddr(r, NFT_CMP_NEQ, "10.0.0.0", 0xff000000);
+	add_verdict(r, NF_DROP, NULL);
+	r = rule_add(list, "input", 15);
+	add_saddr(r, NFT_CMP_EQ, "11.0.0.1", 0xffffffff);
+	add_verdict(r, NF_DROP, NULL);
+	/* tcp dport 5000 accept, twice */
+	for (i = 16; i <= 17; i++) {
+		r = rule_add(list, "input", i);
+		add_tcp(r);
+		add_dport(r, NFT_CMP_EQ, 5000);
+		add_verdict(r, NF_ACCEPT, NULL);
+	}
+	/* meta mark set 1, then ip saddr 10.0.0.5 accept is reached again */
+	r = rule_add(list, "input", 18);
+	add_imm(r, 1);
+	add_meta(r, NFT_META_MARK, true);
+	r = rule_add(list, "input", 19);
+	add_saddr(r, NFT_CMP_EQ, "10.0.0.5", 0xffffffff);
+	add_verdict(r, NF_ACCEPT, NULL);
+	/* the mark is set in another chain, ip saddr 10.0.0.6 is shadowed */
+	r = rule_add(list, "forward", 20);
+	add_saddr(r, NFT_CMP_EQ, "10.0.0.6", 0xffffffff);
+	add_verdict(r, NF_DROP, NULL);
+
+	if (nftnl_rule_list_redundant(list, sets, report, NULL) !=
+	    sizeof(expected) / sizeof(expected[0]))
+		print_err("Wrong number of redundant rules");
+	if (num_reports != sizeof(expected) / sizeof(expected[0]) ||
+	    memcmp(reports, expected, sizeof(expected)) != 0) {
+		for (i = 0; i < num_reports; i++)
+			printf("handle %llu by %llu type %d\n",
+			       (unsigned long long)reports[i].handle,
+			       (unsigned long long)reports[i].by,
+			       reports[i].type);
+		print_err("Wrong redundant rules reported");
+	}
+
+	/* without the set, the lookup is unknown and shadows nothing */
+	num_reports = 0;
+	if (nftnl_rule_list_redundant(list, NULL, report, NULL) !=
+	    sizeof(expected) / sizeof(expected[0]) - 1)
+		print_err("Rule shadowed by an unknown set");
+
+	nftnl_rule_list_free(list);
+	nftnl_set_list_free(sets);
+}
+
+int main(int argc, char *argv[])
+{
+	test_redundant();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,467 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/capture.h>
+#include <libnftnl/gen.h>
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *test, const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s: %s\n", test, msg);
+}
+
+struct dump {
+	char		buf[1 << 16];
+	size_t		len;
+	int		nmsgs;
+	struct nlmsghdr	*msgs[16];
+};
+
+static struct nlmsghdr *dump_next(struct dump *d, uint16_t type)
+{
+	struct nlmsghdr *nlh;
+
+	nlh = nftnl_nlmsg_build_hdr(d->buf + d->len, type, NFPROTO_IPV4,
+				    NLM_F_MULTI, d->nmsgs + 1);
+	d->msgs[d->nmsgs++] = nlh;
+	return nlh;
+}
+
+static void dump_end(struct dump *d, struct nlmsghdr *nlh)
+{
+	d->len += NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+static void dump_elems(struct dump *d, uint32_t first, uint32_t n)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nftnl_set_elem *e;
+	struct nlmsghdr *nlh;
+	uint32_t i, key;
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, "addrs");
+	for (i = first; i < first + n; i++) {
+		e = nftnl_set_elem_alloc();
+		key = htonl(0x0a000000 + i);
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+		nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT,
+				       i % 2 ? NF_ACCEPT : NF_DROP);
+		nftnl_set_elem_add(s, e);
+	}
+
+	nlh = dump_next(d, NFT_MSG_NEWSETELEM);
+	nftnl_set_elems_nlmsg_build_payload(nlh, s);
+	dump_end(d, nlh);
+	nftnl_set_free(s);
+}
+
+static void dump_rule(struct dump *d, uint64_t handle)
+{
+	struct nftnl_rule *r = nftnl_rule_alloc();
+	struct nlmsghdr *nlh;
+	struct nftnl_expr *e;
+
+	nftnl_rule_set(r, NFTNL_RULE_TABLE, "filter");
+	nftnl_rule_set(r, NFTNL_RULE_CHAIN, "input");
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, handle);
+
+	e = nftnl_expr_alloc("payload");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_BASE,
+			   NFT_PAYLOAD_NETWORK_HEADER);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET, 12);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_LEN, 4);
+	nftnl_rule_add_expr(r, e);
+
+	e = nftnl_expr_alloc("lookup");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_LOOKUP_SREG, NFT_REG_1);
+	nftnl_expr_set_str(e, NFTNL_EXPR_LOOKUP_SET, "addrs");
+	nftnl_rule_add_expr(r, e);
+
+	nftnl_rule_add_expr(r, nftnl_expr_alloc("counter"));
+
+	nlh = dump_next(d, NFT_MSG_NEWRULE);
+	nftnl_rule_nlmsg_build_payload(nlh, r);
+	dump_end(d, nlh);
+	nftnl_rule_free(r);
+}
+
+static void dump_build(struct dump *d)
+{
+	struct nftnl_table *t = nftnl_table_alloc();
+	struct nftnl_chain *c = nftnl_chain_alloc();
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nlmsghdr *nlh;
+
+	nftnl_table_set(t, NFTNL_TABLE_NAME, "filter");
+	nlh = dump_next(d, NFT_MSG_NEWTABLE);
+	nftnl_table_nlmsg_build_payload(nlh, t);
+	dump_end(d, nlh);
+	nftnl_table_free(t);
+
+	nftnl_chain_set(c, NFTNL_CHAIN_TABLE, "filter");
+	nftnl_chain_set(c, NFTNL_CHAIN_NAME, "input");
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_HOOKNUM, NF_INET_LOCAL_IN);
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_PRIO, 0);
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_POLICY, NF_ACCEPT);
+	nftnl_chain_set(c, NFTNL_CHAIN_TYPE, "filter");
+	nlh = dump_next(d, NFT_MSG_NEWCHAIN);
+	nftnl_chain_nlmsg_build_payload(nlh, c);
+	dump_end(d, nlh);
+	nftnl_chain_free(c);
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, "addrs");
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS, NFT_SET_MAP);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_TYPE, 7);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, 4);
+	nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, NFT_DATA_VERDICT);
+	nlh = dump_next(d, NFT_MSG_NEWSET);
+	nftnl_set_nlmsg_build_payload(nlh, s);
+	dump_end(d, nlh);
+	nftnl_set_free(s);
+
+	dump_elems(d, 0, 10);
+	dump_elems(d, 10, 100);
+	dump_rule(d, 2);
+	dump_rule(d, 3);
+}
+
+/* the ruleset the messages parse into */
+struct replay {
+	struct nftnl_table_list	*tl;
+	struct nftnl_chain_list	*cl;
+	struct nftnl_set_list	*sl;
+	struct nftnl_rule_list	*rl;
+	struct nftnl_set	*set;
+	struct dump		*ref;
+	int			nmsgs;
+};
+
+static int replay_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct replay *rp = data;
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+	int ret = -1;
+
+	/* messages are replayed byte for byte, in their order */
+	if (rp->ref != NULL &&
+	    (rp->nmsgs >= rp->ref->nmsgs ||
+	     nlh->nlmsg_len != rp->ref->msgs[rp->nmsgs]->nlmsg_len ||
+	     memcmp(nlh, rp->ref->msgs[rp->nmsgs], nlh->nlmsg_len) != 0))
+		return -1;
+	rp->nmsgs++;
+
+	switch (nlh->nlmsg_type & 0xff) {
+	case NFT_MSG_NEWTABLE:
+		t = nftnl_table_alloc();
+		ret = nftnl_table_nlmsg_parse(nlh, t);
+		nftnl_table_list_add_tail(t, rp->tl);
+		break;
+	case NFT_MSG_NEWCHAIN:
+		c = nftnl_chain_alloc();
+		ret = nftnl_chain_nlmsg_parse(nlh, c);
+		nftnl_chain_list_add_tail(c, rp->cl);
+		break;
+	case NFT_MSG_NEWSET:
+		rp->set = nftnl_set_alloc();
+		ret = nftnl_set_nlmsg_parse(nlh, rp->set);
+		nftnl_set_list_add_tail(rp->set, rp->sl);
+		break;
+	case NFT_MSG_NEWSETELEM:
+		if (rp->set != NULL)
+			ret = nftnl_set_elems_nlmsg_parse(nlh, rp->set);
+		break;
+	case NFT_MSG_NEWRULE:
+		r = nftnl_rule_alloc();
+		ret = nftnl_rule_nlmsg_parse(nlh, r);
+		nftnl_rule_list_add_tail(r, rp->rl);
+		break;
+	}
+
+	return ret < 0 ? -1 : 0;
+}
+
+static void replay_init(struct replay *rp, struct dump *ref)
+{
+	memset(rp, 0, sizeof(*rp));
+	rp->tl = nftnl_table_list_alloc();
+	rp->cl = nftnl_chain_list_alloc();
+	rp->sl = nftnl_set_list_alloc();
+	rp->rl = nftnl_rule_list_alloc();
+	rp->ref = ref;
+}
+
+/* prints the ruleset to a string, and releases it */
+static char *replay_print(struct replay *rp)
+{
+	struct nftnl_ruleset *rs = nftnl_ruleset_alloc();
+	char *out = NULL;
+	size_t len;
+	FILE *fp;
+
+	nftnl_ruleset_set(rs, NFTNL_RULESET_TABLELIST, rp->tl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_CHAINLIST, rp->cl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_SETLIST, rp->sl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_RULELIST, rp->rl);
+
+	fp = open_memstream(&out, &len);
+	if (fp != NULL) {
+		nftnl_ruleset_fprintf(fp, rs, NFTNL_OUTPUT_JSON, 0);
+		fclose(fp);
+	}
+	nftnl_ruleset_free(rs);
+
+	return out;
+}
+
+static FILE *capture(struct dump *d, struct nftnl_gen *gen, int end)
+{
+	struct nftnl_capture *cap;
+	FILE *fp;
+	int i;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	cap = nftnl_capture_alloc(fp, gen);
+	if (cap == NULL)
+		goto err;
+
+	for (i = 0; i < d->nmsgs; i++) {
+		if (nftnl_capture_nlmsg(cap, d->msgs[i]) < 0)
+			goto err_free;
+	}
+	if (end ? nftnl_capture_end(cap) < 0 : fflush(fp) != 0)
+		goto err_free;
+
+	nftnl_capture_free(cap);
+	return fp;
+err_free:
+	nftnl_capture_free(cap);
+err:
+	fclose(fp);
+	return NULL;
+}
+
+static void test_replay(void)
+{
+	static struct dump d;
+	struct nftnl_capture_file *f;
+	struct replay rp, ref;
+	struct nftnl_gen *gen;
+	char *out, *ref_out;
+	FILE *fp;
+	int i;
+
+	dump_build(&d);
+
+	gen = nftnl_gen_alloc();
+	nftnl_gen_set_u32(gen, NFTNL_GEN_ID, 42);
+	fp = capture(&d, gen, 1);
+	nftnl_gen_free(gen);
+	if (fp == NULL) {
+		print_err("replay", "cannot capture the dump");
+		return;
+	}
+
+	f = nftnl_capture_open(fileno(fp));
+	fclose(fp);
+	if (f == NULL) {
+		print_err("replay", "cannot open the capture");
+		return;
+	}
+
+	if (nftnl_capture_count(f) != (uint32_t)d.nmsgs)
+		print_err("replay", "wrong number of messages");
+
+	gen = nftnl_gen_alloc();
+	if (nftnl_capture_gen(f, gen) < 0 ||
+	    nftnl_gen_get_u32(gen, NFTNL_GEN_ID) != 42)
+		print_err("replay", "wrong generation");
+	nftnl_gen_free(gen);
+
+	replay_init(&rp, &d);
+	if (nftnl_capture_foreach(f, replay_cb, &rp) < 0 ||
+	    rp.nmsgs != d.nmsgs)
+		print_err("replay", "replayed messages differ");
+	nftnl_capture_close(f);
+
+	/* the same ruleset as parsing the messages of the dump */
+	replay_init(&ref, NULL);
+	for (i = 0; i < d.nmsgs; i++)
+		replay_cb(d.msgs[i], &ref);
+
+	out = replay_print(&rp);
+	ref_out = replay_print(&ref);
+	if (out == NULL || ref_out == NULL || strcmp(out, ref_out) != 0)
+		print_err("replay", "replayed ruleset differs");
+	free(out);
+	free(ref_out);
+}
+
+static void test_empty(void)
+{
+	static struct dump d;
+	struct nftnl_capture_file *f;
+	struct nftnl_gen *gen;
+	FILE *fp;
+
+	fp = capture(&d, NULL, 1);
+	if (fp == NULL) {
+		print_err("empty", "cannot capture");
+		return;
+	}
+	f = nftnl_capture_open(fileno(fp));
+	fclose(fp);
+	if (f == NULL) {
+		print_err("empty", "cannot open the capture");
+		return;
+	}
+
+	if (nftnl_capture_count(f) != 0)
+		print_err("empty", "messages in an empty capture");
+
+	gen = nftnl_gen_alloc();
+	if (nftnl_capture_gen(f, gen) == 0 || errno != ENOENT ||
+	    nftnl_gen_is_set(gen, NFTNL_GEN_ID))
+		print_err("empty", "generation without one");
+	nftnl_gen_free(gen);
+
+	nftnl_capture_close(f);
+}
+
+static int expect_refused(const char *msg, FILE *fp)
+{
+	struct nftnl_capture_file *f;
+
+	f = nftnl_capture_open(fileno(fp));
+	if (f != NULL) {
+		print_err("errors", msg);
+		nftnl_capture_close(f);
+		return -1;
+	}
+	if (errno != EINVAL) {
+		print_err("errors", "unexpected errno");
+		return -1;
+	}
+	return 0;
+}
+
+static void test_errors(void)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	static struct dump d;
+	struct nftnl_capture *cap;
+	struct nlmsghdr *nlh;
+	long i, len;
+	FILE *fp;
+
+	dump_build(&d);
+
+	/* only the messages of a dump are captured */
+	fp = tmpfile();
+	cap = fp != NULL ? nftnl_capture_alloc(fp, NULL) : NULL;
+	if (cap == NULL) {
+		print_err("errors", "cannot allocate capture");
+		if (fp != NULL)
+			fclose(fp);
+		return;
+	}
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_GETRULE, NFPROTO_IPV4,
+				    NLM_F_DUMP, 1);
+	if (nftnl_capture_nlmsg(cap, nlh) == 0 || errno != EINVAL)
+		print_err("errors", "request captured");
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = NLMSG_DONE;
+	if (nftnl_capture_nlmsg(cap, nlh) == 0 || errno != EINVAL)
+		print_err("errors", "NLMSG_DONE captured");
+	nftnl_capture_free(cap);
+	fclose(fp);
+
+	/* a capture that was not ended */
+	fp = capture(&d, NULL, 0);
+	if (fp == NULL) {
+		print_err("errors", "cannot capture");
+		return;
+	}
+	expect_refused("unterminated capture opened", fp);
+	fclose(fp);
+
+	/* cut anywhere, or with anything after its end */
+	fp = capture(&d, NULL, 1);
+	if (fp == NULL) {
+		print_err("errors", "cannot capture");
+		return;
+	}
+	len = ftell(fp);
+	for (i = len - 1; i >= 0; i--) {
+		if (ftruncate(fileno(fp), i) < 0 ||
+		    expect_refused("truncated capture opened", fp) < 0)
+			break;
+	}
+	fclose(fp);
+
+	fp = capture(&d, NULL, 1);
+	if (fp == NULL) {
+		print_err("errors", "cannot capture");
+		return;
+	}
+	fwrite(d.msgs[0], 1, d.msgs[0]->nlmsg_len, fp);
+	fflush(fp);
+	expect_refused("trailing data opened", fp);
+	fclose(fp);
+
+	/* not a capture */
+	fp = tmpfile();
+	if (fp == NULL) {
+		print_err("errors", "cannot open file");
+		return;
+	}
+	fwrite(d.buf, 1, d.len, fp);
+	fflush(fp);
+	expect_refused("netlink messages opened", fp);
+	fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	test_replay();
+	test_empty();
+	test_errors();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
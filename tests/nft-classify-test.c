@@ -0,0 +1,160 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/eval.h>
+
+#include "test-rule.h"
+
+#define RULES	2000
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+static void add_prefix(struct nftnl_rule *r, uint32_t addr, uint32_t mask)
+{
+	addr = htonl(addr);
+	add_payload(r, NFT_PAYLOAD_NETWORK_HEADER, 12, sizeof(addr));
+	add_mask(r, mask);
+	add_cmp(r, NFT_CMP_EQ, &addr, sizeof(addr));
+}
+
+/* the byteorder conversion is not part of the match space */
+static void add_inexact(struct nftnl_rule *r)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("byteorder");
+	uint32_t val = 0;
+
+	add_payload(r, NFT_PAYLOAD_NETWORK_HEADER, 16, sizeof(val));
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_OP, NFT_BYTEORDER_NTOH);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_LEN, sizeof(val));
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_SIZE, sizeof(val));
+	nftnl_rule_add_expr(r, e);
+	add_cmp(r, NFT_CMP_EQ, &val, sizeof(val));
+}
+
+static void make_pkt(uint8_t *buf, uint32_t saddr, uint16_t dport)
+{
+	memset(buf, 0, 40);
+	buf[0] = 0x45;
+	buf[3] = 40;
+	buf[9] = IPPROTO_TCP;
+	saddr = htonl(saddr);
+	memcpy(&buf[12], &saddr, sizeof(saddr));
+	buf[16] = 10;
+	buf[22] = dport >> 8;
+	buf[23] = dport & 0xff;
+}
+
+static void test_classify(void)
+{
+	struct nftnl_rule_list *list = nftnl_rule_list_alloc();
+	struct nftnl_eval_pkt pkt = { .family = NFPROTO_IPV4, .len = 40 };
+	struct nftnl_classify_result res;
+	struct nftnl_classify_stats stats;
+	struct nftnl_eval_result eres;
+	struct nftnl_classifier *c;
+	struct nftnl_eval *ev;
+	struct nftnl_rule *r;
+	uint32_t i, saddr, mismatch = 0, maxcheck = 0;
+	uint8_t buf[40];
+	int chain;
+
+	srandom(1);
+	for (i = 0; i < RULES; i++) {
+		r = rule_add(list, "input", i + 1);
+		add_prefix(r, 0x0a000000 | (i / 4) << 8, 0xffffff00);
+		add_dport(r, i % 4 ? NFT_CMP_EQ : NFT_CMP_LT, 1000 + i % 50);
+		add_verdict(r, NF_ACCEPT, NULL);
+	}
+	r = rule_add(list, "input", RULES + 1);
+	add_prefix(r, 0xac100000, 0xfff00000);
+	add_inexact(r);
+	add_verdict(r, NF_ACCEPT, NULL);
+	r = rule_add(list, "input", RULES + 2);
+	add_dport(r, NFT_CMP_EQ, 22);
+	add_verdict(r, NF_ACCEPT, NULL);
+
+	c = nftnl_classifier_build(list, NULL, NFPROTO_IPV4, "filter",
+				   "input");
+	ev = nftnl_eval_alloc(list, NULL);
+	if (c == NULL || ev == NULL) {
+		print_err("Cannot build classifier");
+		goto out;
+	}
+	chain = nftnl_eval_chain(ev, NFPROTO_IPV4, "filter", "input");
+
+	nftnl_classifier_stats(c, &stats);
+	if (stats.rules != RULES + 2 || stats.inexact != 1 ||
+	    stats.fields != 3 || stats.nodes == 0 ||
+	    stats.leaves != stats.nodes + 1 || stats.memory == 0)
+		print_err("Bad classifier stats");
+
+	pkt.data = buf;
+	for (i = 0; i < 20000; i++) {
+		saddr = 0x0a000000 | (random() % (RULES / 4 + 8)) << 8 |
+			(random() & 0xff);
+		make_pkt(buf, saddr, i % 2 ? 22 : 990 + random() % 70);
+		nftnl_classifier_lookup(c, &pkt, &res);
+		nftnl_eval_run(ev, chain, &pkt, &eres);
+		if (res.handle != eres.handle || (res.rule && !res.exact))
+			mismatch++;
+		if (res.checked > maxcheck)
+			maxcheck = res.checked;
+	}
+	if (mismatch)
+		print_err("Classifier disagrees with evaluation");
+	if (maxcheck > 16)
+		print_err("Classifier leaves too large");
+
+	make_pkt(buf, 0xac100101, 22);
+	if (nftnl_classifier_lookup(c, &pkt, &res) != 1 ||
+	    res.handle != RULES + 1 || res.exact)
+		print_err("Inexact rule not reported");
+	buf[9] = IPPROTO_UDP;
+	if (nftnl_classifier_lookup(c, &pkt, &res) != 1 ||
+	    res.handle != RULES + 1)
+		print_err("Bad classification without ports");
+	make_pkt(buf, 0xc0a80001, 23);
+	if (nftnl_classifier_lookup(c, &pkt, &res) != 0 || res.rule != NULL)
+		print_err("Unmatched packet classified");
+out:
+	if (c != NULL)
+		nftnl_classifier_free(c);
+	if (ev != NULL)
+		nftnl_eval_free(ev);
+	nftnl_rule_list_free(list);
+}
+
+int main(int argc, char *argv[])
+{
+	test_classify();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
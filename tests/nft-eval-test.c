@@ -0,0 +1,281 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/set.h>
+#include <libnftnl/eval.h>
+
+#include "test-rule.h"
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+static void add_tcp_dport(struct nftnl_rule *r, uint16_t port)
+{
+	add_tcp(r);
+	add_dport(r, NFT_CMP_EQ, port);
+}
+
+static void add_ct_state(struct nftnl_rule *r, uint32_t state)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("ct");
+	uint32_t zero = 0;
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CT_KEY, NFT_CT_STATE);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CT_DREG, NFT_REG_1);
+	nftnl_rule_add_expr(r, e);
+
+	e = nftnl_expr_alloc("bitwise");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_LEN, sizeof(state));
+	nftnl_expr_set(e, NFTNL_EXPR_BITWISE_MASK, &state, sizeof(state));
+	nftnl_expr_set(e, NFTNL_EXPR_BITWISE_XOR, &zero, sizeof(zero));
+	nftnl_rule_add_expr(r, e);
+	add_cmp(r, NFT_CMP_NEQ, &zero, sizeof(zero));
+}
+
+static void add_limit(struct nftnl_rule *r, uint64_t rate, uint32_t burst)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("limit");
+
+	nftnl_expr_set_u64(e, NFTNL_EXPR_LIMIT_RATE, rate);
+	nftnl_expr_set_u64(e, NFTNL_EXPR_LIMIT_UNIT, 1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_LIMIT_BURST, burst);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_LIMIT_TYPE, NFT_LIMIT_PKTS);
+	nftnl_rule_add_expr(r, e);
+}
+
+static struct nftnl_set *set_add(struct nftnl_set_list *sets,
+				 const char *name, uint32_t flags,
+				 uint32_t key_len)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, name);
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, NFPROTO_IPV4);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS, flags);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, key_len);
+	if (flags & NFT_SET_MAP)
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, NFT_DATA_VERDICT);
+	nftnl_set_list_add_tail(s, sets);
+
+	return s;
+}
+
+static struct nftnl_set_elem *elem_add(struct nftnl_set *s, const void *key,
+				       uint32_t len, bool end)
+{
+	struct nftnl_set_elem *elem = nftnl_set_elem_alloc();
+
+	nftnl_set_elem_set(elem, NFTNL_SET_ELEM_KEY, key, len);
+	if (end)
+		nftnl_set_elem_set_u32(elem, NFTNL_SET_ELEM_FLAGS,
+				       NFT_SET_ELEM_INTERVAL_END);
+	nftnl_set_elem_add(s, elem);
+
+	return elem;
+}
+
+/* IPv4 header followed by a TCP header */
+static void make_pkt(uint8_t *buf, const char *saddr, uint16_t dport)
+{
+	memset(buf, 0, 40);
+	buf[0] = 0x45;
+	buf[3] = 40;
+	buf[8] = 64;
+	buf[9] = IPPROTO_TCP;
+	inet_pton(AF_INET, saddr, &buf[12]);
+	inet_pton(AF_INET, "10.0.0.1", &buf[16]);
+	buf[22] = dport >> 8;
+	buf[23] = dport & 0xff;
+	buf[32] = 0x50;
+}
+
+static int run(struct nftnl_eval *ev, int chain, const char *saddr,
+	       uint16_t dport, const struct nftnl_eval_ct *ct, uint64_t tstamp,
+	       struct nftnl_eval_result *res)
+{
+	struct nftnl_eval_pkt pkt = {
+		.family	= NFPROTO_IPV4,
+		.len	= 40,
+		.tstamp	= tstamp,
+		.ct	= ct,
+	};
+	uint8_t buf[40];
+
+	make_pkt(buf, saddr, dport);
+	pkt.data = buf;
+	if (nftnl_eval_run(ev, chain, &pkt, res) < 0)
+		return -1;
+
+	return res->verdict;
+}
+
+static void test_eval(void)
+{
+	struct nftnl_rule_list *list = nftnl_rule_list_alloc();
+	struct nftnl_set_list *sets = nftnl_set_list_alloc();
+	struct nftnl_eval_ct ct = { .state = 1 << 1 };	/* established */
+	struct nftnl_eval_result res;
+	struct nftnl_set_elem *elem;
+	struct nftnl_expr *counter;
+	struct nftnl_eval *ev;
+	struct nftnl_rule *r;
+	struct nftnl_set *s;
+	uint32_t addr, mark = 0x10;
+	uint16_t port;
+	int input;
+
+	s = set_add(sets, "blacklist", NFT_SET_INTERVAL, sizeof(addr));
+	inet_pton(AF_INET, "192.168.0.0", &addr);
+	elem_add(s, &addr, sizeof(addr), false);
+	inet_pton(AF_INET, "192.168.1.0", &addr);
+	elem_add(s, &addr, sizeof(addr), true);
+
+	s = set_add(sets, "ports", NFT_SET_MAP, sizeof(port));
+	port = htons(80);
+	elem = elem_add(s, &port, sizeof(port), false);
+	nftnl_set_elem_set_u32(elem, NFTNL_SET_ELEM_VERDICT, NFT_JUMP);
+	nftnl_set_elem_set_str(elem, NFTNL_SET_ELEM_CHAIN, "web");
+
+	r = rule_add(list, "input", 1);
+	add_tcp_dport(r, 22);
+	counter = nftnl_expr_alloc("counter");
+	nftnl_rule_add_expr(r, counter);
+	add_verdict(r, NF_ACCEPT, NULL);
+
+	r = rule_add(list, "input", 2);
+	add_payload(r, NFT_PAYLOAD_NETWORK_HEADER, 12, sizeof(addr));
+	add_lookup(r, "blacklist", false);
+	add_verdict(r, NF_DROP, NULL);
+
+	r = rule_add(list, "input", 3);
+	add_ct_state(r, 1 << 1);
+	add_verdict(r, NFT_JUMP, "est");
+
+	r = rule_add(list, "est", 10);
+	add_imm(r, mark);
+	add_meta(r, NFT_META_MARK, true);
+
+	r = rule_add(list, "input", 4);
+	add_meta(r, NFT_META_MARK, false);
+	add_cmp(r, NFT_CMP_EQ, &mark, sizeof(mark));
+	add_verdict(r, NF_ACCEPT, NULL);
+
+	r = rule_add(list, "input", 5);
+	add_payload(r, NFT_PAYLOAD_TRANSPORT_HEADER, 2, sizeof(port));
+	add_lookup(r, "ports", true);
+
+	r = rule_add(list, "web", 20);
+	add_limit(r, 1, 0);
+	add_verdict(r, NF_ACCEPT, NULL);
+
+	r = rule_add(list, "web", 21);
+	add_verdict(r, NF_DROP, NULL);
+
+	ev = nftnl_eval_alloc(list, sets);
+	if (ev == NULL) {
+		print_err("Cannot compile ruleset");
+		goto out;
+	}
+	input = nftnl_eval_chain(ev, NFPROTO_IPV4, "filter", "input");
+	if (input < 0 || nftnl_eval_chain(ev, NFPROTO_IPV4, "filter", "x") >= 0)
+		print_err("Bad chain lookup");
+
+	if (run(ev, input, "10.0.0.2", 22, NULL, 0, &res) != NF_ACCEPT ||
+	    res.handle != 1 || res.rules != 1)
+		print_err("Bad verdict for ssh");
+	if (run(ev, input, "192.168.0.7", 22, NULL, 0, &res) != NF_ACCEPT ||
+	    run(ev, input, "192.168.0.7", 23, NULL, 0, &res) != NF_DROP ||
+	    res.handle != 2)
+		print_err("Bad verdict for blacklisted address");
+	if (run(ev, input, "192.168.1.0", 23, NULL, 0, &res) != NFT_CONTINUE ||
+	    res.rule != NULL || res.rules != 5)
+		print_err("Interval end matched");
+	if (run(ev, input, "10.0.0.2", 23, &ct, 0, &res) != NF_ACCEPT ||
+	    res.handle != 4 || res.mark != mark || res.rules != 5)
+		print_err("Bad verdict after jump");
+
+	if (run(ev, input, "10.0.0.2", 80, NULL, 0, &res) != NF_ACCEPT ||
+	    res.handle != 20)
+		print_err("Bad verdict map jump");
+	if (run(ev, input, "10.0.0.2", 80, NULL, 1000, &res) != NF_DROP ||
+	    res.handle != 21)
+		print_err("Limit not enforced");
+	if (run(ev, input, "10.0.0.2", 80, NULL, 2000000000ULL, &res) !=
+	    NF_ACCEPT)
+		print_err("Limit not refilled");
+
+	nftnl_eval_sync_counters(ev);
+	if (nftnl_expr_get_u64(counter, NFTNL_EXPR_CTR_PACKETS) != 2 ||
+	    nftnl_expr_get_u64(counter, NFTNL_EXPR_CTR_BYTES) != 80)
+		print_err("Bad counter");
+
+	nftnl_eval_free(ev);
+out:
+	nftnl_rule_list_free(list);
+	nftnl_set_list_free(sets);
+}
+
+static void test_invalid(void)
+{
+	struct nftnl_rule_list *list = nftnl_rule_list_alloc();
+	struct nftnl_rule *r;
+
+	r = rule_add(list, "a", 1);
+	add_verdict(r, NFT_JUMP, "b");
+	r = rule_add(list, "b", 2);
+	add_verdict(r, NFT_GOTO, "a");
+	if (nftnl_eval_alloc(list, NULL) != NULL || errno != ELOOP)
+		print_err("Chain loop not detected");
+	nftnl_rule_list_free(list);
+
+	list = nftnl_rule_list_alloc();
+	r = rule_add(list, "a", 1);
+	nftnl_rule_add_expr(r, nftnl_expr_alloc("match"));
+	if (nftnl_eval_alloc(list, NULL) != NULL || errno != EOPNOTSUPP)
+		print_err("Unsupported expression compiled");
+	nftnl_rule_list_free(list);
+
+	list = nftnl_rule_list_alloc();
+	r = rule_add(list, "a", 1);
+	add_lookup(r, "missing", false);
+	if (nftnl_eval_alloc(list, NULL) != NULL || errno != ENOENT)
+		print_err("Missing set not reported");
+	nftnl_rule_list_free(list);
+}
+
+int main(int argc, char *argv[])
+{
+	test_eval();
+	test_invalid();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+static const char *builtin[] = {
+	"bitwise", "byteorder", "cmp", "counter", "ct", "dup", "dynset",
+	"exthdr", "immediate", "limit", "log", "lookup", "masq", "match",
+	"meta", "nat", "payload", "queue", "redir", "reject", "target",
+};
+
+/* a minimal out-of-tree expression carrying one 32-bit value */
+enum {
+	NFTNL_EXPR_FOO_VALUE	= NFTNL_EXPR_BASE,
+};
+
+#define NFTA_FOO_VALUE	1
+
+struct nftnl_expr_foo {
+	uint32_t	value;
+};
+
+static int foo_set(struct nftnl_expr *e, uint16_t type, const void *data,
+		   uint32_t data_len)
+{
+	struct nftnl_expr_foo *foo = nftnl_expr_priv(e);
+
+	if (type != NFTNL_EXPR_FOO_VALUE)
+		return -1;
+
+	foo->value = *((uint32_t *)data);
+	return 0;
+}
+
+static const void *foo_get(const struct nftnl_expr *e, uint16_t type,
+			   uint32_t *data_len)
+{
+	struct nftnl_expr_foo *foo = nftnl_expr_priv(e);
+
+	if (type != NFTNL_EXPR_FOO_VALUE)
+		return NULL;
+
+	*data_len = sizeof(foo->value);
+	return &foo->value;
+}
+
+static int foo_parse(struct nftnl_expr *e, struct nlattr *attr)
+{
+	struct nlattr *nest;
+
+	mnl_attr_for_each_nested(nest, attr) {
+		if (mnl_attr_get_type(nest) == NFTA_FOO_VALUE)
+			nftnl_expr_set_u32(e, NFTNL_EXPR_FOO_VALUE,
+					   ntohl(mnl_attr_get_u32(nest)));
+	}
+	return 0;
+}
+
+static void foo_build(struct nlmsghdr *nlh, struct nftnl_expr *e)
+{
+	if (nftnl_expr_is_set(e, NFTNL_EXPR_FOO_VALUE))
+		mnl_attr_put_u32(nlh, NFTA_FOO_VALUE,
+				 htonl(nftnl_expr_get_u32(e,
+						NFTNL_EXPR_FOO_VALUE)));
+}
+
+static int foo_snprintf(char *buf, size_t len, uint32_t type,
+			uint32_t flags, struct nftnl_expr *e)
+{
+	return snprintf(buf, len, "value %u ",
+			nftnl_expr_get_u32(e, NFTNL_EXPR_FOO_VALUE));
+}
+
+static const struct nftnl_expr_ops foo_ops = {
+	.name		= "foo",
+	.alloc_len	= sizeof(struct nftnl_expr_foo),
+	.max_attr	= NFTA_FOO_VALUE,
+	.set		= foo_set,
+	.get		= foo_get,
+	.parse		= foo_parse,
+	.build		= foo_build,
+	.snprintf	= foo_snprintf,
+};
+
+static void test_builtin_lookup(void)
+{
+	struct nftnl_expr *e;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) {
+		e = nftnl_expr_alloc(builtin[i]);
+		if (e == NULL) {
+			print_err("Built-in expression not found");
+			continue;
+		}
+		if (strcmp(nftnl_expr_get_str(e, NFTNL_EXPR_NAME),
+			   builtin[i]) != 0)
+			print_err("Built-in expression lookup mismatches");
+		nftnl_expr_free(e);
+	}
+
+	if (nftnl_expr_alloc("cm") != NULL ||
+	    nftnl_expr_alloc("cmpx") != NULL ||
+	    nftnl_expr_alloc("") != NULL ||
+	    nftnl_expr_alloc("Cmp") != NULL)
+		print_err("Unknown expression found");
+}
+
+static void test_register(void)
+{
+	struct nftnl_expr_ops bad = foo_ops;
+	struct nftnl_rule *a, *b;
+	struct nftnl_expr_iter *iter;
+	struct nftnl_expr *e, *ex;
+	struct nlmsghdr *nlh;
+	char buf[4096];
+
+	bad.name = "cmp";
+	if (nftnl_expr_ops_register(&bad) == 0 || errno != EEXIST)
+		print_err("Built-in expression can be registered twice");
+	bad.name = "bar";
+	bad.build = NULL;
+	if (nftnl_expr_ops_register(&bad) == 0 || errno != EINVAL)
+		print_err("Incomplete expression ops accepted");
+
+	if (nftnl_expr_ops_register(&foo_ops) < 0)
+		print_err("Cannot register expression");
+	if (nftnl_expr_ops_register(&foo_ops) == 0)
+		print_err("Expression can be registered twice");
+
+	a = nftnl_rule_alloc();
+	b = nftnl_rule_alloc();
+	ex = nftnl_expr_alloc("foo");
+	if (a == NULL || b == NULL || ex == NULL) {
+		print_err("OOM");
+		return;
+	}
+
+	nftnl_expr_set_u32(ex, NFTNL_EXPR_FOO_VALUE, 0x12345678);
+	nftnl_rule_add_expr(a, ex);
+
+	nlh = nftnl_rule_nlmsg_build_hdr(buf, NFT_MSG_NEWRULE, AF_INET, 0, 1);
+	nftnl_rule_nlmsg_build_payload(nlh, a);
+	if (nftnl_rule_nlmsg_parse(nlh, b) < 0)
+		print_err("parsing problems");
+
+	iter = nftnl_expr_iter_create(b);
+	e = nftnl_expr_iter_next(iter);
+	if (e == NULL ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_FOO_VALUE) != 0x12345678)
+		print_err("Registered expression does not round-trip");
+	else if (!nftnl_expr_cmp(ex, e) ||
+		 nftnl_expr_hash(ex, 0) != nftnl_expr_hash(e, 0))
+		print_err("Registered expression compares unequal");
+	nftnl_expr_iter_destroy(iter);
+
+	nftnl_rule_free(a);
+	nftnl_rule_free(b);
+}
+
+static void test_cache(void)
+{
+	struct nftnl_expr_cache_stats before, after;
+	struct nftnl_expr *e[128];
+	unsigned int i;
+
+	if (nftnl_expr_cache_stats("unknown", &before) == 0)
+		print_err("Stats for unknown expression");
+	if (nftnl_expr_cache_stats("counter", &before) < 0)
+		print_err("No stats for counter expression");
+
+	for (i = 0; i < 128; i++) {
+		e[i] = nftnl_expr_alloc("counter");
+		if (e[i] == NULL)
+			print_err("OOM");
+		nftnl_expr_set_u64(e[i], NFTNL_EXPR_CTR_PACKETS, i);
+	}
+	for (i = 0; i < 128; i++)
+		nftnl_expr_free(e[i]);
+
+	for (i = 0; i < 128; i++) {
+		e[i] = nftnl_expr_alloc("counter");
+		if (e[i] == NULL)
+			print_err("OOM");
+		if (nftnl_expr_is_set(e[i], NFTNL_EXPR_CTR_PACKETS) ||
+		    nftnl_expr_get_u64(e[i], NFTNL_EXPR_CTR_PACKETS) != 0)
+			print_err("Recycled expression is not clean");
+	}
+	for (i = 0; i < 128; i++)
+		nftnl_expr_free(e[i]);
+
+	nftnl_expr_cache_stats("counter", &after);
+	if (after.alloc - before.alloc != 256 ||
+	    after.free - before.free != 256)
+		print_err("Cache stats do not account all operations");
+	if (after.hit - before.hit < 128)
+		print_err("Released expressions are not recycled");
+	if (after.cached == 0)
+		print_err("Released expressions are not cached");
+
+	nftnl_expr_cache_flush();
+	nftnl_expr_cache_stats(NULL, &after);
+	if (after.cached != 0)
+		print_err("Cache flush leaves objects behind");
+}
+
+static void *cache_thread(void *data)
+{
+	struct nftnl_expr *e[16];
+	unsigned int i;
+
+	for (i = 0; i < 16; i++)
+		e[i] = nftnl_expr_alloc("counter");
+	for (i = 0; i < 16; i++)
+		nftnl_expr_free(e[i]);
+
+	return NULL;
+}
+
+/* objects released by other threads are accounted too */
+static void test_cache_threads(void)
+{
+	struct nftnl_expr_cache_stats before, after;
+	pthread_t thread;
+
+	nftnl_expr_cache_stats("counter", &before);
+	if (pthread_create(&thread, NULL, cache_thread, NULL) != 0) {
+		print_err("Cannot create thread");
+		return;
+	}
+	pthread_join(thread, NULL);
+
+	nftnl_expr_cache_stats("counter", &after);
+	if (after.alloc - before.alloc != 16 ||
+	    after.free - before.free != 16)
+		print_err("Cache stats miss other threads");
+	if (after.cached - before.cached != 16)
+		print_err("Objects cached by other threads not counted");
+}
+
+int main(int argc, char *argv[])
+{
+	test_builtin_lookup();
+	test_register();
+	test_cache();
+	test_cache_threads();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,287 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libnftnl/common.h>
+#include <libnftnl/table.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *test, const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s: %s\n", test, msg);
+}
+
+struct printer {
+	const char	*name;
+	int		(*snprintf)(char *buf, size_t size, void *obj,
+				    uint32_t type, uint32_t flags);
+	int		(*fprintf)(FILE *fp, void *obj, uint32_t type,
+				   uint32_t flags);
+};
+
+static int set_snprintf(char *buf, size_t size, void *s, uint32_t type,
+			uint32_t flags)
+{
+	return nftnl_set_snprintf(buf, size, s, type, flags);
+}
+
+static int set_fprintf(FILE *fp, void *s, uint32_t type, uint32_t flags)
+{
+	return nftnl_set_fprintf(fp, s, type, flags);
+}
+
+static int rule_snprintf(char *buf, size_t size, void *r, uint32_t type,
+			 uint32_t flags)
+{
+	return nftnl_rule_snprintf(buf, size, r, type, flags);
+}
+
+static int rule_fprintf(FILE *fp, void *r, uint32_t type, uint32_t flags)
+{
+	return nftnl_rule_fprintf(fp, r, type, flags);
+}
+
+static int table_snprintf(char *buf, size_t size, void *t, uint32_t type,
+			  uint32_t flags)
+{
+	return nftnl_table_snprintf(buf, size, t, type, flags);
+}
+
+static int table_fprintf(FILE *fp, void *t, uint32_t type, uint32_t flags)
+{
+	return nftnl_table_fprintf(fp, t, type, flags);
+}
+
+static const struct printer set_printer = {
+	.name		= "set",
+	.snprintf	= set_snprintf,
+	.fprintf	= set_fprintf,
+};
+
+static const struct printer rule_printer = {
+	.name		= "rule",
+	.snprintf	= rule_snprintf,
+	.fprintf	= rule_fprintf,
+};
+
+static const struct printer table_printer = {
+	.name		= "table",
+	.snprintf	= table_snprintf,
+	.fprintf	= table_fprintf,
+};
+
+/* fprintf() writes what snprintf() prints, up to its first nul byte */
+static void check_print(const struct printer *p, void *obj, uint32_t type,
+			uint32_t flags)
+{
+	char small[16], *buf = NULL, *out = NULL;
+	FILE *fp = NULL;
+	int len, ret;
+	long size;
+
+	/* a trailing comma that is not seen is not removed, the length
+	 * without a buffer is an upper bound
+	 */
+	len = p->snprintf(NULL, 0, obj, type, flags);
+	if (len <= 0) {
+		print_err(p->name, "nothing printed");
+		return;
+	}
+
+	buf = malloc(len + 1);
+	out = malloc(len + 1);
+	fp = tmpfile();
+	if (buf == NULL || out == NULL || fp == NULL) {
+		print_err(p->name, "out of memory");
+		goto out;
+	}
+
+	ret = p->snprintf(buf, len + 1, obj, type, flags);
+	if (ret <= 0 || ret > len) {
+		print_err(p->name, "snprintf failed");
+		goto out;
+	}
+	len = ret;
+
+	p->snprintf(small, sizeof(small), obj, type, flags);
+	if (strncmp(small, buf, sizeof(small) - 1) != 0)
+		print_err(p->name, "truncated output mismatch");
+
+	ret = p->fprintf(fp, obj, type, flags);
+	size = ftell(fp);
+	if (ret < 0 || size < 0 || size > len) {
+		print_err(p->name, "fprintf failed");
+		goto out;
+	}
+	if (strlen(buf) == (size_t)len && ret != len)
+		print_err(p->name, "fprintf length mismatch");
+
+	rewind(fp);
+	if (fread(out, 1, size, fp) != (size_t)size ||
+	    (size_t)size != strlen(buf) || memcmp(out, buf, size) != 0)
+		print_err(p->name, "fprintf output mismatch");
+out:
+	if (fp != NULL)
+		fclose(fp);
+	free(out);
+	free(buf);
+}
+
+static void check_all(const struct printer *p, void *obj)
+{
+	static const uint32_t types[] = {
+		NFTNL_OUTPUT_DEFAULT, NFTNL_OUTPUT_XML, NFTNL_OUTPUT_JSON,
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		check_print(p, obj, types[i], 0);
+		check_print(p, obj, types[i], NFTNL_OF_EVENT_NEW);
+	}
+}
+
+static struct nftnl_set *set_alloc(int elems, const char *udata,
+				   uint32_t udata_len)
+{
+	struct nftnl_set_elem *e;
+	struct nftnl_set *s;
+	uint32_t key;
+	int i;
+
+	s = nftnl_set_alloc();
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, "map");
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, NFPROTO_IPV4);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS, NFT_SET_MAP);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, sizeof(key));
+
+	for (i = 0; i < elems; i++) {
+		e = nftnl_set_elem_alloc();
+		key = htonl(0x0a000000 + i);
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+		nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT, NFT_JUMP);
+		nftnl_set_elem_set_str(e, NFTNL_SET_ELEM_CHAIN, "chain");
+		if (udata != NULL && i == elems / 2)
+			nftnl_set_elem_set(e, NFTNL_SET_ELEM_USERDATA, udata,
+					   udata_len);
+		nftnl_set_elem_add(s, e);
+	}
+
+	return s;
+}
+
+static struct nftnl_rule *rule_alloc(int exprs)
+{
+	struct nftnl_rule *r;
+	struct nftnl_expr *e;
+	int i;
+
+	r = nftnl_rule_alloc();
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, NFPROTO_IPV4);
+	nftnl_rule_set_str(r, NFTNL_RULE_TABLE, "filter");
+	nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, "input");
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, 10);
+
+	for (i = 0; i < exprs; i++) {
+		/* expressions without attributes, then with them */
+		if (i % 2 == 0) {
+			e = nftnl_expr_alloc("counter");
+		} else {
+			e = nftnl_expr_alloc("immediate");
+			nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_DREG,
+					   NFT_REG_VERDICT);
+			nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_VERDICT,
+					   NFT_JUMP);
+			nftnl_expr_set_str(e, NFTNL_EXPR_IMM_CHAIN, "other");
+		}
+		nftnl_rule_add_expr(r, e);
+	}
+	nftnl_rule_set_data(r, NFTNL_RULE_USERDATA, "comment", 7);
+
+	return r;
+}
+
+/* sets and rules larger than a page are written in several chunks */
+static void test_set(void)
+{
+	struct nftnl_set *s;
+	char udata[6000];
+
+	s = set_alloc(0, NULL, 0);
+	check_all(&set_printer, s);
+	nftnl_set_free(s);
+
+	s = set_alloc(2000, NULL, 0);
+	check_all(&set_printer, s);
+	nftnl_set_free(s);
+
+	/* an element that does not fit in the buffer on its own */
+	memset(udata, 'a', sizeof(udata));
+	s = set_alloc(100, udata, sizeof(udata));
+	check_all(&set_printer, s);
+	nftnl_set_free(s);
+
+	/* the output ends at the first nul byte */
+	s = set_alloc(100, "a-b", 3);
+	check_print(&set_printer, s, NFTNL_OUTPUT_DEFAULT, 0);
+	nftnl_set_free(s);
+}
+
+static void test_rule(void)
+{
+	struct nftnl_rule *r;
+
+	r = rule_alloc(0);
+	check_all(&rule_printer, r);
+	nftnl_rule_free(r);
+
+	r = rule_alloc(1);
+	check_all(&rule_printer, r);
+	nftnl_rule_free(r);
+
+	r = rule_alloc(500);
+	check_all(&rule_printer, r);
+	nftnl_rule_free(r);
+}
+
+static void test_table(void)
+{
+	struct nftnl_table *t = nftnl_table_alloc();
+
+	nftnl_table_set_str(t, NFTNL_TABLE_NAME, "filter");
+	nftnl_table_set_u32(t, NFTNL_TABLE_FAMILY, NFPROTO_IPV4);
+	nftnl_table_set_u32(t, NFTNL_TABLE_FLAGS, 0);
+	check_all(&table_printer, t);
+	nftnl_table_free(t);
+}
+
+int main(int argc, char *argv[])
+{
+	test_set();
+	test_rule();
+	test_table();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *test, const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s: %s\n", test, msg);
+}
+
+static struct nftnl_chain *chain_from_nlmsg(const char *table)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nftnl_chain *c, *tmp;
+	struct nlmsghdr *nlh;
+
+	c = nftnl_chain_alloc();
+	tmp = nftnl_chain_alloc();
+	nftnl_chain_set_str(tmp, NFTNL_CHAIN_TABLE, table);
+	nftnl_chain_set_str(tmp, NFTNL_CHAIN_NAME, "input");
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWCHAIN, NFPROTO_IPV4, 0, 1);
+	nftnl_chain_nlmsg_build_payload(nlh, tmp);
+	nftnl_chain_free(tmp);
+
+	nftnl_chain_nlmsg_parse(nlh, c);
+	return c;
+}
+
+static struct nftnl_rule *rule_from_nlmsg(const char *table,
+					  const char *chain)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nftnl_rule *r, *tmp;
+	struct nlmsghdr *nlh;
+	struct nftnl_expr *e;
+
+	r = nftnl_rule_alloc();
+	tmp = nftnl_rule_alloc();
+	nftnl_rule_set_str(tmp, NFTNL_RULE_TABLE, table);
+	nftnl_rule_set_str(tmp, NFTNL_RULE_CHAIN, chain);
+	e = nftnl_expr_alloc("immediate");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_DREG, NFT_REG_VERDICT);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_VERDICT, NFT_JUMP);
+	nftnl_expr_set_str(e, NFTNL_EXPR_IMM_CHAIN, "other");
+	nftnl_rule_add_expr(tmp, e);
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWRULE, NFPROTO_IPV4, 0, 1);
+	nftnl_rule_nlmsg_build_payload(nlh, tmp);
+	nftnl_rule_free(tmp);
+
+	nftnl_rule_nlmsg_parse(nlh, r);
+	return r;
+}
+
+static void set_elems_from_nlmsg(struct nftnl_set *s, const char *chain)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nftnl_set_elem *e;
+	struct nftnl_set *tmp;
+	struct nlmsghdr *nlh;
+	uint32_t key = htonl(0x0a000001);
+
+	tmp = nftnl_set_alloc();
+	nftnl_set_set_str(tmp, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(tmp, NFTNL_SET_NAME, "map");
+	e = nftnl_set_elem_alloc();
+	nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+	nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT, NFT_GOTO);
+	nftnl_set_elem_set_str(e, NFTNL_SET_ELEM_CHAIN, chain);
+	nftnl_set_elem_add(tmp, e);
+	nlh = nftnl_nlmsg_build_hdr(buf, NFT_MSG_NEWSETELEM, NFPROTO_IPV4, 0,
+				    1);
+	nftnl_set_elems_nlmsg_build_payload(nlh, tmp);
+	nftnl_set_free(tmp);
+
+	nftnl_set_elems_nlmsg_parse(nlh, s);
+}
+
+static const char *imm_chain(struct nftnl_rule *r)
+{
+	struct nftnl_expr_iter *iter;
+	const char *chain = NULL;
+	struct nftnl_expr *e;
+
+	iter = nftnl_expr_iter_create(r);
+	e = nftnl_expr_iter_next(iter);
+	if (e != NULL)
+		chain = nftnl_expr_get_str(e, NFTNL_EXPR_IMM_CHAIN);
+	nftnl_expr_iter_destroy(iter);
+
+	return chain;
+}
+
+static const char *elem_chain(struct nftnl_set *s)
+{
+	struct nftnl_set_elems_iter *iter;
+	struct nftnl_set_elem *e;
+	const char *chain = NULL;
+
+	iter = nftnl_set_elems_iter_create(s);
+	e = nftnl_set_elems_iter_next(iter);
+	if (e != NULL)
+		chain = nftnl_set_elem_get_str(e, NFTNL_SET_ELEM_CHAIN);
+	nftnl_set_elems_iter_destroy(iter);
+
+	return chain;
+}
+
+/* the same name in different objects is the same string */
+static void test_objects(void)
+{
+	struct nftnl_table *t = nftnl_table_alloc();
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nftnl_chain *c;
+	struct nftnl_rule *r, *r2;
+	const char *table;
+
+	nftnl_table_set_str(t, NFTNL_TABLE_NAME, "filter");
+	table = nftnl_table_get_str(t, NFTNL_TABLE_NAME);
+
+	c = chain_from_nlmsg("filter");
+	r = rule_from_nlmsg("filter", "input");
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, "map");
+	set_elems_from_nlmsg(s, "other");
+
+	if (nftnl_chain_get_str(c, NFTNL_CHAIN_TABLE) != table ||
+	    nftnl_rule_get_str(r, NFTNL_RULE_TABLE) != table ||
+	    nftnl_set_get_str(s, NFTNL_SET_TABLE) != table)
+		print_err("objects", "table names not shared");
+	if (imm_chain(r) == NULL || imm_chain(r) != elem_chain(s))
+		print_err("objects", "verdict chains not shared");
+
+	/* names outlive the objects they were first seen in */
+	nftnl_table_free(t);
+	nftnl_chain_free(c);
+	nftnl_set_free(s);
+	if (strcmp(nftnl_rule_get_str(r, NFTNL_RULE_TABLE), "filter") != 0 ||
+	    strcmp(imm_chain(r), "other") != 0)
+		print_err("objects", "names released too early");
+
+	/* rules compare equal whichever way their names were set */
+	r2 = rule_from_nlmsg("filter", "input");
+	nftnl_rule_unset(r2, NFTNL_RULE_TABLE);
+	nftnl_rule_set_str(r2, NFTNL_RULE_TABLE, "filter");
+	if (!nftnl_rule_cmp(r, r2))
+		print_err("objects", "same rules differ");
+	nftnl_rule_set_str(r2, NFTNL_RULE_TABLE, "filter2");
+	if (nftnl_rule_cmp(r, r2))
+		print_err("objects", "rules of different tables match");
+
+	nftnl_rule_free(r2);
+	nftnl_rule_free(r);
+}
+
+#define MAX_RULES	64
+
+struct collect {
+	struct nftnl_rule	*rules[MAX_RULES];
+	int			num;
+};
+
+static int collect_cb(const struct nftnl_parse_ctx *ctx)
+{
+	struct collect *col;
+
+	col = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+
+	if (nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE) !=
+	    NFTNL_RULESET_RULE || col->num == MAX_RULES) {
+		nftnl_ruleset_ctx_free(ctx);
+		return 0;
+	}
+
+	col->rules[col->num++] = nftnl_ruleset_ctx_get(ctx,
+						       NFTNL_RULESET_CTX_RULE);
+	return 0;
+}
+
+/* rules decoded by several threads still share their names */
+static void test_threads(const char *path)
+{
+	struct nftnl_parse_err *err;
+	struct collect col = {};
+	const char *a, *b;
+	int i, j;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	err = nftnl_parse_err_alloc();
+	if (fp == NULL || err == NULL) {
+		print_err("threads", "cannot open ruleset");
+		goto out;
+	}
+
+	if (nftnl_ruleset_parse_file_cb_threads(NFTNL_PARSE_JSON, fp, err,
+						&col, collect_cb, 4) < 0) {
+		if (errno != EOPNOTSUPP)
+			print_err("threads", "cannot parse ruleset");
+		goto out;
+	}
+	if (col.num < 2)
+		print_err("threads", "too few rules");
+
+	for (i = 0; i < col.num; i++) {
+		for (j = i + 1; j < col.num; j++) {
+			a = nftnl_rule_get_str(col.rules[i], NFTNL_RULE_CHAIN);
+			b = nftnl_rule_get_str(col.rules[j], NFTNL_RULE_CHAIN);
+			if ((strcmp(a, b) == 0) != (a == b))
+				print_err("threads", "chain names not shared");
+
+			a = nftnl_rule_get_str(col.rules[i], NFTNL_RULE_TABLE);
+			b = nftnl_rule_get_str(col.rules[j], NFTNL_RULE_TABLE);
+			if ((strcmp(a, b) == 0) != (a == b))
+				print_err("threads", "table names not shared");
+		}
+	}
+out:
+	for (i = 0; i < col.num; i++)
+		nftnl_rule_free(col.rules[i]);
+	if (err != NULL)
+		nftnl_parse_err_free(err);
+	if (fp != NULL)
+		fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	test_objects();
+	test_threads(argc > 1 ? argv[1] : "jsonfiles/64-ruleset.json");
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
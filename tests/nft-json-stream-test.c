@@ -0,0 +1,188 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/rule.h>
+
+#define RULES	20000
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+struct counts {
+	int	tables;
+	int	chains;
+	int	rules;
+	int	sets;
+	int	flush;
+	char	table[64];
+};
+
+static int count_cb(const struct nftnl_parse_ctx *ctx)
+{
+	struct counts *c = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+	struct nftnl_table *t;
+
+	switch (nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE)) {
+	case NFTNL_RULESET_TABLE:
+		t = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_TABLE);
+		snprintf(c->table, sizeof(c->table), "%s",
+			 nftnl_table_get_str(t, NFTNL_TABLE_NAME));
+		c->tables++;
+		break;
+	case NFTNL_RULESET_CHAIN:
+		c->chains++;
+		break;
+	case NFTNL_RULESET_RULE:
+		c->rules++;
+		break;
+	case NFTNL_RULESET_SET:
+		c->sets++;
+		break;
+	case NFTNL_RULESET_RULESET:
+		c->flush++;
+		break;
+	}
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+static int parse(const char *json, struct counts *c,
+		 struct nftnl_parse_err *err)
+{
+	memset(c, 0, sizeof(*c));
+	return nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_JSON, json, err, c,
+					     count_cb);
+}
+
+static const char table[] =
+	"{\"table\":{\"name\":\"fil\\u0074er\",\"family\":\"ip\","
+	"\"flags\":0,\"use\":0}}";
+
+static const char rule[] =
+	"{\"rule\":{\"family\":\"ip\",\"table\":\"filter\","
+	"\"chain\":\"input\",\"handle\":%d,\"expr\":[{\"type\":\"payload\","
+	"\"dreg\":1,\"offset\":9,\"len\":1,\"base\":\"network\"},"
+	"{\"type\":\"cmp\",\"sreg\":1,\"op\":\"eq\",\"data\":{\"reg\":"
+	"{\"type\":\"value\",\"len\":1,\"data0\":\"0x00000006\"}}}]}}";
+
+static void test_buffer(struct nftnl_parse_err *err)
+{
+	char buf[4096];
+	struct counts c;
+
+	snprintf(buf, sizeof(buf),
+		 "{\"version\":[1, -2.5e3, true, null, {\"a\":\"\\ud83d"
+		 "\\ude00\"}],\n \"nftables\":[{\"add\":[%s,{\"set\":"
+		 "{\"name\":\"s\",\"table\":\"filter\",\"flags\":0,"
+		 "\"family\":\"ip\",\"key_type\":12,\"key_len\":2}},"
+		 "{\"rule\":{\"family\":\"ip\",\"table\":\"filter\","
+		 "\"chain\":\"input\",\"handle\":1,\"expr\":[]}}]},"
+		 "{\"flush\":[]}]}\n", table);
+
+	if (parse(buf, &c, err) < 0)
+		print_err("Cannot parse document");
+	if (c.tables != 1 || c.sets != 1 || c.rules != 1 || c.flush != 1)
+		print_err("Bad object count");
+	if (strcmp(c.table, "filter") != 0)
+		print_err("Bad escaped table name");
+}
+
+static void test_errors(struct nftnl_parse_err *err)
+{
+	char buf[4096];
+	struct counts c;
+
+	/* the table is delivered before the error is found */
+	snprintf(buf, sizeof(buf), "{\"nftables\":[{\"add\":[%s,\n"
+		 "  {\"chain\":}]}]}", table);
+	if (parse(buf, &c, err) == 0 || errno != EINVAL)
+		print_err("Bad document parsed");
+	if (c.tables != 1)
+		print_err("Table not delivered before error");
+	snprintf(buf, sizeof(buf), "{\"nftables\":[{\"add\":[%s]}]} x",
+		 table);
+	if (parse(buf, &c, err) == 0)
+		print_err("Trailing garbage accepted");
+	if (parse("{\"tables\":[]}", &c, err) == 0)
+		print_err("Document without nftables accepted");
+	if (parse("{\"nftables\":[{\"add\":[{\"table\":{\"name\":01}}]}]}",
+		  &c, err) == 0)
+		print_err("Bad number accepted");
+	if (parse("{\"nftables\":[{\"add\":[{\"table\":"
+		  "{\"name\":\"a\tb\"}}]}]}", &c, err) == 0)
+		print_err("Control character accepted");
+}
+
+static void test_file(struct nftnl_parse_err *err)
+{
+	struct counts c;
+	FILE *fp;
+	int i;
+
+	fp = tmpfile();
+	if (fp == NULL) {
+		print_err("Cannot create file");
+		return;
+	}
+
+	/* several read chunks, objects straddle their boundaries */
+	fprintf(fp, "{\"nftables\":[{\"add\":[%s", table);
+	for (i = 0; i < RULES; i++) {
+		fputs(",\n", fp);
+		fprintf(fp, rule, i + 1);
+	}
+	fputs("]}]}\n", fp);
+	rewind(fp);
+
+	memset(&c, 0, sizeof(c));
+	if (nftnl_ruleset_parse_file_cb(NFTNL_PARSE_JSON, fp, err, &c,
+					count_cb) < 0)
+		print_err("Cannot parse file");
+	if (c.tables != 1 || c.rules != RULES)
+		print_err("Bad object count in file");
+
+	fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_parse_err *err;
+	struct counts c;
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		print_err("OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	if (parse("{\"nftables\":[]}", &c, err) < 0 && errno == EOPNOTSUPP)
+		goto out;
+
+	test_buffer(err);
+	test_errors(err);
+	test_file(err);
+out:
+	nftnl_parse_err_free(err);
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,744 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/set.h>
+
+#include "test-rule.h"
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+/* tcp [s|d]port @port @verdict [@chain] */
+static struct nftnl_rule *port_rule_chain(struct nftnl_rule_list *list,
+					  uint32_t offset, uint16_t port,
+					  int verdict, const char *chain)
+{
+	struct nftnl_rule *r = rule_add(list, "input", 0);
+
+	add_payload(r, NFT_PAYLOAD_TRANSPORT_HEADER, offset, sizeof(port));
+	port = htons(port);
+	add_cmp(r, NFT_CMP_EQ, &port, sizeof(port));
+	add_verdict(r, verdict, chain);
+
+	return r;
+}
+
+static struct nftnl_rule *port_rule(struct nftnl_rule_list *list,
+				    uint32_t offset, uint16_t port,
+				    int verdict)
+{
+	return port_rule_chain(list, offset, port, verdict, NULL);
+}
+
+static int set_elems(struct nftnl_set *s)
+{
+	struct nftnl_set_elems_iter *iter;
+	int n = 0;
+
+	iter = nftnl_set_elems_iter_create(s);
+	while (nftnl_set_elems_iter_next(iter) != NULL)
+		n++;
+	nftnl_set_elems_iter_destroy(iter);
+
+	return n;
+}
+
+static const char *rule_expr_name(struct nftnl_rule *r, int pos)
+{
+	struct nftnl_expr_iter *iter;
+	struct nftnl_expr *e;
+	const char *name = NULL;
+
+	iter = nftnl_expr_iter_create(r);
+	while ((e = nftnl_expr_iter_next(iter)) != NULL) {
+		if (pos-- == 0) {
+			name = nftnl_expr_get_str(e, NFTNL_EXPR_NAME);
+			break;
+		}
+	}
+	nftnl_expr_iter_destroy(iter);
+
+	return name;
+}
+
+static void test_consolidate(void)
+{
+	struct nftnl_rule_list_iter *iter;
+	struct nftnl_set_list_iter *siter;
+	struct nftnl_rule_list *list;
+	struct nftnl_set_list *sets;
+	struct nftnl_rule *r, *single;
+	struct nftnl_set *s;
+	uint32_t set_id = 7;
+
+	list = nftnl_rule_list_alloc();
+	sets = nftnl_set_list_alloc();
+	if (list == NULL || sets == NULL)
+		print_err("OOM");
+
+	port_rule(list, 2, 22, NF_ACCEPT);
+	port_rule(list, 2, 80, NF_ACCEPT);
+	port_rule(list, 2, 443, NF_ACCEPT);
+	port_rule(list, 2, 80, NF_ACCEPT);
+	single = port_rule(list, 0, 53, NF_DROP);
+	port_rule(list, 2, 1000, NF_DROP);
+	port_rule(list, 2, 1001, NF_DROP);
+	port_rule(list, 2, 1002, NF_ACCEPT);
+
+	if (nftnl_rule_list_consolidate(list, sets, &set_id, 0) != 2)
+		print_err("Wrong number of consolidated rule families");
+	if (set_id != 9)
+		print_err("Set IDs not allocated");
+
+	iter = nftnl_rule_list_iter_create(list);
+	r = nftnl_rule_list_iter_next(iter);
+	if (r == NULL || strcmp(rule_expr_name(r, 1), "lookup") != 0)
+		print_err("First family not consolidated");
+	r = nftnl_rule_list_iter_next(iter);
+	if (r != single)
+		print_err("Unrelated rule modified");
+	r = nftnl_rule_list_iter_next(iter);
+	if (r == NULL || strcmp(rule_expr_name(r, 1), "lookup") != 0)
+		print_err("Second family not consolidated");
+	r = nftnl_rule_list_iter_next(iter);
+	if (r == NULL || strcmp(rule_expr_name(r, 1), "cmp") != 0)
+		print_err("Rule with a different verdict consolidated");
+	if (nftnl_rule_list_iter_next(iter) != NULL)
+		print_err("Consolidated rules left behind");
+	nftnl_rule_list_iter_destroy(iter);
+
+	siter = nftnl_set_list_iter_create(sets);
+	s = nftnl_set_list_iter_next(siter);
+	if (s == NULL || set_elems(s) != 3 ||
+	    nftnl_set_get_u32(s, NFTNL_SET_ID) != 7 ||
+	    nftnl_set_get_u32(s, NFTNL_SET_KEY_LEN) != sizeof(uint16_t) ||
+	    !(nftnl_set_get_u32(s, NFTNL_SET_FLAGS) & NFT_SET_ANONYMOUS))
+		print_err("Bad set for first family");
+	s = nftnl_set_list_iter_next(siter);
+	if (s == NULL || set_elems(s) != 2 ||
+	    nftnl_set_get_u32(s, NFTNL_SET_ID) != 8)
+		print_err("Bad set for second family");
+	nftnl_set_list_iter_destroy(siter);
+
+	nftnl_set_list_free(sets);
+	nftnl_rule_list_free(list);
+}
+
+/* a repeated key is only dead after a rule that ends evaluation */
+static void test_consolidate_dups(void)
+{
+	struct nftnl_rule_list *list;
+	struct nftnl_set_list *sets;
+	uint32_t set_id = 1;
+
+	list = nftnl_rule_list_alloc();
+	sets = nftnl_set_list_alloc();
+	if (list == NULL || sets == NULL)
+		print_err("OOM");
+
+	port_rule_chain(list, 2, 22, NFT_JUMP, "count");
+	port_rule_chain(list, 2, 80, NFT_JUMP, "count");
+	port_rule_chain(list, 2, 22, NFT_JUMP, "count");
+
+	if (nftnl_rule_list_consolidate(list, sets, &set_id, 0) != 0 ||
+	    set_id != 1)
+		print_err("Repeated key after a jump folded");
+
+	nftnl_set_list_free(sets);
+	nftnl_rule_list_free(list);
+}
+
+/* tcp dport @port @name accept */
+static void state_rule(struct nftnl_rule_list *list, uint16_t port,
+		       const char *name)
+{
+	struct nftnl_rule *r = rule_add(list, "input", 0);
+
+	add_dport(r, NFT_CMP_EQ, port);
+	add_expr(r, name);
+	add_verdict(r, NF_ACCEPT, NULL);
+}
+
+/* folding rules that keep state would share it between them */
+static void test_consolidate_stateful(void)
+{
+	static const char *names[] = { "limit", "dynset", "counter" };
+	struct nftnl_rule_list *list;
+	struct nftnl_set_list *sets;
+	uint32_t set_id = 1;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		list = nftnl_rule_list_alloc();
+		sets = nftnl_set_list_alloc();
+		if (list == NULL || sets == NULL)
+			print_err("OOM");
+
+		state_rule(list, 22, names[i]);
+		state_rule(list, 80, names[i]);
+
+		if (nftnl_rule_list_consolidate(list, sets, &set_id, 0) != 0 ||
+		    set_id != 1)
+			print_err("Rules with state folded");
+
+		nftnl_set_list_free(sets);
+		nftnl_rule_list_free(list);
+	}
+
+	list = nftnl_rule_list_alloc();
+	sets = nftnl_set_list_alloc();
+	if (list == NULL || sets == NULL)
+		print_err("OOM");
+
+	state_rule(list, 22, "counter");
+	state_rule(list, 80, "counter");
+
+	if (nftnl_rule_list_consolidate(list, sets, &set_id,
+					NFTNL_OPTIMIZE_F_MERGE_COUNTERS) != 1)
+		print_err("Rules with counters not folded on request");
+
+	nftnl_set_list_free(sets);
+	nftnl_rule_list_free(list);
+}
+
+struct verdict {
+	bool		found;
+	int		code;
+	char		chain[32];
+};
+
+static void verdict_set(struct verdict *v, int code, const char *chain)
+{
+	v->found = true;
+	v->code = code;
+	snprintf(v->chain, sizeof(v->chain), "%s", chain ? chain : "");
+}
+
+/* verdict of the first rule matching tcp dport @port */
+static void ladder_eval(struct nftnl_rule_list *list, uint16_t port,
+			struct verdict *v)
+{
+	struct nftnl_rule_list_iter *iter;
+	struct nftnl_expr_iter *eiter;
+	struct nftnl_expr *cmp, *imm;
+	struct nftnl_rule *r;
+	uint32_t len;
+
+	memset(v, 0, sizeof(*v));
+	port = htons(port);
+	iter = nftnl_rule_list_iter_create(list);
+	while (!v->found && (r = nftnl_rule_list_iter_next(iter)) != NULL) {
+		eiter = nftnl_expr_iter_create(r);
+		nftnl_expr_iter_next(eiter);
+		cmp = nftnl_expr_iter_next(eiter);
+		imm = nftnl_expr_iter_next(eiter);
+		if (memcmp(nftnl_expr_get(cmp, NFTNL_EXPR_CMP_DATA, &len),
+			   &port, sizeof(port)) == 0)
+			verdict_set(v,
+				nftnl_expr_get_u32(imm, NFTNL_EXPR_IMM_VERDICT),
+				nftnl_expr_get_str(imm, NFTNL_EXPR_IMM_CHAIN));
+		nftnl_expr_iter_destroy(eiter);
+	}
+	nftnl_rule_list_iter_destroy(iter);
+}
+
+/* verdict that @map yields for @port */
+static void vmap_eval(struct nftnl_set *map, uint16_t port, struct verdict *v)
+{
+	struct nftnl_set_elems_iter *iter;
+	struct nftnl_set_elem *elem;
+	const char *chain = NULL;
+	uint32_t len, code;
+
+	memset(v, 0, sizeof(*v));
+	port = htons(port);
+	iter = nftnl_set_elems_iter_create(map);
+	while ((elem = nftnl_set_elems_iter_next(iter)) != NULL) {
+		if (memcmp(nftnl_set_elem_get(elem, NFTNL_SET_ELEM_KEY, &len),
+			   &port, sizeof(port)) != 0)
+			continue;
+
+		if (nftnl_set_elem_is_set(elem, NFTNL_SET_ELEM_CHAIN))
+			chain = nftnl_set_elem_get_str(elem,
+						       NFTNL_SET_ELEM_CHAIN);
+		code = nftnl_set_elem_get_u32(elem, NFTNL_SET_ELEM_VERDICT);
+		verdict_set(v, code, chain);
+		break;
+	}
+	nftnl_set_elems_iter_destroy(iter);
+}
+
+static void test_verdict_map(void)
+{
+	static const uint16_t ports[] = { 22, 80, 443, 8080, 9999 };
+	struct verdict before[5], after;
+	struct nftnl_set_list_iter *siter;
+	struct nftnl_rule_list_iter *iter;
+	struct nftnl_rule_list *list;
+	struct nftnl_set_list *sets;
+	struct nftnl_set *map;
+	struct nftnl_rule *r;
+	uint32_t set_id = 1;
+	unsigned int i;
+
+	list = nftnl_rule_list_alloc();
+	sets = nftnl_set_list_alloc();
+	if (list == NULL || sets == NULL)
+		print_err("OOM");
+
+	port_rule_chain(list, 2, 22, NFT_GOTO, "ssh");
+	port_rule_chain(list, 2, 80, NFT_JUMP, "web");
+	port_rule_chain(list, 2, 443, NFT_GOTO, "web");
+	port_rule_chain(list, 2, 22, NFT_JUMP, "shadowed");
+	port_rule(list, 2, 8080, NF_ACCEPT);
+
+	for (i = 0; i < 5; i++)
+		ladder_eval(list, ports[i], &before[i]);
+
+	if (nftnl_rule_list_verdict_map(list, sets, &set_id, 0) != 1)
+		print_err("Ladder not turned into a verdict map");
+
+	iter = nftnl_rule_list_iter_create(list);
+	r = nftnl_rule_list_iter_next(iter);
+	if (r == NULL || strcmp(rule_expr_name(r, 1), "lookup") != 0 ||
+	    rule_expr_name(r, 2) != NULL)
+		print_err("Ladder not replaced by a lookup rule");
+	if (nftnl_rule_list_iter_next(iter) != NULL)
+		print_err("Ladder rules left behind");
+	nftnl_rule_list_iter_destroy(iter);
+
+	siter = nftnl_set_list_iter_create(sets);
+	map = nftnl_set_list_iter_cur(siter);
+	nftnl_set_list_iter_destroy(siter);
+	if (map == NULL ||
+	    !(nftnl_set_get_u32(map, NFTNL_SET_FLAGS) & NFT_SET_MAP) ||
+	    nftnl_set_get_u32(map, NFTNL_SET_DATA_TYPE) != NFT_DATA_VERDICT ||
+	    set_elems(map) != 4) {
+		print_err("Bad verdict map");
+		goto out;
+	}
+
+	for (i = 0; i < 5; i++) {
+		vmap_eval(map, ports[i], &after);
+		if (after.found != before[i].found ||
+		    after.code != before[i].code ||
+		    strcmp(after.chain, before[i].chain) != 0)
+			print_err("Verdict map behaves unlike the ladder");
+	}
+out:
+	nftnl_set_list_free(sets);
+	nftnl_rule_list_free(list);
+}
+
+/* after a jump, the ladder goes on and a repeated key fires again */
+static void test_verdict_map_jump(void)
+{
+	struct nftnl_rule_list_iter *iter;
+	struct nftnl_rule_list *list;
+	struct nftnl_set_list *sets;
+	uint32_t set_id = 1;
+	int rules = 0;
+
+	list = nftnl_rule_list_alloc();
+	sets = nftnl_set_list_alloc();
+	if (list == NULL || sets == NULL)
+		print_err("OOM");
+
+	port_rule_chain(list, 2, 22, NFT_JUMP, "ssh");
+	port_rule_chain(list, 2, 80, NFT_JUMP, "web");
+	port_rule_chain(list, 2, 22, NFT_JUMP, "audit");
+
+	if (nftnl_rule_list_verdict_map(list, sets, &set_id, 0) != 0 ||
+	    set_id != 1)
+		print_err("Jump ladder with a repeated key turned into a map");
+
+	iter = nftnl_rule_list_iter_create(list);
+	while (nftnl_rule_list_iter_next(iter) != NULL)
+		rules++;
+	nftnl_rule_list_iter_destroy(iter);
+	if (rules != 3)
+		print_err("Jump ladder modified");
+
+	nftnl_set_list_free(sets);
+	nftnl_rule_list_free(list);
+}
+
+static void add_match(struct nftnl_rule *r, uint32_t base, uint32_t offset,
+		      uint32_t len, uint32_t reg, const void *data,
+		      const void *mask)
+{
+	static const uint8_t zero[16];
+	struct nftnl_expr *e;
+
+	e = nftnl_expr_alloc("payload");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_BASE, base);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_DREG, reg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET, offset);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_LEN, len);
+	nftnl_rule_add_expr(r, e);
+
+	if (mask != NULL) {
+		e = nftnl_expr_alloc("bitwise");
+		nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_SREG, reg);
+		nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_DREG, reg);
+		nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_LEN, len);
+		nftnl_expr_set(e, NFTNL_EXPR_BITWISE_MASK, mask, len);
+		nftnl_expr_set(e, NFTNL_EXPR_BITWISE_XOR, zero, len);
+		nftnl_rule_add_expr(r, e);
+	}
+
+	e = nftnl_expr_alloc("cmp");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, reg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, NFT_CMP_EQ);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, data, len);
+	nftnl_rule_add_expr(r, e);
+}
+
+static struct nftnl_expr *rule_expr(struct nftnl_rule *r, int pos)
+{
+	struct nftnl_expr_iter *iter;
+	struct nftnl_expr *e;
+
+	iter = nftnl_expr_iter_create(r);
+	while ((e = nftnl_expr_iter_next(iter)) != NULL && pos-- > 0)
+		;
+	nftnl_expr_iter_destroy(iter);
+
+	return e;
+}
+
+static void test_coalesce_payload(void)
+{
+	static const uint8_t sport[] = { 0x00, 0x16 };
+	static const uint8_t dport[] = { 0x01, 0xbb };
+	static const uint8_t ports[] = { 0x00, 0x16, 0x01, 0xbb };
+	static const uint8_t saddr[] = { 10, 0, 0, 0 };
+	static const uint8_t smask[] = { 0xff, 0, 0, 0 };
+	static const uint8_t daddr[] = { 192, 168, 0, 1 };
+	static const uint8_t addrs[] = { 10, 0, 0, 0, 192, 168, 0, 1 };
+	static const uint8_t amask[] = {
+		0xff, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	};
+	static const uint8_t clash[] = { 0x17, 0x01 };
+	struct nftnl_expr *e;
+	struct nftnl_rule *r;
+	const void *data;
+	uint32_t len;
+
+	/* tcp sport 22 tcp dport 443 accept */
+	r = nftnl_rule_alloc();
+	add_match(r, NFT_PAYLOAD_TRANSPORT_HEADER, 0, 2, NFT_REG_1, sport,
+		  NULL);
+	add_match(r, NFT_PAYLOAD_TRANSPORT_HEADER, 2, 2, NFT_REG_1, dport,
+		  NULL);
+	add_verdict(r, NF_ACCEPT, NULL);
+	if (nftnl_rule_coalesce_payload(r) != 1)
+		print_err("Adjacent payload loads not coalesced");
+	e = rule_expr(r, 0);
+	if (nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET) != 0 ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_LEN) != 4)
+		print_err("Bad coalesced payload load");
+	data = nftnl_expr_get(rule_expr(r, 1), NFTNL_EXPR_CMP_DATA, &len);
+	if (len != sizeof(ports) || memcmp(data, ports, len) != 0)
+		print_err("Bad coalesced cmp data");
+	if (strcmp(rule_expr_name(r, 2), "immediate") != 0 ||
+	    rule_expr(r, 3) != NULL)
+		print_err("Coalesced expressions left behind");
+	nftnl_rule_free(r);
+
+	/* ip saddr 10.0.0.0/8 ip daddr 192.168.0.1, in reverse order */
+	r = nftnl_rule_alloc();
+	add_match(r, NFT_PAYLOAD_NETWORK_HEADER, 16, 4, NFT_REG_1, daddr,
+		  NULL);
+	add_match(r, NFT_PAYLOAD_NETWORK_HEADER, 12, 4, NFT_REG_2, saddr,
+		  smask);
+	add_verdict(r, NF_ACCEPT, NULL);
+	if (nftnl_rule_coalesce_payload(r) != 1)
+		print_err("Masked payload loads not coalesced");
+	e = rule_expr(r, 0);
+	if (nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET) != 12 ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_LEN) != 8 ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_PAYLOAD_DREG) != NFT_REG_1)
+		print_err("Bad coalesced masked payload load");
+	e = rule_expr(r, 1);
+	data = nftnl_expr_get(e, NFTNL_EXPR_BITWISE_MASK, &len);
+	if (strcmp(rule_expr_name(r, 1), "bitwise") != 0 ||
+	    len != sizeof(amask) || memcmp(data, amask, len) != 0)
+		print_err("Bad coalesced mask");
+	data = nftnl_expr_get(rule_expr(r, 2), NFTNL_EXPR_CMP_DATA, &len);
+	if (len != sizeof(addrs) || memcmp(data, addrs, len) != 0)
+		print_err("Bad coalesced masked cmp data");
+	nftnl_rule_free(r);
+
+	/* the second register is still read afterwards */
+	r = nftnl_rule_alloc();
+	add_match(r, NFT_PAYLOAD_TRANSPORT_HEADER, 0, 2, NFT_REG_1, sport,
+		  NULL);
+	add_match(r, NFT_PAYLOAD_TRANSPORT_HEADER, 2, 2, NFT_REG_2, dport,
+		  NULL);
+	e = nftnl_expr_alloc("lookup");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_LOOKUP_SREG, NFT_REG_2);
+	nftnl_expr_set_str(e, NFTNL_EXPR_LOOKUP_SET, "ports");
+	nftnl_rule_add_expr(r, e);
+	if (nftnl_rule_coalesce_payload(r) != 0)
+		print_err("Payload load coalesced over a live register");
+	nftnl_rule_free(r);
+
+	/* contradicting overlap, the rule never matches */
+	r = nftnl_rule_alloc();
+	add_match(r, NFT_PAYLOAD_TRANSPORT_HEADER, 0, 2, NFT_REG_1, sport,
+		  NULL);
+	add_match(r, NFT_PAYLOAD_TRANSPORT_HEADER, 1, 2, NFT_REG_1, clash,
+		  NULL);
+	if (nftnl_rule_coalesce_payload(r) != 0)
+		print_err("Contradicting payload loads coalesced");
+	nftnl_rule_free(r);
+}
+
+static void add_expr_reg(struct nftnl_rule *r, const char *name,
+			 uint16_t type, uint32_t reg)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc(name);
+
+	nftnl_expr_set_u32(e, type, reg);
+	nftnl_rule_add_expr(r, e);
+}
+
+static void add_bitwise(struct nftnl_rule *r, uint32_t sreg, uint32_t dreg,
+			const void *mask, const void *xor, uint32_t len)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("bitwise");
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_SREG, sreg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_DREG, dreg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BITWISE_LEN, len);
+	nftnl_expr_set(e, NFTNL_EXPR_BITWISE_MASK, mask, len);
+	nftnl_expr_set(e, NFTNL_EXPR_BITWISE_XOR, xor, len);
+	nftnl_rule_add_expr(r, e);
+}
+
+static void add_byteorder_reg(struct nftnl_rule *r, uint32_t op,
+			      uint32_t sreg, uint32_t dreg)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("byteorder");
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_SREG, sreg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_DREG, dreg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_OP, op);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_LEN, sizeof(uint32_t));
+	nftnl_expr_set_u32(e, NFTNL_EXPR_BYTEORDER_SIZE, sizeof(uint32_t));
+	nftnl_rule_add_expr(r, e);
+}
+
+static void add_byteorder(struct nftnl_rule *r, uint32_t op)
+{
+	add_byteorder_reg(r, op, NFT_REG_1, NFT_REG_1);
+}
+
+static void add_cmp_reg(struct nftnl_rule *r, uint32_t reg, const void *data,
+			uint32_t len)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("cmp");
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, reg);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, NFT_CMP_EQ);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, data, len);
+	nftnl_rule_add_expr(r, e);
+}
+
+static void add_imm_reg(struct nftnl_rule *r, uint32_t reg, uint32_t val)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("immediate");
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_DREG, reg);
+	nftnl_expr_set(e, NFTNL_EXPR_IMM_DATA, &val, sizeof(val));
+	nftnl_rule_add_expr(r, e);
+}
+
+static void check_simplify(struct nftnl_rule *r, int ret, const char *names,
+			   const char *msg)
+{
+	char buf[256] = "";
+	int i, off = 0;
+
+	if (nftnl_rule_simplify(r) != ret)
+		print_err(msg);
+
+	for (i = 0; rule_expr_name(r, i) != NULL; i++)
+		off += snprintf(buf + off, sizeof(buf) - off, "%s%s",
+				i ? " " : "", rule_expr_name(r, i));
+	if (strcmp(buf, names) != 0)
+		print_err(msg);
+
+	nftnl_rule_free(r);
+}
+
+static void test_simplify(void)
+{
+	static const uint8_t ones[] = { 0xff, 0xff, 0xff, 0xff };
+	static const uint8_t zero[] = { 0x00, 0x00, 0x00, 0x00 };
+	static const uint8_t flip[] = { 0x01, 0x00, 0x00, 0x00 };
+	static const uint8_t prefix[] = { 0xff, 0x00, 0x00, 0x00 };
+	static const uint8_t net[] = { 10, 0, 0, 0 };
+	uint32_t mark = 0x1234, be_mark = htonl(mark);
+	const void *data;
+	struct nftnl_rule *r;
+	uint32_t len;
+
+	/* bitwise with all ones mask and no xor */
+	r = nftnl_rule_alloc();
+	add_match(r, NFT_PAYLOAD_NETWORK_HEADER, 12, 4, NFT_REG_1, net,
+		  ones);
+	add_verdict(r, NF_ACCEPT, NULL);
+	check_simplify(r, 1, "payload cmp immediate",
+		       "Identity bitwise not removed");
+
+	/* hton then ntoh in place */
+	r = nftnl_rule_alloc();
+	add_meta(r, NFT_META_MARK, false);
+	add_byteorder(r, NFT_BYTEORDER_HTON);
+	add_byteorder(r, NFT_BYTEORDER_NTOH);
+	add_cmp_reg(r, NFT_REG_1, &mark, sizeof(mark));
+	check_simplify(r, 2, "meta cmp", "Cancelling byteorder not removed");
+
+	/* a 16 byte iifname load overwrites the source in between */
+	r = nftnl_rule_alloc();
+	add_expr_reg(r, "meta", NFTNL_EXPR_META_DREG, NFT_REG32_02);
+	add_byteorder_reg(r, NFT_BYTEORDER_HTON, NFT_REG32_02, NFT_REG32_06);
+	add_expr_reg(r, "meta", NFTNL_EXPR_META_DREG, NFT_REG32_00);
+	nftnl_expr_set_u32(rule_expr(r, 2), NFTNL_EXPR_META_KEY,
+			   NFT_META_IIFNAME);
+	add_byteorder_reg(r, NFT_BYTEORDER_NTOH, NFT_REG32_06, NFT_REG32_02);
+	add_cmp_reg(r, NFT_REG32_02, &mark, sizeof(mark));
+	check_simplify(r, 1, "meta byteorder meta cmp",
+		       "Byteorder cancelled across a clobbered source");
+
+	/* immediate overwritten before use */
+	r = nftnl_rule_alloc();
+	add_imm_reg(r, NFT_REG_2, 1);
+	add_match(r, NFT_PAYLOAD_NETWORK_HEADER, 12, 4, NFT_REG_2, net, NULL);
+	check_simplify(r, 1, "payload cmp", "Dead immediate not removed");
+
+	/* byteorder folded into the cmp data */
+	r = nftnl_rule_alloc();
+	add_meta(r, NFT_META_MARK, false);
+	add_byteorder(r, NFT_BYTEORDER_HTON);
+	add_cmp_reg(r, NFT_REG_1, &be_mark, sizeof(be_mark));
+	add_verdict(r, NF_ACCEPT, NULL);
+	if (nftnl_rule_simplify(r) != 1 ||
+	    strcmp(rule_expr_name(r, 1), "cmp") != 0)
+		print_err("Byteorder not folded into cmp");
+	data = nftnl_expr_get(rule_expr(r, 1), NFTNL_EXPR_CMP_DATA, &len);
+	if (len != sizeof(mark) || memcmp(data, &mark, len) != 0)
+		print_err("Bad byteorder folded cmp data");
+	nftnl_rule_free(r);
+
+	/* xor folded into the cmp data */
+	r = nftnl_rule_alloc();
+	add_meta(r, NFT_META_MARK, false);
+	add_bitwise(r, NFT_REG_1, NFT_REG_2, ones, flip, sizeof(ones));
+	add_cmp_reg(r, NFT_REG_2, flip, sizeof(flip));
+	add_verdict(r, NF_ACCEPT, NULL);
+	if (nftnl_rule_simplify(r) != 1)
+		print_err("Xor not folded into cmp");
+	data = nftnl_expr_get(rule_expr(r, 1), NFTNL_EXPR_CMP_DATA, &len);
+	if (len != sizeof(zero) || memcmp(data, zero, len) != 0 ||
+	    nftnl_expr_get_u32(rule_expr(r, 1), NFTNL_EXPR_CMP_SREG) !=
+	    NFT_REG_1)
+		print_err("Bad xor folded cmp");
+	nftnl_rule_free(r);
+
+	/* constant through a mask, the cmp always holds */
+	r = nftnl_rule_alloc();
+	add_imm_reg(r, NFT_REG_1, htonl(0x0a000001));
+	add_bitwise(r, NFT_REG_1, NFT_REG_1, prefix, zero, sizeof(prefix));
+	add_cmp_reg(r, NFT_REG_1, net, sizeof(net));
+	add_verdict(r, NF_ACCEPT, NULL);
+	check_simplify(r, 3, "immediate", "Constant cmp not folded");
+
+	/* the moved value is still read later */
+	r = nftnl_rule_alloc();
+	add_meta(r, NFT_META_MARK, false);
+	add_bitwise(r, NFT_REG_1, NFT_REG_2, ones, zero, sizeof(ones));
+	add_cmp_reg(r, NFT_REG_2, zero, sizeof(zero));
+	add_expr_reg(r, "lookup", NFTNL_EXPR_LOOKUP_SREG, NFT_REG_2);
+	check_simplify(r, 0, "meta bitwise cmp lookup",
+		       "Live register folded");
+}
+
+/* limit; tcp dport @port @verdict */
+static void limit_step(struct nftnl_rule_list *list, const char *name,
+		       uint16_t port, int verdict)
+{
+	struct nftnl_rule *r = rule_add(list, "input", 0);
+
+	add_expr(r, name);
+	add_dport(r, NFT_CMP_EQ, port);
+	add_verdict(r, verdict, NULL);
+}
+
+/* a map would spend one limit for all the steps */
+static void test_verdict_map_stateful(void)
+{
+	static const char *names[] = { "limit", "dynset", "counter" };
+	struct nftnl_rule_list *list;
+	struct nftnl_set_list *sets;
+	uint32_t set_id = 1;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		list = nftnl_rule_list_alloc();
+		sets = nftnl_set_list_alloc();
+		if (list == NULL || sets == NULL)
+			print_err("OOM");
+
+		limit_step(list, names[i], 22, NF_ACCEPT);
+		limit_step(list, names[i], 23, NF_DROP);
+
+		if (nftnl_rule_list_verdict_map(list, sets, &set_id, 0) != 0 ||
+		    set_id != 1)
+			print_err("Ladder with state turned into a map");
+
+		nftnl_set_list_free(sets);
+		nftnl_rule_list_free(list);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	test_consolidate();
+	test_consolidate_dups();
+	test_consolidate_stateful();
+	test_verdict_map();
+	test_verdict_map_jump();
+	test_verdict_map_stateful();
+	test_coalesce_payload();
+	test_simplify();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
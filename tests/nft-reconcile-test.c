@@ -0,0 +1,199 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/uio.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter/nf_tables.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+#include <libnftnl/batch.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+static struct nftnl_rule *rule_alloc(uint16_t port, uint64_t handle)
+{
+	struct nftnl_rule *r;
+	struct nftnl_expr *e;
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		print_err("OOM");
+
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, AF_INET);
+	nftnl_rule_set_str(r, NFTNL_RULE_TABLE, "filter");
+	nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, "input");
+	if (handle)
+		nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, handle);
+
+	e = nftnl_expr_alloc("payload");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_BASE,
+			   NFT_PAYLOAD_TRANSPORT_HEADER);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET, 2);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_LEN, 2);
+	nftnl_rule_add_expr(r, e);
+
+	port = htons(port);
+	e = nftnl_expr_alloc("cmp");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, NFT_CMP_EQ);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, &port, sizeof(port));
+	nftnl_rule_add_expr(r, e);
+
+	return r;
+}
+
+struct op {
+	uint16_t	type;
+	uint16_t	flags;
+	uint64_t	handle;
+	uint64_t	position;
+};
+
+static int parse_op_cb(const struct nlattr *attr, void *data)
+{
+	struct op *op = data;
+
+	switch (mnl_attr_get_type(attr)) {
+	case NFTA_RULE_HANDLE:
+		op->handle = be64toh(mnl_attr_get_u64(attr));
+		break;
+	case NFTA_RULE_POSITION:
+		op->position = be64toh(mnl_attr_get_u64(attr));
+		break;
+	}
+	return MNL_CB_OK;
+}
+
+static int batch_ops(struct nftnl_batch *batch, struct op *ops, int max)
+{
+	struct iovec iov[16];
+	struct nlmsghdr *nlh;
+	int i, len, num = 0, iovlen;
+
+	iovlen = nftnl_batch_iovec_len(batch);
+	nftnl_batch_iovec(batch, iov, iovlen);
+
+	for (i = 0; i < iovlen; i++) {
+		nlh = iov[i].iov_base;
+		len = iov[i].iov_len;
+		while (mnl_nlmsg_ok(nlh, len) && num < max) {
+			memset(&ops[num], 0, sizeof(ops[num]));
+			ops[num].type = nlh->nlmsg_type & 0xff;
+			ops[num].flags = nlh->nlmsg_flags;
+			mnl_attr_parse(nlh, sizeof(struct nfgenmsg),
+				       parse_op_cb, &ops[num]);
+			num++;
+			nlh = mnl_nlmsg_next(nlh, &len);
+		}
+	}
+	return num;
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_rule_list *cur, *want;
+	struct nftnl_batch *batch;
+	struct op ops[16];
+	uint32_t seq = 0;
+	int ret;
+
+	cur = nftnl_rule_list_alloc();
+	want = nftnl_rule_list_alloc();
+	batch = nftnl_batch_alloc(4096, 4096);
+	if (cur == NULL || want == NULL || batch == NULL)
+		print_err("OOM");
+
+	/* kernel: 22 80 443 8080, desired: 22 25 443 8443 */
+	nftnl_rule_list_add_tail(rule_alloc(22, 1), cur);
+	nftnl_rule_list_add_tail(rule_alloc(80, 2), cur);
+	nftnl_rule_list_add_tail(rule_alloc(443, 3), cur);
+	nftnl_rule_list_add_tail(rule_alloc(8080, 4), cur);
+
+	nftnl_rule_list_add_tail(rule_alloc(22, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(25, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(443, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(8443, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(8444, 0), want);
+
+	ret = nftnl_rule_list_reconcile(batch, &seq, cur, want);
+	if (ret != 3)
+		print_err("Unexpected number of edits");
+
+	if (batch_ops(batch, ops, 16) != 3)
+		print_err("Unexpected number of messages in batch");
+
+	if (ops[0].type != NFT_MSG_NEWRULE ||
+	    !(ops[0].flags & NLM_F_REPLACE) || ops[0].handle != 2)
+		print_err("Changed rule is not replaced by handle");
+	if (ops[1].type != NFT_MSG_NEWRULE ||
+	    !(ops[1].flags & NLM_F_REPLACE) || ops[1].handle != 4)
+		print_err("Changed rule is not replaced by handle");
+	if (ops[2].type != NFT_MSG_NEWRULE ||
+	    !(ops[2].flags & NLM_F_APPEND) || ops[2].position != 0)
+		print_err("New trailing rule is not appended");
+
+	nftnl_batch_free(batch);
+	batch = nftnl_batch_alloc(4096, 4096);
+
+	/* kernel: 22 80 443 8080, desired: 80 443 53 8080 */
+	nftnl_rule_list_free(want);
+	want = nftnl_rule_list_alloc();
+	nftnl_rule_list_add_tail(rule_alloc(80, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(443, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(53, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(8080, 0), want);
+
+	ret = nftnl_rule_list_reconcile(batch, &seq, cur, want);
+	if (ret != 2)
+		print_err("Unexpected number of edits");
+
+	batch_ops(batch, ops, 16);
+	if (ops[0].type != NFT_MSG_DELRULE || ops[0].handle != 1)
+		print_err("Stale rule is not deleted by handle");
+	if (ops[1].type != NFT_MSG_NEWRULE || ops[1].flags & NLM_F_APPEND ||
+	    ops[1].position != 4)
+		print_err("New rule is not inserted before the next kept rule");
+
+	nftnl_batch_free(batch);
+	batch = nftnl_batch_alloc(4096, 4096);
+
+	/* Same content, different handles and no edits. */
+	nftnl_rule_list_free(want);
+	want = nftnl_rule_list_alloc();
+	nftnl_rule_list_add_tail(rule_alloc(22, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(80, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(443, 0), want);
+	nftnl_rule_list_add_tail(rule_alloc(8080, 0), want);
+
+	if (nftnl_rule_list_reconcile(batch, &seq, cur, want) != 0)
+		print_err("Identical chains are not left untouched");
+
+	nftnl_batch_free(batch);
+	nftnl_rule_list_free(cur);
+	nftnl_rule_list_free(want);
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
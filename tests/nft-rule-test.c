@@ -15,6 +15,7 @@
 #include <netinet/in.h>
 #include <linux/netfilter/nf_tables.h>
 #include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
 
 static int test_ok = 1;
 
@@ -49,6 +50,185 @@ static void cmp_nftnl_rule(struct nftnl_rule *a, struct nftnl_rule *b)
 		print_err("Rule compat_position mismatches");
 }
 
+static void test_nftnl_rule_cmp(struct nftnl_rule *a, struct nftnl_rule *b)
+{
+	struct nftnl_expr *e;
+	uint16_t port = 22;
+
+	if (!nftnl_rule_cmp(a, b) || nftnl_rule_hash(a) != nftnl_rule_hash(b))
+		print_err("Rule fingerprint mismatches");
+
+	/* handle, position and counter values must be ignored */
+	nftnl_rule_set_u64(b, NFTNL_RULE_HANDLE, 0x1);
+	nftnl_rule_unset(b, NFTNL_RULE_POSITION);
+
+	e = nftnl_expr_alloc("counter");
+	nftnl_expr_set_u64(e, NFTNL_EXPR_CTR_PACKETS, 10);
+	nftnl_rule_add_expr(a, e);
+	e = nftnl_expr_alloc("counter");
+	nftnl_rule_add_expr(b, e);
+
+	if (!nftnl_rule_cmp(a, b) || nftnl_rule_hash(a) != nftnl_rule_hash(b))
+		print_err("Rule fingerprint depends on volatile attributes");
+
+	e = nftnl_expr_alloc("cmp");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, NFT_CMP_EQ);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, &port, sizeof(port));
+	nftnl_rule_add_expr(a, e);
+
+	if (nftnl_rule_cmp(a, b) || nftnl_rule_cmp(b, a))
+		print_err("Rules with different expressions are equal");
+
+	port = 23;
+	e = nftnl_expr_alloc("cmp");
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_CMP_OP, NFT_CMP_EQ);
+	nftnl_expr_set(e, NFTNL_EXPR_CMP_DATA, &port, sizeof(port));
+	nftnl_rule_add_expr(b, e);
+
+	if (nftnl_rule_cmp(a, b) || nftnl_rule_hash(a) == nftnl_rule_hash(b))
+		print_err("Rules with different cmp data are equal");
+}
+
+static struct nftnl_rule *rule_list_add(struct nftnl_rule_list *list,
+					const char *chain, uint64_t handle)
+{
+	struct nftnl_rule *r;
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		print_err("OOM");
+
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, AF_INET);
+	nftnl_rule_set_str(r, NFTNL_RULE_TABLE, "table");
+	nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, chain);
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, handle);
+	nftnl_rule_list_add_tail(r, list);
+
+	return r;
+}
+
+static void test_nftnl_rule_list_index(void)
+{
+	struct nftnl_rule_list_iter *iter;
+	struct nftnl_rule_list *list;
+	struct nftnl_rule *r, *del;
+	uint64_t handle, expected;
+
+	list = nftnl_rule_list_alloc();
+	if (list == NULL)
+		print_err("OOM");
+
+	/* enough rules to resize the handle hash at least once */
+	for (handle = 1; handle <= 200; handle++)
+		rule_list_add(list, handle % 2 ? "odd" : "even", handle);
+
+	if (nftnl_rule_list_lookup_handle(list, 42) == NULL)
+		print_err("Unindexed handle lookup failed");
+	if (nftnl_rule_list_index(list) < 0)
+		print_err("OOM");
+
+	del = nftnl_rule_list_lookup_handle(list, 7);
+	if (del == NULL ||
+	    nftnl_rule_get_u64(del, NFTNL_RULE_HANDLE) != 7)
+		print_err("Indexed handle lookup failed");
+	nftnl_rule_list_del(del);
+	nftnl_rule_free(del);
+	if (nftnl_rule_list_lookup_handle(list, 7) != NULL)
+		print_err("Deleted rule still indexed");
+
+	rule_list_add(list, "odd", 201);
+	r = nftnl_rule_alloc();
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, AF_INET);
+	nftnl_rule_set_str(r, NFTNL_RULE_TABLE, "table");
+	nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, "odd");
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, 1000);
+	nftnl_rule_list_add(r, list);
+
+	iter = nftnl_rule_list_iter_create_chain(list, AF_INET, "table", "odd");
+	if (iter == NULL)
+		print_err("OOM");
+
+	r = nftnl_rule_list_iter_next(iter);
+	if (r == NULL || nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE) != 1000)
+		print_err("Chain iterator misses rule added at head");
+
+	expected = 1;
+	while ((r = nftnl_rule_list_iter_next(iter)) != NULL) {
+		if (expected == 7)
+			expected += 2;
+		if (nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE) != expected)
+			print_err("Chain iterator returns rules out of order");
+		expected += 2;
+	}
+	if (expected != 203)
+		print_err("Chain iterator misses rules");
+	nftnl_rule_list_iter_destroy(iter);
+
+	iter = nftnl_rule_list_iter_create_chain(list, AF_INET6, "table",
+						 "odd");
+	if (iter == NULL || nftnl_rule_list_iter_next(iter) != NULL)
+		print_err("Chain iterator ignores the family");
+	nftnl_rule_list_iter_destroy(iter);
+
+	nftnl_rule_list_free(list);
+}
+
+static void test_rule_json_empty(void)
+{
+	struct nftnl_rule *r;
+	char buf[4096];
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		print_err("OOM");
+
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, AF_INET);
+	nftnl_rule_set_str(r, NFTNL_RULE_TABLE, "table");
+	nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, "chain");
+
+	nftnl_rule_snprintf(buf, sizeof(buf), r, NFTNL_OUTPUT_JSON, 0);
+	if (strstr(buf, "\"expr\":[]}}") == NULL)
+		print_err("Empty expression list is not valid JSON");
+
+	nftnl_rule_free(r);
+}
+
+static void test_rule_json_truncate(void)
+{
+	char full[4096], buf[4096];
+	struct nftnl_rule *r;
+	int len, size, ret;
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		print_err("OOM");
+
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, AF_INET);
+	nftnl_rule_set_str(r, NFTNL_RULE_TABLE, "table");
+	nftnl_rule_set_str(r, NFTNL_RULE_CHAIN, "chain");
+	/* log without attributes prints its type only */
+	nftnl_rule_add_expr(r, nftnl_expr_alloc("log"));
+	nftnl_rule_add_expr(r, nftnl_expr_alloc("counter"));
+	nftnl_rule_add_expr(r, nftnl_expr_alloc("log"));
+
+	len = nftnl_rule_snprintf(full, sizeof(full), r, NFTNL_OUTPUT_JSON, 0);
+
+	/* truncated or not, the full length is reported */
+	for (size = 1; size <= len + 1; size++) {
+		ret = nftnl_rule_snprintf(buf, size, r, NFTNL_OUTPUT_JSON, 0);
+		if (ret != len) {
+			print_err("Rule JSON length depends on the buffer size");
+			break;
+		}
+	}
+	if (strcmp(buf, full) != 0)
+		print_err("Rule JSON does not fit in its own length");
+
+	nftnl_rule_free(r);
+}
+
 int main(int argc, char *argv[])
 {
 	struct nftnl_rule *a, *b;
@@ -75,6 +255,10 @@ int main(int argc, char *argv[])
 		print_err("parsing problems");
 
 	cmp_nftnl_rule(a,b);
+	test_nftnl_rule_cmp(a, b);
+	test_nftnl_rule_list_index();
+	test_rule_json_empty();
+	test_rule_json_truncate();
 
 	nftnl_rule_free(a);
 	nftnl_rule_free(b);
@@ -0,0 +1,481 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *file, const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s: %s\n", file, msg);
+}
+
+static const uint32_t out_flags[] = { 0, NFTNL_OF_EVENT_NEW };
+
+/* the rule printed from its message and from its object must be the same */
+static void test_rule(const char *name, struct nftnl_rule *r)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE], out[8192], ref[8192];
+	struct nftnl_rule *tmp;
+	struct nlmsghdr *nlh;
+	unsigned int i;
+
+	nlh = nftnl_rule_nlmsg_build_hdr(buf, NFT_MSG_NEWRULE,
+				nftnl_rule_get_u32(r, NFTNL_RULE_FAMILY), 0, 1);
+	nftnl_rule_nlmsg_build_payload(nlh, r);
+
+	tmp = nftnl_rule_alloc();
+	if (tmp == NULL || nftnl_rule_nlmsg_parse(nlh, tmp) < 0) {
+		print_err(name, "cannot parse the rule message");
+		goto out;
+	}
+
+	for (i = 0; i < sizeof(out_flags) / sizeof(out_flags[0]); i++) {
+		if (nftnl_rule_snprintf(ref, sizeof(ref), tmp,
+					NFTNL_OUTPUT_JSON, out_flags[i]) < 0 ||
+		    nftnl_rule_nlmsg_snprintf(out, sizeof(out), nlh,
+					      NFTNL_OUTPUT_JSON,
+					      out_flags[i]) < 0) {
+			print_err(name, "cannot print the rule");
+			continue;
+		}
+		if (strcmp(out, ref) != 0) {
+			print_err(name, "rule from its message differs");
+			printf("%s\n%s\n", ref, out);
+		}
+	}
+
+	/* same length on truncation, nftnl_fprintf() relies on it */
+	if (nftnl_rule_nlmsg_snprintf(out, 8, nlh, NFTNL_OUTPUT_JSON, 0) !=
+	    nftnl_rule_snprintf(ref, 8, tmp, NFTNL_OUTPUT_JSON, 0))
+		print_err(name, "bad length on truncation");
+
+	/* other formats go through the object */
+	nftnl_rule_snprintf(ref, sizeof(ref), tmp, NFTNL_OUTPUT_DEFAULT, 0);
+	nftnl_rule_nlmsg_snprintf(out, sizeof(out), nlh, NFTNL_OUTPUT_DEFAULT,
+				  0);
+	if (strcmp(out, ref) != 0)
+		print_err(name, "rule in default format differs");
+out:
+	if (tmp != NULL)
+		nftnl_rule_free(tmp);
+}
+
+static int rule_cb(const struct nftnl_parse_ctx *ctx)
+{
+	const char *path = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+
+	if (nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE) ==
+	    NFTNL_RULESET_RULE)
+		test_rule(path, nftnl_ruleset_ctx_get(ctx,
+						      NFTNL_RULESET_CTX_RULE));
+
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+static void test_dir(const char *dir_name, struct nftnl_parse_err *err)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	size_t len;
+	DIR *d;
+	FILE *fp;
+
+	d = opendir(dir_name);
+	if (d == NULL) {
+		print_err(dir_name, "cannot open directory");
+		return;
+	}
+
+	while ((de = readdir(d)) != NULL) {
+		len = strlen(de->d_name);
+		if (len < 5 || strcmp(de->d_name + len - 5, ".json") != 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir_name, de->d_name);
+		fp = fopen(path, "r");
+		if (fp == NULL) {
+			print_err(path, "cannot open file");
+			continue;
+		}
+
+		if (nftnl_ruleset_parse_file_cb(NFTNL_PARSE_JSON, fp, err, path,
+						rule_cb) < 0)
+			print_err(path, "cannot parse file");
+		fclose(fp);
+	}
+	closedir(d);
+}
+
+struct dump {
+	char		buf[1 << 16];
+	size_t		len;
+	int		nmsgs;
+	struct nlmsghdr	*msgs[64];
+};
+
+static struct nlmsghdr *dump_next(struct dump *d, uint16_t type,
+				  uint16_t family)
+{
+	struct nlmsghdr *nlh;
+
+	nlh = nftnl_nlmsg_build_hdr(d->buf + d->len, type, family,
+				    NLM_F_MULTI, 1);
+	d->msgs[d->nmsgs++] = nlh;
+	return nlh;
+}
+
+static void dump_end(struct dump *d, struct nlmsghdr *nlh)
+{
+	d->len += NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+static struct nftnl_expr *expr_imm_verdict(int verdict, const char *chain)
+{
+	struct nftnl_expr *e = nftnl_expr_alloc("immediate");
+
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_DREG, NFT_REG_VERDICT);
+	nftnl_expr_set_u32(e, NFTNL_EXPR_IMM_VERDICT, verdict);
+	if (chain != NULL)
+		nftnl_expr_set_str(e, NFTNL_EXPR_IMM_CHAIN, chain);
+	return e;
+}
+
+static void dump_rule(struct dump *d, uint64_t handle, int exprs)
+{
+	struct nftnl_rule *r = nftnl_rule_alloc();
+	struct nlmsghdr *nlh;
+	struct nftnl_expr *e;
+
+	nftnl_rule_set(r, NFTNL_RULE_TABLE, "filter");
+	nftnl_rule_set(r, NFTNL_RULE_CHAIN, "input");
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, handle);
+
+	if (exprs > 0) {
+		e = nftnl_expr_alloc("payload");
+		nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+		nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_BASE,
+				   NFT_PAYLOAD_NETWORK_HEADER);
+		nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_OFFSET, 12);
+		nftnl_expr_set_u32(e, NFTNL_EXPR_PAYLOAD_LEN, 4);
+		nftnl_rule_add_expr(r, e);
+
+		e = nftnl_expr_alloc("lookup");
+		nftnl_expr_set_u32(e, NFTNL_EXPR_LOOKUP_SREG, NFT_REG_1);
+		nftnl_expr_set_str(e, NFTNL_EXPR_LOOKUP_SET, "addrs");
+		nftnl_rule_add_expr(r, e);
+
+		nftnl_rule_add_expr(r, nftnl_expr_alloc("counter"));
+		nftnl_rule_add_expr(r, expr_imm_verdict(NFT_JUMP, "other"));
+	}
+
+	nlh = dump_next(d, NFT_MSG_NEWRULE, NFPROTO_IPV4);
+	nftnl_rule_nlmsg_build_payload(nlh, r);
+	dump_end(d, nlh);
+	nftnl_rule_free(r);
+}
+
+static void dump_elems(struct dump *d, const char *name, uint32_t first,
+		       uint32_t n)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nftnl_set_elem *e;
+	struct nlmsghdr *nlh;
+	uint32_t i, key;
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, name);
+	for (i = first; i < first + n; i++) {
+		e = nftnl_set_elem_alloc();
+		key = htonl(0x0a000000 + i);
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+		switch (i % 3) {
+		case 0:
+			nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT,
+					       NF_ACCEPT);
+			break;
+		case 1:
+			nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT,
+					       NFT_JUMP);
+			nftnl_set_elem_set_str(e, NFTNL_SET_ELEM_CHAIN,
+					       "other");
+			break;
+		case 2:
+			nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT,
+					       NF_DROP);
+			break;
+		}
+		nftnl_set_elem_add(s, e);
+	}
+
+	nlh = dump_next(d, NFT_MSG_NEWSETELEM, NFPROTO_IPV4);
+	nftnl_set_elems_nlmsg_build_payload(nlh, s);
+	dump_end(d, nlh);
+	nftnl_set_free(s);
+}
+
+static void dump_set(struct dump *d, const char *name, uint32_t data_type)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+	struct nlmsghdr *nlh;
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, name);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS, NFT_SET_MAP);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_TYPE, 7);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, 4);
+	nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, data_type);
+	nftnl_set_set_u32(s, NFTNL_SET_DATA_LEN, 4);
+
+	nlh = dump_next(d, NFT_MSG_NEWSET, NFPROTO_IPV4);
+	nftnl_set_nlmsg_build_payload(nlh, s);
+	dump_end(d, nlh);
+	nftnl_set_free(s);
+}
+
+static void dump_build(struct dump *d)
+{
+	struct nftnl_table *t = nftnl_table_alloc();
+	struct nftnl_chain *c = nftnl_chain_alloc();
+	struct nlmsghdr *nlh;
+
+	nftnl_table_set(t, NFTNL_TABLE_NAME, "filter");
+	nlh = dump_next(d, NFT_MSG_NEWTABLE, NFPROTO_IPV4);
+	nftnl_table_nlmsg_build_payload(nlh, t);
+	dump_end(d, nlh);
+	nftnl_table_free(t);
+
+	nftnl_chain_set(c, NFTNL_CHAIN_TABLE, "filter");
+	nftnl_chain_set(c, NFTNL_CHAIN_NAME, "input");
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_HOOKNUM, NF_INET_LOCAL_IN);
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_PRIO, 0);
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_POLICY, NF_ACCEPT);
+	nftnl_chain_set(c, NFTNL_CHAIN_TYPE, "filter");
+	nlh = dump_next(d, NFT_MSG_NEWCHAIN, NFPROTO_IPV4);
+	nftnl_chain_nlmsg_build_payload(nlh, c);
+	dump_end(d, nlh);
+	nftnl_chain_free(c);
+
+	/* elements of a set come in several messages */
+	dump_set(d, "addrs", NFT_DATA_VERDICT);
+	dump_elems(d, "addrs", 0, 5);
+	dump_elems(d, "addrs", 5, 0);
+	dump_elems(d, "addrs", 5, 7);
+	/* larger than the first buffer nftnl_set_fprintf() tries */
+	dump_elems(d, "addrs", 12, 200);
+	/* a set without elements */
+	dump_set(d, "empty", NFT_DATA_VERDICT);
+	dump_elems(d, "empty", 0, 0);
+
+	dump_rule(d, 2, 0);
+	dump_rule(d, 3, 4);
+}
+
+/* what the ruleset prints once the dump has been parsed into objects */
+static int dump_ref(struct dump *d, FILE *fp, uint32_t flags)
+{
+	struct nftnl_table_list *tl = nftnl_table_list_alloc();
+	struct nftnl_chain_list *cl = nftnl_chain_list_alloc();
+	struct nftnl_rule_list *rl = nftnl_rule_list_alloc();
+	struct nftnl_set_list *sl = nftnl_set_list_alloc();
+	struct nftnl_ruleset *rs = nftnl_ruleset_alloc();
+	struct nftnl_set *s = NULL;
+	struct nftnl_table *t;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+	int i, ret;
+
+	for (i = 0; i < d->nmsgs; i++) {
+		switch (d->msgs[i]->nlmsg_type & 0xff) {
+		case NFT_MSG_NEWTABLE:
+			t = nftnl_table_alloc();
+			nftnl_table_nlmsg_parse(d->msgs[i], t);
+			nftnl_table_list_add_tail(t, tl);
+			break;
+		case NFT_MSG_NEWCHAIN:
+			c = nftnl_chain_alloc();
+			nftnl_chain_nlmsg_parse(d->msgs[i], c);
+			nftnl_chain_list_add_tail(c, cl);
+			break;
+		case NFT_MSG_NEWSET:
+			s = nftnl_set_alloc();
+			nftnl_set_nlmsg_parse(d->msgs[i], s);
+			nftnl_set_list_add_tail(s, sl);
+			break;
+		case NFT_MSG_NEWSETELEM:
+			nftnl_set_elems_nlmsg_parse(d->msgs[i], s);
+			break;
+		case NFT_MSG_NEWRULE:
+			r = nftnl_rule_alloc();
+			nftnl_rule_nlmsg_parse(d->msgs[i], r);
+			nftnl_rule_list_add_tail(r, rl);
+			break;
+		}
+	}
+
+	nftnl_ruleset_set(rs, NFTNL_RULESET_TABLELIST, tl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_CHAINLIST, cl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_SETLIST, sl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_RULELIST, rl);
+	ret = nftnl_ruleset_fprintf(fp, rs, NFTNL_OUTPUT_JSON, flags);
+	nftnl_ruleset_free(rs);
+
+	return ret;
+}
+
+static int dump_export(struct dump *d, int nmsgs, FILE *fp, uint32_t flags)
+{
+	struct nftnl_ruleset_export *exp;
+	int i, ret = 0;
+
+	exp = nftnl_ruleset_export_alloc(fp, NFTNL_OUTPUT_JSON, flags);
+	if (exp == NULL)
+		return -1;
+
+	for (i = 0; i < nmsgs && ret == 0; i++)
+		ret = nftnl_ruleset_export_nlmsg(exp, d->msgs[i]);
+	if (ret == 0)
+		ret = nftnl_ruleset_export_end(exp);
+
+	nftnl_ruleset_export_free(exp);
+	return ret;
+}
+
+static void test_export(void)
+{
+	static struct dump d, empty;
+	char *out, *ref;
+	size_t out_len, ref_len;
+	FILE *out_fp, *ref_fp;
+	unsigned int i;
+
+	dump_build(&d);
+
+	for (i = 0; i < sizeof(out_flags) / sizeof(out_flags[0]); i++) {
+		out_fp = open_memstream(&out, &out_len);
+		ref_fp = open_memstream(&ref, &ref_len);
+		if (out_fp == NULL || ref_fp == NULL) {
+			print_err("export", "OOM");
+			return;
+		}
+
+		if (dump_export(&d, d.nmsgs, out_fp, out_flags[i]) < 0)
+			print_err("export", "cannot export the dump");
+		if (dump_ref(&d, ref_fp, out_flags[i]) < 0)
+			print_err("export", "cannot print the ruleset");
+		fclose(out_fp);
+		fclose(ref_fp);
+
+		if (strcmp(out, ref) != 0) {
+			print_err("export", "exported dump differs");
+			printf("%s\n%s\n", ref, out);
+		}
+		free(out);
+		free(ref);
+	}
+
+	/* nothing dumped */
+	out_fp = open_memstream(&out, &out_len);
+	ref_fp = open_memstream(&ref, &ref_len);
+	if (out_fp == NULL || ref_fp == NULL) {
+		print_err("export", "OOM");
+		return;
+	}
+	dump_export(&empty, 0, out_fp, 0);
+	dump_ref(&empty, ref_fp, 0);
+	fclose(out_fp);
+	fclose(ref_fp);
+	if (strcmp(out, ref) != 0)
+		print_err("export", "exported empty dump differs");
+	free(out);
+	free(ref);
+}
+
+static void test_errors(void)
+{
+	static struct dump d;
+	struct nftnl_ruleset_export *exp;
+	FILE *fp;
+
+	if (nftnl_ruleset_export_alloc(stdout, NFTNL_OUTPUT_XML, 0) != NULL ||
+	    errno != EOPNOTSUPP)
+		print_err("errors", "XML export allocated");
+
+	fp = fopen("/dev/null", "w");
+	if (fp == NULL) {
+		print_err("errors", "cannot open /dev/null");
+		return;
+	}
+
+	/* elements need the set they belong to right before them */
+	dump_elems(&d, "addrs", 0, 1);
+	exp = nftnl_ruleset_export_alloc(fp, NFTNL_OUTPUT_JSON, 0);
+	if (exp == NULL) {
+		print_err("errors", "OOM");
+		goto out;
+	}
+	if (nftnl_ruleset_export_nlmsg(exp, d.msgs[0]) == 0)
+		print_err("errors", "elements without set exported");
+
+	dump_set(&d, "other", NFT_DATA_VERDICT);
+	if (nftnl_ruleset_export_nlmsg(exp, d.msgs[1]) < 0 ||
+	    nftnl_ruleset_export_nlmsg(exp, d.msgs[0]) == 0)
+		print_err("errors", "elements of another set exported");
+
+	nftnl_ruleset_export_free(exp);
+out:
+	fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_parse_err *err;
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		print_err(argv[0], "OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	test_export();
+	test_errors();
+
+	if (nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_JSON, "{\"nftables\":[]}",
+					  err, NULL, rule_cb) < 0 &&
+	    errno == EOPNOTSUPP)
+		goto out;
+
+	test_dir(argc > 1 ? argv[1] : "jsonfiles", err);
+out:
+	nftnl_parse_err_free(err);
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
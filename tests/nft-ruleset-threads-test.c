@@ -0,0 +1,226 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <libnftnl/ruleset.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+#define SETS	50
+#define RULES	5000
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+struct event {
+	uint32_t	cmd;
+	uint32_t	type;
+	uint64_t	handle;
+	uint32_t	set_id;
+};
+
+struct events {
+	struct event	*ev;
+	uint32_t	num;
+	uint32_t	fail_at;	/* callback error, 0 if none */
+};
+
+static int lookup_cb(struct nftnl_expr *e, void *data)
+{
+	uint32_t *set_id = data;
+
+	if (nftnl_expr_is_set(e, NFTNL_EXPR_LOOKUP_SET_ID))
+		*set_id = nftnl_expr_get_u32(e, NFTNL_EXPR_LOOKUP_SET_ID);
+	return 0;
+}
+
+static int record_cb(const struct nftnl_parse_ctx *ctx)
+{
+	struct events *evs = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+	struct event *ev = &evs->ev[evs->num++];
+	struct nftnl_rule *r;
+	struct nftnl_set *s;
+
+	memset(ev, 0, sizeof(*ev));
+	ev->cmd = nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_CMD);
+	ev->type = nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE);
+	ev->set_id = UINT32_MAX;
+
+	switch (ev->type) {
+	case NFTNL_RULESET_RULE:
+		r = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_RULE);
+		ev->handle = nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE);
+		nftnl_expr_foreach(r, lookup_cb, &ev->set_id);
+		break;
+	case NFTNL_RULESET_SET:
+		s = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_SET);
+		ev->set_id = nftnl_set_get_u32(s, NFTNL_SET_ID);
+		break;
+	}
+	/* the object is released by the parser on errors */
+	if (evs->num == evs->fail_at)
+		return -1;
+
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+static FILE *ruleset_generate(void)
+{
+	FILE *fp;
+	int i;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	fputs("{\"nftables\":[{\"flush\":[]},{\"add\":[{\"table\":{\"name\":"
+	      "\"filter\",\"family\":\"ip\",\"flags\":0,\"use\":0}}", fp);
+	for (i = 0; i < RULES; i++) {
+		/* sets come between the rules, with a redefinition of set0 */
+		if (i % (RULES / SETS) == 0)
+			fprintf(fp, ",\n{\"set\":{\"name\":\"set%d\",\"table\":"
+				"\"filter\",\"flags\":0,\"family\":\"ip\","
+				"\"key_type\":7,\"key_len\":4}}",
+				i / (RULES / SETS) % (SETS - 1));
+		fprintf(fp, ",\n{\"rule\":{\"family\":\"ip\",\"table\":"
+			"\"filter\",\"chain\":\"input\",\"handle\":%d,"
+			"\"expr\":[{\"type\":\"payload\",\"dreg\":1,"
+			"\"offset\":12,\"len\":4,\"base\":\"network\"},"
+			"{\"type\":\"lookup\",\"set\":\"set%d\",\"sreg\":1,"
+			"\"dreg\":0}]}}", i + 1, i * 7 % SETS);
+	}
+	fputs("]},{\"delete\":[{\"table\":{\"name\":\"filter\","
+	      "\"family\":\"ip\",\"flags\":0,\"use\":0}}]}]}\n", fp);
+	rewind(fp);
+
+	return fp;
+}
+
+static int parse(FILE *fp, struct events *evs, uint32_t fail_at,
+		 unsigned int threads, struct nftnl_parse_err *err)
+{
+	rewind(fp);
+	evs->num = 0;
+	evs->fail_at = fail_at;
+
+	return nftnl_ruleset_parse_file_cb_threads(NFTNL_PARSE_JSON, fp, err,
+						   evs, record_cb, threads);
+}
+
+static void test_order(FILE *fp, struct nftnl_parse_err *err)
+{
+	struct events seq, thr;
+	unsigned int threads;
+
+	seq.ev = calloc(RULES + SETS + 8, sizeof(struct event));
+	thr.ev = calloc(RULES + SETS + 8, sizeof(struct event));
+	if (seq.ev == NULL || thr.ev == NULL) {
+		print_err("OOM");
+		goto out;
+	}
+
+	if (parse(fp, &seq, 0, 1, err) < 0) {
+		print_err("Cannot parse sequentially");
+		goto out;
+	}
+	if (seq.num != 1 + 1 + SETS + RULES + 1)
+		print_err("Bad sequential object count");
+
+	for (threads = 2; threads <= 8; threads *= 2) {
+		if (parse(fp, &thr, 0, threads, err) < 0) {
+			print_err("Cannot parse with threads");
+			continue;
+		}
+		if (thr.num != seq.num ||
+		    memcmp(thr.ev, seq.ev, seq.num * sizeof(struct event)))
+			print_err("Threaded objects differ from sequential");
+	}
+
+	/* an error in the callback stops the delivery there */
+	if (parse(fp, &thr, 1000, 4, err) == 0 || thr.num != 1000)
+		print_err("Callback error not honoured");
+	if (memcmp(thr.ev, seq.ev, 1000 * sizeof(struct event)))
+		print_err("Bad objects before the callback error");
+out:
+	free(seq.ev);
+	free(thr.ev);
+}
+
+static void test_errors(struct nftnl_parse_err *err)
+{
+	struct event ev[16];
+	struct events evs = { .ev = ev };
+	FILE *fp;
+
+	fp = tmpfile();
+	if (fp == NULL) {
+		print_err("Cannot create file");
+		return;
+	}
+
+	/* the first rule decodes, the second has a bad family */
+	fputs("{\"nftables\":[{\"add\":[{\"rule\":{\"family\":\"ip\","
+	      "\"table\":\"filter\",\"chain\":\"input\",\"handle\":1,"
+	      "\"expr\":[]}},{\"rule\":{\"family\":\"ipx\",\"chain\":"
+	      "\"input\",\"handle\":2,\"expr\":[]}},{\"table\":{\"name\":"
+	      "\"filter\",\"family\":\"ip\",\"flags\":0,\"use\":0}}]}]}", fp);
+
+	if (parse(fp, &evs, 0, 4, err) == 0)
+		print_err("Bad object parsed");
+	if (evs.num != 1)
+		print_err("Objects delivered past the bad one");
+
+	fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_parse_err *err;
+	FILE *fp;
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		print_err("OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	fp = ruleset_generate();
+	if (fp == NULL) {
+		print_err("Cannot create file");
+		goto out;
+	}
+
+	if (nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_JSON, "{\"nftables\":[]}",
+					  err, NULL, record_cb) < 0 &&
+	    errno == EOPNOTSUPP)
+		goto out;
+
+	test_order(fp, err);
+	test_errors(err);
+out:
+	if (fp != NULL)
+		fclose(fp);
+	nftnl_parse_err_free(err);
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libnftnl/set.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+static struct nftnl_set *set_alloc(uint32_t flags, uint32_t key_len)
+{
+	struct nftnl_set *s = nftnl_set_alloc();
+
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, "set0");
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, NFPROTO_IPV4);
+	nftnl_set_set_u32(s, NFTNL_SET_FLAGS, flags);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, key_len);
+	if (flags & NFT_SET_MAP)
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, NFT_DATA_VERDICT);
+
+	return s;
+}
+
+static struct nftnl_set_elem *elem_add(struct nftnl_set *s, uint32_t key,
+				       uint32_t key_len, bool end)
+{
+	struct nftnl_set_elem *e = nftnl_set_elem_alloc();
+	uint32_t k32 = htonl(key);
+	uint16_t k16 = htons(key);
+	uint8_t k8 = key;
+
+	switch (key_len) {
+	case 1:
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &k8, key_len);
+		break;
+	case 2:
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &k16, key_len);
+		break;
+	default:
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &k32, key_len);
+		break;
+	}
+	if (end)
+		nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_FLAGS,
+				       NFT_SET_ELEM_INTERVAL_END);
+	nftnl_set_elem_add(s, e);
+
+	return e;
+}
+
+static void test_ports(void)
+{
+	struct nftnl_set *s = set_alloc(0, sizeof(uint16_t));
+	struct nftnl_set_advice adv;
+	uint32_t i;
+
+	for (i = 0; i < 256; i++)
+		elem_add(s, 1024 + i * 3, sizeof(uint16_t), false);
+
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model port set");
+	if (!adv.cost[NFTNL_SET_BACKEND_HASH].usable ||
+	    !adv.cost[NFTNL_SET_BACKEND_RBTREE].usable ||
+	    !adv.cost[NFTNL_SET_BACKEND_BITMAP].usable)
+		print_err("Port set backends not usable");
+	if (adv.keys != 256 || adv.ranges != 256)
+		print_err("Bad port set keys");
+	if (adv.backend != NFTNL_SET_BACKEND_BITMAP || adv.interval ||
+	    adv.size != 256)
+		print_err("Bitmap not recommended for ports");
+	if (adv.cost[NFTNL_SET_BACKEND_BITMAP].lookup >=
+	    adv.cost[NFTNL_SET_BACKEND_HASH].lookup ||
+	    adv.cost[NFTNL_SET_BACKEND_HASH].lookup >=
+	    adv.cost[NFTNL_SET_BACKEND_RBTREE].lookup)
+		print_err("Bad port set lookup ranking");
+
+	nftnl_set_free(s);
+}
+
+static void test_addresses(void)
+{
+	struct nftnl_set *s = set_alloc(0, sizeof(uint32_t));
+	struct nftnl_set_advice adv;
+	uint32_t i;
+
+	for (i = 0; i < 1000; i++)
+		elem_add(s, 0x0a000000 + i * 65537, sizeof(uint32_t), false);
+
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model address set");
+	if (adv.cost[NFTNL_SET_BACKEND_BITMAP].usable)
+		print_err("Bitmap usable for 32 bit keys");
+	if (adv.backend != NFTNL_SET_BACKEND_HASH ||
+	    adv.selected != NFTNL_SET_BACKEND_HASH || adv.interval ||
+	    adv.policy != NFT_SET_POL_PERFORMANCE || adv.size != 1000)
+		print_err("Hash not recommended for addresses");
+	if (adv.cost[NFTNL_SET_BACKEND_HASH].memory >=
+	    adv.cost[NFTNL_SET_BACKEND_RBTREE].memory)
+		print_err("Bad address set memory ranking");
+
+	nftnl_set_free(s);
+}
+
+static void test_ranges(void)
+{
+	struct nftnl_set *s = set_alloc(0, sizeof(uint32_t));
+	struct nftnl_set_advice adv;
+	uint32_t i;
+
+	/* 10.0.0.0/22 and 10.1.0.0/24, one key at a time */
+	for (i = 0; i < 1024; i++)
+		elem_add(s, 0x0a000000 + i, sizeof(uint32_t), false);
+	for (i = 0; i < 256; i++)
+		elem_add(s, 0x0a010000 + i, sizeof(uint32_t), false);
+
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model range set");
+	if (adv.keys != 1280 || adv.ranges != 2)
+		print_err("Bad range set keys");
+	if (adv.backend != NFTNL_SET_BACKEND_RBTREE || !adv.interval ||
+	    adv.selected != NFTNL_SET_BACKEND_RBTREE || adv.size != 4)
+		print_err("Intervals not recommended for ranges");
+
+	nftnl_set_free(s);
+}
+
+static void test_singletons(void)
+{
+	struct nftnl_set *s = set_alloc(NFT_SET_INTERVAL, sizeof(uint32_t));
+	struct nftnl_set_advice adv;
+	uint32_t i;
+
+	for (i = 0; i < 100; i++) {
+		elem_add(s, 0xc0a80000 + i * 7, sizeof(uint32_t), false);
+		elem_add(s, 0xc0a80000 + i * 7 + 1, sizeof(uint32_t), true);
+	}
+
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model singleton intervals");
+	if (adv.keys != 100 || adv.ranges != 100)
+		print_err("Bad singleton interval keys");
+	if (adv.cost[NFTNL_SET_BACKEND_RBTREE].interval ||
+	    adv.cost[NFTNL_SET_BACKEND_RBTREE].elements != 100)
+		print_err("Singleton intervals kept in rbtree");
+	if (adv.backend != NFTNL_SET_BACKEND_HASH || adv.interval)
+		print_err("Intervals recommended for single keys");
+
+	nftnl_set_free(s);
+}
+
+static void test_open_interval(void)
+{
+	struct nftnl_set *s = set_alloc(NFT_SET_INTERVAL, sizeof(uint8_t));
+	struct nftnl_set_advice adv;
+
+	elem_add(s, 0x10, sizeof(uint8_t), false);
+	elem_add(s, 0x20, sizeof(uint8_t), true);
+	elem_add(s, 0xf0, sizeof(uint8_t), false);
+
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model open interval");
+	if (adv.keys != 32 || adv.ranges != 2)
+		print_err("Bad open interval keys");
+	if (adv.cost[NFTNL_SET_BACKEND_RBTREE].elements != 3)
+		print_err("Bad open interval elements");
+
+	nftnl_set_free(s);
+}
+
+static void test_flags(void)
+{
+	struct nftnl_set *s = set_alloc(NFT_SET_MAP, sizeof(uint16_t));
+	struct nftnl_set_advice adv;
+	struct nftnl_set_elem *e;
+	uint32_t i;
+
+	/* consecutive keys with alternating verdicts do not merge */
+	for (i = 0; i < 16; i++) {
+		e = elem_add(s, 80 + i, sizeof(uint16_t), false);
+		nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT,
+				       i % 2 ? NF_ACCEPT : NF_DROP);
+	}
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model verdict map");
+	if (adv.cost[NFTNL_SET_BACKEND_BITMAP].usable)
+		print_err("Bitmap usable for maps");
+	if (adv.ranges != 16)
+		print_err("Verdict map ranges merged");
+	nftnl_set_free(s);
+
+	s = set_alloc(NFT_SET_TIMEOUT, sizeof(uint16_t));
+	elem_add(s, 22, sizeof(uint16_t), false);
+	if (nftnl_set_advise(s, &adv) < 0)
+		print_err("Cannot model timeout set");
+	if (adv.cost[NFTNL_SET_BACKEND_RBTREE].usable ||
+	    adv.cost[NFTNL_SET_BACKEND_BITMAP].usable ||
+	    adv.backend != NFTNL_SET_BACKEND_HASH)
+		print_err("Only hash supports timeouts");
+	nftnl_set_free(s);
+
+	s = set_alloc(0, 0);
+	if (nftnl_set_advise(s, &adv) == 0 || errno != EINVAL)
+		print_err("Set without key length modelled");
+	nftnl_set_free(s);
+}
+
+int main(int argc, char *argv[])
+{
+	test_ports();
+	test_addresses();
+	test_ranges();
+	test_singletons();
+	test_open_interval();
+	test_flags();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -12,7 +12,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <netinet/in.h>
+#include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
 
 #include <libnftnl/set.h>
 
@@ -49,6 +51,114 @@ static void cmp_nftnl_set(struct nftnl_set *a, struct nftnl_set *b)
 		print_err("Set data-len mismatches");
 }
 
+static struct nftnl_set *set_elems_alloc(int n)
+{
+	struct nftnl_set_elem *e;
+	struct nftnl_set *s;
+	uint32_t key;
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		print_err("OOM");
+
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, AF_INET);
+	nftnl_set_set_str(s, NFTNL_SET_TABLE, "test-table");
+	nftnl_set_set_str(s, NFTNL_SET_NAME, "test-name");
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, sizeof(key));
+
+	for (key = 1; key <= (uint32_t)n; key++) {
+		e = nftnl_set_elem_alloc();
+		if (e == NULL)
+			print_err("OOM");
+		nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+		nftnl_set_elem_add(s, e);
+	}
+
+	return s;
+}
+
+static void test_set_json_truncate(void)
+{
+	char full[4096], buf[4096];
+	struct nftnl_set *s;
+	int len, size, ret;
+
+	s = set_elems_alloc(3);
+	len = nftnl_set_snprintf(full, sizeof(full), s, NFTNL_OUTPUT_JSON, 0);
+
+	/* truncated or not, the full length is reported */
+	for (size = 1; size <= len + 1; size++) {
+		ret = nftnl_set_snprintf(buf, size, s, NFTNL_OUTPUT_JSON, 0);
+		if (ret != len) {
+			print_err("Set JSON length depends on the buffer size");
+			break;
+		}
+	}
+	if (strcmp(buf, full) != 0)
+		print_err("Set JSON does not fit in its own length");
+
+	nftnl_set_free(s);
+}
+
+static int set_elem_count(struct nftnl_set_elem *e, void *data)
+{
+	(*(int *)data)++;
+	return 0;
+}
+
+static void set_elems_check(struct nlmsghdr *nlh, int n)
+{
+	struct nlattr *attr, *nest;
+	struct nftnl_set *s;
+	int count = 0;
+
+	/* the kernel only takes elements nested in NFTA_LIST_ELEM */
+	mnl_attr_for_each(attr, nlh, sizeof(struct nfgenmsg)) {
+		if (mnl_attr_get_type(attr) != NFTA_SET_ELEM_LIST_ELEMENTS)
+			continue;
+		mnl_attr_for_each_nested(nest, attr) {
+			if (mnl_attr_get_type(nest) != NFTA_LIST_ELEM)
+				print_err("Set element not in NFTA_LIST_ELEM");
+		}
+	}
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		print_err("OOM");
+	if (nftnl_set_elems_nlmsg_parse(nlh, s) < 0)
+		print_err("parsing problems");
+	nftnl_set_elem_foreach(s, set_elem_count, &count);
+	if (count != n)
+		print_err("Set elements do not parse back");
+	nftnl_set_free(s);
+}
+
+static void test_set_elems_nest(void)
+{
+	struct nftnl_set_elems_iter *iter;
+	struct nlmsghdr *nlh;
+	struct nftnl_set *s;
+	char buf[4096];
+
+	s = set_elems_alloc(3);
+
+	nlh = nftnl_set_elem_nlmsg_build_hdr(buf, NFT_MSG_NEWSETELEM, AF_INET,
+					     0, 1234);
+	nftnl_set_elems_nlmsg_build_payload(nlh, s);
+	set_elems_check(nlh, 3);
+
+	iter = nftnl_set_elems_iter_create(s);
+	if (iter == NULL)
+		print_err("OOM");
+	nlh = nftnl_set_elem_nlmsg_build_hdr(buf, NFT_MSG_NEWSETELEM, AF_INET,
+					     0, 1234);
+	nftnl_set_elems_nlmsg_build_payload_iter(nlh, iter);
+	set_elems_check(nlh, 3);
+	nftnl_set_elems_iter_destroy(iter);
+
+	nftnl_set_free(s);
+}
+
 int main(int argc, char *argv[])
 {
 	struct nftnl_set *a, *b = NULL;
@@ -80,6 +190,9 @@ int main(int argc, char *argv[])
 
 	nftnl_set_free(a); nftnl_set_free(b);
 
+	test_set_json_truncate();
+	test_set_elems_nest();
+
 	if (!test_ok)
 		exit(EXIT_FAILURE);
 
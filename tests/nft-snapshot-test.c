@@ -0,0 +1,646 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+
+#include <netinet/in.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include <libmnl/libmnl.h>
+#include <libnftnl/ruleset.h>
+#include <libnftnl/snapshot.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *file, const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s: %s\n", file, msg);
+}
+
+static char ref[1 << 16], out[1 << 16];
+
+static FILE *snapshot_write(const struct nftnl_ruleset *rs)
+{
+	FILE *fp;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	if (nftnl_ruleset_fprintf(fp, rs, NFTNL_OUTPUT_SNAPSHOT, 0) < 0 ||
+	    fflush(fp) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+/* the ruleset read back from its snapshot must print the same */
+static struct nftnl_ruleset *snapshot_reload(const char *name,
+					     const struct nftnl_ruleset *rs,
+					     struct nftnl_parse_err *err)
+{
+	struct nftnl_ruleset *tmp;
+	FILE *fp;
+
+	fp = snapshot_write(rs);
+	if (fp == NULL) {
+		print_err(name, "cannot write snapshot");
+		return NULL;
+	}
+
+	rewind(fp);
+	tmp = nftnl_ruleset_alloc();
+	if (tmp == NULL ||
+	    nftnl_ruleset_parse_file(tmp, NFTNL_PARSE_SNAPSHOT, fp, err) < 0) {
+		print_err(name, "cannot read snapshot");
+		goto err;
+	}
+
+	nftnl_ruleset_snprintf(ref, sizeof(ref), rs, NFTNL_OUTPUT_JSON, 0);
+	nftnl_ruleset_snprintf(out, sizeof(out), tmp, NFTNL_OUTPUT_JSON, 0);
+	if (strcmp(ref, out) != 0) {
+		print_err(name, "ruleset from snapshot differs");
+		printf("%s\n%s\n", ref, out);
+	}
+
+	fclose(fp);
+	return tmp;
+err:
+	if (tmp != NULL)
+		nftnl_ruleset_free(tmp);
+	fclose(fp);
+	return NULL;
+}
+
+static void test_dir(const char *dir_name, struct nftnl_parse_err *err)
+{
+	struct nftnl_ruleset *rs, *tmp;
+	char path[PATH_MAX];
+	struct dirent *de;
+	size_t len;
+	DIR *d;
+	FILE *fp;
+
+	d = opendir(dir_name);
+	if (d == NULL) {
+		print_err(dir_name, "cannot open directory");
+		return;
+	}
+
+	while ((de = readdir(d)) != NULL) {
+		len = strlen(de->d_name);
+		if (len < 5 || strcmp(de->d_name + len - 5, ".json") != 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir_name, de->d_name);
+		fp = fopen(path, "r");
+		if (fp == NULL) {
+			print_err(path, "cannot open file");
+			continue;
+		}
+
+		/* only files made of additions build a ruleset */
+		rs = nftnl_ruleset_alloc();
+		if (rs != NULL &&
+		    nftnl_ruleset_parse_file(rs, NFTNL_PARSE_JSON, fp,
+					     err) == 0) {
+			tmp = snapshot_reload(path, rs, err);
+			if (tmp != NULL)
+				nftnl_ruleset_free(tmp);
+		}
+		if (rs != NULL)
+			nftnl_ruleset_free(rs);
+		fclose(fp);
+	}
+	closedir(d);
+}
+
+static const char rule_udata[] = "a comment";
+static const char elem_udata[] = { 1, 2, 3 };
+
+static struct nftnl_set_elem *elem_alloc(uint32_t key)
+{
+	struct nftnl_set_elem *e;
+
+	e = nftnl_set_elem_alloc();
+	if (e == NULL)
+		return NULL;
+
+	key = htonl(key);
+	nftnl_set_elem_set(e, NFTNL_SET_ELEM_KEY, &key, sizeof(key));
+	return e;
+}
+
+static struct nftnl_set *set_alloc(const char *name, uint32_t data_type,
+				   uint32_t nelems)
+{
+	struct nftnl_set_elem *e;
+	struct nftnl_set *s;
+	uint32_t i, data;
+
+	s = nftnl_set_alloc();
+	if (s == NULL)
+		return NULL;
+
+	nftnl_set_set(s, NFTNL_SET_TABLE, "filter");
+	nftnl_set_set(s, NFTNL_SET_NAME, name);
+	nftnl_set_set_u32(s, NFTNL_SET_FAMILY, NFPROTO_IPV4);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_TYPE, 7);
+	nftnl_set_set_u32(s, NFTNL_SET_KEY_LEN, 4);
+	nftnl_set_set_u32(s, NFTNL_SET_ID, 1);
+	if (data_type != 0) {
+		nftnl_set_set_u32(s, NFTNL_SET_FLAGS, NFT_SET_MAP);
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_TYPE, data_type);
+		nftnl_set_set_u32(s, NFTNL_SET_DATA_LEN,
+				  data_type == NFT_DATA_VERDICT ? 0 : 4);
+	}
+
+	for (i = 0; i < nelems; i++) {
+		e = elem_alloc(0x0a000000 + i);
+		if (e == NULL)
+			return s;
+
+		switch (data_type) {
+		case NFT_DATA_VERDICT:
+			nftnl_set_elem_set_u32(e, NFTNL_SET_ELEM_VERDICT,
+					       i % 2 ? NFT_JUMP : NF_ACCEPT);
+			if (i % 2)
+				nftnl_set_elem_set_str(e, NFTNL_SET_ELEM_CHAIN,
+						       "other");
+			break;
+		case 0:
+			break;
+		default:
+			data = htonl(i);
+			nftnl_set_elem_set(e, NFTNL_SET_ELEM_DATA, &data,
+					   sizeof(data));
+			break;
+		}
+		if (i == 0) {
+			nftnl_set_elem_set_u64(e, NFTNL_SET_ELEM_TIMEOUT, 1000);
+			nftnl_set_elem_set(e, NFTNL_SET_ELEM_USERDATA,
+					   elem_udata, sizeof(elem_udata));
+		}
+		nftnl_set_elem_add(s, e);
+	}
+	return s;
+}
+
+static struct nftnl_rule *rule_alloc(uint64_t handle, bool exprs)
+{
+	struct nftnl_expr *expr;
+	struct nftnl_rule *r;
+
+	r = nftnl_rule_alloc();
+	if (r == NULL)
+		return NULL;
+
+	nftnl_rule_set_u32(r, NFTNL_RULE_FAMILY, NFPROTO_IPV4);
+	nftnl_rule_set(r, NFTNL_RULE_TABLE, "filter");
+	nftnl_rule_set(r, NFTNL_RULE_CHAIN, "input");
+	nftnl_rule_set_u64(r, NFTNL_RULE_HANDLE, handle);
+	if (!exprs)
+		return r;
+
+	nftnl_rule_set_u64(r, NFTNL_RULE_POSITION, handle - 1);
+	nftnl_rule_set_u32(r, NFTNL_RULE_COMPAT_PROTO, IPPROTO_TCP);
+	nftnl_rule_set_u32(r, NFTNL_RULE_COMPAT_FLAGS, 0);
+	nftnl_rule_set_data(r, NFTNL_RULE_USERDATA, rule_udata,
+			    sizeof(rule_udata));
+
+	expr = nftnl_expr_alloc("payload");
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_DREG, NFT_REG_1);
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_BASE,
+			   NFT_PAYLOAD_NETWORK_HEADER);
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_OFFSET, 12);
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_PAYLOAD_LEN, 4);
+	nftnl_rule_add_expr(r, expr);
+
+	expr = nftnl_expr_alloc("lookup");
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_LOOKUP_SREG, NFT_REG_1);
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_LOOKUP_DREG, NFT_REG_VERDICT);
+	nftnl_expr_set_str(expr, NFTNL_EXPR_LOOKUP_SET, "vmap");
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_LOOKUP_SET_ID, 1);
+	nftnl_rule_add_expr(r, expr);
+
+	expr = nftnl_expr_alloc("counter");
+	nftnl_expr_set_u64(expr, NFTNL_EXPR_CTR_PACKETS, 3);
+	nftnl_expr_set_u64(expr, NFTNL_EXPR_CTR_BYTES, 300);
+	nftnl_rule_add_expr(r, expr);
+
+	expr = nftnl_expr_alloc("immediate");
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_IMM_DREG, NFT_REG_VERDICT);
+	nftnl_expr_set_u32(expr, NFTNL_EXPR_IMM_VERDICT, NFT_JUMP);
+	nftnl_expr_set_str(expr, NFTNL_EXPR_IMM_CHAIN, "other");
+	nftnl_rule_add_expr(r, expr);
+
+	return r;
+}
+
+static struct nftnl_chain *chain_alloc(const char *name, bool base)
+{
+	struct nftnl_chain *c;
+
+	c = nftnl_chain_alloc();
+	if (c == NULL)
+		return NULL;
+
+	nftnl_chain_set(c, NFTNL_CHAIN_TABLE, "filter");
+	nftnl_chain_set(c, NFTNL_CHAIN_NAME, name);
+	nftnl_chain_set_u32(c, NFTNL_CHAIN_FAMILY, NFPROTO_IPV4);
+	nftnl_chain_set_u64(c, NFTNL_CHAIN_HANDLE, base ? 1 : 2);
+	if (base) {
+		nftnl_chain_set(c, NFTNL_CHAIN_TYPE, "filter");
+		nftnl_chain_set_u32(c, NFTNL_CHAIN_HOOKNUM, NF_INET_LOCAL_IN);
+		nftnl_chain_set_s32(c, NFTNL_CHAIN_PRIO, -150);
+		nftnl_chain_set_u32(c, NFTNL_CHAIN_POLICY, NF_DROP);
+		nftnl_chain_set_u64(c, NFTNL_CHAIN_PACKETS, 10);
+		nftnl_chain_set_u64(c, NFTNL_CHAIN_BYTES, 1000);
+	}
+	return c;
+}
+
+static struct nftnl_ruleset *ruleset_alloc(void)
+{
+	struct nftnl_table_list *tl = nftnl_table_list_alloc();
+	struct nftnl_chain_list *cl = nftnl_chain_list_alloc();
+	struct nftnl_set_list *sl = nftnl_set_list_alloc();
+	struct nftnl_rule_list *rl = nftnl_rule_list_alloc();
+	struct nftnl_ruleset *rs = nftnl_ruleset_alloc();
+	struct nftnl_table *t;
+
+	if (rs == NULL || tl == NULL || cl == NULL || sl == NULL || rl == NULL)
+		return NULL;
+
+	t = nftnl_table_alloc();
+	nftnl_table_set(t, NFTNL_TABLE_NAME, "filter");
+	nftnl_table_set_u32(t, NFTNL_TABLE_FAMILY, NFPROTO_IPV4);
+	nftnl_table_set_u32(t, NFTNL_TABLE_USE, 5);
+	nftnl_table_list_add_tail(t, tl);
+
+	nftnl_chain_list_add_tail(chain_alloc("input", true), cl);
+	nftnl_chain_list_add_tail(chain_alloc("other", false), cl);
+
+	nftnl_set_list_add_tail(set_alloc("vmap", NFT_DATA_VERDICT, 4), sl);
+	nftnl_set_list_add_tail(set_alloc("map", NFT_DATA_VALUE, 300), sl);
+	nftnl_set_list_add_tail(set_alloc("empty", 0, 0), sl);
+
+	nftnl_rule_list_add_tail(rule_alloc(3, true), rl);
+	nftnl_rule_list_add_tail(rule_alloc(4, false), rl);
+
+	nftnl_ruleset_set(rs, NFTNL_RULESET_TABLELIST, tl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_CHAINLIST, cl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_SETLIST, sl);
+	nftnl_ruleset_set(rs, NFTNL_RULESET_RULELIST, rl);
+	return rs;
+}
+
+static void test_objects(struct nftnl_ruleset *rs, struct nftnl_ruleset *tmp)
+{
+	struct nftnl_rule_list *rl, *tmp_rl;
+	struct nftnl_set_elems_iter *iter;
+	struct nftnl_rule_list_iter *ri;
+	struct nftnl_set_list_iter *si;
+	struct nftnl_rule *r1, *r2;
+	struct nftnl_set_elem *e;
+	struct nftnl_set *s;
+	const void *data;
+	uint32_t len;
+
+	/* not all attributes are printed, compare the rules themselves */
+	rl = nftnl_ruleset_get(rs, NFTNL_RULESET_RULELIST);
+	tmp_rl = nftnl_ruleset_get(tmp, NFTNL_RULESET_RULELIST);
+	ri = nftnl_rule_list_iter_create(tmp_rl);
+	r2 = nftnl_rule_list_iter_next(ri);
+	r1 = nftnl_rule_list_lookup_handle(rl, 3);
+	if (r1 == NULL || r2 == NULL || !nftnl_rule_cmp(r1, r2))
+		print_err("objects", "rule differs");
+	if (r2 != NULL &&
+	    (nftnl_rule_get_u64(r2, NFTNL_RULE_POSITION) != 2 ||
+	     nftnl_rule_get_u32(r2, NFTNL_RULE_COMPAT_PROTO) != IPPROTO_TCP))
+		print_err("objects", "rule attributes differ");
+	nftnl_rule_list_iter_destroy(ri);
+
+	si = nftnl_set_list_iter_create(nftnl_ruleset_get(tmp,
+						NFTNL_RULESET_SETLIST));
+	s = nftnl_set_list_iter_next(si);
+	nftnl_set_list_iter_destroy(si);
+	if (s == NULL ||
+	    strcmp(nftnl_set_get_str(s, NFTNL_SET_NAME), "vmap") != 0) {
+		print_err("objects", "missing set");
+		return;
+	}
+	iter = nftnl_set_elems_iter_create(s);
+	e = nftnl_set_elems_iter_next(iter);
+	data = e ? nftnl_set_elem_get(e, NFTNL_SET_ELEM_USERDATA, &len) : NULL;
+	if (data == NULL || len != sizeof(elem_udata) ||
+	    memcmp(data, elem_udata, len) != 0 ||
+	    nftnl_set_elem_get_u64(e, NFTNL_SET_ELEM_TIMEOUT) != 1000)
+		print_err("objects", "element attributes differ");
+	nftnl_set_elems_iter_destroy(iter);
+}
+
+/* objects are built on demand and do not need the snapshot to stay open */
+static void test_lazy(const struct nftnl_ruleset *rs)
+{
+	struct nftnl_snapshot *snap;
+	struct nftnl_chain *c;
+	struct nftnl_rule *r;
+	struct nftnl_set *s;
+	FILE *fp;
+
+	fp = snapshot_write(rs);
+	if (fp == NULL) {
+		print_err("lazy", "cannot write snapshot");
+		return;
+	}
+
+	snap = nftnl_snapshot_open(fileno(fp));
+	if (snap == NULL) {
+		print_err("lazy", "cannot open snapshot");
+		fclose(fp);
+		return;
+	}
+
+	if (nftnl_snapshot_count(snap, NFTNL_RULESET_TABLE) != 1 ||
+	    nftnl_snapshot_count(snap, NFTNL_RULESET_CHAIN) != 2 ||
+	    nftnl_snapshot_count(snap, NFTNL_RULESET_SET) != 3 ||
+	    nftnl_snapshot_count(snap, NFTNL_RULESET_SET_ELEMS) != 304 ||
+	    nftnl_snapshot_count(snap, NFTNL_RULESET_RULE) != 2 ||
+	    nftnl_snapshot_count(snap, NFTNL_RULESET_RULESET) != 0)
+		print_err("lazy", "bad counts");
+
+	if (nftnl_snapshot_get_rule(snap, 2) != NULL || errno != ENOENT)
+		print_err("lazy", "rule out of range");
+
+	c = nftnl_snapshot_get_chain(snap, 1);
+	s = nftnl_snapshot_get_set(snap, 1);
+	r = nftnl_snapshot_get_rule(snap, 0);
+	nftnl_snapshot_close(snap);
+	fclose(fp);
+
+	if (c == NULL || strcmp(nftnl_chain_get_str(c, NFTNL_CHAIN_NAME),
+				"other") != 0)
+		print_err("lazy", "bad chain");
+	if (s == NULL || strcmp(nftnl_set_get_str(s, NFTNL_SET_NAME),
+				"map") != 0)
+		print_err("lazy", "bad set");
+	if (r == NULL || nftnl_rule_get_u64(r, NFTNL_RULE_HANDLE) != 3)
+		print_err("lazy", "bad rule");
+
+	if (s != NULL) {
+		nftnl_set_snprintf(out, sizeof(out), s, NFTNL_OUTPUT_JSON, 0);
+		nftnl_set_free(s);
+	}
+	if (r != NULL) {
+		nftnl_rule_snprintf(out, sizeof(out), r, NFTNL_OUTPUT_JSON, 0);
+		nftnl_rule_free(r);
+	}
+	if (c != NULL)
+		nftnl_chain_free(c);
+}
+
+static void test_snapshot(struct nftnl_parse_err *err)
+{
+	struct nftnl_ruleset *rs, *tmp;
+
+	rs = ruleset_alloc();
+	if (rs == NULL) {
+		print_err("snapshot", "OOM");
+		return;
+	}
+
+	tmp = snapshot_reload("snapshot", rs, err);
+	if (tmp != NULL) {
+		test_objects(rs, tmp);
+		nftnl_ruleset_free(tmp);
+	}
+	test_lazy(rs);
+
+	nftnl_ruleset_free(rs);
+}
+
+static FILE *bytes_write(const char *buf, size_t len)
+{
+	FILE *fp;
+
+	fp = tmpfile();
+	if (fp == NULL)
+		return NULL;
+
+	if (fwrite(buf, len, 1, fp) != 1 || fflush(fp) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static void snapshot_load_all(struct nftnl_snapshot *snap)
+{
+	uint32_t i;
+
+	for (i = 0; i < nftnl_snapshot_count(snap, NFTNL_RULESET_TABLE); i++) {
+		struct nftnl_table *t = nftnl_snapshot_get_table(snap, i);
+
+		if (t != NULL)
+			nftnl_table_free(t);
+	}
+	for (i = 0; i < nftnl_snapshot_count(snap, NFTNL_RULESET_CHAIN); i++) {
+		struct nftnl_chain *c = nftnl_snapshot_get_chain(snap, i);
+
+		if (c != NULL)
+			nftnl_chain_free(c);
+	}
+	for (i = 0; i < nftnl_snapshot_count(snap, NFTNL_RULESET_SET); i++) {
+		struct nftnl_set *s = nftnl_snapshot_get_set(snap, i);
+
+		if (s != NULL)
+			nftnl_set_free(s);
+	}
+	for (i = 0; i < nftnl_snapshot_count(snap, NFTNL_RULESET_RULE); i++) {
+		struct nftnl_rule *r = nftnl_snapshot_get_rule(snap, i);
+
+		if (r != NULL)
+			nftnl_rule_free(r);
+	}
+}
+
+/* a snapshot parsed from a stream starts at the position of the stream */
+static void test_offset(struct nftnl_parse_err *err)
+{
+	static const long skips[] = { 24, 4096 + 16, 20 };
+	struct nftnl_ruleset *rs, *tmp;
+	char junk[4096 + 16], tail[4];
+	long end;
+	size_t i;
+	FILE *fp;
+	int ret;
+
+	rs = ruleset_alloc();
+	if (rs == NULL)
+		return;
+
+	memset(junk, 'x', sizeof(junk));
+	nftnl_ruleset_snprintf(ref, sizeof(ref), rs, NFTNL_OUTPUT_JSON, 0);
+
+	for (i = 0; i < sizeof(skips) / sizeof(skips[0]); i++) {
+		fp = tmpfile();
+		if (fp == NULL)
+			continue;
+
+		if (fwrite(junk, skips[i], 1, fp) != 1 ||
+		    nftnl_ruleset_fprintf(fp, rs, NFTNL_OUTPUT_SNAPSHOT,
+					  0) < 0 ||
+		    fwrite("tail", 4, 1, fp) != 1) {
+			print_err("offset", "cannot write snapshot");
+			fclose(fp);
+			continue;
+		}
+		end = ftell(fp) - 4;
+
+		/* the stream buffers the snapshot, the file offset is past it */
+		rewind(fp);
+		if (fread(junk, skips[i], 1, fp) != 1) {
+			print_err("offset", "cannot read leading data");
+			fclose(fp);
+			continue;
+		}
+
+		tmp = nftnl_ruleset_alloc();
+		if (tmp == NULL) {
+			fclose(fp);
+			continue;
+		}
+		ret = nftnl_ruleset_parse_file(tmp, NFTNL_PARSE_SNAPSHOT, fp,
+					       err);
+		if (skips[i] % 8) {
+			/* records are read in place, they have to be aligned */
+			if (ret == 0)
+				print_err("offset", "misaligned snapshot read");
+		} else if (ret < 0) {
+			print_err("offset", "cannot read snapshot after data");
+		} else {
+			nftnl_ruleset_snprintf(out, sizeof(out), tmp,
+					       NFTNL_OUTPUT_JSON, 0);
+			if (strcmp(ref, out) != 0)
+				print_err("offset", "ruleset differs");
+			if (ftell(fp) != end || fread(tail, 4, 1, fp) != 1 ||
+			    memcmp(tail, "tail", 4) != 0)
+				print_err("offset", "stream not left after it");
+		}
+		nftnl_ruleset_free(tmp);
+		fclose(fp);
+	}
+
+	nftnl_ruleset_free(rs);
+}
+
+/* damaged snapshots are refused, or give errors, but never crash */
+static void test_errors(struct nftnl_parse_err *err)
+{
+	struct nftnl_snapshot *snap;
+	struct nftnl_ruleset *rs;
+	char *buf = NULL;
+	long len, i;
+	FILE *fp;
+
+	rs = ruleset_alloc();
+	if (rs == NULL)
+		goto out;
+
+	if (nftnl_ruleset_snprintf(out, sizeof(out), rs, NFTNL_OUTPUT_SNAPSHOT,
+				   0) >= 0)
+		print_err("errors", "snapshot printed to a buffer");
+	if (nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_SNAPSHOT, "", err, NULL,
+					  NULL) == 0 || errno != EOPNOTSUPP)
+		print_err("errors", "snapshot parsed from a buffer");
+
+	fp = snapshot_write(rs);
+	if (fp == NULL)
+		goto out;
+	len = ftell(fp);
+	buf = malloc(len);
+	rewind(fp);
+	if (buf == NULL || fread(buf, len, 1, fp) != 1) {
+		fclose(fp);
+		goto out;
+	}
+	fclose(fp);
+
+	/* truncated */
+	fp = bytes_write(buf, len - 8);
+	if (fp != NULL) {
+		if (nftnl_snapshot_open(fileno(fp)) != NULL || errno != EINVAL)
+			print_err("errors", "truncated snapshot opened");
+		fclose(fp);
+	}
+
+	for (i = 0; i < len; i++) {
+		buf[i] ^= 0xff;
+		fp = bytes_write(buf, len);
+		buf[i] ^= 0xff;
+		if (fp == NULL)
+			continue;
+
+		snap = nftnl_snapshot_open(fileno(fp));
+		if (snap != NULL) {
+			snapshot_load_all(snap);
+			nftnl_snapshot_close(snap);
+		} else if (errno != EINVAL) {
+			print_err("errors", "unexpected error");
+		}
+		fclose(fp);
+	}
+out:
+	free(buf);
+	if (rs != NULL)
+		nftnl_ruleset_free(rs);
+}
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_parse_err *err;
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		print_err(argv[0], "OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	test_snapshot(err);
+	test_errors(err);
+	test_offset(err);
+
+	if (nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_JSON, "{\"nftables\":[]}",
+					  err, NULL, NULL) < 0 &&
+	    errno == EOPNOTSUPP)
+		goto out;
+
+	test_dir(argc > 1 ? argv[1] : "jsonfiles", err);
+out:
+	nftnl_parse_err_free(err);
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
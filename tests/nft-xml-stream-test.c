@@ -0,0 +1,408 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include <libnftnl/ruleset.h>
+#include <libnftnl/table.h>
+#include <libnftnl/chain.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/set.h>
+
+#define RULES	20000
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+struct counts {
+	int	tables;
+	int	chains;
+	int	rules;
+	int	sets;
+	int	flush;
+	int	exprs;
+	char	table[64];
+};
+
+static int count_expr_cb(struct nftnl_expr *e, void *data)
+{
+	struct counts *c = data;
+
+	c->exprs++;
+	return 0;
+}
+
+static int count_cb(const struct nftnl_parse_ctx *ctx)
+{
+	struct counts *c = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+	struct nftnl_table *t;
+	struct nftnl_rule *r;
+
+	switch (nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE)) {
+	case NFTNL_RULESET_TABLE:
+		t = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_TABLE);
+		snprintf(c->table, sizeof(c->table), "%s",
+			 nftnl_table_get_str(t, NFTNL_TABLE_NAME));
+		c->tables++;
+		break;
+	case NFTNL_RULESET_CHAIN:
+		c->chains++;
+		break;
+	case NFTNL_RULESET_RULE:
+		r = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_RULE);
+		nftnl_expr_foreach(r, count_expr_cb, c);
+		c->rules++;
+		break;
+	case NFTNL_RULESET_SET:
+		c->sets++;
+		break;
+	case NFTNL_RULESET_RULESET:
+		c->flush++;
+		break;
+	}
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+static int parse(const char *xml, struct counts *c,
+		 struct nftnl_parse_err *err)
+{
+	memset(c, 0, sizeof(*c));
+	return nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_XML, xml, err, c,
+					     count_cb);
+}
+
+static const char table[] =
+	"<table><name>filter</name><family>ip</family><flags>0</flags>"
+	"<use>0</use></table>";
+
+static const char set[] =
+	"<set><family>ip</family><table>filter</table><name>s</name>"
+	"<flags>3</flags><key_type>12</key_type><key_len>2</key_len>"
+	"<data_type>0</data_type><data_len>0</data_len><set_elem><key>"
+	"<reg type=\"value\"><len>2</len><data0>0x00004300</data0></reg>"
+	"</key></set_elem></set>";
+
+static const char rule[] =
+	"<rule><family>ip</family><table>filter</table><chain>input</chain>"
+	"<handle>%d</handle><expr type=\"payload\"><dreg>1</dreg>"
+	"<offset>9</offset><len>1</len><base>network</base></expr>"
+	"<expr type=\"cmp\"><sreg>1</sreg><op>eq</op><data>"
+	"<reg type=\"value\"><len>1</len><data0>0x00000006</data0></reg>"
+	"</data></expr></rule>";
+
+static void test_buffer(struct nftnl_parse_err *err)
+{
+	char buf[4096], r[1024];
+	struct counts c;
+
+	/* text and comments around and inside objects are released too */
+	snprintf(r, sizeof(r), rule, 1);
+	snprintf(buf, sizeof(buf),
+		 "<?xml version=\"1.0\"?>\n<nftables>\n  <add>\n"
+		 "    %s\n    <!-- set -->%s\n    %s\n  </add>\n"
+		 "  <flush></flush>\n</nftables>\n", table, set, r);
+
+	if (parse(buf, &c, err) < 0)
+		print_err("Cannot parse document");
+	if (c.tables != 1 || c.sets != 1 || c.rules != 1 || c.flush != 1)
+		print_err("Bad object count");
+	if (strcmp(c.table, "filter") != 0)
+		print_err("Bad table name");
+	if (c.exprs != 2)
+		print_err("Bad expression count");
+}
+
+static void test_errors(struct nftnl_parse_err *err)
+{
+	char buf[4096];
+	struct counts c;
+
+	/* the table is delivered before the error is found */
+	snprintf(buf, sizeof(buf), "<nftables><add>%s<foo></foo>%s</add>"
+		 "</nftables>", table, table);
+	if (parse(buf, &c, err) == 0 || errno != EINVAL)
+		print_err("Bad document parsed");
+	if (c.tables != 1)
+		print_err("Table not delivered before error");
+	snprintf(buf, sizeof(buf), "<nftables><add>%s</add>", table);
+	if (parse(buf, &c, err) == 0)
+		print_err("Unclosed document accepted");
+	if (parse("<tables></tables>", &c, err) == 0)
+		print_err("Document without nftables accepted");
+	if (parse("<nftables><frob></frob></nftables>", &c, err) == 0)
+		print_err("Unknown command accepted");
+}
+
+static void test_file(struct nftnl_parse_err *err)
+{
+	struct counts c;
+	FILE *fp;
+	int i;
+
+	fp = tmpfile();
+	if (fp == NULL) {
+		print_err("Cannot create file");
+		return;
+	}
+
+	/* every object is parsed and released before the next one */
+	fprintf(fp, "<nftables><add>%s", table);
+	for (i = 0; i < RULES; i++) {
+		fputc('\n', fp);
+		fprintf(fp, rule, i + 1);
+	}
+	fputs("</add></nftables>\n", fp);
+	rewind(fp);
+
+	memset(&c, 0, sizeof(c));
+	if (nftnl_ruleset_parse_file_cb(NFTNL_PARSE_XML, fp, err, &c,
+					count_cb) < 0)
+		print_err("Cannot parse file");
+	if (c.tables != 1 || c.rules != RULES || c.exprs != 2 * RULES)
+		print_err("Bad object count in file");
+
+	fclose(fp);
+}
+
+#ifdef XML_PARSING
+#include <mxml.h>
+
+#define CORPUS_OBJS	64
+
+/* the objects the streaming parser delivered, printed as XML */
+struct corpus {
+	char		xml[CORPUS_OBJS][4096];
+	int		objs;
+};
+
+static int corpus_print(char *buf, size_t size, uint32_t type, void *obj)
+{
+	uint32_t xml = NFTNL_OUTPUT_XML;
+
+	switch (type) {
+	case NFTNL_RULESET_TABLE:
+		return nftnl_table_snprintf(buf, size, obj, xml, 0);
+	case NFTNL_RULESET_CHAIN:
+		return nftnl_chain_snprintf(buf, size, obj, xml, 0);
+	case NFTNL_RULESET_RULE:
+		return nftnl_rule_snprintf(buf, size, obj, xml, 0);
+	case NFTNL_RULESET_SET:
+		return nftnl_set_snprintf(buf, size, obj, xml, 0);
+	}
+	return -1;
+}
+
+static int corpus_cb(const struct nftnl_parse_ctx *ctx)
+{
+	struct corpus *c = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_DATA);
+	uint32_t type = nftnl_ruleset_ctx_get_u32(ctx, NFTNL_RULESET_CTX_TYPE);
+	void *obj = NULL;
+
+	switch (type) {
+	case NFTNL_RULESET_TABLE:
+		obj = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_TABLE);
+		break;
+	case NFTNL_RULESET_CHAIN:
+		obj = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_CHAIN);
+		break;
+	case NFTNL_RULESET_RULE:
+		obj = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_RULE);
+		break;
+	case NFTNL_RULESET_SET:
+		obj = nftnl_ruleset_ctx_get(ctx, NFTNL_RULESET_CTX_SET);
+		break;
+	}
+
+	if (obj != NULL && c->objs < CORPUS_OBJS)
+		corpus_print(c->xml[c->objs++], sizeof(c->xml[0]), type, obj);
+
+	nftnl_ruleset_ctx_free(ctx);
+	return 0;
+}
+
+/* parse one object of the document with the tree based object parsers */
+static int corpus_tree_obj(mxml_node_t *node, char *buf, size_t size,
+			   struct nftnl_parse_err *err)
+{
+	const char *name = node->value.opaque;
+	uint32_t type = NFTNL_RULESET_UNSPEC;
+	void *obj = NULL;
+	char *xml;
+	int ret = -1;
+
+	xml = mxmlSaveAllocString(node, MXML_NO_CALLBACK);
+	if (xml == NULL)
+		return -1;
+
+	if (strcmp(name, "table") == 0) {
+		type = NFTNL_RULESET_TABLE;
+		obj = nftnl_table_alloc();
+		if (nftnl_table_parse(obj, NFTNL_PARSE_XML, xml, err) == 0)
+			ret = corpus_print(buf, size, type, obj);
+		nftnl_table_free(obj);
+	} else if (strcmp(name, "chain") == 0) {
+		type = NFTNL_RULESET_CHAIN;
+		obj = nftnl_chain_alloc();
+		if (nftnl_chain_parse(obj, NFTNL_PARSE_XML, xml, err) == 0)
+			ret = corpus_print(buf, size, type, obj);
+		nftnl_chain_free(obj);
+	} else if (strcmp(name, "rule") == 0) {
+		type = NFTNL_RULESET_RULE;
+		obj = nftnl_rule_alloc();
+		if (nftnl_rule_parse(obj, NFTNL_PARSE_XML, xml, err) == 0)
+			ret = corpus_print(buf, size, type, obj);
+		nftnl_rule_free(obj);
+	} else if (strcmp(name, "set") == 0) {
+		type = NFTNL_RULESET_SET;
+		obj = nftnl_set_alloc();
+		if (nftnl_set_parse(obj, NFTNL_PARSE_XML, xml, err) == 0)
+			ret = corpus_print(buf, size, type, obj);
+		nftnl_set_free(obj);
+	}
+
+	free(xml);
+	return ret;
+}
+
+/*
+ * Load @xml as a whole tree and compare each object, parsed on its own,
+ * with the object the streaming parser delivered at that position.
+ */
+static void corpus_tree(const char *path, const char *xml,
+			const struct corpus *c, struct nftnl_parse_err *err)
+{
+	mxml_node_t *tree, *cmd, *node;
+	char buf[4096];
+	int objs = 0;
+
+	tree = mxmlLoadString(NULL, xml, MXML_OPAQUE_CALLBACK);
+	if (tree == NULL) {
+		print_err("Cannot load corpus file as a tree");
+		return;
+	}
+
+	for (cmd = mxmlFindElement(tree, tree, NULL, NULL, NULL,
+				   MXML_DESCEND_FIRST);
+	     cmd != NULL;
+	     cmd = mxmlFindElement(cmd, tree, NULL, NULL, NULL,
+				   MXML_NO_DESCEND)) {
+		for (node = mxmlFindElement(cmd, cmd, NULL, NULL, NULL,
+					    MXML_DESCEND_FIRST);
+		     node != NULL;
+		     node = mxmlFindElement(node, cmd, NULL, NULL, NULL,
+					    MXML_NO_DESCEND)) {
+			if (corpus_tree_obj(node, buf, sizeof(buf), err) < 0 ||
+			    objs >= c->objs ||
+			    strcmp(buf, c->xml[objs]) != 0) {
+				printf("%s: object %d: ", path, objs);
+				print_err("Parsers disagree");
+			}
+			objs++;
+		}
+	}
+	if (objs != c->objs)
+		print_err("Streaming parser delivered other objects");
+
+	mxmlDelete(tree);
+}
+
+static void corpus_file(const char *path, struct nftnl_parse_err *err)
+{
+	static struct corpus c;
+	static char xml[65536];
+	size_t len;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		print_err("Cannot open corpus file");
+		return;
+	}
+	len = fread(xml, 1, sizeof(xml) - 1, fp);
+	xml[len] = '\0';
+	fclose(fp);
+
+	memset(&c, 0, sizeof(c));
+	if (nftnl_ruleset_parse_buffer_cb(NFTNL_PARSE_XML, xml, err, &c,
+					  corpus_cb) < 0) {
+		printf("%s: ", path);
+		print_err("Cannot parse corpus file");
+		return;
+	}
+
+	corpus_tree(path, xml, &c, err);
+}
+
+/* the streaming parser yields what the tree parsers do on @dir */
+static void test_corpus(const char *dir, struct nftnl_parse_err *err)
+{
+	char path[PATH_MAX];
+	struct dirent *dent;
+	size_t len;
+	DIR *d;
+
+	d = opendir(dir);
+	if (d == NULL) {
+		print_err("Cannot open corpus directory");
+		return;
+	}
+
+	while ((dent = readdir(d)) != NULL) {
+		len = strlen(dent->d_name);
+		if (len < 4 || strcmp(&dent->d_name[len - 4], ".xml") != 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, dent->d_name);
+		corpus_file(path, err);
+	}
+	closedir(d);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	struct nftnl_parse_err *err;
+	struct counts c;
+
+	err = nftnl_parse_err_alloc();
+	if (err == NULL) {
+		print_err("OOM");
+		exit(EXIT_FAILURE);
+	}
+
+	/* built without XML support */
+	if (parse("<nftables></nftables>", &c, err) < 0 &&
+	    errno == EOPNOTSUPP)
+		goto out;
+
+	test_buffer(err);
+	test_errors(err);
+	test_file(err);
+#ifdef XML_PARSING
+	if (argc > 1)
+		test_corpus(argv[1], err);
+#endif
+out:
+	nftnl_parse_err_free(err);
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
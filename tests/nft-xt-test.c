@@ -0,0 +1,214 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netfilter/nf_tables.h>
+#include <libmnl/libmnl.h>
+#include <libnftnl/rule.h>
+#include <libnftnl/expr.h>
+
+static int test_ok = 1;
+
+static void print_err(const char *msg)
+{
+	test_ok = 0;
+	printf("\033[31mERROR:\e[0m %s\n", msg);
+}
+
+/* blob layouts, see include/uapi/linux/netfilter/xt_*.h */
+struct xt_tcp {
+	uint16_t	spts[2];
+	uint16_t	dpts[2];
+	uint8_t		option;
+	uint8_t		flg_mask;
+	uint8_t		flg_cmp;
+	uint8_t		invflags;
+};
+
+struct xt_conntrack_mtinfo3 {
+	uint8_t		addr[8][16];
+	uint32_t	expires_min, expires_max;
+	uint16_t	l4proto;
+	uint16_t	ports[4];
+	uint16_t	match_flags, invert_flags;
+	uint16_t	state_mask, status_mask;
+	uint16_t	port_high[4];
+};
+
+struct xt_mark_mtinfo1 {
+	uint32_t	mark, mask;
+	uint8_t		invert;
+};
+
+struct xt_mark_tginfo2 {
+	uint32_t	mark, mask;
+};
+
+struct xt_rateinfo {
+	uint32_t	avg;
+	uint32_t	burst;
+	unsigned long	prev;
+	uint32_t	credit;
+	uint32_t	credit_cap, cost;
+	void		*master;
+};
+
+static void add_xt(struct nftnl_rule *r, const char *type, const char *name,
+		   uint32_t rev, const void *info, size_t len)
+{
+	bool target = strcmp(type, "target") == 0;
+	struct nftnl_expr *e;
+	void *data;
+
+	data = calloc(1, len);
+	memcpy(data, info, len);
+
+	e = nftnl_expr_alloc(type);
+	nftnl_expr_set_str(e, target ? NFTNL_EXPR_TG_NAME : NFTNL_EXPR_MT_NAME,
+			   name);
+	nftnl_expr_set_u32(e, target ? NFTNL_EXPR_TG_REV : NFTNL_EXPR_MT_REV,
+			   rev);
+	nftnl_expr_set(e, target ? NFTNL_EXPR_TG_INFO : NFTNL_EXPR_MT_INFO,
+		       data, len);
+	nftnl_rule_add_expr(r, e);
+}
+
+static void rule_expr_names(struct nftnl_rule *r, char *buf, size_t len)
+{
+	struct nftnl_expr_iter *iter;
+	struct nftnl_expr *e;
+	size_t off = 0;
+
+	buf[0] = '\0';
+	iter = nftnl_expr_iter_create(r);
+	while ((e = nftnl_expr_iter_next(iter)) != NULL)
+		off += snprintf(buf + off, len - off, "%s%s", off ? " " : "",
+				nftnl_expr_get_str(e, NFTNL_EXPR_NAME));
+	nftnl_expr_iter_destroy(iter);
+}
+
+static struct nftnl_expr *rule_expr(struct nftnl_rule *r, int pos)
+{
+	struct nftnl_expr_iter *iter;
+	struct nftnl_expr *e;
+
+	iter = nftnl_expr_iter_create(r);
+	while ((e = nftnl_expr_iter_next(iter)) != NULL && pos-- > 0)
+		;
+	nftnl_expr_iter_destroy(iter);
+
+	return e;
+}
+
+static int reported;
+
+static void report(const struct nftnl_rule *r, const struct nftnl_expr *e,
+		   int err, void *data)
+{
+	if (strcmp(nftnl_expr_get_str(e, NFTNL_EXPR_MT_NAME), data) != 0 ||
+	    err != EOPNOTSUPP)
+		print_err("Unexpected untranslated extension reported");
+	reported++;
+}
+
+static void test_translate(void)
+{
+	struct xt_tcp tcp = { .spts = { 0, 65535 }, .dpts = { 22, 22 } };
+	struct xt_mark_mtinfo1 mark = { .mark = 1, .mask = 0xff };
+	struct xt_mark_tginfo2 mark_tg = { .mark = 0x10, .mask = ~0U };
+	struct xt_rateinfo limit = { .avg = 10000 / 3, .burst = 5 };
+	uint32_t state = (1 << 1) | (1 << 2);
+	char comment[256] = "ssh";
+	uint16_t dport = htons(22);
+	struct nftnl_rule *r;
+	struct nftnl_expr *e;
+	const void *data;
+	uint32_t len;
+	char buf[256];
+
+	r = nftnl_rule_alloc();
+	add_xt(r, "match", "tcp", 0, &tcp, sizeof(tcp));
+	add_xt(r, "match", "state", 0, &state, sizeof(state));
+	add_xt(r, "match", "mark", 1, &mark, sizeof(mark));
+	add_xt(r, "match", "limit", 0, &limit, sizeof(limit));
+	add_xt(r, "match", "comment", 0, comment, sizeof(comment));
+	add_xt(r, "match", "multiport", 1, comment, sizeof(comment));
+	add_xt(r, "target", "MARK", 2, &mark_tg, sizeof(mark_tg));
+
+	reported = 0;
+	if (nftnl_rule_xt_translate(r, report, "multiport") != 1 ||
+	    reported != 1)
+		print_err("Untranslatable extension not reported");
+
+	rule_expr_names(r, buf, sizeof(buf));
+	if (strcmp(buf, "meta cmp payload cmp ct bitwise cmp "
+			"meta bitwise cmp limit match immediate meta") != 0)
+		print_err("Bad translated expressions");
+
+	data = nftnl_expr_get(rule_expr(r, 3), NFTNL_EXPR_CMP_DATA, &len);
+	if (len != sizeof(dport) || memcmp(data, &dport, len) != 0)
+		print_err("Bad translated port");
+	e = rule_expr(r, 10);
+	if (nftnl_expr_get_u64(e, NFTNL_EXPR_LIMIT_RATE) != 3 ||
+	    nftnl_expr_get_u64(e, NFTNL_EXPR_LIMIT_UNIT) != 1 ||
+	    nftnl_expr_get_u32(e, NFTNL_EXPR_LIMIT_BURST) != 5)
+		print_err("Bad translated limit");
+
+	data = nftnl_rule_get_data(r, NFTNL_RULE_USERDATA, &len);
+	if (data == NULL || len != 4 || strcmp(data, "ssh") != 0)
+		print_err("Comment not moved to userdata");
+	nftnl_rule_free(r);
+}
+
+static void test_untranslatable(void)
+{
+	struct xt_tcp tcp = { .spts = { 0, 65535 }, .dpts = { 1, 1023 } };
+	struct xt_conntrack_mtinfo3 ct = {
+		.match_flags	= 1,
+		.invert_flags	= 1,
+		.state_mask	= 1 << 3,
+	};
+	struct xt_rateinfo limit = { .avg = ~0U, .burst = 5 };
+	char buf[256];
+	struct nftnl_rule *r;
+
+	/* inverted port range, rate below one per day */
+	tcp.invflags = 0x02;
+	r = nftnl_rule_alloc();
+	add_xt(r, "match", "tcp", 0, &tcp, sizeof(tcp));
+	add_xt(r, "match", "limit", 0, &limit, sizeof(limit));
+	add_xt(r, "match", "conntrack", 3, &ct, sizeof(ct));
+	if (nftnl_rule_xt_translate(r, NULL, NULL) != 2)
+		print_err("Untranslatable extension translated");
+
+	rule_expr_names(r, buf, sizeof(buf));
+	if (strcmp(buf, "match match ct bitwise cmp") != 0)
+		print_err("Partial translation left behind");
+	if (nftnl_expr_get_u32(rule_expr(r, 4), NFTNL_EXPR_CMP_OP) !=
+	    NFT_CMP_EQ)
+		print_err("Inverted ct state not translated");
+	nftnl_rule_free(r);
+}
+
+int main(int argc, char *argv[])
+{
+	test_translate();
+	test_untranslatable();
+
+	if (!test_ok)
+		exit(EXIT_FAILURE);
+
+	printf("%s: \033[32mOK\e[0m\n", argv[0]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#ifndef _NFT_TEST_RULE_H_
+#define _NFT_TEST_RULE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libnftnl/rule.h>
+
+/*
+ * Builders of the rules the analysis tests run on. Rules are in the ip
+ * filter table, matches load into NFT_REG_1, values are in host byte order
+ * unless the field is stored in network byte order in the packet.
+ */
+struct nftnl_rule *rule_add(struct nftnl_rule_list *list, const char *chain,
+			    uint64_t handle);
+
+void add_expr(struct nftnl_rule *r, const char *name);
+void add_payload(struct nftnl_rule *r, uint32_t base, uint32_t offset,
+		 uint32_t len);
+void add_mask(struct nftnl_rule *r, uint32_t mask);
+void add_cmp(struct nftnl_rule *r, uint32_t op, const void *data,
+	     uint32_t len);
+void add_meta(struct nftnl_rule *r, uint32_t key, bool set);
+void add_imm(struct nftnl_rule *r, uint32_t val);
+void add_lookup(struct nftnl_rule *r, const char *set, bool map);
+void add_verdict(struct nftnl_rule *r, int verdict, const char *chain);
+
+/* meta l4proto tcp */
+void add_tcp(struct nftnl_rule *r);
+/* th dport @op @port */
+void add_dport(struct nftnl_rule *r, uint32_t op, uint16_t port);
+
+#endif
@@ -1,4 +1,7 @@
+./nft-analyze-test
 ./nft-chain-test
+./nft-classify-test
+./nft-eval-test
 ./nft-expr_bitwise-test
 ./nft-expr_byteorder-test
 ./nft-expr_cmp-test
@@ -14,11 +17,24 @@
 ./nft-expr_meta-test
 ./nft-expr_redir-test
 ./nft-expr_nat-test
+./nft-expr_ops-test
 ./nft-expr_payload-test
 ./nft-expr_reject-test
 ./nft-expr_target-test
+./nft-json-stream-test
+./nft-xml-stream-test xmlfiles
+./nft-optimize-test
+./nft-reconcile-test
+./nft-xt-test
 ./nft-rule-test
+./nft-ruleset-export-test
+./nft-snapshot-test
+./nft-capture-test
+./nft-intern-test
+./nft-fprintf-test
+./nft-ruleset-threads-test
 ./nft-set-test
+./nft-set-cost-test
 ./nft-table-test
 ./nft-parsing-test -d xmlfiles
 ./nft-parsing-test -d jsonfiles